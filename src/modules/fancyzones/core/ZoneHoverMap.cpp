@@ -0,0 +1,82 @@
+#include "ZoneHoverMap.h"
+#include <algorithm>
+
+void ZoneHoverMap::Build(ZoneRect const& area, std::vector<ZoneRect> const& zones, int cellShift)
+{
+    m_index.Build(zones);
+    m_area = area.empty() ? ZoneRect{} : area;
+    m_cellShift = cellShift;
+    int const cellSize = 1 << cellShift;
+    m_columns = (m_area.width() + cellSize - 1) >> cellShift;
+    m_rows = (m_area.height() + cellSize - 1) >> cellShift;
+
+    // Indexes too large for a cell leave every cell to the zone index
+    bool const allMixed = zones.size() >= MixedCell;
+    m_cells.assign(static_cast<size_t>(m_columns) * m_rows, allMixed ? MixedCell : 0);
+    if (allMixed || m_cells.empty())
+    {
+        return;
+    }
+
+    // Mark the cells an edge runs through, not along
+    auto markColumn = [&](int x, int top, int bottom) {
+        int const offset = x - m_area.left;
+        if (offset <= 0 || offset >= m_area.width() || (offset & (cellSize - 1)) == 0)
+        {
+            return;
+        }
+        int const column = offset >> cellShift;
+        int const firstRow = std::max(0, (top - m_area.top) >> cellShift);
+        int const lastRow = std::min(m_rows - 1, (bottom - 1 - m_area.top) >> cellShift);
+        for (int row = firstRow; row <= lastRow; row++)
+        {
+            m_cells[static_cast<size_t>(row) * m_columns + column] = MixedCell;
+        }
+    };
+    auto markRow = [&](int y, int left, int right) {
+        int const offset = y - m_area.top;
+        if (offset <= 0 || offset >= m_area.height() || (offset & (cellSize - 1)) == 0)
+        {
+            return;
+        }
+        size_t const row = static_cast<size_t>(offset >> cellShift);
+        int const firstColumn = std::max(0, (left - m_area.left) >> cellShift);
+        int const lastColumn = std::min(m_columns - 1, (right - 1 - m_area.left) >> cellShift);
+        for (int column = firstColumn; column <= lastColumn; column++)
+        {
+            m_cells[row * m_columns + column] = MixedCell;
+        }
+    };
+
+    for (ZoneRect const& zone : zones)
+    {
+        if (!zone.empty() && zone.right > m_area.left && zone.left < m_area.right && zone.bottom > m_area.top && zone.top < m_area.bottom)
+        {
+            markColumn(zone.left, zone.top, zone.bottom);
+            markColumn(zone.right, zone.top, zone.bottom);
+            markRow(zone.top, zone.left, zone.right);
+            markRow(zone.bottom, zone.left, zone.right);
+        }
+    }
+
+    // Every other cell has one answer, the one for any of its points.  Cells cut by the
+    // right or bottom edge of the area are mapped by the part inside it.
+    for (int row = 0; row < m_rows; row++)
+    {
+        int const y = m_area.top + (row << cellShift);
+        for (int column = 0; column < m_columns; column++)
+        {
+            uint16_t& cell = m_cells[static_cast<size_t>(row) * m_columns + column];
+            if (cell != MixedCell)
+            {
+                int const zone = m_index.ZoneFromPoint(m_area.left + (column << cellShift), y);
+                cell = zone < 0 ? NoZoneCell : static_cast<uint16_t>(zone);
+            }
+        }
+    }
+}
+
+size_t ZoneHoverMap::MixedCellCount() const noexcept
+{
+    return std::count(m_cells.begin(), m_cells.end(), MixedCell);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "ZoneIndex.h"
+#include <cstdint>
+#include <vector>
+
+// Cells of the hover map are 1 << ZONE_HOVER_MAP_CELL_SHIFT pixels wide and high
+#define ZONE_HOVER_MAP_CELL_SHIFT 3
+
+// Lookup table from the cells of an area, the client area of a zone window, to the zone
+// under them, so a drag finds the zone under the cursor with a shift and a load.  Only
+// the cells a zone edge runs through have more than one answer.  Those, and points
+// outside the area, are answered by a ZoneIndex.
+class ZoneHoverMap
+{
+public:
+    // Maps area for zones, with the same rules as ZoneIndex::Build
+    void Build(ZoneRect const& area, std::vector<ZoneRect> const& zones, int cellShift = ZONE_HOVER_MAP_CELL_SHIFT);
+
+    // Index of the smallest zone that contains the point, or -1 when there is none
+    int ZoneFromPoint(int x, int y) const noexcept
+    {
+        if (m_area.contains(x, y))
+        {
+            uint16_t const cell = m_cells[static_cast<size_t>((y - m_area.top) >> m_cellShift) * m_columns + ((x - m_area.left) >> m_cellShift)];
+            if (cell < MixedCell)
+            {
+                return cell;
+            }
+            if (cell == NoZoneCell)
+            {
+                return -1;
+            }
+        }
+        return m_index.ZoneFromPoint(x, y);
+    }
+
+    size_t CellCount() const noexcept { return m_cells.size(); }
+    size_t MixedCellCount() const noexcept;
+
+private:
+    static constexpr uint16_t NoZoneCell = 0xFFFF;
+    static constexpr uint16_t MixedCell = 0xFFFE;
+
+    ZoneRect m_area{};
+    int m_cellShift{};
+    int m_columns{};
+    int m_rows{};
+    std::vector<uint16_t> m_cells;
+    ZoneIndex m_index;
+};
@@ -0,0 +1,101 @@
+#include "ZoneIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Cells per zone the grid aims for.  More cells mean fewer zones to test per cell, but
+// large zones then have to be listed in more of them.
+#define ZONE_INDEX_CELLS_PER_ZONE 4
+#define ZONE_INDEX_MAX_CELLS 65536
+
+void ZoneIndex::Build(std::vector<ZoneRect> const& zones)
+{
+    m_zoneCount = zones.size();
+    m_bounds = {};
+    m_columns = 0;
+    m_rows = 0;
+    m_cellStarts.clear();
+    m_entries.clear();
+
+    // Smallest first, then in the order of the zone set, so the first zone of a cell
+    // that contains a point is the one to return
+    std::vector<int> order;
+    order.reserve(zones.size());
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        if (!zones[i].empty())
+        {
+            order.push_back(static_cast<int>(i));
+        }
+    }
+    if (order.empty())
+    {
+        return;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return zones[a].area() < zones[b].area();
+    });
+
+    m_bounds = zones[order[0]];
+    for (int i : order)
+    {
+        m_bounds.left = std::min(m_bounds.left, zones[i].left);
+        m_bounds.top = std::min(m_bounds.top, zones[i].top);
+        m_bounds.right = std::max(m_bounds.right, zones[i].right);
+        m_bounds.bottom = std::max(m_bounds.bottom, zones[i].bottom);
+    }
+
+    // Cells about as wide as they are high, never narrower than a pixel
+    double const cellCount = std::min<double>(ZONE_INDEX_MAX_CELLS, static_cast<double>(order.size()) * ZONE_INDEX_CELLS_PER_ZONE);
+    double const cellSize = std::sqrt(static_cast<double>(m_bounds.width()) * m_bounds.height() / cellCount);
+    m_columns = std::clamp(static_cast<int>(std::lround(m_bounds.width() / cellSize)), 1, m_bounds.width());
+    m_rows = std::clamp(static_cast<int>(std::lround(m_bounds.height() / cellSize)), 1, m_bounds.height());
+
+    // Count the entries of each cell, turn the counts into starts and fill the cells
+    m_cellStarts.assign(CellCount() + 1, 0);
+    for (int i : order)
+    {
+        ZoneRect const& zone = zones[i];
+        for (int row = RowFromY(zone.top); row <= RowFromY(zone.bottom - 1); row++)
+        {
+            for (int column = ColumnFromX(zone.left); column <= ColumnFromX(zone.right - 1); column++)
+            {
+                m_cellStarts[static_cast<size_t>(row) * m_columns + column + 1]++;
+            }
+        }
+    }
+    std::partial_sum(m_cellStarts.begin(), m_cellStarts.end(), m_cellStarts.begin());
+
+    std::vector<uint32_t> next(m_cellStarts.begin(), m_cellStarts.end() - 1);
+    m_entries.resize(m_cellStarts.back());
+    for (int i : order)
+    {
+        ZoneRect const& zone = zones[i];
+        for (int row = RowFromY(zone.top); row <= RowFromY(zone.bottom - 1); row++)
+        {
+            for (int column = ColumnFromX(zone.left); column <= ColumnFromX(zone.right - 1); column++)
+            {
+                m_entries[next[static_cast<size_t>(row) * m_columns + column]++] = { zone, i };
+            }
+        }
+    }
+}
+
+int ZoneIndex::ZoneFromPoint(int x, int y) const noexcept
+{
+    if (!m_bounds.contains(x, y))
+    {
+        return -1;
+    }
+
+    size_t const cell = static_cast<size_t>(RowFromY(y)) * m_columns + ColumnFromX(x);
+    for (uint32_t i = m_cellStarts[cell]; i < m_cellStarts[cell + 1]; i++)
+    {
+        if (m_entries[i].rect.contains(x, y))
+        {
+            return m_entries[i].index;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "ZoneRect.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Finds the zone under a point without testing every zone.  The bounds of the zones are
+// split into a uniform grid and every cell lists the zones that overlap it, smallest
+// first.  A point is tested against the zones of its cell only, and the first one that
+// contains it is the answer.
+class ZoneIndex
+{
+public:
+    // Indexes zones, in the order the zone set keeps them.  Where zones overlap, the
+    // smallest wins and of zones of the same size the one that comes first.
+    void Build(std::vector<ZoneRect> const& zones);
+
+    // Index of the smallest zone that contains the point, or -1 when there is none
+    int ZoneFromPoint(int x, int y) const noexcept;
+
+    size_t ZoneCount() const noexcept { return m_zoneCount; }
+    size_t CellCount() const noexcept { return static_cast<size_t>(m_columns) * m_rows; }
+
+private:
+    struct Entry
+    {
+        ZoneRect rect;
+        int index;
+    };
+
+    int ColumnFromX(int x) const noexcept { return static_cast<int>(static_cast<int64_t>(x - m_bounds.left) * m_columns / m_bounds.width()); }
+    int RowFromY(int y) const noexcept { return static_cast<int>(static_cast<int64_t>(y - m_bounds.top) * m_rows / m_bounds.height()); }
+
+    size_t m_zoneCount{};
+    // Union of the zones.  No point outside of it is in a zone.
+    ZoneRect m_bounds{};
+    int m_columns{};
+    int m_rows{};
+    // The entries of cell i are m_entries[m_cellStarts[i]] to m_entries[m_cellStarts[i + 1]]
+    std::vector<uint32_t> m_cellStarts;
+    std::vector<Entry> m_entries;
+};
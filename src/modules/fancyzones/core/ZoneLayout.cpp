@@ -0,0 +1,191 @@
+#include "ZoneLayout.h"
+#include <algorithm>
+#include <cstdint>
+
+// Largest focus zone, in pixels
+#define FOCUS_ZONE_MAX_WIDTH 1920
+#define FOCUS_ZONE_MAX_HEIGHT 1200
+
+ZoneLayoutNode MakeSplitLayout(ZoneSplit split, int count)
+{
+    return MakeWeightedLayout(split, std::vector<int>(std::max(count, 0), 1));
+}
+
+ZoneLayoutNode MakeWeightedLayout(ZoneSplit split, std::vector<int> const& weights)
+{
+    ZoneLayoutNode node;
+    node.split = split;
+    node.children.reserve(weights.size());
+    for (int weight : weights)
+    {
+        ZoneLayoutNode child;
+        child.weight = weight;
+        node.children.push_back(std::move(child));
+    }
+    return node;
+}
+
+ZoneLayoutNode MakeGridLayout(int zoneCount, bool portrait)
+{
+    if (zoneCount <= 1)
+    {
+        return {};
+    }
+
+    if (zoneCount == 2 && portrait)
+    {
+        return MakeSplitLayout(ZoneSplit::Rows, 2);
+    }
+
+    // Like Settings.cs in the editor
+    int rows = 1;
+    while ((rows + 1) * (rows + 1) <= zoneCount)
+    {
+        rows++;
+    }
+    int cols = zoneCount / rows;
+    int mergeCount = 0;
+    if (zoneCount % rows != 0)
+    {
+        cols++;
+        mergeCount = rows - zoneCount % rows;
+    }
+
+    ZoneLayoutNode grid;
+    if (mergeCount == 0)
+    {
+        grid.split = ZoneSplit::Rows;
+        grid.children.assign(rows, MakeSplitLayout(ZoneSplit::Columns, cols));
+        return grid;
+    }
+
+    // The merged zone spans the cells of the first column it replaces
+    grid.split = ZoneSplit::Columns;
+    grid.children.assign(cols, MakeSplitLayout(ZoneSplit::Rows, rows));
+    std::vector<ZoneLayoutNode>& firstColumn = grid.children[0].children;
+    firstColumn.erase(firstColumn.begin(), firstColumn.begin() + mergeCount);
+    firstColumn[0].span = mergeCount + 1;
+    return grid;
+}
+
+// Shares length, less the padding between the parts the children span, in proportion to
+// weights.  The ends of each part are rounded down from the running total, so no pixel
+// is lost.
+static void SplitLength(int start, int length, int padding, std::vector<ZoneLayoutNode> const& children, std::vector<std::pair<int, int>>& parts)
+{
+    int64_t total = 0;
+    int count = 0;
+    for (auto const& child : children)
+    {
+        int const span = std::max(child.span, 1);
+        total += static_cast<int64_t>(std::max(child.weight, 0)) * span;
+        count += span;
+    }
+
+    int64_t const available = std::max<int64_t>(static_cast<int64_t>(length) - static_cast<int64_t>(padding) * (count - 1), 0);
+    int64_t running = 0;
+    int first = 0;
+    parts.clear();
+    for (auto const& child : children)
+    {
+        int const span = std::max(child.span, 1);
+        int64_t const begin = total > 0 ? available * running / total : available * first / count;
+        running += static_cast<int64_t>(std::max(child.weight, 0)) * span;
+        int64_t const end = total > 0 ? available * running / total : available * (first + span) / count;
+        parts.push_back({ start + padding * first + static_cast<int>(begin), start + padding * (first + span - 1) + static_cast<int>(end) });
+        first += span;
+    }
+}
+
+static void LayoutNode(ZoneRect const& area, ZoneLayoutNode const& node, int paddingInner, std::vector<ZoneRect>& zones)
+{
+    if (node.split == ZoneSplit::None || node.children.empty())
+    {
+        zones.push_back(area);
+        return;
+    }
+
+    std::vector<std::pair<int, int>> parts;
+    if (node.split == ZoneSplit::Columns)
+    {
+        SplitLength(area.left, area.width(), paddingInner, node.children, parts);
+    }
+    else
+    {
+        SplitLength(area.top, area.height(), paddingInner, node.children, parts);
+    }
+
+    for (size_t i = 0; i < node.children.size(); i++)
+    {
+        ZoneRect part = area;
+        if (node.split == ZoneSplit::Columns)
+        {
+            part.left = parts[i].first;
+            part.right = parts[i].second;
+        }
+        else
+        {
+            part.top = parts[i].first;
+            part.bottom = parts[i].second;
+        }
+        LayoutNode(part, node.children[i], paddingInner, zones);
+    }
+}
+
+std::vector<ZoneRect> LayoutZones(ZoneRect const& workArea, ZoneLayoutNode const& layout, int paddingOuter, int paddingInner)
+{
+    ZoneRect const area = {
+        workArea.left + paddingOuter,
+        workArea.top + paddingOuter,
+        std::max(workArea.left + paddingOuter, workArea.right - paddingOuter),
+        std::max(workArea.top + paddingOuter, workArea.bottom - paddingOuter)
+    };
+
+    std::vector<ZoneRect> zones;
+    LayoutNode(area, layout, paddingInner, zones);
+    return zones;
+}
+
+std::vector<ZoneRect> LayoutFocusZones(ZoneRect const& workArea, int zoneCount, int paddingOuter, int paddingInner)
+{
+    std::vector<ZoneRect> zones;
+    if (zoneCount <= 0)
+    {
+        return zones;
+    }
+
+    ZoneRect const safeZone = {
+        workArea.left + paddingOuter,
+        workArea.top + paddingOuter,
+        workArea.right - paddingOuter,
+        workArea.bottom - paddingOuter
+    };
+
+    int const width = std::min(FOCUS_ZONE_MAX_WIDTH, workArea.width() * 60 / 100);
+    int const height = std::min(FOCUS_ZONE_MAX_HEIGHT, workArea.height() * 75 / 100);
+    int const halfWidth = width / 2;
+    int const halfHeight = height / 2;
+    int x = workArea.left + workArea.width() / 2 - halfWidth;
+    int y = workArea.top + workArea.height() / 2 - halfHeight;
+
+    ZoneRect const focusRect = { x, y, x + width, y + height };
+    zones.push_back(focusRect);
+
+    for (int i = 2; i <= zoneCount; i++)
+    {
+        switch (i)
+        {
+            case 2: x = focusRect.right - halfWidth; y = focusRect.top + paddingInner; break; // right
+            case 3: x = focusRect.left - halfWidth; y = focusRect.top + (paddingInner * 2); break; // left
+            case 4: x = focusRect.left + paddingInner; y = focusRect.top - halfHeight; break; // up
+            case 5: x = focusRect.left - paddingInner; y = focusRect.bottom - halfHeight; break; // down
+        }
+
+        // Bound into safe zone
+        x = std::min(safeZone.right - width, std::max(safeZone.left, x));
+        y = std::min(safeZone.bottom - height, std::max(safeZone.top, y));
+
+        zones.push_back({ x, y, x + width, y + height });
+    }
+    return zones;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "ZoneRect.h"
+#include <vector>
+
+// How a layout node divides its area between its children
+enum class ZoneSplit
+{
+    // The node is a zone
+    None,
+    // Children side by side, left to right
+    Columns,
+    // Children stacked, top to bottom
+    Rows
+};
+
+// Description of a layout as a tree of splits.  Every leaf is a zone and every split
+// shares its area between its children in proportion to their weights.
+struct ZoneLayoutNode
+{
+    ZoneSplit split{ ZoneSplit::None };
+    int weight{ 1 };
+    // Parts of its parent's split the node covers, each of its weight, with the padding
+    // between them.  A merged cell of a grid spans the cells it replaces.
+    int span{ 1 };
+    std::vector<ZoneLayoutNode> children;
+};
+
+// A split of count zones of the same size
+ZoneLayoutNode MakeSplitLayout(ZoneSplit split, int count);
+
+// A split of zones sized by weights
+ZoneLayoutNode MakeWeightedLayout(ZoneSplit split, std::vector<int> const& weights);
+
+// The grid the editor offers for zoneCount zones: as many rows as the square root allows
+// and the columns needed for the rest.  When the count doesn't fill the grid, the top
+// cells of the first column are merged into one zone.  A full grid is numbered row by
+// row, one with a merged zone column by column.  Two zones on a portrait work area are
+// stacked instead of side by side.
+ZoneLayoutNode MakeGridLayout(int zoneCount, bool portrait);
+
+// Rects of the zones of layout in workArea, in the order of the leaves, depth first.
+// paddingOuter is left around the work area and paddingInner between neighbours.
+std::vector<ZoneRect> LayoutZones(ZoneRect const& workArea, ZoneLayoutNode const& layout, int paddingOuter, int paddingInner);
+
+// Overlapping zones around a focus zone in the middle of workArea.  The second to fifth
+// zone peek out right, left, above and below it and the ones past that are stacked on
+// the fifth.
+std::vector<ZoneRect> LayoutFocusZones(ZoneRect const& workArea, int zoneCount, int paddingOuter, int paddingInner);
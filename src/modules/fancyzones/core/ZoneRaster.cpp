@@ -0,0 +1,63 @@
+#include "ZoneRaster.h"
+#include <algorithm>
+#include <cstring>
+
+void ZoneRaster::Resize(int width, int height)
+{
+    m_width = std::max(0, width);
+    m_height = std::max(0, height);
+    m_pixels.assign(static_cast<size_t>(m_width) * m_height, 0);
+}
+
+void ZoneRaster::Fill(ZoneFill const& fill, ZoneRect const& clip) noexcept
+{
+    ZoneRect const rect = fill.rect.intersection(clip).intersection(Bounds());
+    if (rect.empty())
+    {
+        return;
+    }
+
+    uint32_t const alpha = fill.pixel >> 24;
+    if (!fill.blend || alpha == 255)
+    {
+        for (int y = rect.top; y < rect.bottom; y++)
+        {
+            uint32_t* const row = &m_pixels[static_cast<size_t>(y) * m_width];
+            std::fill(row + rect.left, row + rect.right, fill.pixel);
+        }
+        return;
+    }
+
+    // Source over with premultiplied colors, like GdiAlphaBlend with AC_SRC_ALPHA
+    uint32_t const inverse = 255 - alpha;
+    for (int y = rect.top; y < rect.bottom; y++)
+    {
+        uint32_t* const row = &m_pixels[static_cast<size_t>(y) * m_width];
+        for (int x = rect.left; x < rect.right; x++)
+        {
+            uint32_t const under = row[x];
+            uint32_t pixel = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                uint32_t const channel = ((fill.pixel >> shift) & 0xFF) + (((under >> shift) & 0xFF) * inverse + 127) / 255;
+                pixel |= std::min<uint32_t>(channel, 255) << shift;
+            }
+            row[x] = pixel;
+        }
+    }
+}
+
+void ZoneRaster::Copy(ZoneRaster const& source, ZoneRect const& rect) noexcept
+{
+    ZoneRect const copy = rect.intersection(Bounds()).intersection(source.Bounds());
+    if (copy.empty() || source.m_width != m_width)
+    {
+        return;
+    }
+
+    for (int y = copy.top; y < copy.bottom; y++)
+    {
+        size_t const offset = static_cast<size_t>(y) * m_width + copy.left;
+        memcpy(&m_pixels[offset], &source.m_pixels[offset], static_cast<size_t>(copy.width()) * sizeof(uint32_t));
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "ZoneRect.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Pixels are laid out like those of a 32 bit BI_RGB DIB, blue in the low byte and alpha
+// in the high one, with the colors premultiplied by alpha.
+inline uint32_t ZonePixel(uint8_t alpha, uint8_t red, uint8_t green, uint8_t blue) noexcept
+{
+    return (static_cast<uint32_t>(alpha) << 24) |
+           (static_cast<uint32_t>(red * alpha / 255) << 16) |
+           (static_cast<uint32_t>(green * alpha / 255) << 8) |
+           static_cast<uint32_t>(blue * alpha / 255);
+}
+
+// A rect filled with a pixel, the only thing a zone window draws.  Like FillRectARGB, the
+// pixel replaces what is under it unless blend is set and it isn't opaque.
+struct ZoneFill
+{
+    ZoneRect rect;
+    uint32_t pixel{};
+    bool blend{};
+
+    bool operator==(ZoneFill const& other) const
+    {
+        return rect == other.rect && pixel == other.pixel && blend == other.blend;
+    }
+    bool operator!=(ZoneFill const& other) const { return !(*this == other); }
+};
+
+// Off-screen top-down image a zone window is drawn into before it is copied to the
+// screen, and that the tests read back.
+class ZoneRaster
+{
+public:
+    // Resizes to width by height transparent pixels
+    void Resize(int width, int height);
+
+    int Width() const noexcept { return m_width; }
+    int Height() const noexcept { return m_height; }
+    ZoneRect Bounds() const noexcept { return { 0, 0, m_width, m_height }; }
+    uint32_t const* Bits() const noexcept { return m_pixels.data(); }
+    uint32_t Pixel(int x, int y) const noexcept { return m_pixels[static_cast<size_t>(y) * m_width + x]; }
+
+    // Draws the part of fill inside clip
+    void Fill(ZoneFill const& fill, ZoneRect const& clip) noexcept;
+
+    // Copies rect from source, which has the same size
+    void Copy(ZoneRaster const& source, ZoneRect const& rect) noexcept;
+
+private:
+    int m_width{};
+    int m_height{};
+    std::vector<uint32_t> m_pixels;
+};
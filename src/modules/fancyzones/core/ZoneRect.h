@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+// Bounds of a zone with the layout of a Win32 RECT, so the portable core builds without
+// the Windows SDK.  Like a RECT, right and bottom are outside the zone.
+struct ZoneRect
+{
+    int left{};
+    int top{};
+    int right{};
+    int bottom{};
+
+    int width() const { return right - left; }
+    int height() const { return bottom - top; }
+    bool empty() const { return right <= left || bottom <= top; }
+    int64_t area() const { return empty() ? 0 : static_cast<int64_t>(width()) * height(); }
+    bool contains(int x, int y) const { return x >= left && x < right && y >= top && y < bottom; }
+    bool contains(ZoneRect const& other) const
+    {
+        return other.empty() || (other.left >= left && other.top >= top && other.right <= right && other.bottom <= bottom);
+    }
+
+    ZoneRect intersection(ZoneRect const& other) const
+    {
+        return { left > other.left ? left : other.left,
+                 top > other.top ? top : other.top,
+                 right < other.right ? right : other.right,
+                 bottom < other.bottom ? bottom : other.bottom };
+    }
+
+    // Smallest rect that holds both, ignoring empty ones
+    ZoneRect united(ZoneRect const& other) const
+    {
+        if (other.empty())
+        {
+            return *this;
+        }
+        if (empty())
+        {
+            return other;
+        }
+        return { left < other.left ? left : other.left,
+                 top < other.top ? top : other.top,
+                 right > other.right ? right : other.right,
+                 bottom > other.bottom ? bottom : other.bottom };
+    }
+
+    bool operator==(ZoneRect const& other) const
+    {
+        return left == other.left && top == other.top && right == other.right && bottom == other.bottom;
+    }
+    bool operator!=(ZoneRect const& other) const { return !(*this == other); }
+};
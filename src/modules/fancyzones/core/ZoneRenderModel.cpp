@@ -0,0 +1,110 @@
+#include "ZoneRenderModel.h"
+#include <algorithm>
+
+void ZoneRenderModel::Resize(int width, int height)
+{
+    if (width == m_frame.Width() && height == m_frame.Height())
+    {
+        return;
+    }
+
+    m_static.Resize(width, height);
+    m_frame.Resize(width, height);
+    m_staticDirty.clear();
+    m_frameDirty.clear();
+    AddDirty(m_static.Bounds(), m_staticDirty);
+}
+
+void ZoneRenderModel::SetStaticLayer(std::vector<ZoneFill> const& fills)
+{
+    AddChangedFills(m_staticFills, fills, m_staticDirty);
+    m_staticFills = fills;
+}
+
+void ZoneRenderModel::SetDynamicLayer(std::vector<ZoneFill> const& fills)
+{
+    AddChangedFills(m_dynamicFills, fills, m_frameDirty);
+    m_dynamicFills = fills;
+}
+
+std::vector<ZoneRect> const& ZoneRenderModel::Render()
+{
+    for (auto const& rect : m_staticDirty)
+    {
+        m_static.Fill({ rect }, rect);
+        for (auto const& fill : m_staticFills)
+        {
+            m_static.Fill(fill, rect);
+        }
+        AddDirty(rect, m_frameDirty);
+    }
+    m_staticDirty.clear();
+
+    m_painted.swap(m_frameDirty);
+    m_frameDirty.clear();
+    for (auto const& rect : m_painted)
+    {
+        m_frame.Copy(m_static, rect);
+        for (auto const& fill : m_dynamicFills)
+        {
+            m_frame.Fill(fill, rect);
+        }
+    }
+    return m_painted;
+}
+
+void ZoneRenderModel::AddChangedFills(std::vector<ZoneFill> const& oldFills, std::vector<ZoneFill> const& newFills, std::vector<ZoneRect>& dirty) const
+{
+    // A pixel outside every fill that changed is covered by the same fills in the same
+    // order as before, so it keeps its color
+    size_t prefix = 0;
+    while (prefix < oldFills.size() && prefix < newFills.size() && oldFills[prefix] == newFills[prefix])
+    {
+        prefix++;
+    }
+
+    size_t suffix = 0;
+    while (suffix < oldFills.size() - prefix && suffix < newFills.size() - prefix &&
+           oldFills[oldFills.size() - 1 - suffix] == newFills[newFills.size() - 1 - suffix])
+    {
+        suffix++;
+    }
+
+    for (size_t i = prefix; i < oldFills.size() - suffix; i++)
+    {
+        AddDirty(oldFills[i].rect, dirty);
+    }
+    for (size_t i = prefix; i < newFills.size() - suffix; i++)
+    {
+        AddDirty(newFills[i].rect, dirty);
+    }
+}
+
+void ZoneRenderModel::AddDirty(ZoneRect const& rect, std::vector<ZoneRect>& dirty) const
+{
+    ZoneRect const clipped = rect.intersection(m_frame.Bounds());
+    if (clipped.empty())
+    {
+        return;
+    }
+
+    for (auto const& existing : dirty)
+    {
+        if (existing.contains(clipped))
+        {
+            return;
+        }
+    }
+    dirty.erase(std::remove_if(dirty.begin(), dirty.end(), [&](ZoneRect const& existing) { return clipped.contains(existing); }), dirty.end());
+    dirty.push_back(clipped);
+
+    if (dirty.size() > ZONE_RENDER_MODEL_MAX_DIRTY_RECTS)
+    {
+        ZoneRect bounds{};
+        for (auto const& existing : dirty)
+        {
+            bounds = bounds.united(existing);
+        }
+        dirty.assign(1, bounds);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "ZoneRaster.h"
+#include <vector>
+
+// Rects Render repaints before it gives up and repaints their bounds
+#define ZONE_RENDER_MODEL_MAX_DIRTY_RECTS 8
+
+// Retained drawing of a zone window.  The window describes what it shows as two lists of
+// fills drawn in order: the static layer, which changes with the layout and the mode of
+// the window, and the dynamic layer over it, which follows the cursor.  The static layer
+// is kept rasterized, and each list is compared with the last one so only the rects of
+// the fills that changed are drawn again.
+class ZoneRenderModel
+{
+public:
+    // Sizes the frame.  A new size repaints all of it.
+    void Resize(int width, int height);
+
+    void SetStaticLayer(std::vector<ZoneFill> const& fills);
+    void SetDynamicLayer(std::vector<ZoneFill> const& fills);
+
+    // Repaints the parts of the frame that changed since the last call and returns them
+    std::vector<ZoneRect> const& Render();
+
+    ZoneRaster const& Frame() const noexcept { return m_frame; }
+
+private:
+    // Adds the rects of the fills that differ between the old and new list to dirty
+    void AddChangedFills(std::vector<ZoneFill> const& oldFills, std::vector<ZoneFill> const& newFills, std::vector<ZoneRect>& dirty) const;
+    void AddDirty(ZoneRect const& rect, std::vector<ZoneRect>& dirty) const;
+
+    std::vector<ZoneFill> m_staticFills;
+    std::vector<ZoneFill> m_dynamicFills;
+    std::vector<ZoneRect> m_staticDirty;
+    std::vector<ZoneRect> m_frameDirty;
+    std::vector<ZoneRect> m_painted;
+    ZoneRaster m_static;
+    ZoneRaster m_frame;
+};
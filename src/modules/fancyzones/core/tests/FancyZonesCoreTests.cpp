@@ -0,0 +1,449 @@
+#include "ZoneHoverMap.h"
+#include "ZoneIndex.h"
+#include "ZoneLayout.h"
+#include "ZoneRenderModel.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+// Tests of the portable FancyZones core that build without the Windows SDK.  The tests
+// in tests/UnitTests cover the zone set and the zone window through the COM objects.
+
+static int s_failures = 0;
+
+#define CHECK(expression)                                                          \
+    do                                                                             \
+    {                                                                              \
+        if (!(expression))                                                         \
+        {                                                                          \
+            fprintf(stderr, "%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #expression); \
+            s_failures++;                                                          \
+        }                                                                          \
+    } while (0)
+
+// What ZoneSet::ZoneFromPoint did before the index, without the smallest zone bug
+static int LinearZoneFromPoint(std::vector<ZoneRect> const& zones, int x, int y)
+{
+    int smallest = -1;
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        if (zones[i].contains(x, y) && (smallest < 0 || zones[i].area() < zones[smallest].area()))
+        {
+            smallest = static_cast<int>(i);
+        }
+    }
+    return smallest;
+}
+
+static bool SameRect(ZoneRect const& a, ZoneRect const& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+static void TestZoneLayout()
+{
+    ZoneRect const workArea{ 0, 0, 1000, 800 };
+
+    // A single zone fills the work area less the outer padding
+    std::vector<ZoneRect> zones = LayoutZones(workArea, MakeGridLayout(1, false), 10, 5);
+    CHECK(zones.size() == 1);
+    CHECK(SameRect(zones[0], { 10, 10, 990, 790 }));
+
+    // Columns share the width left by the padding and leave no pixel out
+    zones = LayoutZones({ 0, 0, 1003, 800 }, MakeSplitLayout(ZoneSplit::Columns, 3), 0, 2);
+    CHECK(zones.size() == 3);
+    CHECK(SameRect(zones[0], { 0, 0, 333, 800 }));
+    CHECK(SameRect(zones[1], { 335, 0, 668, 800 }));
+    CHECK(SameRect(zones[2], { 670, 0, 1003, 800 }));
+
+    // Work areas that don't start at the origin, like a second monitor
+    zones = LayoutZones({ -1000, 200, 0, 1000 }, MakeSplitLayout(ZoneSplit::Rows, 2), 0, 0);
+    CHECK(zones.size() == 2);
+    CHECK(SameRect(zones[0], { -1000, 200, 0, 600 }));
+    CHECK(SameRect(zones[1], { -1000, 600, 0, 1000 }));
+
+    // Weighted splits
+    zones = LayoutZones(workArea, MakeWeightedLayout(ZoneSplit::Columns, { 1, 3 }), 0, 0);
+    CHECK(zones.size() == 2);
+    CHECK(SameRect(zones[0], { 0, 0, 250, 800 }));
+    CHECK(SameRect(zones[1], { 250, 0, 1000, 800 }));
+
+    // Nested splits: a wide zone on the left and two stacked ones on the right
+    ZoneLayoutNode layout = MakeWeightedLayout(ZoneSplit::Columns, { 2, 1 });
+    layout.children[1] = MakeSplitLayout(ZoneSplit::Rows, 2);
+    zones = LayoutZones({ 0, 0, 900, 800 }, layout, 0, 0);
+    CHECK(zones.size() == 3);
+    CHECK(SameRect(zones[0], { 0, 0, 600, 800 }));
+    CHECK(SameRect(zones[1], { 600, 0, 900, 400 }));
+    CHECK(SameRect(zones[2], { 600, 400, 900, 800 }));
+
+    // The grid has as many rows as the square root allows and is numbered row by row
+    zones = LayoutZones({ 0, 0, 1200, 800 }, MakeGridLayout(6, false), 0, 0);
+    CHECK(zones.size() == 6);
+    CHECK(SameRect(zones[0], { 0, 0, 400, 400 }));
+    CHECK(SameRect(zones[2], { 800, 0, 1200, 400 }));
+    CHECK(SameRect(zones[3], { 0, 400, 400, 800 }));
+
+    // Like in the editor, the cells the count doesn't fill are merged at the top of the
+    // first column, and the zones are numbered column by column
+    zones = LayoutZones({ 0, 0, 1200, 800 }, MakeGridLayout(5, false), 0, 0);
+    CHECK(zones.size() == 5);
+    CHECK(SameRect(zones[0], { 0, 0, 400, 800 }));
+    CHECK(SameRect(zones[1], { 400, 0, 800, 400 }));
+    CHECK(SameRect(zones[2], { 400, 400, 800, 800 }));
+    CHECK(SameRect(zones[4], { 800, 400, 1200, 800 }));
+
+    // A merged zone spans the padding between the cells it replaces
+    zones = LayoutZones({ 0, 0, 1206, 912 }, MakeGridLayout(11, false), 0, 6);
+    CHECK(zones.size() == 11);
+    CHECK(SameRect(zones[0], { 0, 0, 297, 606 }));
+    CHECK(SameRect(zones[1], { 0, 612, 297, 912 }));
+    CHECK(SameRect(zones[3], { 303, 306, 600, 606 }));
+
+    // Only two zones on a portrait work area are stacked
+    zones = LayoutZones({ 0, 0, 800, 1200 }, MakeGridLayout(2, true), 0, 0);
+    CHECK(zones.size() == 2);
+    CHECK(SameRect(zones[0], { 0, 0, 800, 600 }));
+    CHECK(SameRect(zones[1], { 0, 600, 800, 1200 }));
+    zones = LayoutZones({ 0, 0, 800, 1200 }, MakeGridLayout(3, true), 0, 0);
+    CHECK(zones.size() == 3);
+    CHECK(SameRect(zones[1], { 266, 0, 533, 1200 }));
+
+    // Grids of any size cover the work area less the padding without overlapping
+    for (int zoneCount = 1; zoneCount <= 200; zoneCount++)
+    {
+        zones = LayoutZones({ 0, 0, 3840, 2160 }, MakeGridLayout(zoneCount, false), 0, 0);
+        CHECK(zones.size() == static_cast<size_t>(zoneCount));
+        int64_t area = 0;
+        for (auto const& zone : zones)
+        {
+            area += zone.area();
+        }
+        CHECK(area == 3840 * 2160);
+    }
+
+    // The focus zone is centered and the others stay inside the outer padding
+    zones = LayoutFocusZones({ 0, 0, 1000, 800 }, 5, 10, 5);
+    CHECK(zones.size() == 5);
+    CHECK(SameRect(zones[0], { 200, 100, 800, 700 }));
+    for (auto const& zone : zones)
+    {
+        CHECK(zone.width() == 600 && zone.height() == 600);
+        CHECK(zone.left >= 10 && zone.top >= 10 && zone.right <= 990 && zone.bottom <= 790);
+    }
+    CHECK(LayoutFocusZones(workArea, 0, 0, 0).empty());
+}
+
+static void TestZoneIndex()
+{
+    ZoneIndex index;
+    CHECK(index.ZoneFromPoint(0, 0) == -1);
+
+    // Right and bottom edges are outside a zone
+    index.Build({ { 0, 0, 100, 100 }, { 100, 0, 200, 100 } });
+    CHECK(index.ZoneFromPoint(0, 0) == 0);
+    CHECK(index.ZoneFromPoint(99, 99) == 0);
+    CHECK(index.ZoneFromPoint(100, 50) == 1);
+    CHECK(index.ZoneFromPoint(199, 99) == 1);
+    CHECK(index.ZoneFromPoint(200, 50) == -1);
+    CHECK(index.ZoneFromPoint(50, 100) == -1);
+    CHECK(index.ZoneFromPoint(-1, 50) == -1);
+
+    // The smallest zone wins wherever it is in the list.  Scanning kept comparing with
+    // the first zone hit instead of the smallest so far and could return the middle one.
+    index.Build({ { 0, 0, 400, 400 }, { 0, 0, 200, 200 }, { 0, 0, 100, 100 }, { 300, 300, 400, 400 } });
+    CHECK(index.ZoneFromPoint(50, 50) == 2);
+    CHECK(index.ZoneFromPoint(150, 150) == 1);
+    CHECK(index.ZoneFromPoint(250, 250) == 0);
+    CHECK(index.ZoneFromPoint(350, 350) == 3);
+    index.Build({ { 0, 0, 100, 100 }, { 0, 0, 400, 400 }, { 0, 0, 200, 200 } });
+    CHECK(index.ZoneFromPoint(50, 50) == 0);
+
+    // Of zones of the same size the first one wins
+    index.Build({ { 0, 0, 100, 100 }, { 50, 50, 150, 150 } });
+    CHECK(index.ZoneFromPoint(75, 75) == 0);
+    index.Build({ { 50, 50, 150, 150 }, { 0, 0, 100, 100 } });
+    CHECK(index.ZoneFromPoint(75, 75) == 0);
+
+    // Empty zones are never hit, and indexes still refer to the list given
+    index.Build({ { 10, 10, 10, 50 }, { 0, 0, 100, 100 } });
+    CHECK(index.ZoneCount() == 2);
+    CHECK(index.ZoneFromPoint(10, 20) == 1);
+
+    // Zones with negative coordinates, like those of a monitor left of the primary one
+    index.Build({ { -1920, 0, -960, 1080 }, { -960, 0, 0, 1080 } });
+    CHECK(index.ZoneFromPoint(-1920, 0) == 0);
+    CHECK(index.ZoneFromPoint(-961, 1079) == 0);
+    CHECK(index.ZoneFromPoint(-960, 0) == 1);
+    CHECK(index.ZoneFromPoint(0, 0) == -1);
+
+    // Overlapping zones of every size agree with a scan of every zone
+    std::mt19937 random(7);
+    for (int round = 0; round < 20; round++)
+    {
+        std::vector<ZoneRect> zones;
+        size_t const zoneCount = 1 + random() % 200;
+        for (size_t i = 0; i < zoneCount; i++)
+        {
+            int const left = static_cast<int>(random() % 3000);
+            int const top = static_cast<int>(random() % 2000);
+            zones.push_back({ left, top, left + 1 + static_cast<int>(random() % 1000), top + 1 + static_cast<int>(random() % 800) });
+        }
+        index.Build(zones);
+
+        int mismatches = 0;
+        for (int i = 0; i < 2000; i++)
+        {
+            int const x = static_cast<int>(random() % 4200) - 100;
+            int const y = static_cast<int>(random() % 3000) - 100;
+            mismatches += index.ZoneFromPoint(x, y) != LinearZoneFromPoint(zones, x, y);
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+static void TestZoneHoverMap()
+{
+    ZoneHoverMap map;
+    map.Build({ 0, 0, 0, 0 }, {});
+    CHECK(map.ZoneFromPoint(0, 0) == -1);
+
+    // Edges on cell boundaries leave every cell with one answer
+    map.Build({ 0, 0, 64, 32 }, { { 0, 0, 32, 32 }, { 32, 0, 64, 32 } });
+    CHECK(map.CellCount() == 32);
+    CHECK(map.MixedCellCount() == 0);
+    CHECK(map.ZoneFromPoint(31, 31) == 0);
+    CHECK(map.ZoneFromPoint(32, 0) == 1);
+    CHECK(map.ZoneFromPoint(64, 0) == -1);
+
+    // Edges inside cells leave those to the index, and the area needn't be a whole
+    // number of cells
+    map.Build({ 0, 0, 101, 50 }, { { 0, 0, 50, 50 }, { 50, 0, 101, 50 }, { 20, 10, 30, 20 } });
+    CHECK(map.MixedCellCount() > 0);
+    CHECK(map.ZoneFromPoint(49, 5) == 0);
+    CHECK(map.ZoneFromPoint(50, 5) == 1);
+    CHECK(map.ZoneFromPoint(100, 49) == 1);
+    CHECK(map.ZoneFromPoint(25, 15) == 2);
+    CHECK(map.ZoneFromPoint(30, 15) == 0);
+
+    // Zones outside the area are still found
+    map.Build({ 0, 0, 100, 100 }, { { 0, 0, 100, 100 }, { 100, 0, 200, 100 } });
+    CHECK(map.ZoneFromPoint(150, 50) == 1);
+
+    // Overlapping zones anywhere around the area agree with a scan of every zone
+    std::mt19937 random(11);
+    for (int round = 0; round < 20; round++)
+    {
+        std::vector<ZoneRect> zones;
+        size_t const zoneCount = 1 + random() % 100;
+        for (size_t i = 0; i < zoneCount; i++)
+        {
+            int const left = static_cast<int>(random() % 2200) - 100;
+            int const top = static_cast<int>(random() % 1300) - 100;
+            zones.push_back({ left, top, left + 1 + static_cast<int>(random() % 800), top + 1 + static_cast<int>(random() % 600) });
+        }
+        ZoneRect const area{ static_cast<int>(random() % 50), static_cast<int>(random() % 50), 1920 + static_cast<int>(random() % 7), 1080 + static_cast<int>(random() % 7) };
+        map.Build(area, zones, 1 + round % 5);
+
+        int mismatches = 0;
+        for (int i = 0; i < 5000; i++)
+        {
+            int const x = static_cast<int>(random() % 2200) - 100;
+            int const y = static_cast<int>(random() % 1300) - 100;
+            mismatches += map.ZoneFromPoint(x, y) != LinearZoneFromPoint(zones, x, y);
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+// Draws both layers from scratch, the way OnPaint did before the render model
+static ZoneRaster RasterizeFrame(int width, int height, std::vector<ZoneFill> const& staticFills, std::vector<ZoneFill> const& dynamicFills)
+{
+    ZoneRaster raster;
+    raster.Resize(width, height);
+    for (auto const& fill : staticFills)
+    {
+        raster.Fill(fill, raster.Bounds());
+    }
+    for (auto const& fill : dynamicFills)
+    {
+        raster.Fill(fill, raster.Bounds());
+    }
+    return raster;
+}
+
+static bool SameFrame(ZoneRaster const& a, ZoneRaster const& b)
+{
+    if (a.Width() != b.Width() || a.Height() != b.Height())
+    {
+        return false;
+    }
+    return std::equal(a.Bits(), a.Bits() + static_cast<size_t>(a.Width()) * a.Height(), b.Bits());
+}
+
+static void TestZoneRaster()
+{
+    CHECK(ZonePixel(255, 10, 20, 30) == 0xFF0A141E);
+    CHECK(ZonePixel(0, 10, 20, 30) == 0);
+    CHECK(ZonePixel(51, 255, 0, 255) == 0x33330033);
+
+    ZoneRaster raster;
+    raster.Resize(10, 10);
+    CHECK(raster.Pixel(9, 9) == 0);
+
+    // Fills are clipped to the clip rect and the raster
+    raster.Fill({ { -5, -5, 5, 5 }, 0x80402010 }, raster.Bounds());
+    CHECK(raster.Pixel(0, 0) == 0x80402010);
+    CHECK(raster.Pixel(4, 4) == 0x80402010);
+    CHECK(raster.Pixel(5, 5) == 0);
+    raster.Fill({ { 0, 0, 10, 10 }, 0xFFFFFFFF }, { 8, 8, 20, 20 });
+    CHECK(raster.Pixel(7, 7) == 0);
+    CHECK(raster.Pixel(9, 9) == 0xFFFFFFFF);
+
+    // Without blend the pixel replaces what is under it, with it the pixel goes over it
+    raster.Fill({ { 0, 0, 1, 1 }, 0x00FFFFFF }, raster.Bounds());
+    CHECK(raster.Pixel(0, 0) == 0x00FFFFFF);
+    raster.Fill({ { 9, 9, 10, 10 }, ZonePixel(128, 0, 0, 0), true }, raster.Bounds());
+    CHECK(raster.Pixel(9, 9) == 0xFF7F7F7F);
+    raster.Fill({ { 9, 9, 10, 10 }, ZonePixel(0, 0, 0, 0), true }, raster.Bounds());
+    CHECK(raster.Pixel(9, 9) == 0xFF7F7F7F);
+
+    ZoneRaster copy;
+    copy.Resize(10, 10);
+    copy.Copy(raster, { 4, 4, 20, 20 });
+    CHECK(copy.Pixel(3, 3) == 0);
+    CHECK(copy.Pixel(4, 4) == 0x80402010);
+    CHECK(copy.Pixel(9, 9) == 0xFF7F7F7F);
+}
+
+static void TestZoneRenderModel()
+{
+    int const width = 400;
+    int const height = 300;
+    ZoneFill const backdrop{ { 0, 0, width, height }, ZonePixel(225, 0, 0, 0) };
+    ZoneFill const zoneA{ { 10, 10, 190, 290 }, ZonePixel(225, 81, 92, 107) };
+    ZoneFill const zoneB{ { 210, 10, 390, 290 }, ZonePixel(225, 81, 92, 107) };
+    ZoneFill const glyph{ { 15, 15, 25, 25 }, ZonePixel(100, 255, 255, 255), true };
+    std::vector<ZoneFill> const staticFills{ backdrop, zoneA, glyph, zoneB };
+
+    ZoneRenderModel model;
+    model.SetStaticLayer(staticFills);
+    model.Resize(width, height);
+    auto painted = model.Render();
+    CHECK(painted.size() == 1 && SameRect(painted[0], { 0, 0, width, height }));
+    CHECK(SameFrame(model.Frame(), RasterizeFrame(width, height, staticFills, {})));
+
+    // Nothing changed, nothing is painted
+    model.SetStaticLayer(staticFills);
+    model.SetDynamicLayer({});
+    CHECK(model.Render().empty());
+
+    // Moving the highlight from one zone to the other paints only the two zones
+    ZoneFill highlightA{ zoneA.rect, ZonePixel(225, 0, 120, 215) };
+    ZoneFill highlightB{ zoneB.rect, ZonePixel(225, 0, 120, 215) };
+    model.SetDynamicLayer({ highlightA });
+    painted = model.Render();
+    CHECK(painted.size() == 1 && SameRect(painted[0], zoneA.rect));
+    CHECK(SameFrame(model.Frame(), RasterizeFrame(width, height, staticFills, { highlightA })));
+
+    model.SetDynamicLayer({ highlightB });
+    painted = model.Render();
+    CHECK(painted.size() == 2);
+    CHECK(SameFrame(model.Frame(), RasterizeFrame(width, height, staticFills, { highlightB })));
+
+    model.SetDynamicLayer({});
+    painted = model.Render();
+    CHECK(painted.size() == 1 && SameRect(painted[0], zoneB.rect));
+    CHECK(SameFrame(model.Frame(), RasterizeFrame(width, height, staticFills, {})));
+
+    // Rects inside a dirty rect are dropped, and too many collapse into their bounds
+    std::vector<ZoneFill> nested{ { { 0, 0, 100, 100 }, 1 }, { { 10, 10, 20, 20 }, 2 } };
+    model.SetDynamicLayer(nested);
+    painted = model.Render();
+    CHECK(painted.size() == 1 && SameRect(painted[0], { 0, 0, 100, 100 }));
+    std::vector<ZoneFill> scattered;
+    for (int i = 0; i <= ZONE_RENDER_MODEL_MAX_DIRTY_RECTS; i++)
+    {
+        scattered.push_back({ { i * 20, 200, i * 20 + 10, 210 }, 3 });
+    }
+    model.SetDynamicLayer(scattered);
+    painted = model.Render();
+    ZoneRect paintedBounds{};
+    for (auto const& rect : painted)
+    {
+        paintedBounds = paintedBounds.united(rect);
+    }
+    CHECK(painted.size() < ZONE_RENDER_MODEL_MAX_DIRTY_RECTS);
+    CHECK(SameRect(paintedBounds, { 0, 0, ZONE_RENDER_MODEL_MAX_DIRTY_RECTS * 20 + 10, 210 }));
+
+    // Random edits of both layers always leave the frame the layers draw from scratch
+    std::mt19937 random(5);
+    auto randomFill = [&]() {
+        int const left = static_cast<int>(random() % (width + 40)) - 20;
+        int const top = static_cast<int>(random() % (height + 40)) - 20;
+        return ZoneFill{ { left, top, left + static_cast<int>(random() % 150), top + static_cast<int>(random() % 150) },
+                         ZonePixel(static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random())),
+                         random() % 2 == 0 };
+    };
+    auto edit = [&](std::vector<ZoneFill>& fills) {
+        switch (random() % 3)
+        {
+        case 0:
+            fills.insert(fills.begin() + random() % (fills.size() + 1), randomFill());
+            break;
+        case 1:
+            if (!fills.empty())
+            {
+                fills.erase(fills.begin() + random() % fills.size());
+            }
+            break;
+        default:
+            if (!fills.empty())
+            {
+                fills[random() % fills.size()] = randomFill();
+            }
+            break;
+        }
+    };
+
+    std::vector<ZoneFill> randomStatic = staticFills;
+    std::vector<ZoneFill> randomDynamic;
+    int mismatches = 0;
+    for (int round = 0; round < 200; round++)
+    {
+        if (round % 4 == 0)
+        {
+            edit(randomStatic);
+            model.SetStaticLayer(randomStatic);
+        }
+        edit(randomDynamic);
+        model.SetDynamicLayer(randomDynamic);
+        model.Render();
+        mismatches += !SameFrame(model.Frame(), RasterizeFrame(width, height, randomStatic, randomDynamic));
+    }
+    CHECK(mismatches == 0);
+
+    // A new size paints everything again
+    model.Resize(width / 2, height / 2);
+    painted = model.Render();
+    CHECK(painted.size() == 1 && SameRect(painted[0], { 0, 0, width / 2, height / 2 }));
+    CHECK(SameFrame(model.Frame(), RasterizeFrame(width / 2, height / 2, randomStatic, randomDynamic)));
+}
+
+int main()
+{
+    TestZoneLayout();
+    TestZoneIndex();
+    TestZoneHoverMap();
+    TestZoneRaster();
+    TestZoneRenderModel();
+
+    if (s_failures)
+    {
+        fprintf(stderr, "%d checks failed\n", s_failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
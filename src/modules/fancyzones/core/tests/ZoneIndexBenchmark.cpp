@@ -0,0 +1,146 @@
+#include "ZoneHoverMap.h"
+#include "ZoneIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+// Times finding the zone under the cursor of a drag with a scan of every zone, with
+// ZoneIndex and with the ZoneHoverMap of a zone window, for grid and overlapping layouts
+// of 40 and 1000 zones on a 4K work area.
+//
+//   ZoneIndexBenchmark [queryCount]
+//
+// Defaults to 1000000 queries per layout.
+
+using Clock = std::chrono::steady_clock;
+
+#define WORK_AREA_WIDTH 3840
+#define WORK_AREA_HEIGHT 2160
+
+static std::vector<ZoneRect> MakeGrid(int columns, int rows)
+{
+    std::vector<ZoneRect> zones;
+    int const width = WORK_AREA_WIDTH / columns;
+    int const height = WORK_AREA_HEIGHT / rows;
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            zones.push_back({ column * width, row * height, (column + 1) * width, (row + 1) * height });
+        }
+    }
+    return zones;
+}
+
+// Zones of every size dropped anywhere, like a custom layout drawn in the editor
+static std::vector<ZoneRect> MakeOverlapping(size_t zoneCount, std::mt19937& random)
+{
+    std::vector<ZoneRect> zones;
+    for (size_t i = 0; i < zoneCount; i++)
+    {
+        int const width = 100 + static_cast<int>(random() % 1200);
+        int const height = 100 + static_cast<int>(random() % 800);
+        int const left = static_cast<int>(random() % (WORK_AREA_WIDTH - width));
+        int const top = static_cast<int>(random() % (WORK_AREA_HEIGHT - height));
+        zones.push_back({ left, top, left + width, top + height });
+    }
+    return zones;
+}
+
+// The smallest zone that contains the point, testing every zone
+static int LinearZoneFromPoint(std::vector<ZoneRect> const& zones, int x, int y)
+{
+    int smallest = -1;
+    int64_t smallestArea = 0;
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        if (zones[i].contains(x, y))
+        {
+            int64_t const area = zones[i].area();
+            if (smallest < 0 || area < smallestArea)
+            {
+                smallest = static_cast<int>(i);
+                smallestArea = area;
+            }
+        }
+    }
+    return smallest;
+}
+
+static void Run(char const* name, std::vector<ZoneRect> const& zones, size_t queryCount, std::mt19937& random)
+{
+    // A cursor wandering over the work area in small steps, like a drag
+    std::vector<std::pair<int, int>> points(queryCount);
+    int x = WORK_AREA_WIDTH / 2;
+    int y = WORK_AREA_HEIGHT / 2;
+    for (auto& point : points)
+    {
+        x = std::min(WORK_AREA_WIDTH - 1, std::max(0, x + static_cast<int>(random() % 41) - 20));
+        y = std::min(WORK_AREA_HEIGHT - 1, std::max(0, y + static_cast<int>(random() % 41) - 20));
+        point = { x, y };
+    }
+
+    Clock::time_point start = Clock::now();
+    ZoneIndex index;
+    index.Build(zones);
+    double const buildUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    long long linearSum = 0;
+    start = Clock::now();
+    for (auto const& point : points)
+    {
+        linearSum += LinearZoneFromPoint(zones, point.first, point.second);
+    }
+    double const linearNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / queryCount;
+
+    long long indexSum = 0;
+    start = Clock::now();
+    for (auto const& point : points)
+    {
+        indexSum += index.ZoneFromPoint(point.first, point.second);
+    }
+    double const indexNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / queryCount;
+
+    start = Clock::now();
+    ZoneHoverMap map;
+    map.Build({ 0, 0, WORK_AREA_WIDTH, WORK_AREA_HEIGHT }, zones);
+    double const mapBuildUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    long long mapSum = 0;
+    start = Clock::now();
+    for (auto const& point : points)
+    {
+        mapSum += map.ZoneFromPoint(point.first, point.second);
+    }
+    double const mapNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / queryCount;
+
+    printf("%-12s %5zu zones  scan %7.1f ns  index %5.1f ns (build %7.1f us)  map %5.1f ns (build %7.1f us, %4.1f%% mixed)%s\n",
+           name,
+           zones.size(),
+           linearNs,
+           indexNs,
+           buildUs,
+           mapNs,
+           mapBuildUs,
+           map.CellCount() ? 100.0 * map.MixedCellCount() / map.CellCount() : 0.0,
+           linearSum == indexSum && linearSum == mapSum ? "" : "  MISMATCH");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t const queryCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    if (queryCount == 0)
+    {
+        fprintf(stderr, "Usage: ZoneIndexBenchmark [queryCount]\n");
+        return 1;
+    }
+
+    std::mt19937 random(1);
+    Run("grid", MakeGrid(8, 5), queryCount, random);
+    Run("grid", MakeGrid(40, 25), queryCount, random);
+    Run("overlapping", MakeOverlapping(40, random), queryCount, random);
+    Run("overlapping", MakeOverlapping(1000, random), queryCount, random);
+    return 0;
+}
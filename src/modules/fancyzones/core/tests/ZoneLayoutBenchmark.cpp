@@ -0,0 +1,70 @@
+#include "ZoneLayout.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Times laying out grids, weighted columns and nested splits of up to 10000 zones on a
+// 4K work area, the way a zone set does when its monitor or layout changes.
+//
+//   ZoneLayoutBenchmark [iterations]
+//
+// Defaults to 1000 layouts per case.
+
+using Clock = std::chrono::steady_clock;
+
+// Splits every zone in two, alternating columns and rows, levels times
+static ZoneLayoutNode MakeNestedLayout(int levels, bool columns)
+{
+    if (levels == 0)
+    {
+        return {};
+    }
+
+    ZoneLayoutNode node = MakeWeightedLayout(columns ? ZoneSplit::Columns : ZoneSplit::Rows, { 2, 1 });
+    for (auto& child : node.children)
+    {
+        int const weight = child.weight;
+        child = MakeNestedLayout(levels - 1, !columns);
+        child.weight = weight;
+    }
+    return node;
+}
+
+static void Run(char const* name, ZoneLayoutNode const& layout, int iterations)
+{
+    ZoneRect const workArea{ 0, 0, 3840, 2160 };
+    size_t zoneCount = 0;
+    Clock::time_point const start = Clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        zoneCount = LayoutZones(workArea, layout, 16, 8).size();
+    }
+    double const us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations;
+    printf("%-24s %6zu zones %10.2f us/layout %8.1f ns/zone\n", name, zoneCount, us, zoneCount ? us * 1000 / zoneCount : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+    int const iterations = argc > 1 ? std::atoi(argv[1]) : 1000;
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "Usage: ZoneLayoutBenchmark [iterations]\n");
+        return 1;
+    }
+
+    Run("grid", MakeGridLayout(9, false), iterations);
+    Run("grid", MakeGridLayout(100, false), iterations);
+    Run("grid", MakeGridLayout(1000, false), iterations);
+    Run("grid", MakeGridLayout(10000, false), iterations);
+
+    std::vector<int> weights;
+    for (int i = 0; i < 1000; i++)
+    {
+        weights.push_back(1 + i % 7);
+    }
+    Run("weighted columns", MakeWeightedLayout(ZoneSplit::Columns, weights), iterations);
+
+    Run("nested", MakeNestedLayout(4, true), iterations);
+    Run("nested", MakeNestedLayout(10, true), iterations);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "ZoneLayout.h"
+#include "ZoneRenderModel.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Times the frames of a drag across a 4K zone window, drawing every frame from scratch
+// like OnPaint did and with ZoneRenderModel, for grids of 4, 40 and 400 zones.
+//
+//   ZoneRenderBenchmark [frames]
+//
+// Defaults to 200 frames per case.
+
+using Clock = std::chrono::steady_clock;
+
+static int const WORK_AREA_WIDTH = 3840;
+static int const WORK_AREA_HEIGHT = 2160;
+
+// The fills DrawZone makes: the border, the fill inside it and a glyph of the index
+static void AddZone(std::vector<ZoneFill>& fills, ZoneRect const& rect, uint32_t fill)
+{
+    fills.push_back({ rect, ZonePixel(255, 104, 118, 138) });
+    fills.push_back({ { rect.left + 2, rect.top + 2, rect.right - 2, rect.bottom - 2 }, fill });
+    fills.push_back({ { rect.left + 7, rect.top + 7, rect.left + 17, rect.top + 17 }, ZonePixel(200, 50, 50, 50), true });
+}
+
+static void Run(int zoneCount, int frames)
+{
+    std::vector<ZoneRect> const zones = LayoutZones({ 0, 0, WORK_AREA_WIDTH, WORK_AREA_HEIGHT }, MakeGridLayout(zoneCount, false), 16, 8);
+    std::vector<ZoneFill> staticFills{ { { 0, 0, WORK_AREA_WIDTH, WORK_AREA_HEIGHT }, 0 } };
+    for (auto const& zone : zones)
+    {
+        AddZone(staticFills, zone, ZonePixel(225, 81, 92, 107));
+    }
+
+    // Each frame highlights the next zone, the worst a drag does
+    std::vector<std::vector<ZoneFill>> highlights(zones.size());
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        AddZone(highlights[i], zones[i], ZonePixel(225, 0, 120, 215));
+    }
+
+    ZoneRaster raster;
+    raster.Resize(WORK_AREA_WIDTH, WORK_AREA_HEIGHT);
+    Clock::time_point start = Clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        for (auto const& fill : staticFills)
+        {
+            raster.Fill(fill, raster.Bounds());
+        }
+        for (auto const& fill : highlights[frame % zones.size()])
+        {
+            raster.Fill(fill, raster.Bounds());
+        }
+    }
+    double const fullUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / frames;
+
+    ZoneRenderModel model;
+    model.Resize(WORK_AREA_WIDTH, WORK_AREA_HEIGHT);
+    model.SetStaticLayer(staticFills);
+    model.Render();
+
+    int64_t paintedPixels = 0;
+    start = Clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        model.SetStaticLayer(staticFills);
+        model.SetDynamicLayer(highlights[frame % zones.size()]);
+        for (auto const& rect : model.Render())
+        {
+            paintedPixels += rect.area();
+        }
+    }
+    double const retainedUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / frames;
+
+    printf("%4zu zones  full %9.1f us/frame  retained %8.1f us/frame  %5.1f%% of the frame painted\n",
+           zones.size(),
+           fullUs,
+           retainedUs,
+           100.0 * paintedPixels / frames / (static_cast<double>(WORK_AREA_WIDTH) * WORK_AREA_HEIGHT));
+}
+
+int main(int argc, char* argv[])
+{
+    int const frames = argc > 1 ? std::atoi(argv[1]) : 200;
+    if (frames <= 0)
+    {
+        fprintf(stderr, "Usage: ZoneRenderBenchmark [frames]\n");
+        return 1;
+    }
+
+    Run(4, frames);
+    Run(40, frames);
+    Run(400, frames);
+    return 0;
+}
@@ -116,6 +116,24 @@ public:
         return events;
     }
 
+    // Return the win_hook_event events HandleWinHookEvent handles, so the runner only
+    // hooks those. Location changes of the cursor are kept because windows that don't
+    // show their contents while dragging only move when the drag ends.
+    virtual const WinHookEventFilter* get_win_hook_event_filters() override
+    {
+        static const WinHookEventFilter filters[] = {
+            { EVENT_SYSTEM_MOVESIZESTART, EVENT_SYSTEM_MOVESIZEEND, 0, true },
+            { EVENT_OBJECT_CREATE, EVENT_OBJECT_CREATE, OBJID_WINDOW, false },
+            { EVENT_OBJECT_SHOW, EVENT_OBJECT_SHOW, OBJID_WINDOW, false },
+            { EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, OBJID_WINDOW, false },
+            { EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, OBJID_CURSOR, false },
+            { EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, 0, true },
+            { EVENT_OBJECT_UNCLOAKED, EVENT_OBJECT_UNCLOAKED, OBJID_WINDOW, false },
+            {}
+        };
+        return filters;
+    }
+
     // Return JSON with the configuration options.
     // These are the settings shown on the settings page along with their current values.
     virtual bool get_config(_Out_ PWSTR buffer, _Out_ int *buffer_size) override
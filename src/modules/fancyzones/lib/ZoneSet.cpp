@@ -1,4 +1,6 @@
 #include "pch.h"
+#include "core\ZoneIndex.h"
+#include "core\ZoneLayout.h"
 
 struct ZoneSet : winrt::implements<ZoneSet, IZoneSet>
 {
@@ -37,13 +39,15 @@ public:
 
 private:
     void InitialPopulateZones() noexcept;
-    void GenerateGridZones(MONITORINFO const& mi) noexcept;
-    void DoGridLayout(SIZE const& zoneArea, int numCols, int numRows) noexcept;
-    void GenerateFocusZones(MONITORINFO const& mi) noexcept;
     void StampZone(HWND window, _In_opt_ winrt::com_ptr<IZone> zone) noexcept;
+    void UpdateZoneIndex() noexcept;
 
     std::vector<winrt::com_ptr<IZone>> m_zones;
     ZoneSetConfig m_config;
+    // Finds the zone under the cursor during a drag.  Built again on the first query
+    // after zones were added, removed or reordered.
+    ZoneIndex m_zoneIndex;
+    bool m_zoneIndexDirty{ true };
 };
 
 IFACEMETHODIMP ZoneSet::AddZone(winrt::com_ptr<IZone> zone, bool front) noexcept
@@ -61,6 +65,7 @@ IFACEMETHODIMP ZoneSet::AddZone(winrt::com_ptr<IZone> zone, bool front) noexcept
     // Important not to set Id 0 since we store it in the HWND using SetProp.
     // SetProp(0) doesn't really work.
     zone->SetId(m_zones.size());
+    m_zoneIndexDirty = true;
     return S_OK;
 }
 
@@ -70,6 +75,7 @@ IFACEMETHODIMP ZoneSet::RemoveZone(winrt::com_ptr<IZone> zone) noexcept
     if (iter != m_zones.end())
     {
         m_zones.erase(iter);
+        m_zoneIndexDirty = true;
         return S_OK;
     }
     return E_INVALIDARG;
@@ -77,38 +83,14 @@ IFACEMETHODIMP ZoneSet::RemoveZone(winrt::com_ptr<IZone> zone) noexcept
 
 IFACEMETHODIMP_(winrt::com_ptr<IZone>) ZoneSet::ZoneFromPoint(POINT pt) noexcept
 {
-    winrt::com_ptr<IZone> smallestKnownZone = nullptr;
-    // To reduce redundant calculations, we will store the last known zones area.
-    int smallestKnownZoneArea = INT32_MAX;
-    for (auto iter = m_zones.begin(); iter != m_zones.end(); iter++)
+    // The smallest zone that contains the point, or the first of those of the same size
+    UpdateZoneIndex();
+    int const index = m_zoneIndex.ZoneFromPoint(pt.x, pt.y);
+    if (index >= 0)
     {
-        if (winrt::com_ptr<IZone> zone = iter->try_as<IZone>())
-        {
-            RECT* newZoneRect = &zone->GetZoneRect();
-            if (PtInRect(newZoneRect, pt))
-            {
-                if (smallestKnownZone == nullptr)
-                {
-                    smallestKnownZone = zone;
-
-                    RECT* r = &smallestKnownZone->GetZoneRect();
-                    smallestKnownZoneArea = (r->right-r->left)*(r->bottom-r->top);
-                }
-                else
-                {
-                    int newZoneArea = (newZoneRect->right-newZoneRect->left)*(newZoneRect->bottom-newZoneRect->top);
-
-                    if (newZoneArea<smallestKnownZoneArea)
-                    {
-                        smallestKnownZone = zone;
-                        newZoneArea = smallestKnownZoneArea;
-                    }
-                }
-            }
-        }
+        return m_zones[index];
     }
-
-    return smallestKnownZone;
+    return nullptr;
 }
 
 IFACEMETHODIMP_(winrt::com_ptr<IZone>) ZoneSet::ZoneFromWindow(HWND window) noexcept
@@ -138,7 +120,8 @@ IFACEMETHODIMP_(winrt::com_ptr<IZoneSet>) ZoneSet::MakeCustomClone() noexcept
 
 IFACEMETHODIMP_(void) ZoneSet::Save() noexcept
 {
-    size_t const zoneCount = m_zones.size();
+    // Only as many zones as the persisted data has room for are saved
+    size_t const zoneCount = min(m_zones.size(), ARRAYSIZE(ZoneSetPersistedData::Zones));
     if (zoneCount == 0)
     {
         RegistryHelpers::DeleteZoneSet(m_config.ResolutionKey, m_config.Id);
@@ -152,11 +135,10 @@ IFACEMETHODIMP_(void) ZoneSet::Save() noexcept
         data.PaddingInner = m_config.PaddingInner;
         data.PaddingOuter = m_config.PaddingOuter;
 
-        int i = 0;
-        for (auto iter = m_zones.begin(); iter != m_zones.end(); iter++)
+        for (size_t i = 0; i < zoneCount; i++)
         {
-            winrt::com_ptr<IZone> zone = iter->as<IZone>();
-            CopyRect(&data.Zones[i++], &zone->GetZoneRect());
+            RECT const zoneRect = m_zones[i]->GetZoneRect();
+            CopyRect(&data.Zones[i], &zoneRect);
         }
 
         wil::unique_cotaskmem_string guid;
@@ -176,6 +158,7 @@ IFACEMETHODIMP_(void) ZoneSet::MoveZoneToFront(winrt::com_ptr<IZone> zone) noexc
     if (iter != m_zones.end())
     {
         std::rotate(m_zones.begin(), iter, iter + 1);
+        m_zoneIndexDirty = true;
     }
 }
 
@@ -185,6 +168,7 @@ IFACEMETHODIMP_(void) ZoneSet::MoveZoneToBack(winrt::com_ptr<IZone> zone) noexce
     if (iter != m_zones.end())
     {
         std::rotate(iter, iter + 1, m_zones.end());
+        m_zoneIndexDirty = true;
     }
 }
 
@@ -273,126 +257,54 @@ IFACEMETHODIMP_(void) ZoneSet::MoveSizeEnd(HWND window, HWND zoneWindow, POINT p
     }
 }
 
-void ZoneSet::InitialPopulateZones() noexcept
+void ZoneSet::UpdateZoneIndex() noexcept
 {
-    // TODO: reconcile the pregenerated FZ layouts with the editor
-
-    MONITORINFO mi{};
-    mi.cbSize = sizeof(mi);
-    if (GetMonitorInfoW(m_config.Monitor, &mi))
+    if (m_zoneIndexDirty)
     {
-        if ((m_config.Layout == ZoneSetLayout::Grid) || (m_config.Layout == ZoneSetLayout::Row))
-        {
-            GenerateGridZones(mi);
-        }
-        else if (m_config.Layout == ZoneSetLayout::Focus)
+        std::vector<ZoneRect> rects;
+        rects.reserve(m_zones.size());
+        for (auto const& zone : m_zones)
         {
-            GenerateFocusZones(mi);
+            RECT const rect = zone->GetZoneRect();
+            rects.push_back({ rect.left, rect.top, rect.right, rect.bottom });
         }
-
-        Save();
+        m_zoneIndex.Build(rects);
+        m_zoneIndexDirty = false;
     }
 }
 
-void ZoneSet::GenerateGridZones(MONITORINFO const& mi) noexcept
+void ZoneSet::InitialPopulateZones() noexcept
 {
-    Rect workArea(mi.rcWork);
+    // TODO: reconcile the pregenerated FZ layouts with the editor
 
-    int numCols, numRows;
-    if (m_config.Layout == ZoneSetLayout::Grid)
+    MONITORINFO mi{};
+    mi.cbSize = sizeof(mi);
+    if (GetMonitorInfoW(m_config.Monitor, &mi))
     {
-        switch (m_config.ZoneCount)
+        // Zones are in the coordinates of the zone window, which covers the work area
+        Rect const workArea(mi.rcWork);
+        ZoneRect const zoneArea{ 0, 0, workArea.width(), workArea.height() };
+
+        std::vector<ZoneRect> zoneRects;
+        if (m_config.Layout == ZoneSetLayout::Grid)
         {
-            case 1: numCols = 1; numRows = 1; break;
-            case 2: numCols = 2; numRows = 1; break;
-            case 3: numCols = 2; numRows = 2; break;
-            case 4: numCols = 2; numRows = 2; break;
-            case 5: numCols = 3; numRows = 3; break;
-            case 6: numCols = 3; numRows = 3; break;
-            case 7: numCols = 3; numRows = 3; break;
-            case 8: numCols = 3; numRows = 3; break;
-            case 9: numCols = 3; numRows = 3; break;
+            zoneRects = LayoutZones(zoneArea, MakeGridLayout(m_config.ZoneCount, workArea.height() > workArea.width()), m_config.PaddingOuter, m_config.PaddingInner);
         }
-
-        if ((m_config.ZoneCount == 2) && (workArea.height() > workArea.width()))
+        else if (m_config.Layout == ZoneSetLayout::Row)
         {
-            numCols = 1;
-            numRows = 2;
+            zoneRects = LayoutZones(zoneArea, MakeSplitLayout(ZoneSplit::Columns, m_config.ZoneCount), m_config.PaddingOuter, m_config.PaddingInner);
         }
-    }
-    else if (m_config.Layout == ZoneSetLayout::Row)
-    {
-        numCols = m_config.ZoneCount;
-        numRows = 1;
-    }
-
-    SIZE const zoneArea = {
-        workArea.width() - ((m_config.PaddingOuter * 2) + (m_config.PaddingInner * (numCols - 1))),
-        workArea.height() - ((m_config.PaddingOuter * 2) + (m_config.PaddingInner * (numRows - 1)))
-    };
-
-    DoGridLayout(zoneArea, numCols, numRows);
-}
-
-void ZoneSet::DoGridLayout(SIZE const& zoneArea, int numCols, int numRows) noexcept
-{
-    auto x = m_config.PaddingOuter;
-    auto y = m_config.PaddingOuter;
-    auto const zoneWidth = (zoneArea.cx / numCols);
-    auto const zoneHeight = (zoneArea.cy / numRows);
-    for (auto i = 1; i <= m_config.ZoneCount; i++)
-    {
-        auto col = numCols - (i % numCols);
-        RECT const zoneRect = { x, y, x + zoneWidth, y + zoneHeight };
-        AddZone(MakeZone(zoneRect), false);
-
-        x += zoneWidth + m_config.PaddingInner;
-        if (col == numCols)
+        else if (m_config.Layout == ZoneSetLayout::Focus)
         {
-            x = m_config.PaddingOuter;
-            y += zoneHeight + m_config.PaddingInner;
+            zoneRects = LayoutFocusZones(zoneArea, m_config.ZoneCount, m_config.PaddingOuter, m_config.PaddingInner);
         }
-    }
-}
-
-void ZoneSet::GenerateFocusZones(MONITORINFO const& mi) noexcept
-{
-    Rect const workArea(mi.rcWork);
 
-    SIZE const workHalf = { workArea.width() / 2, workArea.height() / 2 };
-    RECT const safeZone = {
-        m_config.PaddingOuter,
-        m_config.PaddingOuter,
-        workArea.width() - m_config.PaddingOuter,
-        workArea.height() - m_config.PaddingOuter
-    };
-
-    int const width = min(1920, workArea.width() * 60 / 100);
-    int const height = min(1200, workArea.height() * 75 / 100);
-    int const halfWidth = width / 2;
-    int const halfHeight = height / 2;
-    int x = workHalf.cx - halfWidth;
-    int y = workHalf.cy - halfHeight;
-
-    RECT const focusRect = { x, y, x + width, y + height };
-    AddZone(MakeZone(focusRect), false);
-
-    for (auto i = 2; i <= m_config.ZoneCount; i++)
-    {
-        switch (i)
+        for (auto const& zoneRect : zoneRects)
         {
-            case 2: x = focusRect.right - halfWidth; y = focusRect.top + m_config.PaddingInner; break; // right
-            case 3: x = focusRect.left - halfWidth; y = focusRect.top + (m_config.PaddingInner * 2); break; // left
-            case 4: x = focusRect.left + m_config.PaddingInner; y = focusRect.top - halfHeight; break; // up
-            case 5: x = focusRect.left - m_config.PaddingInner; y = focusRect.bottom - halfHeight; break; // down
+            AddZone(MakeZone({ zoneRect.left, zoneRect.top, zoneRect.right, zoneRect.bottom }), false);
         }
 
-        // Bound into safe zone
-        x = min(safeZone.right - width, max(safeZone.left, x));
-        y = min(safeZone.bottom - height, max(safeZone.top, y));
-
-        RECT const zoneRect = { x, y, x + width, y + height };
-        AddZone(MakeZone(zoneRect), false);
+        Save();
     }
 }
 
@@ -1,6 +1,14 @@
 #include "pch.h"
+#include "core\ZoneHoverMap.h"
+#include "core\ZoneRenderModel.h"
 #include <ShellScalingApi.h>
 
+// Adds what FillRectARGB would draw to fills
+static void AddFillARGB(std::vector<ZoneFill>& fills, RECT const& rect, BYTE alpha, COLORREF color, bool blendAlpha)
+{
+    fills.push_back({ { rect.left, rect.top, rect.right, rect.bottom }, ZonePixel(alpha, GetRValue(color), GetGValue(color), GetBValue(color)), blendAlpha });
+}
+
 struct ZoneWindow : public winrt::implements<ZoneWindow, IZoneWindow>
 {
 public:
@@ -42,18 +50,21 @@ private:
     winrt::com_ptr<IZoneSet> AddZoneSet(ZoneSetLayout layout, int numZones, int paddingOuter, int paddingInner) noexcept;
     void MakeActiveZoneSetCustom() noexcept;
     void UpdateActiveZoneSet(_In_opt_ IZoneSet* zoneSet) noexcept;
+    void UpdateHoverMap() noexcept;
     LRESULT WndProc(UINT message, WPARAM wparam, LPARAM lparam) noexcept;
     void OnLButtonDown(LPARAM lparam) noexcept;
     void OnLButtonUp(LPARAM lparam) noexcept;
     void OnRButtonUp(LPARAM lparam) noexcept;
     void OnMouseMove(LPARAM lparam) noexcept;
-    void DrawBackdrop(wil::unique_hdc& hdc, RECT const& clientRect) noexcept;
-    void DrawGridLines(wil::unique_hdc& hdc, RECT const& clientRect) noexcept;
-    void DrawZone(wil::unique_hdc& hdc, ColorSetting const& colorSetting, winrt::com_ptr<IZone> zone) noexcept;
-    void DrawIndex(wil::unique_hdc& hdc, POINT offset, size_t index, int padding, int size, bool flipX, bool flipY, COLORREF colorFill);
-    void DrawActiveZoneSet(wil::unique_hdc& hdc, RECT const& clientRect) noexcept;
-    void DrawZoneBuilder(wil::unique_hdc& hdc, RECT const& clientRect) noexcept;
-    void DrawSwitchButtons(wil::unique_hdc& hdc, RECT const& clientRect) noexcept;
+    void DrawBackdrop(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept;
+    void DrawGridLines(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept;
+    void DrawZone(std::vector<ZoneFill>& fills, ColorSetting const& colorSetting, winrt::com_ptr<IZone> zone) noexcept;
+    void DrawIndex(std::vector<ZoneFill>& fills, POINT offset, size_t index, int padding, int size, bool flipX, bool flipY, COLORREF colorFill);
+    void DrawActiveZoneSet(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept;
+    void DrawHighlightZone(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept;
+    void DrawZoneBuilder(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept;
+    void DrawSwitchButtons(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept;
+    void UpdateFrame(bool staticLayer = true) noexcept;
     void OnPaint(wil::unique_hdc& hdc) noexcept;
     void UpdateGrid(int stepColumns, int stepRows) noexcept;
     void UpdateGridMargins(int inc) noexcept;
@@ -86,6 +97,14 @@ private:
     GUID m_activeZoneSetId{};
     std::vector<winrt::com_ptr<IZoneSet>> m_zoneSets;
     winrt::com_ptr<IZone> m_highlightZone;
+    ZoneHoverMap m_hoverMap;
+    std::vector<winrt::com_ptr<IZone>> m_hoverZones;
+    winrt::com_ptr<IZoneSet> m_hoverMapZoneSet;
+    bool m_hoverMapDirty{ true };
+    POINT m_windowOrigin{};
+    ZoneRenderModel m_renderModel;
+    std::vector<ZoneFill> m_staticFills;
+    std::vector<ZoneFill> m_dynamicFills;
     WPARAM m_keyLast{};
     size_t m_keyCycle{};
     int m_gridWidth{};
@@ -159,6 +178,7 @@ IFACEMETHODIMP ZoneWindow::ShowZoneWindow(bool activate, bool fadeIn) noexcept
     if (m_window)
     {
         m_flashMode = false;
+        UpdateFrame();
 
         UINT flags = SWP_NOSIZE | SWP_NOMOVE;
         if (!activate)
@@ -222,33 +242,37 @@ IFACEMETHODIMP ZoneWindow::MoveSizeEnter(HWND window, bool dragEnabled) noexcept
     m_windowMoveSize = window;
     m_drawHints = true;
     m_highlightZone = nullptr;
+
+    // The window stays put during the drag, so the cursor is mapped to it with the
+    // origin instead of asking for every update
+    m_windowOrigin = {};
+    MapWindowPoints(m_window.get(), nullptr, &m_windowOrigin, 1);
+    UpdateHoverMap();
+
     ShowZoneWindow(false /*activate*/, true /*fadeIn*/);
     return S_OK;
 }
 
 IFACEMETHODIMP ZoneWindow::MoveSizeUpdate(POINT const& ptScreen, bool dragEnabled) noexcept
 {
-    bool redraw = false;
-    POINT ptClient = ptScreen;
-    MapWindowPoints(nullptr, m_window.get(), &ptClient, 1);
-
     m_dragEnabled = dragEnabled;
 
+    winrt::com_ptr<IZone> highlightZone;
     if (dragEnabled)
     {
-        auto highlightZone = ZoneFromPoint(ptClient);
-        redraw = (highlightZone != m_highlightZone);
-        m_highlightZone = std::move(highlightZone);
-    }
-    else if (m_highlightZone)
-    {
-        m_highlightZone = nullptr;
-        redraw = true;
+        UpdateHoverMap();
+        int const index = m_hoverMap.ZoneFromPoint(ptScreen.x - m_windowOrigin.x, ptScreen.y - m_windowOrigin.y);
+        if (index >= 0)
+        {
+            highlightZone = m_hoverZones[index];
+        }
     }
 
-    if (redraw)
+    if (highlightZone != m_highlightZone)
     {
-        InvalidateRect(m_window.get(), nullptr, true);
+        // Only the zones that change color are repainted
+        m_highlightZone = std::move(highlightZone);
+        UpdateFrame(false /*staticLayer*/);
     }
     return S_OK;
 }
@@ -304,7 +328,7 @@ IFACEMETHODIMP_(void) ZoneWindow::CycleActiveZoneSet(DWORD wparam) noexcept
 
     if (m_windowMoveSize)
     {
-        InvalidateRect(m_window.get(), nullptr, true);
+        UpdateFrame();
     }
     else
     {
@@ -436,6 +460,7 @@ void ZoneWindow::MakeActiveZoneSetCustom() noexcept
 void ZoneWindow::UpdateActiveZoneSet(_In_opt_ IZoneSet* zoneSet) noexcept
 {
     m_activeZoneSet.copy_from(zoneSet);
+    m_hoverMapDirty = true;
 
     if (m_activeZoneSet)
     {
@@ -447,6 +472,34 @@ void ZoneWindow::UpdateActiveZoneSet(_In_opt_ IZoneSet* zoneSet) noexcept
     }
 }
 
+void ZoneWindow::UpdateHoverMap() noexcept
+{
+    if (!m_hoverMapDirty && m_hoverMapZoneSet == m_activeZoneSet)
+    {
+        return;
+    }
+
+    m_hoverMapDirty = false;
+    m_hoverMapZoneSet = m_activeZoneSet;
+    m_hoverZones.clear();
+    if (m_activeZoneSet)
+    {
+        m_hoverZones = m_activeZoneSet->GetZones();
+    }
+
+    std::vector<ZoneRect> rects;
+    rects.reserve(m_hoverZones.size());
+    for (auto const& zone : m_hoverZones)
+    {
+        RECT const rect = zone->GetZoneRect();
+        rects.push_back({ rect.left, rect.top, rect.right, rect.bottom });
+    }
+
+    RECT clientRect{};
+    GetClientRect(m_window.get(), &clientRect);
+    m_hoverMap.Build({ clientRect.left, clientRect.top, clientRect.right, clientRect.bottom }, rects);
+}
+
 LRESULT ZoneWindow::WndProc(UINT message, WPARAM wparam, LPARAM lparam) noexcept
 {
     switch (message)
@@ -573,7 +626,8 @@ void ZoneWindow::OnLButtonUp(LPARAM lparam) noexcept
 
     m_zoneBuilder = {};
     m_buttonDown = false;
-    InvalidateRect(m_window.get(), nullptr, true);
+    m_hoverMapDirty = true;
+    UpdateFrame();
 }
 
 void ZoneWindow::OnRButtonUp(LPARAM lparam) noexcept
@@ -615,7 +669,8 @@ void ZoneWindow::OnRButtonUp(LPARAM lparam) noexcept
             m_activeZoneSet->Save();
         }
     }
-    InvalidateRect(m_window.get(), nullptr, true);
+    m_hoverMapDirty = true;
+    UpdateFrame();
 }
 
 void ZoneWindow::OnMouseMove(LPARAM lparam) noexcept
@@ -644,7 +699,6 @@ void ZoneWindow::OnMouseMove(LPARAM lparam) noexcept
         current.bottom = current.top + m_gridHeight;
         OffsetRect(&current, m_gridMargins.cx, m_gridMargins.cy);
 
-        RECT invalidateRect = m_zoneBuilder;
         POINT const last = {
              m_gridMargins.cx + ((m_ptLast.x - m_gridMargins.cx) / m_gridWidth),
              m_gridMargins.cy + ((m_ptLast.y - m_gridMargins.cy) / m_gridHeight)
@@ -652,11 +706,10 @@ void ZoneWindow::OnMouseMove(LPARAM lparam) noexcept
 
         m_ptLast = ptClient;
         UnionRect(&m_zoneBuilder, &start, &current);
-        UnionRect(&invalidateRect, &invalidateRect, &m_zoneBuilder);
 
         if ((current.left != last.x) || (current.top != last.y))
         {
-            InvalidateRect(m_window.get(), &invalidateRect, true);
+            UpdateFrame(false /*staticLayer*/);
         }
     }
     else if (!m_flashMode && !m_editorMode && !m_drawHints && PtInRect(&m_switchButtonContainerRect, ptClient))
@@ -666,55 +719,51 @@ void ZoneWindow::OnMouseMove(LPARAM lparam) noexcept
 
     if (oldHover != m_switchButtonHover)
     {
-        InvalidateRect(m_window.get(), &m_switchButtonContainerRect, true);
+        UpdateFrame(false /*staticLayer*/);
     }
 }
 
-void ZoneWindow::DrawBackdrop(wil::unique_hdc& hdc, RECT const& clientRect) noexcept
+void ZoneWindow::DrawBackdrop(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept
 {
     if (m_windowMoveSize || m_flashMode)
     {
-        FillRectARGB(hdc, &clientRect, 0, RGB(0, 0, 0), false);
+        AddFillARGB(fills, clientRect, 0, RGB(0, 0, 0), false);
     }
     else
     {
-        FillRectARGB(hdc, &clientRect, 225, RGB(0, 0, 0), false);
+        AddFillARGB(fills, clientRect, 225, RGB(0, 0, 0), false);
     }
 }
 
-void ZoneWindow::DrawGridLines(wil::unique_hdc& hdc, RECT const& clientRect) noexcept
+void ZoneWindow::DrawGridLines(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept
 {
     if (m_editorMode)
     {
-        COLORREF const color = RGB(225, 225, 225);
-
-        wil::unique_hpen pen{ CreatePen(PS_SOLID, 1, color) };
-        wil::unique_select_object oldPen{ SelectObject(hdc.get(), pen.get()) };
+        // Like the 1 pixel pen these were drawn with, the lines leave alpha at 0
+        uint32_t const pixel = 0x00E1E1E1;
         for (int i = 0; i <= m_gridRows; i++)
         {
             int const y = m_gridMargins.cy + (i * m_gridHeight);
-            MoveToEx(hdc.get(), m_gridMargins.cx, y, nullptr);
-            LineTo(hdc.get(), clientRect.right - m_gridMargins.cx, y);
+            fills.push_back({ { m_gridMargins.cx, y, clientRect.right - m_gridMargins.cx, y + 1 }, pixel });
         }
 
         for (int i = 0; i <= m_gridColumns; i++)
         {
             int const x = m_gridMargins.cx + (i * m_gridWidth);
-            MoveToEx(hdc.get(), x, m_gridMargins.cy, nullptr);
-            LineTo(hdc.get(), x, clientRect.bottom - m_gridMargins.cy);
+            fills.push_back({ { x, m_gridMargins.cy, x + 1, clientRect.bottom - m_gridMargins.cy }, pixel });
         }
     }
 }
 
-void ZoneWindow::DrawZone(wil::unique_hdc& hdc, ColorSetting const& colorSetting, winrt::com_ptr<IZone> zone) noexcept
+void ZoneWindow::DrawZone(std::vector<ZoneFill>& fills, ColorSetting const& colorSetting, winrt::com_ptr<IZone> zone) noexcept
 {
     RECT zoneRect = zone->GetZoneRect();
     if (colorSetting.borderAlpha > 0)
     {
-        FillRectARGB(hdc, &zoneRect, colorSetting.borderAlpha, colorSetting.border, false);
+        AddFillARGB(fills, zoneRect, colorSetting.borderAlpha, colorSetting.border, false);
         InflateRect(&zoneRect, colorSetting.thickness, colorSetting.thickness);
     }
-    FillRectARGB(hdc, &zoneRect, colorSetting.fillAlpha, colorSetting.fill, false);
+    AddFillARGB(fills, zoneRect, colorSetting.fillAlpha, colorSetting.fill, false);
 
     if (!m_flashMode)
     {
@@ -726,30 +775,30 @@ void ZoneWindow::DrawZone(wil::unique_hdc& hdc, ColorSetting const& colorSetting
         POINT offset = { zoneRect.left + padding, zoneRect.top + padding };
         if (!IsOccluded(offset, index))
         {
-            DrawIndex(hdc, offset, index, padding, size, false, false, colorFill); // top left
+            DrawIndex(fills, offset, index, padding, size, false, false, colorFill); // top left
             return;
         }
 
         offset.x = zoneRect.right - ((padding + size) * 3);
         if (!IsOccluded(offset, index))
         {
-            DrawIndex(hdc, offset, index, padding, size, true, false, colorFill); // top right
+            DrawIndex(fills, offset, index, padding, size, true, false, colorFill); // top right
             return;
         }
 
         offset.y = zoneRect.bottom - ((padding + size) * 3);
         if (!IsOccluded(offset, index))
         {
-            DrawIndex(hdc, offset, index, padding, size, true, true, colorFill); // bottom right
+            DrawIndex(fills, offset, index, padding, size, true, true, colorFill); // bottom right
             return;
         }
 
         offset.x = zoneRect.left + padding;
-        DrawIndex(hdc, offset, index, padding, size, false, true, colorFill); // bottom left
+        DrawIndex(fills, offset, index, padding, size, false, true, colorFill); // bottom left
     }
 }
 
-void ZoneWindow::DrawIndex(wil::unique_hdc& hdc, POINT offset, size_t index, int padding, int size, bool flipX, bool flipY, COLORREF colorFill)
+void ZoneWindow::DrawIndex(std::vector<ZoneFill>& fills, POINT offset, size_t index, int padding, int size, bool flipX, bool flipY, COLORREF colorFill)
 {
     RECT rect = { offset.x, offset.y, offset.x + size, offset.y + size };
     for (int y = 0; y < 3; y++)
@@ -771,12 +820,12 @@ void ZoneWindow::DrawIndex(wil::unique_hdc& hdc, POINT offset, size_t index, int
                 useRect.bottom = useRect.top + size;
             }
 
-            FillRectARGB(hdc, &useRect, 200, RGB(50, 50, 50), true);
+            AddFillARGB(fills, useRect, 200, RGB(50, 50, 50), true);
 
             RECT inside = useRect;
             InflateRect(&inside, -2, -2);
 
-            FillRectARGB(hdc, &inside, 100, colorFill, true);
+            AddFillARGB(fills, inside, 100, colorFill, true);
 
             rect.left += (size + padding);
             rect.right = rect.left + size;
@@ -793,7 +842,7 @@ void ZoneWindow::DrawIndex(wil::unique_hdc& hdc, POINT offset, size_t index, int
     }
 }
 
-void ZoneWindow::DrawActiveZoneSet(wil::unique_hdc& hdc, RECT const& clientRect) noexcept
+void ZoneWindow::DrawActiveZoneSet(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept
 {
     if (m_activeZoneSet)
     {
@@ -813,7 +862,6 @@ void ZoneWindow::DrawActiveZoneSet(wil::unique_hdc& hdc, RECT const& clientRect)
         ColorSetting const colorHints      { 225, RGB(81, 92, 107),   255, RGB(104, 118, 138), -2 };
         ColorSetting const colorEditorMode { 240, RGB(100, 100, 100), 255, RGB(50, 50, 50),    -5 };
         ColorSetting       colorViewer     { 225, 0,                  255, RGB(40, 50, 60),    -2 };
-        ColorSetting       colorHighlight  { 225, 0,                  255, 0,                  -2 };
         ColorSetting const colorFlash      { 200, RGB(81, 92, 107),   200, RGB(104, 118, 138), -2 };
 
         auto zones = m_activeZoneSet->GetZones();
@@ -822,53 +870,55 @@ void ZoneWindow::DrawActiveZoneSet(wil::unique_hdc& hdc, RECT const& clientRect)
         {
             if (winrt::com_ptr<IZone> zone = iter->try_as<IZone>())
             {
-                if (zone != m_highlightZone)
+                // The highlighted zone is drawn too, DrawHighlightZone covers it
+                if (m_flashMode)
                 {
-                    if (m_flashMode)
-                    {
-                        DrawZone(hdc, colorFlash, zone);
-                    }
-                    else if (m_drawHints)
-                    {
-                        DrawZone(hdc, colorHints, zone);
-                    }
-                    else if (m_editorMode)
-                    {
-                        DrawZone(hdc, colorEditorMode, zone);
-                    }
-                    else
-                    {
-                        colorViewer.fill = colors[colorIndex];
-                        DrawZone(hdc, colorViewer, zone);
-                    }
+                    DrawZone(fills, colorFlash, zone);
+                }
+                else if (m_drawHints)
+                {
+                    DrawZone(fills, colorHints, zone);
+                }
+                else if (m_editorMode)
+                {
+                    DrawZone(fills, colorEditorMode, zone);
+                }
+                else
+                {
+                    colorViewer.fill = colors[colorIndex];
+                    DrawZone(fills, colorViewer, zone);
                 }
                 colorIndex--;
             }
         }
+    }
+}
 
-        if (m_highlightZone)
-        {
-            colorHighlight.fill = m_host->GetZoneHighlightColor();
-            colorHighlight.border = RGB(
-                max(0, GetRValue(colorHighlight.fill) - 25),
-                max(0, GetGValue(colorHighlight.fill) - 25),
-                max(0, GetBValue(colorHighlight.fill) - 25)
-            );
-            DrawZone(hdc, colorHighlight, m_highlightZone);
-        }
+void ZoneWindow::DrawHighlightZone(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept
+{
+    if (m_activeZoneSet && m_highlightZone)
+    {
+        ColorSetting colorHighlight{ 225, 0, 255, 0, -2 };
+        colorHighlight.fill = m_host->GetZoneHighlightColor();
+        colorHighlight.border = RGB(
+            max(0, GetRValue(colorHighlight.fill) - 25),
+            max(0, GetGValue(colorHighlight.fill) - 25),
+            max(0, GetBValue(colorHighlight.fill) - 25)
+        );
+        DrawZone(fills, colorHighlight, m_highlightZone);
     }
 }
 
-void ZoneWindow::DrawZoneBuilder(wil::unique_hdc& hdc, RECT const& clientRect) noexcept
+void ZoneWindow::DrawZoneBuilder(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept
 {
     if (m_editorMode && m_buttonDown)
     {
         COLORREF const colorDrag = RGB(255, 255, 255);
-        FillRectARGB(hdc, &m_zoneBuilder, 255, colorDrag, false);
+        AddFillARGB(fills, m_zoneBuilder, 255, colorDrag, false);
     }
 }
 
-void ZoneWindow::DrawSwitchButtons(wil::unique_hdc& hdc, RECT const& clientRect) noexcept
+void ZoneWindow::DrawSwitchButtons(std::vector<ZoneFill>& fills, RECT const& clientRect) noexcept
 {
     if (!m_editorMode && !m_drawHints && !m_flashMode)
     {
@@ -882,7 +932,7 @@ void ZoneWindow::DrawSwitchButtons(wil::unique_hdc& hdc, RECT const& clientRect)
 
         COLORREF const switchButtonContainerColor = RGB(50, 50, 50);
         BYTE const switchButtonContainerAlpha = 150;
-        FillRectARGB(hdc, &m_switchButtonContainerRect, switchButtonContainerAlpha, switchButtonContainerColor, true);
+        AddFillARGB(fills, m_switchButtonContainerRect, switchButtonContainerAlpha, switchButtonContainerColor, true);
 
         COLORREF const fillColor = RGB(128, 128, 128);
         COLORREF const hoverColor = RGB(255, 255, 255);
@@ -919,30 +969,65 @@ void ZoneWindow::DrawSwitchButtons(wil::unique_hdc& hdc, RECT const& clientRect)
                 color = hoverColor;
             }
 
-            DrawIndex(hdc, offset, i, padding, size, false /*flipX*/, false /*flipY*/, color);
+            DrawIndex(fills, offset, i, padding, size, false /*flipX*/, false /*flipY*/, color);
             x += m_switchButtonWidth + m_switchButtonPadding;
         }
     }
 }
 
-void ZoneWindow::OnPaint(wil::unique_hdc& hdc) noexcept
+void ZoneWindow::UpdateFrame(bool staticLayer) noexcept
 {
     RECT clientRect;
     GetClientRect(m_window.get(), &clientRect);
+    m_renderModel.Resize(clientRect.right - clientRect.left, clientRect.bottom - clientRect.top);
+
+    // What changes with the layout and the mode is only described again when it may have
+    // changed, what follows the cursor every time
+    if (staticLayer)
+    {
+        m_staticFills.clear();
+        DrawBackdrop(m_staticFills, clientRect);
+        DrawGridLines(m_staticFills, clientRect);
+        DrawActiveZoneSet(m_staticFills, clientRect);
+        m_renderModel.SetStaticLayer(m_staticFills);
+    }
+
+    m_dynamicFills.clear();
+    DrawHighlightZone(m_dynamicFills, clientRect);
+    DrawZoneBuilder(m_dynamicFills, clientRect);
+    DrawSwitchButtons(m_dynamicFills, clientRect);
+    m_renderModel.SetDynamicLayer(m_dynamicFills);
 
-    wil::unique_hdc hdcMem;;
-    HPAINTBUFFER bufferedPaint = BeginBufferedPaint(hdc.get(), &clientRect, BPBF_TOPDOWNDIB, nullptr, &hdcMem);
-    if (bufferedPaint)
+    for (auto const& rect : m_renderModel.Render())
     {
-        DrawBackdrop(hdcMem, clientRect);
-        DrawGridLines(hdcMem, clientRect);
-        DrawActiveZoneSet(hdcMem, clientRect);
-        DrawZoneBuilder(hdcMem, clientRect);
-        DrawSwitchButtons(hdcMem, clientRect);
-        EndBufferedPaint(bufferedPaint, TRUE);
+        RECT const invalidRect{ rect.left, rect.top, rect.right, rect.bottom };
+        InvalidateRect(m_window.get(), &invalidRect, false);
     }
 }
 
+void ZoneWindow::OnPaint(wil::unique_hdc& hdc) noexcept
+{
+    RECT clientRect;
+    GetClientRect(m_window.get(), &clientRect);
+    if (m_renderModel.Frame().Width() != clientRect.right - clientRect.left ||
+        m_renderModel.Frame().Height() != clientRect.bottom - clientRect.top)
+    {
+        UpdateFrame();
+    }
+
+    // The frame is kept up to date as the window changes, so painting copies it and the
+    // clip region of the paint limits that to what was invalidated
+    ZoneRaster const& frame = m_renderModel.Frame();
+    BITMAPINFO bi{};
+    bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bi.bmiHeader.biWidth = frame.Width();
+    bi.bmiHeader.biHeight = -frame.Height();
+    bi.bmiHeader.biPlanes = 1;
+    bi.bmiHeader.biBitCount = 32;
+    bi.bmiHeader.biCompression = BI_RGB;
+    SetDIBitsToDevice(hdc.get(), 0, 0, frame.Width(), frame.Height(), 0, 0, 0, frame.Height(), frame.Bits(), &bi, DIB_RGB_COLORS);
+}
+
 void ZoneWindow::UpdateGrid(int stepColumns, int stepRows) noexcept
 {
     bool const shift = GetAsyncKeyState(VK_SHIFT) & 0x8000;
@@ -1082,7 +1167,7 @@ void ZoneWindow::OnKeyUp(WPARAM wparam) noexcept
             case VK_ESCAPE: m_host->ToggleZoneViewers(); break;
         }
     }
-    InvalidateRect(m_window.get(), nullptr, true);
+    UpdateFrame();
 }
 
 winrt::com_ptr<IZone> ZoneWindow::ZoneFromPoint(POINT pt) noexcept
@@ -1237,6 +1322,7 @@ void ZoneWindow::CycleActiveZoneSetInternal(DWORD wparam, Trace::ZoneWindow::Inp
 void ZoneWindow::FlashZones() noexcept
 {
     m_flashMode = true;
+    UpdateFrame();
 
     ShowWindow(m_window.get(), SW_SHOWNA);
     std::thread([window = m_window.get()]()
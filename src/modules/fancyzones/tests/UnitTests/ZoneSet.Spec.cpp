@@ -241,6 +241,64 @@ namespace FancyZonesUnitTests
             Assert::IsFalse(zone2->ContainsWindow(window));
             Assert::IsFalse(zone3->ContainsWindow(window));
         }
+
+        TEST_METHOD(TestZoneFromPoint)
+        {
+            ZoneSetConfig config({}, 0xFFFF, Mocks::Monitor(), L"WorkAreaIn", ZoneSetLayout::Grid, 0, 3, 4);
+            winrt::com_ptr<IZoneSet> set = MakeZoneSet(config);
+
+            winrt::com_ptr<IZone> zone1 = MakeZone({ 0, 0, 100, 100 });
+            winrt::com_ptr<IZone> zone2 = MakeZone({ 100, 0, 200, 100 });
+            set->AddZone(zone1, false /*front*/);
+            set->AddZone(zone2, false /*front*/);
+
+            Assert::IsTrue(set->ZoneFromPoint({ 50, 50 }) == zone1);
+            Assert::IsTrue(set->ZoneFromPoint({ 100, 50 }) == zone2);
+            Assert::IsTrue(set->ZoneFromPoint({ 200, 50 }) == nullptr);
+            Assert::IsTrue(set->ZoneFromPoint({ 50, 100 }) == nullptr);
+        }
+
+        TEST_METHOD(TestZoneFromPointReturnsSmallestZone)
+        {
+            ZoneSetConfig config({}, 0xFFFF, Mocks::Monitor(), L"WorkAreaIn", ZoneSetLayout::Grid, 0, 3, 4);
+            winrt::com_ptr<IZoneSet> set = MakeZoneSet(config);
+
+            // The smallest zone comes last, after a middle one smaller than the first
+            winrt::com_ptr<IZone> zone1 = MakeZone({ 0, 0, 400, 400 });
+            winrt::com_ptr<IZone> zone2 = MakeZone({ 0, 0, 200, 200 });
+            winrt::com_ptr<IZone> zone3 = MakeZone({ 0, 0, 100, 100 });
+            set->AddZone(zone1, false /*front*/);
+            set->AddZone(zone2, false /*front*/);
+            set->AddZone(zone3, false /*front*/);
+
+            Assert::IsTrue(set->ZoneFromPoint({ 50, 50 }) == zone3);
+            Assert::IsTrue(set->ZoneFromPoint({ 150, 150 }) == zone2);
+            Assert::IsTrue(set->ZoneFromPoint({ 300, 300 }) == zone1);
+        }
+
+        TEST_METHOD(TestZoneFromPointAfterZonesChange)
+        {
+            ZoneSetConfig config({}, 0xFFFF, Mocks::Monitor(), L"WorkAreaIn", ZoneSetLayout::Grid, 0, 3, 4);
+            winrt::com_ptr<IZoneSet> set = MakeZoneSet(config);
+
+            // Zones of the same size go to the first one
+            winrt::com_ptr<IZone> zone1 = MakeZone({ 0, 0, 100, 100 });
+            winrt::com_ptr<IZone> zone2 = MakeZone({ 0, 0, 100, 100 });
+            set->AddZone(zone1, false /*front*/);
+            set->AddZone(zone2, false /*front*/);
+            Assert::IsTrue(set->ZoneFromPoint({ 50, 50 }) == zone1);
+
+            set->MoveZoneToBack(zone1);
+            Assert::IsTrue(set->ZoneFromPoint({ 50, 50 }) == zone2);
+
+            set->RemoveZone(zone2);
+            Assert::IsTrue(set->ZoneFromPoint({ 50, 50 }) == zone1);
+
+            winrt::com_ptr<IZone> zone3 = MakeZone({ 25, 25, 75, 75 });
+            set->AddZone(zone3, false /*front*/);
+            Assert::IsTrue(set->ZoneFromPoint({ 50, 50 }) == zone3);
+            Assert::IsTrue(set->ZoneFromPoint({ 10, 10 }) == zone1);
+        }
     };
 
     // MoveWindowIntoZoneByDirection is complicated enough to warrant it's own test class
@@ -13,6 +13,7 @@
   On the received object, the runner will call:
     - get_name() to get the name of the PowerToy,
     - get_events() to get the list of the events the PowerToy wants to subscribe to,
+    - get_win_hook_event_filters() to get the win_hook_event events it handles,
     - enable() to initialize the PowerToy.
 
   While running, the runner might call the following methods between create_powertoy()
@@ -28,6 +29,8 @@
     - unload the DLL.
  */
 
+struct WinHookEventFilter;
+
 class PowertoyModuleIface {
 public:
   /* Returns the name of the PowerToy, this will be cached by the runner. */
@@ -65,6 +68,12 @@ public:
   virtual intptr_t signal_event(const wchar_t* name, intptr_t data) = 0;
   /* Destroy the PowerToy and free all memory. */
   virtual void destroy() = 0;
+  /* Returns a table of the win_hook_event events the PowerToy handles, see
+     win_hook_event_data.h. Only the events that match the table are signaled.
+
+     The default nullptr signals every event.
+  */
+  virtual const WinHookEventFilter* get_win_hook_event_filters() { return nullptr; }
 };
 
 /*
@@ -48,3 +48,49 @@ struct WinHookEvent {
   DWORD idEventThread;
   DWORD dwmsEventTime;
 };
+
+/*
+  By default a PowerToy is signaled every event from EVENT_MIN to EVENT_MAX.
+  To get only the events it handles, a PowerToy overrides
+  get_win_hook_event_filters() to return a table of WinHookEventFilter, ended
+  by a filter with eventMin of 0. An event is signaled to the PowerToy when it
+  matches a filter in the table: its event ID is between eventMin and eventMax,
+  both included, and its idObject equals the one of the filter, unless
+  anyObject is set.
+
+  The runner installs hooks only for the event IDs the subscribed PowerToys
+  need, and drops the events none of them wants before they are queued.
+
+  Example usage, that gets the windows being moved or resized and the windows
+  being created:
+
+  virtual const WinHookEventFilter* get_win_hook_event_filters() override {
+    static const WinHookEventFilter filters[] = {
+      { EVENT_SYSTEM_MOVESIZESTART, EVENT_SYSTEM_MOVESIZEEND, 0, true },
+      { EVENT_OBJECT_CREATE, EVENT_OBJECT_CREATE, OBJID_WINDOW, false },
+      {}
+    };
+    return filters;
+  }
+*/
+
+struct WinHookEventFilter {
+  DWORD eventMin;
+  DWORD eventMax;
+  LONG idObject;
+  bool anyObject;
+};
+
+// Returns true if a filter in the table matches the event, or if there is no table.
+inline bool win_hook_event_matches(const WinHookEventFilter* filters, DWORD event, LONG idObject) {
+  if (!filters) {
+    return true;
+  }
+  for (; filters->eventMin; ++filters) {
+    if (event >= filters->eventMin && event <= filters->eventMax &&
+        (filters->anyObject || idObject == filters->idObject)) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Lets the portable core build without the Windows SDK.  On Windows the SAL
+// annotations come from sal.h, elsewhere they expand to nothing.
+#ifdef _WIN32
+#include <sal.h>
+#else
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Inout_
+#define _Out_writes_(size)
+#endif
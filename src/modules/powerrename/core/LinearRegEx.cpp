@@ -0,0 +1,1073 @@
+#include "LinearRegEx.h"
+
+// Upper bounds that keep compiled programs small.  Patterns beyond these are handed
+// to the std engine instead.
+const size_t c_maxProgramSize = 10000;
+const int c_maxRepeatCount = 1000;
+const int c_maxNestingDepth = 256;
+
+struct CLinearRegExMatcher::Node
+{
+    enum class Type
+    {
+        Empty,
+        Char,
+        Any,
+        Class,
+        Begin,
+        End,
+        WordBoundary,
+        NotWordBoundary,
+        Group,
+        Concat,
+        Alternate,
+        Repeat
+    };
+
+    Type type = Type::Empty;
+    wchar_t ch = 0;
+    // Class index for Class nodes, capture index for Group nodes (-1 when non-capturing)
+    int index = -1;
+    int min = 0;
+    // -1 when unbounded
+    int max = 0;
+    bool greedy = true;
+    std::vector<std::unique_ptr<Node>> children;
+};
+
+struct CLinearRegExMatcher::ThreadList
+{
+    // Sizes the list for a program.  Storage left from a previous search is reused.
+    void Reset(_In_ size_t programSize, _In_ size_t slotCount)
+    {
+        pcs.clear();
+        caps.clear();
+        stack.clear();
+        marks.assign(programSize, 0);
+        generation = 1;
+        slots = slotCount;
+
+        pcs.reserve(programSize);
+        caps.reserve(programSize * slotCount);
+        // Every instruction is visited at most once per step and pushes at most two frames
+        stack.reserve(programSize * 2 + 1);
+    }
+
+    void Clear()
+    {
+        pcs.clear();
+        caps.clear();
+        generation++;
+    }
+
+    struct Frame
+    {
+        // Instruction to follow, or -1 to restore caps[slot] to value
+        int pc;
+        size_t slot;
+        size_t value;
+    };
+
+    // Program counters of the live threads in priority order and their capture slots
+    std::vector<int> pcs;
+    std::vector<size_t> caps;
+    // Instructions already visited in this step are marked with the current generation
+    std::vector<unsigned int> marks;
+    unsigned int generation = 1;
+    size_t slots = 0;
+    std::vector<Frame> stack;
+};
+
+// Working memory of _Search.  Each thread keeps its own so searching doesn't allocate
+// once the thread has run a program at least as large.
+struct CLinearRegExMatcher::SearchState
+{
+    ThreadList first;
+    ThreadList second;
+    std::vector<size_t> caps;
+    std::vector<size_t> matchCaps;
+};
+
+// Recursive descent parser for the supported ECMAScript subset.  Anything outside of
+// it (or anything std::regex would reject) marks the parse as failed.
+class CLinearRegExMatcher::Parser
+{
+public:
+    Parser(_In_ const wchar_t* pattern, _Inout_ std::vector<CharClass>& classes) :
+        m_pattern(pattern),
+        m_classes(classes)
+    {
+    }
+
+    std::unique_ptr<Node> Parse()
+    {
+        std::unique_ptr<Node> root = _ParseDisjunction();
+        if (m_failed || m_pos != m_pattern.size())
+        {
+            root.reset();
+        }
+        return root;
+    }
+
+    size_t GetGroupCount() const { return m_groupCount; }
+
+private:
+    bool _AtEnd() const { return m_pos >= m_pattern.size(); }
+    wchar_t _Peek() const { return _AtEnd() ? L'\0' : m_pattern[m_pos]; }
+
+    std::unique_ptr<Node> _Fail()
+    {
+        m_failed = true;
+        return nullptr;
+    }
+
+    static std::unique_ptr<Node> _MakeNode(_In_ Node::Type type)
+    {
+        auto node = std::make_unique<Node>();
+        node->type = type;
+        return node;
+    }
+
+    std::unique_ptr<Node> _ParseDisjunction()
+    {
+        if (++m_depth > c_maxNestingDepth)
+        {
+            return _Fail();
+        }
+
+        auto alternate = _MakeNode(Node::Type::Alternate);
+        alternate->children.push_back(_ParseAlternative());
+        while (!m_failed && _Peek() == L'|')
+        {
+            m_pos++;
+            alternate->children.push_back(_ParseAlternative());
+        }
+
+        m_depth--;
+        if (m_failed)
+        {
+            return nullptr;
+        }
+
+        if (alternate->children.size() == 1)
+        {
+            return std::move(alternate->children[0]);
+        }
+        return alternate;
+    }
+
+    std::unique_ptr<Node> _ParseAlternative()
+    {
+        auto concat = _MakeNode(Node::Type::Concat);
+        while (!m_failed && !_AtEnd() && _Peek() != L'|' && _Peek() != L')')
+        {
+            auto term = _ParseTerm();
+            if (term)
+            {
+                concat->children.push_back(std::move(term));
+            }
+        }
+        return concat;
+    }
+
+    std::unique_ptr<Node> _ParseTerm()
+    {
+        std::unique_ptr<Node> atom;
+        bool quantifiable = true;
+        wchar_t ch = m_pattern[m_pos++];
+        switch (ch)
+        {
+        case L'^':
+            atom = _MakeNode(Node::Type::Begin);
+            quantifiable = false;
+            break;
+
+        case L'$':
+            atom = _MakeNode(Node::Type::End);
+            quantifiable = false;
+            break;
+
+        case L'.':
+            atom = _MakeNode(Node::Type::Any);
+            break;
+
+        case L'(':
+        {
+            atom = _MakeNode(Node::Type::Group);
+            if (_Peek() == L'?')
+            {
+                // Only non-capturing groups.  Lookahead needs backtracking.
+                if (m_pos + 1 >= m_pattern.size() || m_pattern[m_pos + 1] != L':')
+                {
+                    return _Fail();
+                }
+                m_pos += 2;
+            }
+            else
+            {
+                atom->index = static_cast<int>(++m_groupCount);
+            }
+
+            auto child = _ParseDisjunction();
+            if (m_failed || _Peek() != L')')
+            {
+                return _Fail();
+            }
+            m_pos++;
+            atom->children.push_back(std::move(child));
+            break;
+        }
+
+        case L'[':
+            atom = _ParseClass();
+            break;
+
+        case L'\\':
+            atom = _ParseAtomEscape(quantifiable);
+            break;
+
+        // Quantifiers without an atom and lone brackets are errors (or implementation
+        // specific extensions) in std::regex.  Let it decide.
+        case L'*':
+        case L'+':
+        case L'?':
+        case L'{':
+        case L'}':
+        case L']':
+            return _Fail();
+
+        default:
+            atom = _MakeNode(Node::Type::Char);
+            atom->ch = ch;
+            break;
+        }
+
+        if (m_failed)
+        {
+            return nullptr;
+        }
+
+        int min = 0;
+        int max = 0;
+        bool greedy = true;
+        if (_ParseQuantifier(min, max, greedy))
+        {
+            if (!quantifiable)
+            {
+                return _Fail();
+            }
+
+            auto repeat = _MakeNode(Node::Type::Repeat);
+            repeat->min = min;
+            repeat->max = max;
+            repeat->greedy = greedy;
+            repeat->children.push_back(std::move(atom));
+            atom = std::move(repeat);
+
+            // A quantifier can't be quantified
+            wchar_t next = _Peek();
+            if (next == L'*' || next == L'+' || next == L'?' || next == L'{')
+            {
+                return _Fail();
+            }
+        }
+
+        return m_failed ? nullptr : std::move(atom);
+    }
+
+    bool _ParseQuantifier(_Out_ int& min, _Out_ int& max, _Out_ bool& greedy)
+    {
+        min = 0;
+        max = 0;
+        greedy = true;
+        switch (_Peek())
+        {
+        case L'*':
+            max = -1;
+            m_pos++;
+            break;
+
+        case L'+':
+            min = 1;
+            max = -1;
+            m_pos++;
+            break;
+
+        case L'?':
+            max = 1;
+            m_pos++;
+            break;
+
+        case L'{':
+        {
+            m_pos++;
+            if (!_ParseDecimal(min))
+            {
+                m_failed = true;
+                return false;
+            }
+
+            max = min;
+            if (_Peek() == L',')
+            {
+                m_pos++;
+                max = -1;
+                if (_Peek() != L'}' && !_ParseDecimal(max))
+                {
+                    m_failed = true;
+                    return false;
+                }
+            }
+
+            if (_Peek() != L'}' || (max != -1 && max < min))
+            {
+                m_failed = true;
+                return false;
+            }
+            m_pos++;
+            break;
+        }
+
+        default:
+            return false;
+        }
+
+        if (_Peek() == L'?')
+        {
+            greedy = false;
+            m_pos++;
+        }
+        return true;
+    }
+
+    bool _ParseDecimal(_Out_ int& value)
+    {
+        value = 0;
+        size_t start = m_pos;
+        while (!_AtEnd() && _Peek() >= L'0' && _Peek() <= L'9')
+        {
+            value = value * 10 + (_Peek() - L'0');
+            if (value > c_maxRepeatCount)
+            {
+                return false;
+            }
+            m_pos++;
+        }
+        return m_pos > start;
+    }
+
+    bool _ParseHex(_In_ size_t digits, _Out_ wchar_t& ch)
+    {
+        unsigned int value = 0;
+        for (size_t i = 0; i < digits; i++)
+        {
+            wchar_t digit = _Peek();
+            if (digit >= L'0' && digit <= L'9')
+            {
+                value = value * 16 + (digit - L'0');
+            }
+            else if (digit >= L'a' && digit <= L'f')
+            {
+                value = value * 16 + (digit - L'a' + 10);
+            }
+            else if (digit >= L'A' && digit <= L'F')
+            {
+                value = value * 16 + (digit - L'A' + 10);
+            }
+            else
+            {
+                return false;
+            }
+            m_pos++;
+        }
+        ch = static_cast<wchar_t>(value);
+        return true;
+    }
+
+    // Parses the character escapes shared by atoms and classes.  Returns false for
+    // anything that is not a single character.
+    bool _ParseCharacterEscape(_In_ wchar_t escape, _Out_ wchar_t& ch)
+    {
+        ch = 0;
+        switch (escape)
+        {
+        case L't':
+            ch = L'\t';
+            return true;
+        case L'n':
+            ch = L'\n';
+            return true;
+        case L'v':
+            ch = L'\v';
+            return true;
+        case L'f':
+            ch = L'\f';
+            return true;
+        case L'r':
+            ch = L'\r';
+            return true;
+        case L'0':
+            // \0 followed by a digit is an octal escape in some implementations
+            return !(_Peek() >= L'0' && _Peek() <= L'9');
+        case L'c':
+        {
+            wchar_t letter = _Peek();
+            if ((letter >= L'a' && letter <= L'z') || (letter >= L'A' && letter <= L'Z'))
+            {
+                m_pos++;
+                ch = static_cast<wchar_t>(letter % 32);
+                return true;
+            }
+            return false;
+        }
+        case L'x':
+            return _ParseHex(2, ch);
+        case L'u':
+            return _ParseHex(4, ch);
+        default:
+            // Identity escapes of syntax characters only.  Escaped letters and digits
+            // mean different things across std::regex implementations.
+            if (!iswalnum(escape) && escape != L'_')
+            {
+                ch = escape;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    // Marks a shorthand class escape (\d, \w, \s and their negations) on charClass.
+    static bool _ApplyClassEscape(_In_ wchar_t escape, _Inout_ CharClass& charClass)
+    {
+        switch (escape)
+        {
+        case L'd':
+            charClass.digit = true;
+            return true;
+        case L'D':
+            charClass.notDigit = true;
+            return true;
+        case L'w':
+            charClass.word = true;
+            return true;
+        case L'W':
+            charClass.notWord = true;
+            return true;
+        case L's':
+            charClass.space = true;
+            return true;
+        case L'S':
+            charClass.notSpace = true;
+            return true;
+        }
+        return false;
+    }
+
+    std::unique_ptr<Node> _ParseAtomEscape(_Out_ bool& quantifiable)
+    {
+        quantifiable = true;
+        if (_AtEnd())
+        {
+            return _Fail();
+        }
+
+        wchar_t escape = m_pattern[m_pos++];
+        if (escape == L'b' || escape == L'B')
+        {
+            quantifiable = false;
+            return _MakeNode(escape == L'b' ? Node::Type::WordBoundary : Node::Type::NotWordBoundary);
+        }
+
+        CharClass charClass;
+        if (_ApplyClassEscape(escape, charClass))
+        {
+            auto node = _MakeNode(Node::Type::Class);
+            node->index = static_cast<int>(m_classes.size());
+            m_classes.push_back(charClass);
+            return node;
+        }
+
+        // Backreferences (\1..\9) and unknown escapes end up here
+        wchar_t ch = 0;
+        if (!_ParseCharacterEscape(escape, ch))
+        {
+            return _Fail();
+        }
+
+        auto node = _MakeNode(Node::Type::Char);
+        node->ch = ch;
+        return node;
+    }
+
+    // Parses one class member.  Returns false on error, otherwise either sets ch or
+    // marks a shorthand class on charClass (isClassEscape).
+    bool _ParseClassAtom(_Inout_ CharClass& charClass, _Out_ wchar_t& ch, _Out_ bool& isClassEscape)
+    {
+        ch = 0;
+        isClassEscape = false;
+        if (_AtEnd())
+        {
+            return false;
+        }
+
+        wchar_t current = m_pattern[m_pos++];
+        if (current == L'[')
+        {
+            // POSIX bracket expressions ([:alpha:], [=a=], [.a.]) are std::regex extensions
+            wchar_t next = _Peek();
+            if (next == L':' || next == L'=' || next == L'.')
+            {
+                return false;
+            }
+        }
+
+        if (current != L'\\')
+        {
+            ch = current;
+            return true;
+        }
+
+        if (_AtEnd())
+        {
+            return false;
+        }
+
+        wchar_t escape = m_pattern[m_pos++];
+        if (escape == L'b')
+        {
+            ch = L'\b';
+            return true;
+        }
+
+        if (_ApplyClassEscape(escape, charClass))
+        {
+            isClassEscape = true;
+            return true;
+        }
+
+        return _ParseCharacterEscape(escape, ch);
+    }
+
+    std::unique_ptr<Node> _ParseClass()
+    {
+        CharClass charClass;
+        if (_Peek() == L'^')
+        {
+            charClass.negated = true;
+            m_pos++;
+        }
+
+        // Empty classes ([] and [^]) are handled differently across implementations
+        if (_Peek() == L']')
+        {
+            return _Fail();
+        }
+
+        while (!_AtEnd() && _Peek() != L']')
+        {
+            wchar_t low = 0;
+            bool lowIsClass = false;
+            if (!_ParseClassAtom(charClass, low, lowIsClass))
+            {
+                return _Fail();
+            }
+
+            if (_Peek() == L'-' && m_pos + 1 < m_pattern.size() && m_pattern[m_pos + 1] != L']')
+            {
+                m_pos++;
+                wchar_t high = 0;
+                bool highIsClass = false;
+                if (!_ParseClassAtom(charClass, high, highIsClass) || lowIsClass || highIsClass || high < low)
+                {
+                    return _Fail();
+                }
+                charClass.ranges.push_back({ low, high });
+            }
+            else if (!lowIsClass)
+            {
+                charClass.ranges.push_back({ low, low });
+            }
+        }
+
+        if (_AtEnd())
+        {
+            return _Fail();
+        }
+        m_pos++;
+
+        auto node = _MakeNode(Node::Type::Class);
+        node->index = static_cast<int>(m_classes.size());
+        m_classes.push_back(charClass);
+        return node;
+    }
+
+    std::wstring m_pattern;
+    std::vector<CharClass>& m_classes;
+    size_t m_pos = 0;
+    size_t m_groupCount = 0;
+    int m_depth = 0;
+    bool m_failed = false;
+};
+
+CLinearRegExMatcher::CLinearRegExMatcher(_In_ bool caseInsensitive) :
+    m_caseInsensitive(caseInsensitive),
+    m_ctype(&std::use_facet<std::ctype<wchar_t>>(m_locale))
+{
+}
+
+std::unique_ptr<CLinearRegExMatcher> CLinearRegExMatcher::s_Compile(_In_ const wchar_t* pattern, _In_ bool caseInsensitive)
+{
+    std::unique_ptr<CLinearRegExMatcher> matcher(new CLinearRegExMatcher(caseInsensitive));
+
+    Parser parser(pattern, matcher->m_classes);
+    std::unique_ptr<Node> root = parser.Parse();
+    if (!root)
+    {
+        return nullptr;
+    }
+
+    matcher->m_groupCount = parser.GetGroupCount();
+
+    // Slot 0 and 1 hold the bounds of the whole match
+    matcher->_Append(Op::Save, 0, 0);
+    if (!matcher->_Emit(root.get()))
+    {
+        return nullptr;
+    }
+    matcher->_Append(Op::Save, 0, 1);
+    matcher->_Append(Op::Match);
+
+    // Patterns that start with a literal (possibly inside groups) let the search skip
+    // ahead to candidates instead of starting a thread at every position.
+    size_t first = 0;
+    while (matcher->m_program[first].op == Op::Save)
+    {
+        first++;
+    }
+    if (matcher->m_program[first].op == Op::Char)
+    {
+        matcher->m_firstChar = matcher->m_program[first].ch;
+    }
+
+    return matcher;
+}
+
+int CLinearRegExMatcher::_Append(_In_ Op op, _In_ wchar_t ch, _In_ int x, _In_ int y)
+{
+    m_program.push_back({ op, ch, x, y });
+    return static_cast<int>(m_program.size() - 1);
+}
+
+bool CLinearRegExMatcher::_Emit(_In_ const Node* node)
+{
+    if (m_program.size() > c_maxProgramSize)
+    {
+        return false;
+    }
+
+    switch (node->type)
+    {
+    case Node::Type::Empty:
+        break;
+
+    case Node::Type::Char:
+        _Append(Op::Char, m_caseInsensitive ? _Fold(node->ch) : node->ch);
+        break;
+
+    case Node::Type::Any:
+        _Append(Op::Any);
+        break;
+
+    case Node::Type::Class:
+        _Append(Op::Class, 0, node->index);
+        break;
+
+    case Node::Type::Begin:
+        _Append(Op::AssertBegin);
+        break;
+
+    case Node::Type::End:
+        _Append(Op::AssertEnd);
+        break;
+
+    case Node::Type::WordBoundary:
+        _Append(Op::WordBoundary);
+        break;
+
+    case Node::Type::NotWordBoundary:
+        _Append(Op::NotWordBoundary);
+        break;
+
+    case Node::Type::Group:
+        if (node->index >= 0)
+        {
+            _Append(Op::Save, 0, node->index * 2);
+        }
+        if (!_Emit(node->children[0].get()))
+        {
+            return false;
+        }
+        if (node->index >= 0)
+        {
+            _Append(Op::Save, 0, node->index * 2 + 1);
+        }
+        break;
+
+    case Node::Type::Concat:
+        for (const auto& child : node->children)
+        {
+            if (!_Emit(child.get()))
+            {
+                return false;
+            }
+        }
+        break;
+
+    case Node::Type::Alternate:
+    {
+        // Split(this, next) chain.  Earlier alternatives get priority.
+        std::vector<int> jumps;
+        for (size_t i = 0; i < node->children.size(); i++)
+        {
+            int split = -1;
+            if (i + 1 < node->children.size())
+            {
+                split = _Append(Op::Split);
+                m_program[split].x = split + 1;
+            }
+
+            if (!_Emit(node->children[i].get()))
+            {
+                return false;
+            }
+
+            if (split != -1)
+            {
+                jumps.push_back(_Append(Op::Jmp));
+                m_program[split].y = static_cast<int>(m_program.size());
+            }
+        }
+
+        for (int jump : jumps)
+        {
+            m_program[jump].x = static_cast<int>(m_program.size());
+        }
+        break;
+    }
+
+    case Node::Type::Repeat:
+    {
+        const Node* body = node->children[0].get();
+        for (int i = 0; i < node->min; i++)
+        {
+            if (!_Emit(body))
+            {
+                return false;
+            }
+        }
+
+        if (node->max == -1)
+        {
+            int split = _Append(Op::Split);
+            if (!_Emit(body))
+            {
+                return false;
+            }
+            _Append(Op::Jmp, 0, split);
+            int exit = static_cast<int>(m_program.size());
+            m_program[split].x = node->greedy ? split + 1 : exit;
+            m_program[split].y = node->greedy ? exit : split + 1;
+        }
+        else
+        {
+            std::vector<int> splits;
+            for (int i = node->min; i < node->max; i++)
+            {
+                splits.push_back(_Append(Op::Split));
+                if (!_Emit(body))
+                {
+                    return false;
+                }
+            }
+
+            int exit = static_cast<int>(m_program.size());
+            for (int split : splits)
+            {
+                m_program[split].x = node->greedy ? split + 1 : exit;
+                m_program[split].y = node->greedy ? exit : split + 1;
+            }
+        }
+        break;
+    }
+    }
+
+    return m_program.size() <= c_maxProgramSize;
+}
+
+wchar_t CLinearRegExMatcher::_Fold(_In_ wchar_t ch) const
+{
+    return m_ctype->tolower(ch);
+}
+
+bool CLinearRegExMatcher::_IsWordChar(_In_ wchar_t ch) const
+{
+    return ch == L'_' || m_ctype->is(std::ctype_base::alnum, ch);
+}
+
+bool CLinearRegExMatcher::_IsWordBoundary(_In_ std::wstring_view source, _In_ size_t pos) const
+{
+    bool before = pos > 0 && _IsWordChar(source[pos - 1]);
+    bool after = pos < source.size() && _IsWordChar(source[pos]);
+    return before != after;
+}
+
+bool CLinearRegExMatcher::_InClass(_In_ const CharClass& charClass, _In_ wchar_t ch) const
+{
+    for (const auto& range : charClass.ranges)
+    {
+        if (ch >= range.first && ch <= range.second)
+        {
+            return true;
+        }
+    }
+
+    return (charClass.digit && m_ctype->is(std::ctype_base::digit, ch)) ||
+           (charClass.notDigit && !m_ctype->is(std::ctype_base::digit, ch)) ||
+           (charClass.word && _IsWordChar(ch)) ||
+           (charClass.notWord && !_IsWordChar(ch)) ||
+           (charClass.space && m_ctype->is(std::ctype_base::space, ch)) ||
+           (charClass.notSpace && !m_ctype->is(std::ctype_base::space, ch));
+}
+
+bool CLinearRegExMatcher::_MatchClass(_In_ const CharClass& charClass, _In_ wchar_t ch) const
+{
+    bool inClass = _InClass(charClass, ch);
+    if (!inClass && m_caseInsensitive)
+    {
+        inClass = _InClass(charClass, m_ctype->tolower(ch)) || _InClass(charClass, m_ctype->toupper(ch));
+    }
+    return inClass != charClass.negated;
+}
+
+bool CLinearRegExMatcher::_MatchChar(_In_ const Instruction& instruction, _In_ wchar_t ch) const
+{
+    switch (instruction.op)
+    {
+    case Op::Char:
+        return ch == instruction.ch || (m_caseInsensitive && _Fold(ch) == instruction.ch);
+
+    case Op::Any:
+        // Everything but ECMAScript line terminators
+        return ch != L'\n' && ch != L'\r' && ch != 0x2028 && ch != 0x2029;
+
+    case Op::Class:
+        return _MatchClass(m_classes[instruction.x], ch);
+
+    default:
+        return false;
+    }
+}
+
+// Follows every empty transition from pc and queues the character consuming (or
+// Match) instructions it reaches onto list, in priority order.
+void CLinearRegExMatcher::_AddThread(_In_ std::wstring_view source, _In_ size_t pos, _In_ int pc, _Inout_ std::vector<size_t>& caps,
+    _Inout_ ThreadList& list) const
+{
+    list.stack.push_back({ pc, 0, 0 });
+    while (!list.stack.empty())
+    {
+        ThreadList::Frame frame = list.stack.back();
+        list.stack.pop_back();
+
+        if (frame.pc < 0)
+        {
+            caps[frame.slot] = frame.value;
+            continue;
+        }
+
+        if (list.marks[frame.pc] == list.generation)
+        {
+            continue;
+        }
+        list.marks[frame.pc] = list.generation;
+
+        const Instruction& instruction = m_program[frame.pc];
+        switch (instruction.op)
+        {
+        case Op::Jmp:
+            list.stack.push_back({ instruction.x, 0, 0 });
+            break;
+
+        case Op::Split:
+            // Pushed in reverse so the preferred branch is followed first
+            list.stack.push_back({ instruction.y, 0, 0 });
+            list.stack.push_back({ instruction.x, 0, 0 });
+            break;
+
+        case Op::Save:
+            list.stack.push_back({ -1, static_cast<size_t>(instruction.x), caps[instruction.x] });
+            caps[instruction.x] = pos;
+            list.stack.push_back({ frame.pc + 1, 0, 0 });
+            break;
+
+        case Op::AssertBegin:
+            if (pos == 0)
+            {
+                list.stack.push_back({ frame.pc + 1, 0, 0 });
+            }
+            break;
+
+        case Op::AssertEnd:
+            if (pos == source.size())
+            {
+                list.stack.push_back({ frame.pc + 1, 0, 0 });
+            }
+            break;
+
+        case Op::WordBoundary:
+        case Op::NotWordBoundary:
+            if (_IsWordBoundary(source, pos) == (instruction.op == Op::WordBoundary))
+            {
+                list.stack.push_back({ frame.pc + 1, 0, 0 });
+            }
+            break;
+
+        default:
+            list.pcs.push_back(frame.pc);
+            list.caps.insert(list.caps.end(), caps.begin(), caps.end());
+            break;
+        }
+    }
+}
+
+bool CLinearRegExMatcher::_Search(_In_ std::wstring_view source, _In_ size_t start, _In_ size_t noEmptyMatchAt, _Out_ MatchCaptures& captures) const
+{
+    captures.clear();
+
+    const size_t slots = (m_groupCount + 1) * 2;
+    thread_local SearchState state;
+    state.first.Reset(m_program.size(), slots);
+    state.second.Reset(m_program.size(), slots);
+    ThreadList* current = &state.first;
+    ThreadList* next = &state.second;
+
+    std::vector<size_t>& caps = state.caps;
+    std::vector<size_t>& matchCaps = state.matchCaps;
+    caps.assign(slots, std::wstring::npos);
+    bool matched = false;
+
+    for (size_t pos = start; pos <= source.size(); pos++)
+    {
+        // Start a new attempt at every position until something matches.  It has the
+        // lowest priority so earlier starting threads win.
+        if (!matched)
+        {
+            if (m_firstChar != L'\0' && current->pcs.empty())
+            {
+                const Instruction firstChar = { Op::Char, m_firstChar, 0, 0 };
+                while (pos < source.size() && !_MatchChar(firstChar, source[pos]))
+                {
+                    pos++;
+                }
+
+                if (pos == source.size())
+                {
+                    break;
+                }
+            }
+
+            std::fill(caps.begin(), caps.end(), std::wstring::npos);
+            _AddThread(source, pos, 0, caps, *current);
+        }
+
+        if (current->pcs.empty())
+        {
+            if (matched)
+            {
+                break;
+            }
+            current->Clear();
+            continue;
+        }
+
+        next->Clear();
+        for (size_t i = 0; i < current->pcs.size(); i++)
+        {
+            const Instruction& instruction = m_program[current->pcs[i]];
+            const size_t* threadCaps = &current->caps[i * slots];
+            if (instruction.op == Op::Match)
+            {
+                if (threadCaps[0] == pos && pos == noEmptyMatchAt)
+                {
+                    continue;
+                }
+
+                // Lower priority threads can no longer win
+                matchCaps.assign(threadCaps, threadCaps + slots);
+                matched = true;
+                break;
+            }
+
+            if (pos < source.size() && _MatchChar(instruction, source[pos]))
+            {
+                caps.assign(threadCaps, threadCaps + slots);
+                _AddThread(source, pos + 1, current->pcs[i] + 1, caps, *next);
+            }
+        }
+
+        std::swap(current, next);
+    }
+
+    if (matched)
+    {
+        captures.resize(m_groupCount + 1);
+        for (size_t group = 0; group <= m_groupCount; group++)
+        {
+            size_t groupStart = matchCaps[group * 2];
+            size_t groupEnd = matchCaps[group * 2 + 1];
+            if (groupStart == std::wstring::npos || groupEnd == std::wstring::npos)
+            {
+                captures[group] = { std::wstring::npos, std::wstring::npos };
+            }
+            else
+            {
+                captures[group] = { groupStart, groupEnd };
+            }
+        }
+    }
+
+    return matched;
+}
+
+bool CLinearRegExMatcher::Search(_In_ std::wstring_view source, _In_ size_t start, _Out_ MatchCaptures& captures) const
+{
+    return _Search(source, start, std::wstring::npos, captures);
+}
+
+void CLinearRegExMatcher::FindAll(_In_ std::wstring_view source, _Out_ std::vector<PowerRenameMatch>& matches) const
+{
+    size_t matchCount = 0;
+    size_t pos = 0;
+    // Like std::regex_iterator, after an empty match the next match may start at the
+    // same position only if it isn't empty.  After a non-empty match an empty one
+    // where it ended is a new occurrence.
+    size_t noEmptyMatchAt = std::wstring::npos;
+    while (pos <= source.size())
+    {
+        PowerRenameMatch& match = s_NextMatch(matches, matchCount);
+        if (!_Search(source, pos, noEmptyMatchAt, match.captures))
+        {
+            matchCount--;
+            break;
+        }
+
+        const size_t matchStart = match.captures[0].first;
+        const size_t matchEnd = match.captures[0].second;
+        match.searchStart = pos;
+
+        pos = matchEnd;
+        noEmptyMatchAt = matchEnd == matchStart ? matchEnd : std::wstring::npos;
+    }
+
+    matches.resize(matchCount);
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameMatcher.h"
+#include <locale>
+
+// Thompson NFA (Pike VM) implementation of the ECMAScript subset used for renaming.
+// Every search runs in O(pattern * input) time so patterns with nested quantifiers
+// such as (a+)+b cannot stall the regex worker thread.  Threads are kept in priority
+// order so the leftmost match and its capture groups are the ones a backtracking
+// engine would report.
+//
+// Backreferences, lookahead and POSIX bracket expressions are not supported.
+// s_Compile returns nullptr for those so the caller can fall back to std::wregex.
+class CLinearRegExMatcher : public CPowerRenameMatcher
+{
+public:
+    static std::unique_ptr<CLinearRegExMatcher> s_Compile(_In_ const wchar_t* pattern, _In_ bool caseInsensitive);
+
+    bool Search(_In_ std::wstring_view source, _In_ size_t start, _Out_ MatchCaptures& captures) const override;
+    void FindAll(_In_ std::wstring_view source, _Out_ std::vector<PowerRenameMatch>& matches) const override;
+
+    size_t GetGroupCount() const { return m_groupCount; }
+
+private:
+    enum class Op
+    {
+        Char,
+        Any,
+        Class,
+        Split,
+        Jmp,
+        Save,
+        AssertBegin,
+        AssertEnd,
+        WordBoundary,
+        NotWordBoundary,
+        Match
+    };
+
+    struct Instruction
+    {
+        Op op;
+        wchar_t ch;
+        // Jump target (Jmp, Split), class index (Class) or capture slot (Save)
+        int x;
+        // Lower priority jump target (Split)
+        int y;
+    };
+
+    struct CharClass
+    {
+        bool negated = false;
+        bool digit = false;
+        bool notDigit = false;
+        bool word = false;
+        bool notWord = false;
+        bool space = false;
+        bool notSpace = false;
+        std::vector<std::pair<wchar_t, wchar_t>> ranges;
+    };
+
+    struct Node;
+    struct ThreadList;
+    struct SearchState;
+    class Parser;
+
+    CLinearRegExMatcher(_In_ bool caseInsensitive);
+
+    bool _Emit(_In_ const Node* node);
+    int _Append(_In_ Op op, _In_ wchar_t ch = 0, _In_ int x = 0, _In_ int y = 0);
+
+    void _AddThread(_In_ std::wstring_view source, _In_ size_t pos, _In_ int pc, _Inout_ std::vector<size_t>& caps,
+        _Inout_ ThreadList& list) const;
+    bool _IsWordBoundary(_In_ std::wstring_view source, _In_ size_t pos) const;
+    bool _MatchChar(_In_ const Instruction& instruction, _In_ wchar_t ch) const;
+    bool _MatchClass(_In_ const CharClass& charClass, _In_ wchar_t ch) const;
+    bool _InClass(_In_ const CharClass& charClass, _In_ wchar_t ch) const;
+    bool _IsWordChar(_In_ wchar_t ch) const;
+    wchar_t _Fold(_In_ wchar_t ch) const;
+
+    bool _Search(_In_ std::wstring_view source, _In_ size_t start, _In_ size_t noEmptyMatchAt, _Out_ MatchCaptures& captures) const;
+
+    bool m_caseInsensitive = false;
+    size_t m_groupCount = 0;
+    // Literal every match starts with, or L'\0' when the pattern doesn't start with one
+    wchar_t m_firstChar = L'\0';
+    std::vector<Instruction> m_program;
+    std::vector<CharClass> m_classes;
+
+    // Same character classification and case folding as std::regex_traits<wchar_t>
+    std::locale m_locale;
+    const std::ctype<wchar_t>* m_ctype = nullptr;
+};
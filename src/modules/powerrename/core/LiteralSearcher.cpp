@@ -0,0 +1,284 @@
+#include "LiteralSearcher.h"
+#include <cwctype>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <immintrin.h>
+#define LITERAL_SEARCH_X86
+#endif
+
+CLiteralSearcher::CLiteralSearcher(_In_ const wchar_t* needle, _In_ bool caseInsensitive) :
+    m_needle(needle),
+    m_caseInsensitive(caseInsensitive),
+    m_kernel(s_GetBestKernel())
+{
+    if (m_caseInsensitive)
+    {
+        for (auto& ch : m_needle)
+        {
+            ch = _Fold(ch);
+        }
+    }
+}
+
+bool CLiteralSearcher::s_IsKernelSupported(_In_ LiteralSearchKernel kernel)
+{
+#ifdef LITERAL_SEARCH_X86
+    // Checked once.  AVX2 also needs the OS to save the YMM registers.
+    static const bool avx2Supported = []() {
+        int info[4] = { 0 };
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+
+        __cpuid(info, 1);
+        const int osxsave = 1 << 27;
+        const int avx = 1 << 28;
+        if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 0x6) != 0x6)
+        {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        const int avx2 = 1 << 5;
+        return (info[1] & avx2) != 0;
+    }();
+
+    switch (kernel)
+    {
+    case LiteralSearchKernel::Avx2:
+        return avx2Supported;
+    default:
+        // SSE2 is part of every processor Windows supports
+        return true;
+    }
+#else
+    return kernel == LiteralSearchKernel::Scalar;
+#endif
+}
+
+LiteralSearchKernel CLiteralSearcher::s_GetBestKernel()
+{
+    if (s_IsKernelSupported(LiteralSearchKernel::Avx2))
+    {
+        return LiteralSearchKernel::Avx2;
+    }
+    if (s_IsKernelSupported(LiteralSearchKernel::Sse2))
+    {
+        return LiteralSearchKernel::Sse2;
+    }
+    return LiteralSearchKernel::Scalar;
+}
+
+size_t CLiteralSearcher::Find(_In_ std::wstring_view haystack, _In_ size_t start) const
+{
+    return Find(haystack, start, m_kernel);
+}
+
+size_t CLiteralSearcher::Find(_In_ std::wstring_view haystack, _In_ size_t start, _In_ LiteralSearchKernel kernel) const
+{
+    if (m_needle.empty() || start > haystack.size() || haystack.size() - start < m_needle.size())
+    {
+        return std::wstring::npos;
+    }
+
+    if (!s_IsKernelSupported(kernel))
+    {
+        kernel = LiteralSearchKernel::Scalar;
+    }
+
+    switch (kernel)
+    {
+    case LiteralSearchKernel::Avx2:
+        return _FindAvx2(haystack, start);
+    case LiteralSearchKernel::Sse2:
+        return _FindSse2(haystack, start);
+    default:
+        return _FindScalar(haystack, start);
+    }
+}
+
+// Same folding as towlower with ASCII handled inline
+wchar_t CLiteralSearcher::_Fold(_In_ wchar_t ch) const
+{
+    if (ch < 0x80)
+    {
+        return (ch >= L'A' && ch <= L'Z') ? static_cast<wchar_t>(ch | 0x20) : ch;
+    }
+    return static_cast<wchar_t>(::towlower(ch));
+}
+
+bool CLiteralSearcher::_MatchesAt(_In_ std::wstring_view haystack, _In_ size_t pos) const
+{
+    if (!m_caseInsensitive)
+    {
+        return haystack.compare(pos, m_needle.size(), m_needle) == 0;
+    }
+
+    for (size_t i = 0; i < m_needle.size(); i++)
+    {
+        if (_Fold(haystack[pos + i]) != m_needle[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t CLiteralSearcher::_FindScalar(_In_ std::wstring_view haystack, _In_ size_t start) const
+{
+    if (!m_caseInsensitive)
+    {
+        return haystack.find(m_needle, start);
+    }
+
+    const wchar_t first = m_needle[0];
+    for (size_t pos = start; pos + m_needle.size() <= haystack.size(); pos++)
+    {
+        if (_Fold(haystack[pos]) == first && _MatchesAt(haystack, pos))
+        {
+            return pos;
+        }
+    }
+    return std::wstring::npos;
+}
+
+#ifdef LITERAL_SEARCH_X86
+
+// The kernels compare UTF-16 code units, one per 16 bit lane
+static_assert(sizeof(wchar_t) == sizeof(short), "wchar_t must be a UTF-16 code unit");
+
+size_t CLiteralSearcher::_FindSse2(_In_ std::wstring_view haystack, _In_ size_t start) const
+{
+    const size_t blockSize = sizeof(__m128i) / sizeof(wchar_t);
+    const size_t lastOffset = m_needle.size() - 1;
+    const wchar_t* data = haystack.data();
+
+    const __m128i first = _mm_set1_epi16(static_cast<short>(m_needle[0]));
+    const __m128i last = _mm_set1_epi16(static_cast<short>(m_needle[lastOffset]));
+    const __m128i nonAsciiBits = _mm_set1_epi16(static_cast<short>(0xff80));
+    const __m128i beforeUpper = _mm_set1_epi16(L'A' - 1);
+    const __m128i afterUpper = _mm_set1_epi16(L'Z' + 1);
+    const __m128i caseBit = _mm_set1_epi16(0x20);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t pos = start;
+    for (; pos + lastOffset + blockSize <= haystack.size(); pos += blockSize)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + lastOffset));
+
+        if (m_caseInsensitive)
+        {
+            __m128i nonAscii = _mm_and_si128(_mm_or_si128(blockFirst, blockLast), nonAsciiBits);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonAscii, zero)) != 0xffff)
+            {
+                for (size_t i = 0; i < blockSize; i++)
+                {
+                    if (_MatchesAt(haystack, pos + i))
+                    {
+                        return pos + i;
+                    }
+                }
+                continue;
+            }
+
+            // Every lane is ASCII so the signed compares are safe
+            __m128i upperFirst = _mm_and_si128(_mm_cmpgt_epi16(blockFirst, beforeUpper), _mm_cmplt_epi16(blockFirst, afterUpper));
+            __m128i upperLast = _mm_and_si128(_mm_cmpgt_epi16(blockLast, beforeUpper), _mm_cmplt_epi16(blockLast, afterUpper));
+            blockFirst = _mm_or_si128(blockFirst, _mm_and_si128(upperFirst, caseBit));
+            blockLast = _mm_or_si128(blockLast, _mm_and_si128(upperLast, caseBit));
+        }
+
+        // Two mask bits per position
+        unsigned long candidates = static_cast<unsigned long>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi16(blockFirst, first), _mm_cmpeq_epi16(blockLast, last))));
+        unsigned long bit = 0;
+        while (_BitScanForward(&bit, candidates))
+        {
+            if (_MatchesAt(haystack, pos + bit / 2))
+            {
+                return pos + bit / 2;
+            }
+            candidates &= ~(3ul << bit);
+        }
+    }
+
+    return _FindScalar(haystack, pos);
+}
+
+size_t CLiteralSearcher::_FindAvx2(_In_ std::wstring_view haystack, _In_ size_t start) const
+{
+    const size_t blockSize = sizeof(__m256i) / sizeof(wchar_t);
+    const size_t lastOffset = m_needle.size() - 1;
+    const wchar_t* data = haystack.data();
+
+    const __m256i first = _mm256_set1_epi16(static_cast<short>(m_needle[0]));
+    const __m256i last = _mm256_set1_epi16(static_cast<short>(m_needle[lastOffset]));
+    const __m256i nonAsciiBits = _mm256_set1_epi16(static_cast<short>(0xff80));
+    const __m256i beforeUpper = _mm256_set1_epi16(L'A' - 1);
+    const __m256i lastUpper = _mm256_set1_epi16(L'Z');
+    const __m256i caseBit = _mm256_set1_epi16(0x20);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t pos = start;
+    for (; pos + lastOffset + blockSize <= haystack.size(); pos += blockSize)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + lastOffset));
+
+        if (m_caseInsensitive)
+        {
+            __m256i nonAscii = _mm256_and_si256(_mm256_or_si256(blockFirst, blockLast), nonAsciiBits);
+            if (static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(nonAscii, zero))) != 0xffffffff)
+            {
+                for (size_t i = 0; i < blockSize; i++)
+                {
+                    if (_MatchesAt(haystack, pos + i))
+                    {
+                        return pos + i;
+                    }
+                }
+                continue;
+            }
+
+            // Every lane is ASCII so the signed compares are safe.  AVX2 has no
+            // less than compare so the upper bound is checked as not greater than 'Z'.
+            __m256i upperFirst = _mm256_andnot_si256(_mm256_cmpgt_epi16(blockFirst, lastUpper), _mm256_cmpgt_epi16(blockFirst, beforeUpper));
+            __m256i upperLast = _mm256_andnot_si256(_mm256_cmpgt_epi16(blockLast, lastUpper), _mm256_cmpgt_epi16(blockLast, beforeUpper));
+            blockFirst = _mm256_or_si256(blockFirst, _mm256_and_si256(upperFirst, caseBit));
+            blockLast = _mm256_or_si256(blockLast, _mm256_and_si256(upperLast, caseBit));
+        }
+
+        // Two mask bits per position
+        unsigned long candidates = static_cast<unsigned long>(static_cast<unsigned int>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi16(blockFirst, first), _mm256_cmpeq_epi16(blockLast, last)))));
+        unsigned long bit = 0;
+        while (_BitScanForward(&bit, candidates))
+        {
+            if (_MatchesAt(haystack, pos + bit / 2))
+            {
+                return pos + bit / 2;
+            }
+            candidates &= ~(3ul << bit);
+        }
+    }
+
+    return _FindScalar(haystack, pos);
+}
+
+#else
+
+size_t CLiteralSearcher::_FindSse2(_In_ std::wstring_view haystack, _In_ size_t start) const
+{
+    return _FindScalar(haystack, start);
+}
+
+size_t CLiteralSearcher::_FindAvx2(_In_ std::wstring_view haystack, _In_ size_t start) const
+{
+    return _FindScalar(haystack, start);
+}
+
+#endif
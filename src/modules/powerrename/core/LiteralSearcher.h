@@ -0,0 +1,51 @@
+#pragma once
+#include "CorePlatform.h"
+#include <string>
+#include <string_view>
+
+// Instruction set used by CLiteralSearcher to find candidate positions
+enum class LiteralSearchKernel
+{
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+// Plain text search used when regular expressions are off.  The needle is folded once
+// when it is built and the haystack is folded as it is scanned, so no copy of either
+// string is made per search.
+//
+// The vector kernels compare the first and last character of the needle against a
+// block of start positions at a time and only check the positions where both match.
+// ASCII characters are folded in the vector registers.  Blocks with other characters
+// are checked with towlower so the results are the same as the scalar kernel's.
+class CLiteralSearcher
+{
+public:
+    CLiteralSearcher(_In_ const wchar_t* needle, _In_ bool caseInsensitive);
+
+    // Returns the position of the first occurrence of the needle at or after start,
+    // or npos.  Uses the fastest kernel the processor supports.
+    size_t Find(_In_ std::wstring_view haystack, _In_ size_t start) const;
+
+    // Same as Find with a specific kernel.  Used by the tests and the benchmarks.
+    size_t Find(_In_ std::wstring_view haystack, _In_ size_t start, _In_ LiteralSearchKernel kernel) const;
+
+    size_t GetLength() const { return m_needle.size(); }
+
+    static bool s_IsKernelSupported(_In_ LiteralSearchKernel kernel);
+    static LiteralSearchKernel s_GetBestKernel();
+
+private:
+    wchar_t _Fold(_In_ wchar_t ch) const;
+    bool _MatchesAt(_In_ std::wstring_view haystack, _In_ size_t pos) const;
+
+    size_t _FindScalar(_In_ std::wstring_view haystack, _In_ size_t start) const;
+    size_t _FindSse2(_In_ std::wstring_view haystack, _In_ size_t start) const;
+    size_t _FindAvx2(_In_ std::wstring_view haystack, _In_ size_t start) const;
+
+    // Folded when the search is case insensitive
+    std::wstring m_needle;
+    bool m_caseInsensitive = false;
+    LiteralSearchKernel m_kernel = LiteralSearchKernel::Scalar;
+};
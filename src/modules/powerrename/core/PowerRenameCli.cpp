@@ -0,0 +1,301 @@
+#include "PowerRenameEngine.h"
+#include "PowerRenameFileSystem.h"
+#include "PowerRenameJournal.h"
+#include "PowerRenameUndoLog.h"
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Command line front end of the portable core.  Prints the preview and only renames
+// anything when --commit is given.
+
+static void PrintUsage()
+{
+    fwprintf(stderr,
+             L"Usage: powerrename [options] <path>...\n"
+             L"  -s, --search <term>       Text or regular expression to search for\n"
+             L"  -r, --replace <term>      Replacement, may use $1 etc. with --regex and the\n"
+             L"                            ${counter}, ${size}, ${modified} and ${taken} tokens\n"
+             L"  -e, --regex               Use regular expressions\n"
+             L"      --std-regex           Use std::wregex instead of the linear engine\n"
+             L"  -c, --case-sensitive      Match case\n"
+             L"      --first               Only replace the first occurrence\n"
+             L"      --name-only           Only rename the part before the extension\n"
+             L"      --ext-only            Only rename the extension\n"
+             L"  -n, --enumerate           Number the new names\n"
+             L"      --exclude-files       Do not rename files\n"
+             L"      --exclude-folders     Do not rename folders\n"
+             L"      --exclude-subfolders  Do not rename the contents of folders\n"
+             L"  -R, --recursive           Include the contents of folders\n"
+             L"      --commit              Rename, instead of only showing the preview\n"
+             L"      --journal <file>      Log the commit to file until it is complete\n"
+             L"      --stats <file>        Write timings and counters as JSON to file\n"
+             L"      --undo-log <file>     Append the renames to file so they can be undone\n"
+             L"\n"
+             L"       powerrename --resume <file> | --rollback <file>\n"
+             L"  Finishes or undoes a commit that was interrupted, from its journal\n"
+             L"\n"
+             L"       powerrename --undo <file>\n"
+             L"  Undoes the last batch of renames appended to an undo log\n");
+}
+
+static const wchar_t* GetStateLabel(_In_ PowerRenameItemState state)
+{
+    switch (state)
+    {
+    case PowerRenameItemState::Collision:
+        return L"collision";
+    case PowerRenameItemState::Committed:
+        return L"renamed";
+    case PowerRenameItemState::Failed:
+        return L"failed";
+    default:
+        return L"";
+    }
+}
+
+// Resumes or rolls back the batch logged in a journal
+static int Recover(_In_ const std::filesystem::path& journalPath, _In_ bool rollBack)
+{
+    CPowerRenameJournal journal;
+    PowerRenamePlan plan;
+    std::vector<PowerRenameStepState> states;
+    if (!journal.Open(journalPath, plan, states))
+    {
+        fwprintf(stderr, L"%ls is not a complete journal\n", FromFileSystemPath(journalPath).c_str());
+        return 1;
+    }
+
+    CFileSystemRenameSink sink;
+    ResolveStartedSteps(plan, sink, states);
+
+    CPowerRenameCommitter committer;
+    bool recovered = rollBack ? committer.RollBack(plan, sink, &journal, states) : committer.Commit(plan, sink, &journal, states);
+    for (size_t i = 0; i < plan.steps.size(); i++)
+    {
+        if (states[i] == PowerRenameStepState::Failed || (rollBack && states[i] == PowerRenameStepState::Done))
+        {
+            fwprintf(stdout, L"%ls: %ls -> %ls [failed]\n", plan.steps[i].parent.c_str(), plan.steps[i].from.c_str(), plan.steps[i].to.c_str());
+        }
+    }
+
+    if (!recovered)
+    {
+        return 2;
+    }
+
+    journal.Remove();
+    return 0;
+}
+
+// Reverts the last batch of an undo log
+static int Undo(_In_ const std::filesystem::path& undoLogPath)
+{
+    CPowerRenameUndoLog undoLog(undoLogPath);
+    PowerRenamePlan plan;
+    if (!undoLog.ReadLastBatch(plan))
+    {
+        fwprintf(stderr, L"%ls has nothing to undo\n", FromFileSystemPath(undoLogPath).c_str());
+        return 1;
+    }
+
+    CFileSystemRenameSink sink;
+    size_t revertedCount = undoLog.RevertLastBatch(sink);
+    fwprintf(stdout, L"Undid %zu of %zu renames\n", revertedCount, plan.steps.size());
+    return revertedCount == plan.steps.size() ? 0 : 2;
+}
+
+static int Run(_In_ const std::vector<std::wstring>& args)
+{
+    std::wstring searchTerm;
+    std::wstring replaceTerm;
+    std::uint32_t flags = DEFAULT_FLAGS;
+    PowerRenameRegExEngine engine = LinearRegExEngine;
+    bool recursive = false;
+    bool commit = false;
+    std::filesystem::path journalPath;
+    std::filesystem::path statsPath;
+    std::filesystem::path undoLogPath;
+    std::vector<std::filesystem::path> paths;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const std::wstring& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if ((arg == L"-s" || arg == L"--search") && hasValue)
+        {
+            searchTerm = args[++i];
+        }
+        else if ((arg == L"-r" || arg == L"--replace") && hasValue)
+        {
+            replaceTerm = args[++i];
+        }
+        else if (arg == L"-e" || arg == L"--regex")
+        {
+            flags |= UseRegularExpressions;
+        }
+        else if (arg == L"--std-regex")
+        {
+            flags |= UseRegularExpressions;
+            engine = StdRegExEngine;
+        }
+        else if (arg == L"-c" || arg == L"--case-sensitive")
+        {
+            flags |= CaseSensitive;
+        }
+        else if (arg == L"--first")
+        {
+            flags &= ~MatchAllOccurences;
+        }
+        else if (arg == L"--name-only")
+        {
+            flags |= NameOnly;
+        }
+        else if (arg == L"--ext-only")
+        {
+            flags |= ExtensionOnly;
+        }
+        else if (arg == L"-n" || arg == L"--enumerate")
+        {
+            flags |= EnumerateItems;
+        }
+        else if (arg == L"--exclude-files")
+        {
+            flags |= ExcludeFiles;
+        }
+        else if (arg == L"--exclude-folders")
+        {
+            flags |= ExcludeFolders;
+        }
+        else if (arg == L"--exclude-subfolders")
+        {
+            flags |= ExcludeSubfolders;
+        }
+        else if (arg == L"-R" || arg == L"--recursive")
+        {
+            recursive = true;
+        }
+        else if (arg == L"--commit")
+        {
+            commit = true;
+        }
+        else if (arg == L"--journal" && hasValue)
+        {
+            journalPath = ToFileSystemPath(args[++i]);
+        }
+        else if (arg == L"--stats" && hasValue)
+        {
+            statsPath = ToFileSystemPath(args[++i]);
+        }
+        else if (arg == L"--undo-log" && hasValue)
+        {
+            undoLogPath = ToFileSystemPath(args[++i]);
+        }
+        else if (arg == L"--undo" && hasValue && args.size() == 2)
+        {
+            return Undo(ToFileSystemPath(args[i + 1]));
+        }
+        else if ((arg == L"--resume" || arg == L"--rollback") && hasValue && args.size() == 2)
+        {
+            return Recover(ToFileSystemPath(args[i + 1]), arg == L"--rollback");
+        }
+        else if (!arg.empty() && arg[0] == L'-')
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+        {
+            paths.push_back(ToFileSystemPath(arg));
+        }
+    }
+
+    if (searchTerm.empty() || paths.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    CPowerRenameEngine renameEngine;
+    CPowerRenameSearch& search = renameEngine.GetSearch();
+    search.SetFlags(flags);
+    search.SetEngine(engine);
+    search.SetSearchTerm(searchTerm);
+    search.SetReplaceTerm(replaceTerm);
+
+    // Pictures are only opened when the replace term has a ${taken}
+    CFileSystemItemSource source(paths, recursive, (search.GetTemplateUsage() & TemplateUsesHeader) != 0);
+    CFileSystemRenameSink sink;
+    renameEngine.Load(source);
+    renameEngine.Preview(&sink);
+
+    if (commit)
+    {
+        renameEngine.Commit(sink, journalPath, undoLogPath);
+    }
+
+    int result = 0;
+    for (const auto& item : renameEngine.GetItems())
+    {
+        if (item.newName.empty())
+        {
+            continue;
+        }
+
+        fwprintf(stdout, L"%ls -> %ls", item.source.path.c_str(), item.newName.c_str());
+        if (*GetStateLabel(item.state))
+        {
+            fwprintf(stdout, L" [%ls]", GetStateLabel(item.state));
+        }
+        fwprintf(stdout, L"\n");
+
+        if (item.state == PowerRenameItemState::Collision || item.state == PowerRenameItemState::Failed)
+        {
+            result = 2;
+        }
+    }
+
+    // For benchmark drivers that track the timings across versions
+    if (!statsPath.empty() && !(std::ofstream(statsPath, std::ios::binary) << renameEngine.GetStats().ToJson() << '\n'))
+    {
+        fwprintf(stderr, L"Could not write %ls\n", FromFileSystemPath(statsPath).c_str());
+        result = 1;
+    }
+
+    return result;
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t* argv[])
+{
+    std::vector<std::wstring> args(argv + 1, argv + argc);
+    return Run(args);
+}
+#else
+int main(int argc, char* argv[])
+{
+    // Arguments and paths are converted with the user's locale, normally UTF-8
+    setlocale(LC_ALL, "");
+
+    std::vector<std::wstring> args;
+    for (int i = 1; i < argc; i++)
+    {
+        size_t length = mbstowcs(nullptr, argv[i], 0);
+        if (length == static_cast<size_t>(-1))
+        {
+            fwprintf(stderr, L"Invalid argument encoding\n");
+            return 1;
+        }
+
+        std::wstring arg(length + 1, L'\0');
+        mbstowcs(&arg[0], argv[i], arg.size());
+        arg.resize(length);
+        args.push_back(arg);
+    }
+    return Run(args);
+}
+#endif
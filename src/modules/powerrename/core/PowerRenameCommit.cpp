@@ -0,0 +1,277 @@
+#include "PowerRenameCommit.h"
+#include "PowerRenameJournal.h"
+#include "PowerRenameNaming.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#define NO_STEP static_cast<size_t>(-1)
+
+static size_t GetPathDepth(_In_ const std::wstring& path)
+{
+    return std::count_if(path.begin(), path.end(), [](wchar_t ch) { return ch == L'/' || ch == L'\\'; });
+}
+
+// Returns a name for parking an entry of a cycle that no step and no entry uses
+static std::wstring GetTemporaryName(_In_ const std::wstring& parent, _In_ const std::unordered_set<std::wstring>& usedNames, _In_ IPowerRenameSink& sink, _Inout_ unsigned long& number)
+{
+    std::wstring name;
+    do
+    {
+        name = L"~powerrename" + std::to_wstring(++number) + L".tmp";
+    } while (usedNames.find(FoldName(name)) != usedNames.end() || sink.Exists(parent, name));
+    return name;
+}
+
+// Orders the renames of one folder.  A rename can only go once no other pending rename
+// still has its target as its name.  Names are unique in a folder so every rename waits
+// for at most one other and the renames form chains and cycles.  Chains are run from
+// their end, cycles are opened by moving one entry to a temporary name.
+static void PlanFolder(_In_ const std::vector<PowerRenameStep>& renames, _In_ const std::vector<size_t>& indexes, _In_ IPowerRenameSink& sink, _Inout_ std::vector<PowerRenameStep>& steps)
+{
+    std::vector<PowerRenameStep> pending;
+    pending.reserve(indexes.size());
+    std::unordered_map<std::wstring, size_t> sources;
+    std::unordered_set<std::wstring> usedNames;
+    for (size_t index : indexes)
+    {
+        pending.push_back(renames[index]);
+        std::wstring from = FoldName(renames[index].from);
+        sources[from] = pending.size() - 1;
+        usedNames.insert(from);
+        usedNames.insert(FoldName(renames[index].to));
+    }
+
+    // waitsFor[i] is the rename that has to vacate the target of rename i and
+    // blocks[j] is the rename waiting for j.  A change of case only waits for itself.
+    std::vector<size_t> waitsFor(pending.size(), NO_STEP);
+    std::vector<size_t> blocks(pending.size(), NO_STEP);
+    std::deque<size_t> ready;
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        auto it = sources.find(FoldName(pending[i].to));
+        if (it != sources.end() && it->second != i)
+        {
+            waitsFor[i] = it->second;
+            blocks[it->second] = i;
+        }
+        else
+        {
+            ready.push_back(i);
+        }
+    }
+
+    std::vector<bool> done(pending.size(), false);
+    size_t remaining = pending.size();
+    size_t firstPending = 0;
+    unsigned long temporaryNumber = 0;
+    while (remaining > 0)
+    {
+        if (ready.empty())
+        {
+            // Everything left is part of a cycle
+            while (done[firstPending])
+            {
+                firstPending++;
+            }
+
+            PowerRenameStep& parked = pending[firstPending];
+            std::wstring temporaryName = GetTemporaryName(parked.parent, usedNames, sink, temporaryNumber);
+            usedNames.insert(FoldName(temporaryName));
+            steps.push_back({ parked.parent, parked.from, temporaryName, parked.item });
+
+            // Its name is free now.  The entry itself moves on once its target is.
+            parked.from = temporaryName;
+            if (blocks[firstPending] != NO_STEP)
+            {
+                ready.push_back(blocks[firstPending]);
+                blocks[firstPending] = NO_STEP;
+            }
+            continue;
+        }
+
+        size_t next = ready.front();
+        ready.pop_front();
+        steps.push_back(pending[next]);
+        done[next] = true;
+        remaining--;
+
+        if (blocks[next] != NO_STEP)
+        {
+            ready.push_back(blocks[next]);
+        }
+    }
+}
+
+PowerRenamePlan CreateRenamePlan(_In_ const std::vector<PowerRenameStep>& renames, _In_ IPowerRenameSink& sink)
+{
+    std::map<std::wstring, std::vector<size_t>> folders;
+    for (size_t i = 0; i < renames.size(); i++)
+    {
+        folders[renames[i].parent].push_back(i);
+    }
+
+    PowerRenamePlan plan;
+    plan.steps.reserve(renames.size());
+    for (const auto& folder : folders)
+    {
+        PowerRenameFolderPlan folderPlan;
+        folderPlan.firstStep = plan.steps.size();
+        folderPlan.depth = GetPathDepth(folder.first);
+        PlanFolder(renames, folder.second, sink, plan.steps);
+        folderPlan.stepCount = plan.steps.size() - folderPlan.firstStep;
+        plan.folders.push_back(folderPlan);
+    }
+
+    std::stable_sort(plan.folders.begin(), plan.folders.end(), [](const PowerRenameFolderPlan& left, const PowerRenameFolderPlan& right) {
+        return left.depth > right.depth;
+    });
+
+    return plan;
+}
+
+// Calls callback for every folder of every depth, the folders of one depth on up to
+// threadCount threads.  The depths are visited in plan order, or the other way round.
+static void ForEachFolder(_In_ const PowerRenamePlan& plan, _In_ unsigned int threadCount, _In_ bool reverse, _In_ const std::function<void(const PowerRenameFolderPlan&)>& callback)
+{
+    if (threadCount == 0)
+    {
+        threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<std::pair<size_t, size_t>> levels;
+    for (size_t i = 0; i < plan.folders.size(); i++)
+    {
+        if (levels.empty() || plan.folders[levels.back().first].depth != plan.folders[i].depth)
+        {
+            levels.push_back({ i, 0 });
+        }
+        levels.back().second++;
+    }
+    if (reverse)
+    {
+        std::reverse(levels.begin(), levels.end());
+    }
+
+    for (const auto& level : levels)
+    {
+        std::atomic<size_t> nextFolder = 0;
+        auto worker = [&]() {
+            for (size_t i = nextFolder++; i < level.second; i = nextFolder++)
+            {
+                callback(plan.folders[level.first + i]);
+            }
+        };
+
+        size_t levelThreads = (std::min)(static_cast<size_t>(threadCount), level.second);
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < levelThreads; i++)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+bool CPowerRenameCommitter::Commit(
+    _In_ const PowerRenamePlan& plan,
+    _In_ IPowerRenameSink& sink,
+    _In_opt_ CPowerRenameJournal* journal,
+    _Inout_ std::vector<PowerRenameStepState>& states)
+{
+    states.resize(plan.steps.size(), PowerRenameStepState::Pending);
+
+    std::atomic<bool> failed = false;
+    ForEachFolder(plan, m_threadCount, false, [&](const PowerRenameFolderPlan& folder) {
+        for (size_t i = folder.firstStep; i < folder.firstStep + folder.stepCount && !failed; i++)
+        {
+            if (states[i] == PowerRenameStepState::Done)
+            {
+                continue;
+            }
+
+            if (journal)
+            {
+                journal->LogState(i, PowerRenameStepState::Started);
+            }
+
+            const PowerRenameStep& step = plan.steps[i];
+            states[i] = sink.Rename(step.parent, step.from, step.to) ? PowerRenameStepState::Done : PowerRenameStepState::Failed;
+            if (journal)
+            {
+                journal->LogState(i, states[i]);
+            }
+
+            if (states[i] == PowerRenameStepState::Failed)
+            {
+                failed = true;
+            }
+        }
+    });
+
+    return !failed;
+}
+
+bool CPowerRenameCommitter::RollBack(
+    _In_ const PowerRenamePlan& plan,
+    _In_ IPowerRenameSink& sink,
+    _In_opt_ CPowerRenameJournal* journal,
+    _Inout_ std::vector<PowerRenameStepState>& states)
+{
+    states.resize(plan.steps.size(), PowerRenameStepState::Pending);
+
+    // Folders are restored from the top down so the paths of their contents are the
+    // ones the steps recorded
+    std::atomic<bool> failed = false;
+    ForEachFolder(plan, m_threadCount, true, [&](const PowerRenameFolderPlan& folder) {
+        for (size_t i = folder.firstStep + folder.stepCount; i-- > folder.firstStep;)
+        {
+            if (states[i] != PowerRenameStepState::Done)
+            {
+                continue;
+            }
+
+            // The earlier steps of the folder may depend on this one
+            const PowerRenameStep& step = plan.steps[i];
+            if (!sink.Rename(step.parent, step.to, step.from))
+            {
+                failed = true;
+                break;
+            }
+
+            states[i] = PowerRenameStepState::RolledBack;
+            if (journal)
+            {
+                journal->LogState(i, states[i]);
+            }
+        }
+    });
+
+    return !failed;
+}
+
+void ResolveStartedSteps(
+    _In_ const PowerRenamePlan& plan,
+    _In_ IPowerRenameSink& sink,
+    _Inout_ std::vector<PowerRenameStepState>& states)
+{
+    for (size_t i = 0; i < plan.steps.size() && i < states.size(); i++)
+    {
+        if (states[i] == PowerRenameStepState::Started)
+        {
+            const PowerRenameStep& step = plan.steps[i];
+            bool renamed = !sink.Exists(step.parent, step.from) && sink.Exists(step.parent, step.to);
+            states[i] = renamed ? PowerRenameStepState::Done : PowerRenameStepState::Pending;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameEngine.h"
+#include <string>
+#include <vector>
+
+class CPowerRenameJournal;
+
+// One rename of an entry inside a folder
+struct PowerRenameStep
+{
+    std::wstring parent;
+    std::wstring from;
+    std::wstring to;
+    // Index of the item the step belongs to.  An item that is part of a cycle has two
+    // steps, one to a temporary name and one from it.
+    size_t item = 0;
+};
+
+// Steps of one folder, in the order they have to run
+struct PowerRenameFolderPlan
+{
+    size_t firstStep = 0;
+    size_t stepCount = 0;
+    // Number of separators in the folder's path.  Folders of the same depth can't
+    // contain each other so they are committed in parallel.
+    size_t depth = 0;
+};
+
+// Order in which a batch of renames is committed.  Folders are sorted deepest first so
+// the contents of a folder are renamed before the folder itself.
+struct PowerRenamePlan
+{
+    std::vector<PowerRenameStep> steps;
+    std::vector<PowerRenameFolderPlan> folders;
+};
+
+enum class PowerRenameStepState
+{
+    Pending,
+    // Written to the journal as started but not as done
+    Started,
+    Done,
+    Failed,
+    // Done and then undone by a rollback
+    RolledBack
+};
+
+// Orders renames, given as steps with one entry per item, so that no rename targets a
+// name that is still in use.  Within a folder a -> b waits for b -> c, and cycles such
+// as a -> b, b -> a go through a temporary name.  sink is asked which temporary names
+// are free.
+PowerRenamePlan CreateRenamePlan(_In_ const std::vector<PowerRenameStep>& renames, _In_ IPowerRenameSink& sink);
+
+// Runs the steps of a plan against a sink.  Folders of the same depth are committed on a
+// pool of threads so the sink's Rename must allow calls for different folders at once.
+// With a journal every step is recorded before and after it runs.
+class CPowerRenameCommitter
+{
+public:
+    // threadCount 0 uses one thread per processor
+    explicit CPowerRenameCommitter(_In_ unsigned int threadCount = 0) :
+        m_threadCount(threadCount)
+    {
+    }
+
+    // Commits the steps that aren't done yet.  Stops at the first step that fails and
+    // returns false; the steps done so far are left as they are.
+    bool Commit(
+        _In_ const PowerRenamePlan& plan,
+        _In_ IPowerRenameSink& sink,
+        _In_opt_ CPowerRenameJournal* journal,
+        _Inout_ std::vector<PowerRenameStepState>& states);
+
+    // Undoes the steps that are done, the last one first.  Returns false when one of
+    // them couldn't be undone.
+    bool RollBack(
+        _In_ const PowerRenamePlan& plan,
+        _In_ IPowerRenameSink& sink,
+        _In_opt_ CPowerRenameJournal* journal,
+        _Inout_ std::vector<PowerRenameStepState>& states);
+
+private:
+    unsigned int m_threadCount;
+};
+
+// Decides for the steps a journal recorded as started but not as done whether they went
+// through before the batch was interrupted, from which of the two names exists.
+void ResolveStartedSteps(
+    _In_ const PowerRenamePlan& plan,
+    _In_ IPowerRenameSink& sink,
+    _Inout_ std::vector<PowerRenameStepState>& states);
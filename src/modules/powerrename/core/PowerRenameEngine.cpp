@@ -0,0 +1,244 @@
+#include "PowerRenameEngine.h"
+#include "PowerRenameCommit.h"
+#include "PowerRenameJournal.h"
+#include "PowerRenameNameIndex.h"
+#include "PowerRenameNaming.h"
+#include "PowerRenameUndoLog.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+
+void CPowerRenameEngine::Load(_In_ IPowerRenameItemSource& source)
+{
+    CPowerRenamePhaseTimer timer(m_stats, PowerRenamePhase::Enumerate);
+    m_items.clear();
+
+    PowerRenameEngineItem item;
+    while (source.GetNextItem(item.source))
+    {
+        m_items.push_back(item);
+    }
+}
+
+size_t CPowerRenameEngine::Preview(_In_opt_ IPowerRenameSink* sink)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point passStart = Clock::now();
+    Clock::duration matchTime{};
+    Clock::duration numberTime{};
+
+    std::uint32_t flags = m_search.GetFlags();
+    PowerRenameMatches matches;
+    std::wstring newName;
+    unsigned long enumIndex = 1;
+    PowerRenameTemplateContext context;
+    bool usesCounter = (m_search.GetTemplateUsage() & TemplateUsesCounter) != 0;
+    size_t scannedCount = 0;
+    size_t matchedCount = 0;
+
+    // Numbered names skip the names the items and the entries next to them already
+    // have.  Folders whose contents are among the items don't need to be listed.
+    CPowerRenameNameIndex nameIndex([sink](const std::wstring& parent, std::vector<std::wstring>& names) {
+        if (sink)
+        {
+            sink->List(parent, names);
+        }
+    });
+    if (flags & EnumerateItems)
+    {
+        for (const auto& item : m_items)
+        {
+            nameIndex.AddName(item.source.parent, item.source.name);
+            if (item.source.depth > 0)
+            {
+                nameIndex.AddFolder(item.source.parent);
+            }
+        }
+    }
+
+    for (auto& item : m_items)
+    {
+        item.newName.clear();
+        item.state = PowerRenameItemState::Unchanged;
+
+        if (IsExcluded(item.source.isFolder, item.source.depth > 0, flags))
+        {
+            item.state = PowerRenameItemState::Excluded;
+            continue;
+        }
+
+        Clock::time_point itemStart = Clock::now();
+        std::wstring_view sourceName = GetMatchSource(item.source.name, flags);
+        bool hasNewName = m_search.Match(sourceName, matches);
+        if (hasNewName)
+        {
+            // The counter numbers the items the search term matched, in order
+            if (!matches.matches.empty())
+            {
+                context.counter++;
+            }
+            context.metadata = &item.source.metadata;
+
+            // An empty name can't be committed so it counts as no change
+            m_search.Substitute(sourceName, matches, context, newName);
+            hasNewName = ComposeNewName(item.source.name, flags, newName) && !newName.empty();
+        }
+
+        Clock::duration itemTime = Clock::now() - itemStart;
+        m_stats.AddMatchTime(itemTime);
+        matchTime += itemTime;
+        scannedCount++;
+        if (!hasNewName)
+        {
+            continue;
+        }
+        matchedCount++;
+
+        if (flags & EnumerateItems)
+        {
+            Clock::time_point numberStart = Clock::now();
+            std::wstring uniqueName;
+            unsigned long countUsed = 0;
+            // A ${counter} in the replace term numbers the names already, so only the
+            // names that are taken get numbered again
+            unsigned long minNumber = enumIndex++;
+            bool keepName = usesCounter && nameIndex.Reserve(item.source.parent, newName);
+            if (!keepName && nameIndex.ReserveEnumeratedName(item.source.parent, item.source.name, newName, minNumber, POWERRENAME_MAX_PATH, uniqueName, &countUsed))
+            {
+                newName = std::move(uniqueName);
+            }
+            numberTime += Clock::now() - numberStart;
+        }
+
+        item.newName = newName;
+        item.state = PowerRenameItemState::Renamed;
+    }
+
+    _FindCollisions(sink);
+
+    // Numbering happens item by item as part of the pass.  Its share is reported as a
+    // phase of its own.
+    m_stats.AddPhaseTime(PowerRenamePhase::Match, Clock::now() - passStart - numberTime);
+    if (flags & EnumerateItems)
+    {
+        m_stats.AddPhaseTime(PowerRenamePhase::Number, numberTime);
+    }
+    m_stats.AddPatternPass(m_search.GetSearchTerm(), flags, scannedCount, matchTime);
+    m_stats.AddItemsScanned(scannedCount);
+    m_stats.AddItemsMatched(matchedCount);
+
+    return std::count_if(m_items.begin(), m_items.end(), [](const PowerRenameEngineItem& item) {
+        return item.state == PowerRenameItemState::Renamed;
+    });
+}
+
+void CPowerRenameEngine::_FindCollisions(_In_opt_ IPowerRenameSink* sink)
+{
+    // An item that collides keeps its name, which can take the name another item was
+    // renamed to and no longer leaves its own free.  The names are worked out again until
+    // no new collision is found.
+    bool foundCollision = true;
+    while (foundCollision)
+    {
+        foundCollision = false;
+
+        // Names are folded so a preview made on a case sensitive file system doesn't allow
+        // names that would collide on Windows
+        // Name every item has once the renames are done, per folder
+        std::map<std::pair<std::wstring, std::wstring>, size_t> finalNames;
+        // Names that renamed items leave free
+        std::set<std::pair<std::wstring, std::wstring>> vacatedNames;
+        for (const auto& item : m_items)
+        {
+            bool renamed = item.state == PowerRenameItemState::Renamed;
+            finalNames[{ item.source.parent, FoldName(renamed ? item.newName : item.source.name) }]++;
+            if (renamed)
+            {
+                vacatedNames.insert({ item.source.parent, FoldName(item.source.name) });
+            }
+        }
+
+        for (auto& item : m_items)
+        {
+            if (item.state != PowerRenameItemState::Renamed)
+            {
+                continue;
+            }
+
+            std::pair<std::wstring, std::wstring> key(item.source.parent, FoldName(item.newName));
+            bool collides = finalNames[key] > 1;
+            if (!collides && sink && vacatedNames.find(key) == vacatedNames.end())
+            {
+                // Taken by an entry that isn't renamed away
+                collides = sink->Exists(item.source.parent, item.newName);
+            }
+
+            if (collides)
+            {
+                item.state = PowerRenameItemState::Collision;
+                foundCollision = true;
+            }
+        }
+    }
+}
+
+size_t CPowerRenameEngine::Commit(_In_ IPowerRenameSink& sink, _In_ const std::filesystem::path& journalPath, _In_ const std::filesystem::path& undoLogPath)
+{
+    CPowerRenamePhaseTimer timer(m_stats, PowerRenamePhase::Commit);
+    std::vector<PowerRenameStep> renames;
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        const PowerRenameEngineItem& item = m_items[i];
+        if (item.state == PowerRenameItemState::Renamed)
+        {
+            renames.push_back({ item.source.parent, item.source.name, item.newName, i });
+        }
+    }
+
+    PowerRenamePlan plan = CreateRenamePlan(renames, sink);
+
+    // Nothing is renamed without the journal that was asked for
+    CPowerRenameJournal journal;
+    bool journaled = !journalPath.empty();
+    if (journaled && !journal.Create(journalPath, plan))
+    {
+        return 0;
+    }
+
+    CPowerRenameCommitter committer;
+    std::vector<PowerRenameStepState> states;
+    bool committed = committer.Commit(plan, sink, journaled ? &journal : nullptr, states);
+    bool recovered = committed || committer.RollBack(plan, sink, journaled ? &journal : nullptr, states);
+    if (journaled && recovered)
+    {
+        journal.Remove();
+    }
+
+    // Renames a failed rollback left in place can be reverted too
+    if (!undoLogPath.empty())
+    {
+        CPowerRenameUndoLog(undoLogPath).Append(plan, states);
+    }
+
+    // An item is renamed once its last step is done.  Items renamed in two steps
+    // through a temporary name have two.
+    for (size_t i = 0; i < plan.steps.size(); i++)
+    {
+        PowerRenameEngineItem& item = m_items[plan.steps[i].item];
+        if (states[i] == PowerRenameStepState::Failed)
+        {
+            item.state = PowerRenameItemState::Failed;
+        }
+        else if (item.state != PowerRenameItemState::Failed)
+        {
+            item.state = plan.steps[i].to == item.newName && states[i] == PowerRenameStepState::Done ? PowerRenameItemState::Committed : PowerRenameItemState::Renamed;
+        }
+    }
+
+    size_t committedCount = std::count_if(m_items.begin(), m_items.end(), [](const PowerRenameEngineItem& item) {
+        return item.state == PowerRenameItemState::Committed;
+    });
+    m_stats.AddItemsRenamed(committedCount);
+    return committedCount;
+}
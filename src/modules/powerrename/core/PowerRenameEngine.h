@@ -0,0 +1,113 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameSearch.h"
+#include "PowerRenameStats.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// An item to rename as handed out by an item source
+struct PowerRenameSourceItem
+{
+    // Full path of the item and of the folder it is in
+    std::wstring path;
+    std::wstring parent;
+    std::wstring name;
+    bool isFolder = false;
+    // 0 for the items the user picked, 1 for their children and so on
+    int depth = 0;
+    // Read by sources that can, for the ${size} and ${modified} template tokens
+    PowerRenameItemMetadata metadata;
+};
+
+// Hands out the items to rename.  Parents are handed out before their children.
+class IPowerRenameItemSource
+{
+public:
+    virtual ~IPowerRenameItemSource() = default;
+
+    // Fills item with the next item and returns true, or returns false once every item
+    // was handed out
+    virtual bool GetNextItem(_Out_ PowerRenameSourceItem& item) = 0;
+};
+
+// Where renames end up.  Also answers which names are already taken so the preview can
+// report collisions before anything is renamed.
+class IPowerRenameSink
+{
+public:
+    virtual ~IPowerRenameSink() = default;
+
+    // Returns true when parent already has an entry called name
+    virtual bool Exists(_In_ const std::wstring& parent, _In_ const std::wstring& name) = 0;
+
+    // Appends the names of the entries in parent to names
+    virtual void List(_In_ const std::wstring& parent, _Inout_ std::vector<std::wstring>& names) = 0;
+
+    // Renames the entry name of parent to newName.  Must fail rather than replace an
+    // existing entry.  Called from several threads at once for different folders.
+    virtual bool Rename(_In_ const std::wstring& parent, _In_ const std::wstring& name, _In_ const std::wstring& newName) = 0;
+};
+
+enum class PowerRenameItemState
+{
+    // No match or the new name is the same as the old one
+    Unchanged,
+    // Skipped by the exclude flags
+    Excluded,
+    // Has a new name that can be committed
+    Renamed,
+    // The new name is used by another item or an existing entry in the same folder
+    Collision,
+    // Committed
+    Committed,
+    // The sink failed to rename the item
+    Failed
+};
+
+struct PowerRenameEngineItem
+{
+    PowerRenameSourceItem source;
+    std::wstring newName;
+    PowerRenameItemState state = PowerRenameItemState::Unchanged;
+};
+
+// Platform independent rename pipeline: loads the items from a source, computes their
+// new names with the same matching, naming, numbering and exclusion rules as the
+// shell extension, checks them for collisions and commits them to a sink.
+class CPowerRenameEngine
+{
+public:
+    CPowerRenameSearch& GetSearch() { return m_search; }
+    const CPowerRenameSearch& GetSearch() const { return m_search; }
+
+    const std::vector<PowerRenameEngineItem>& GetItems() const { return m_items; }
+
+    // Timings and counters of every Load, Preview and Commit so far
+    CPowerRenameStats& GetStats() { return m_stats; }
+
+    // Replaces the items with the ones handed out by source
+    void Load(_In_ IPowerRenameItemSource& source);
+
+    // Computes the new names of the items.  When sink is given the new names are also
+    // checked against the entries that already exist.  Returns the number of items
+    // that would be renamed.
+    size_t Preview(_In_opt_ IPowerRenameSink* sink);
+
+    // Renames the items Preview gave a new name, all of them or none: when a rename
+    // fails the ones done so far are undone.  With a journal path the batch is logged
+    // there as it runs and the journal is deleted once the batch needs no recovery.
+    // With an undo log path the renames are appended there as a batch that
+    // CPowerRenameUndoLog can revert.  Returns the number of items renamed.
+    size_t Commit(
+        _In_ IPowerRenameSink& sink,
+        _In_ const std::filesystem::path& journalPath = std::filesystem::path(),
+        _In_ const std::filesystem::path& undoLogPath = std::filesystem::path());
+
+private:
+    void _FindCollisions(_In_opt_ IPowerRenameSink* sink);
+
+    CPowerRenameSearch m_search;
+    std::vector<PowerRenameEngineItem> m_items;
+    CPowerRenameStats m_stats;
+};
@@ -0,0 +1,242 @@
+#include "PowerRenameFileSystem.h"
+#include "PowerRenameMetadata.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+fs::path ToFileSystemPath(_In_ const std::wstring& path)
+{
+    return fs::path(path);
+}
+
+std::wstring FromFileSystemPath(_In_ const fs::path& path)
+{
+    return path.wstring();
+}
+#else
+fs::path ToFileSystemPath(_In_ const std::wstring& path)
+{
+    std::string bytes;
+    bytes.reserve(path.size());
+    for (wchar_t wch : path)
+    {
+        std::uint32_t ch = static_cast<std::uint32_t>(wch);
+        if (ch < 0x80)
+        {
+            bytes += static_cast<char>(ch);
+        }
+        else if (ch >= 0xDC80 && ch <= 0xDCFF)
+        {
+            bytes += static_cast<char>(ch - 0xDC00);
+        }
+        else if (ch < 0x800)
+        {
+            bytes += static_cast<char>(0xC0 | (ch >> 6));
+            bytes += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else if (ch < 0x10000)
+        {
+            bytes += static_cast<char>(0xE0 | (ch >> 12));
+            bytes += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            bytes += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else
+        {
+            bytes += static_cast<char>(0xF0 | (ch >> 18));
+            bytes += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+            bytes += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            bytes += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+    }
+    return fs::path(bytes);
+}
+
+std::wstring FromFileSystemPath(_In_ const fs::path& path)
+{
+    const std::string& bytes = path.native();
+    std::wstring text;
+    text.reserve(bytes.size());
+    for (size_t i = 0; i < bytes.size();)
+    {
+        unsigned char lead = static_cast<unsigned char>(bytes[i]);
+        size_t length = lead < 0x80 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 0;
+        std::uint32_t ch = length == 1 ? lead : length == 2 ? lead & 0x1F : length == 3 ? lead & 0x0F : lead & 0x07;
+        bool valid = length > 0 && i + length <= bytes.size();
+        for (size_t j = 1; valid && j < length; j++)
+        {
+            unsigned char next = static_cast<unsigned char>(bytes[i + j]);
+            valid = (next & 0xC0) == 0x80;
+            ch = (ch << 6) | (next & 0x3F);
+        }
+
+        // Overlong forms, surrogates and values past U+10FFFF are not UTF-8 either
+        static const std::uint32_t s_minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (valid && (ch < s_minimum[length] || (ch >= 0xD800 && ch < 0xE000) || ch > 0x10FFFF))
+        {
+            valid = false;
+        }
+
+        if (valid)
+        {
+            text += static_cast<wchar_t>(ch);
+            i += length;
+        }
+        else
+        {
+            text += static_cast<wchar_t>(0xDC00 + lead);
+            i++;
+        }
+    }
+    return text;
+}
+#endif
+
+// Reads the size and the local time of the last write of path.  A symbolic link reports
+// its target.
+static void ReadMetadata(_In_ const fs::path& path, _In_ bool isFolder, _Out_ PowerRenameItemMetadata& metadata)
+{
+    metadata = PowerRenameItemMetadata();
+
+    std::error_code error;
+    fs::file_time_type lastWrite = fs::last_write_time(path, error);
+    std::uintmax_t size = isFolder ? 0 : fs::file_size(path, error);
+    if (error)
+    {
+        return;
+    }
+
+    // The file clock has no conversion to system time before C++20
+    auto systemTime = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+        lastWrite - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+    std::time_t time = std::chrono::system_clock::to_time_t(systemTime);
+    std::tm local = {};
+#ifdef _WIN32
+    bool converted = localtime_s(&local, &time) == 0;
+#else
+    bool converted = localtime_r(&time, &local) != nullptr;
+#endif
+    if (!converted)
+    {
+        return;
+    }
+
+    metadata.valid = true;
+    metadata.size = size;
+    metadata.modified.year = local.tm_year + 1900;
+    metadata.modified.month = local.tm_mon + 1;
+    metadata.modified.day = local.tm_mday;
+    metadata.modified.hour = local.tm_hour;
+    metadata.modified.minute = local.tm_min;
+    metadata.modified.second = local.tm_sec;
+}
+
+// Reads the Exif date taken from the start of the file at path into metadata
+static void ReadHeader(_In_ const fs::path& path, _Inout_ std::vector<unsigned char>& header, _Inout_ PowerRenameItemMetadata& metadata)
+{
+    header.resize(POWERRENAME_METADATA_HEADER_SIZE);
+    std::ifstream file(path, std::ios::binary);
+    file.read(reinterpret_cast<char*>(header.data()), header.size());
+    metadata.hasTaken = ParseExifDateTaken(header.data(), static_cast<size_t>(file.gcount()), metadata.taken);
+}
+
+CFileSystemItemSource::CFileSystemItemSource(_In_ const std::vector<fs::path>& roots, _In_ bool recursive, _In_ bool readHeaders) :
+    m_recursive(recursive),
+    m_readHeaders(readHeaders)
+{
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it)
+    {
+        m_pending.push_back({ *it, 0 });
+    }
+}
+
+bool CFileSystemItemSource::GetNextItem(_Out_ PowerRenameSourceItem& item)
+{
+    while (!m_pending.empty())
+    {
+        PendingItem pending = std::move(m_pending.back());
+        m_pending.pop_back();
+
+        std::error_code error;
+        fs::file_status status = fs::symlink_status(pending.path, error);
+        if (error || !fs::exists(status))
+        {
+            continue;
+        }
+
+        // Trailing separators would leave the file name empty
+        fs::path path = pending.path.lexically_normal();
+        if (!path.has_filename())
+        {
+            path = path.parent_path();
+        }
+
+        item.path = FromFileSystemPath(path);
+        item.parent = FromFileSystemPath(path.parent_path());
+        item.name = FromFileSystemPath(path.filename());
+        item.isFolder = fs::is_directory(status);
+        item.depth = pending.depth;
+        ReadMetadata(path, item.isFolder, item.metadata);
+        if (m_readHeaders && item.metadata.valid && !item.isFolder && MayHaveExifHeader(item.name))
+        {
+            ReadHeader(path, m_header, item.metadata);
+        }
+
+        if (item.isFolder && m_recursive)
+        {
+            std::vector<fs::path> children;
+            for (fs::directory_iterator it(path, error), end; !error && it != end; it.increment(error))
+            {
+                children.push_back(it->path());
+            }
+
+            std::sort(children.begin(), children.end());
+            for (auto it = children.rbegin(); it != children.rend(); ++it)
+            {
+                m_pending.push_back({ *it, pending.depth + 1 });
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool CFileSystemRenameSink::Exists(_In_ const std::wstring& parent, _In_ const std::wstring& name)
+{
+    std::error_code error;
+    return fs::exists(fs::symlink_status(ToFileSystemPath(parent) / ToFileSystemPath(name), error));
+}
+
+void CFileSystemRenameSink::List(_In_ const std::wstring& parent, _Inout_ std::vector<std::wstring>& names)
+{
+    std::error_code error;
+    for (fs::directory_iterator it(ToFileSystemPath(parent), error), end; !error && it != end; it.increment(error))
+    {
+        names.push_back(FromFileSystemPath(it->path().filename()));
+    }
+}
+
+bool CFileSystemRenameSink::Rename(_In_ const std::wstring& parent, _In_ const std::wstring& name, _In_ const std::wstring& newName)
+{
+    fs::path folder = ToFileSystemPath(parent);
+    fs::path from = folder / ToFileSystemPath(name);
+    fs::path to = folder / ToFileSystemPath(newName);
+
+    // fs::rename replaces existing files on some platforms.  Only let it through when
+    // the target is the item itself, which is a change of case on Windows.
+    std::error_code error;
+    if (fs::exists(fs::symlink_status(to, error)) && !fs::equivalent(from, to, error))
+    {
+        return false;
+    }
+
+    fs::rename(from, to, error);
+    return !error;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameEngine.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// std::filesystem converts wide paths with the "C" locale where paths are bytes, which
+// fails on anything but ASCII.  These take the bytes as UTF-8 instead and do nothing
+// where paths are wide.  Bytes that are not UTF-8 round trip through U+DC80-U+DCFF.
+std::filesystem::path ToFileSystemPath(_In_ const std::wstring& path);
+std::wstring FromFileSystemPath(_In_ const std::filesystem::path& path);
+
+// Item source over paths on disk.  With recursion on, the contents of every folder are
+// handed out right after the folder, sorted by name, like the shell extension lists
+// them.  With readHeaders on, the start of pictures is read for the date they were
+// taken.
+class CFileSystemItemSource : public IPowerRenameItemSource
+{
+public:
+    CFileSystemItemSource(_In_ const std::vector<std::filesystem::path>& roots, _In_ bool recursive, _In_ bool readHeaders = false);
+
+    bool GetNextItem(_Out_ PowerRenameSourceItem& item) override;
+
+private:
+    struct PendingItem
+    {
+        std::filesystem::path path;
+        int depth;
+    };
+
+    bool m_recursive;
+    bool m_readHeaders;
+    // Reused for every header that is read
+    std::vector<unsigned char> m_header;
+    // Next item on top
+    std::vector<PendingItem> m_pending;
+};
+
+// Sink that renames entries on disk with std::filesystem
+class CFileSystemRenameSink : public IPowerRenameSink
+{
+public:
+    bool Exists(_In_ const std::wstring& parent, _In_ const std::wstring& name) override;
+    void List(_In_ const std::wstring& parent, _Inout_ std::vector<std::wstring>& names) override;
+    bool Rename(_In_ const std::wstring& parent, _In_ const std::wstring& name, _In_ const std::wstring& newName) override;
+};
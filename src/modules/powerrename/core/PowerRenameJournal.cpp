@@ -0,0 +1,306 @@
+#include "PowerRenameJournal.h"
+#include <cstdint>
+#include <sstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+#define JOURNAL_HEADER "POWERRENAME JOURNAL 1"
+
+// Names are written as UTF-8 whatever the size of wchar_t.  Tabs, line breaks and
+// backslashes are escaped so every field stays on its line.
+static void AppendEscaped(_In_ const std::wstring& text, _Inout_ std::string& out)
+{
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        std::uint32_t ch = static_cast<std::uint32_t>(text[i]);
+        if (sizeof(wchar_t) == 2 && ch >= 0xD800 && ch < 0xDC00 && i + 1 < text.size())
+        {
+            std::uint32_t low = static_cast<std::uint32_t>(text[i + 1]);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+        }
+
+        switch (ch)
+        {
+        case L'\\':
+            out += "\\\\";
+            break;
+        case L'\t':
+            out += "\\t";
+            break;
+        case L'\n':
+            out += "\\n";
+            break;
+        case L'\r':
+            out += "\\r";
+            break;
+        default:
+            if (ch < 0x80)
+            {
+                out += static_cast<char>(ch);
+            }
+            else if (ch < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (ch >> 6));
+                out += static_cast<char>(0x80 | (ch & 0x3F));
+            }
+            else if (ch < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (ch >> 12));
+                out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (ch & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (ch >> 18));
+                out += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (ch & 0x3F));
+            }
+        }
+    }
+}
+
+static void AppendCodePoint(_In_ std::uint32_t ch, _Inout_ std::wstring& out)
+{
+    if (sizeof(wchar_t) == 2 && ch >= 0x10000)
+    {
+        ch -= 0x10000;
+        out += static_cast<wchar_t>(0xD800 + (ch >> 10));
+        out += static_cast<wchar_t>(0xDC00 + (ch & 0x3FF));
+    }
+    else
+    {
+        out += static_cast<wchar_t>(ch);
+    }
+}
+
+static bool Unescape(_In_ const std::string& text, _Out_ std::wstring& out)
+{
+    out.clear();
+    for (size_t i = 0; i < text.size();)
+    {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        if (lead == '\\')
+        {
+            if (i + 1 == text.size())
+            {
+                return false;
+            }
+
+            switch (text[i + 1])
+            {
+            case '\\':
+                out += L'\\';
+                break;
+            case 't':
+                out += L'\t';
+                break;
+            case 'n':
+                out += L'\n';
+                break;
+            case 'r':
+                out += L'\r';
+                break;
+            default:
+                return false;
+            }
+            i += 2;
+            continue;
+        }
+
+        size_t length = lead < 0x80 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+        if (length == 0 || i + length > text.size())
+        {
+            return false;
+        }
+
+        std::uint32_t ch = length == 1 ? lead : lead & (0xFF >> (length + 1));
+        for (size_t j = 1; j < length; j++)
+        {
+            ch = (ch << 6) | (static_cast<unsigned char>(text[i + j]) & 0x3F);
+        }
+        AppendCodePoint(ch, out);
+        i += length;
+    }
+    return true;
+}
+
+static const char* GetStateCode(_In_ PowerRenameStepState state)
+{
+    switch (state)
+    {
+    case PowerRenameStepState::Started:
+        return "S";
+    case PowerRenameStepState::Done:
+        return "D";
+    case PowerRenameStepState::Failed:
+        return "X";
+    case PowerRenameStepState::RolledBack:
+        return "U";
+    default:
+        return "P";
+    }
+}
+
+void CPowerRenameJournal::_Write(_In_ const std::string& record)
+{
+    m_file << record << '\n';
+    m_file.flush();
+}
+
+bool CPowerRenameJournal::Create(_In_ const fs::path& path, _In_ const PowerRenamePlan& plan)
+{
+    m_path = path;
+    m_file.close();
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file)
+    {
+        return false;
+    }
+
+    // The plan is written in one go.  The closing B record tells a complete plan from
+    // one that was cut off.
+    std::string records = JOURNAL_HEADER "\n";
+    for (const auto& folder : plan.folders)
+    {
+        records += "F " + std::to_string(folder.firstStep) + " " + std::to_string(folder.stepCount) + " " + std::to_string(folder.depth) + "\n";
+    }
+    for (const auto& step : plan.steps)
+    {
+        records += "P " + std::to_string(step.item) + "\t";
+        AppendEscaped(step.parent, records);
+        records += "\t";
+        AppendEscaped(step.from, records);
+        records += "\t";
+        AppendEscaped(step.to, records);
+        records += "\n";
+    }
+    records += "B";
+
+    _Write(records);
+    return !!m_file;
+}
+
+bool CPowerRenameJournal::Open(_In_ const fs::path& path, _Out_ PowerRenamePlan& plan, _Out_ std::vector<PowerRenameStepState>& states)
+{
+    plan = PowerRenamePlan();
+    states.clear();
+
+    std::ifstream file(path, std::ios::binary);
+    std::string line;
+    if (!std::getline(file, line) || line != JOURNAL_HEADER)
+    {
+        return false;
+    }
+
+    bool planComplete = false;
+    std::streamoff recordStart = file.tellg();
+    std::streamoff cutOffAt = -1;
+    while (std::getline(file, line))
+    {
+        // A record cut off by the interruption has no line break and is dropped
+        if (file.eof() || line.empty())
+        {
+            cutOffAt = line.empty() ? -1 : recordStart;
+            break;
+        }
+        recordStart = file.tellg();
+
+        std::istringstream fields(line.substr(1));
+        if (!planComplete && line[0] == 'F')
+        {
+            PowerRenameFolderPlan folder;
+            if (!(fields >> folder.firstStep >> folder.stepCount >> folder.depth))
+            {
+                return false;
+            }
+            plan.folders.push_back(folder);
+        }
+        else if (!planComplete && line[0] == 'P')
+        {
+            PowerRenameStep step;
+            size_t parentStart = line.find('\t');
+            size_t fromStart = parentStart == std::string::npos ? parentStart : line.find('\t', parentStart + 1);
+            size_t toStart = fromStart == std::string::npos ? fromStart : line.find('\t', fromStart + 1);
+            if (!(fields >> step.item) || toStart == std::string::npos ||
+                !Unescape(line.substr(parentStart + 1, fromStart - parentStart - 1), step.parent) ||
+                !Unescape(line.substr(fromStart + 1, toStart - fromStart - 1), step.from) ||
+                !Unescape(line.substr(toStart + 1), step.to))
+            {
+                return false;
+            }
+            plan.steps.push_back(step);
+        }
+        else if (!planComplete && line == "B")
+        {
+            planComplete = true;
+            states.assign(plan.steps.size(), PowerRenameStepState::Pending);
+        }
+        else if (planComplete)
+        {
+            size_t step = 0;
+            if (!(fields >> step) || step >= states.size())
+            {
+                return false;
+            }
+
+            switch (line[0])
+            {
+            case 'S':
+                states[step] = PowerRenameStepState::Started;
+                break;
+            case 'D':
+                states[step] = PowerRenameStepState::Done;
+                break;
+            case 'X':
+                states[step] = PowerRenameStepState::Failed;
+                break;
+            case 'U':
+                states[step] = PowerRenameStepState::RolledBack;
+                break;
+            default:
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+    file.close();
+
+    if (!planComplete)
+    {
+        return false;
+    }
+
+    std::error_code error;
+    if (cutOffAt >= 0)
+    {
+        fs::resize_file(path, static_cast<std::uintmax_t>(cutOffAt), error);
+    }
+
+    m_path = path;
+    m_file.close();
+    m_file.open(path, std::ios::binary | std::ios::app);
+    return !error && !!m_file;
+}
+
+void CPowerRenameJournal::LogState(_In_ size_t step, _In_ PowerRenameStepState state)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    _Write(std::string(GetStateCode(state)) + " " + std::to_string(step));
+}
+
+void CPowerRenameJournal::Remove()
+{
+    m_file.close();
+
+    std::error_code error;
+    fs::remove(m_path, error);
+}
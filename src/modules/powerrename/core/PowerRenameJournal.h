@@ -0,0 +1,36 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameCommit.h"
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Write-ahead log of a commit.  Holds the plan followed by a record written before and
+// one written after every step, so a batch that was interrupted can be rolled back or
+// resumed from the journal alone.  Records are lines of UTF-8 text, flushed as they
+// are written.  The Log methods are thread safe.
+class CPowerRenameJournal
+{
+public:
+    // Creates the journal at path, replacing an existing one, and writes the plan
+    bool Create(_In_ const std::filesystem::path& path, _In_ const PowerRenamePlan& plan);
+
+    // Reads the plan and the last recorded state of every step from the journal at path
+    // and keeps it open to append to.  Fails when the plan wasn't written completely,
+    // in which case no step was started either.
+    bool Open(_In_ const std::filesystem::path& path, _Out_ PowerRenamePlan& plan, _Out_ std::vector<PowerRenameStepState>& states);
+
+    void LogState(_In_ size_t step, _In_ PowerRenameStepState state);
+
+    // Closes and deletes the journal once the batch needs no more recovery
+    void Remove();
+
+private:
+    void _Write(_In_ const std::string& record);
+
+    std::filesystem::path m_path;
+    std::mutex m_lock;
+    std::ofstream m_file;
+};
@@ -0,0 +1,263 @@
+#include "PowerRenameMatcher.h"
+#include "LinearRegEx.h"
+#include <iterator>
+
+std::unique_ptr<CPowerRenameMatcher> CPowerRenameMatcher::s_Create(_In_ const wchar_t* pattern, _In_ std::uint32_t flags, _In_ PowerRenameRegExEngine engine,
+    _In_ std::chrono::steady_clock::duration matchBudget)
+{
+    std::unique_ptr<CPowerRenameMatcher> matcher;
+
+    bool caseInsensitive = !(flags & CaseSensitive);
+    if (engine == LinearRegExEngine)
+    {
+        matcher = CLinearRegExMatcher::s_Compile(pattern, caseInsensitive);
+    }
+
+    if (!matcher)
+    {
+        // Fall back to std::wregex for patterns the linear engine doesn't support.
+        // It also reports the syntax errors.
+        try
+        {
+            matcher = std::make_unique<CStdRegExMatcher>(pattern, caseInsensitive, matchBudget);
+        }
+        catch (std::regex_error e)
+        {
+        }
+    }
+
+    return matcher;
+}
+
+std::wstring CPowerRenameMatcher::ReplaceAll(_In_ std::wstring_view source, _In_ std::wstring_view format) const
+{
+    std::vector<PowerRenameMatch> matches;
+    FindAll(source, matches);
+
+    std::wstring result;
+    size_t pos = 0;
+    for (const auto& match : matches)
+    {
+        result.append(source, pos, match.captures[0].first - pos);
+        s_AppendFormat(source, match, format, result);
+        pos = match.captures[0].second;
+    }
+
+    result.append(source, pos, std::wstring::npos);
+    return result;
+}
+
+PowerRenameMatch& CPowerRenameMatcher::s_NextMatch(_Inout_ std::vector<PowerRenameMatch>& matches, _Inout_ size_t& matchCount)
+{
+    if (matchCount == matches.size())
+    {
+        matches.emplace_back();
+    }
+    return matches[matchCount++];
+}
+
+// Expands an ECMAScript replacement format the way std::regex_replace does
+void CPowerRenameMatcher::s_AppendFormat(_In_ std::wstring_view source, _In_ const PowerRenameMatch& match,
+    _In_ std::wstring_view format, _Inout_ std::wstring& result)
+{
+    const MatchCaptures& captures = match.captures;
+    auto appendGroup = [&](size_t group) {
+        if (group < captures.size() && captures[group].first != std::wstring::npos)
+        {
+            result.append(source, captures[group].first, captures[group].second - captures[group].first);
+        }
+    };
+
+    for (size_t i = 0; i < format.size(); i++)
+    {
+        wchar_t ch = format[i];
+        if (ch != L'$' || i + 1 >= format.size())
+        {
+            result.push_back(ch);
+            continue;
+        }
+
+        wchar_t next = format[i + 1];
+        if (next == L'$')
+        {
+            result.push_back(L'$');
+            i++;
+        }
+        else if (next == L'&')
+        {
+            appendGroup(0);
+            i++;
+        }
+        else if (next == L'`')
+        {
+            result.append(source, match.searchStart, captures[0].first - match.searchStart);
+            i++;
+        }
+        else if (next == L'\'')
+        {
+            result.append(source, captures[0].second, std::wstring::npos);
+            i++;
+        }
+        else if (next >= L'0' && next <= L'9')
+        {
+            // Like std::regex_replace, a second digit is always part of the group number
+            size_t group = next - L'0';
+            i++;
+            if (i + 1 < format.size() && format[i + 1] >= L'0' && format[i + 1] <= L'9')
+            {
+                group = group * 10 + (format[i + 1] - L'0');
+                i++;
+            }
+            appendGroup(group);
+        }
+        else
+        {
+            result.push_back(ch);
+        }
+    }
+}
+
+// Steps a search takes between two looks at the clock
+#define MATCH_BUDGET_CHECK_STEPS 1024
+
+// Deadline of a single search, shared by the iterators std::regex_search copies
+class CMatchBudget
+{
+public:
+    CMatchBudget(_In_ std::chrono::steady_clock::duration budget) :
+        m_deadline(std::chrono::steady_clock::now() + budget)
+    {
+    }
+
+    void Step()
+    {
+        if (++m_steps % MATCH_BUDGET_CHECK_STEPS == 0 && std::chrono::steady_clock::now() > m_deadline)
+        {
+            throw std::regex_error(std::regex_constants::error_complexity);
+        }
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_deadline;
+    size_t m_steps = 0;
+};
+
+// Iterator over the source that counts every move the backtracking engine makes
+// against the budget of the search.  That is the only way to stop std::regex_search
+// part way.
+class CBudgetIterator
+{
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = wchar_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const wchar_t*;
+    using reference = const wchar_t&;
+
+    CBudgetIterator() = default;
+    CBudgetIterator(_In_ const wchar_t* pos, _In_ CMatchBudget* budget) :
+        m_pos(pos), m_budget(budget)
+    {
+    }
+
+    reference operator*() const { return *m_pos; }
+    pointer operator->() const { return m_pos; }
+    const wchar_t* base() const { return m_pos; }
+
+    CBudgetIterator& operator++()
+    {
+        m_pos++;
+        m_budget->Step();
+        return *this;
+    }
+
+    CBudgetIterator operator++(int)
+    {
+        CBudgetIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    CBudgetIterator& operator--()
+    {
+        m_pos--;
+        m_budget->Step();
+        return *this;
+    }
+
+    CBudgetIterator operator--(int)
+    {
+        CBudgetIterator previous = *this;
+        --*this;
+        return previous;
+    }
+
+    bool operator==(_In_ const CBudgetIterator& other) const { return m_pos == other.m_pos; }
+    bool operator!=(_In_ const CBudgetIterator& other) const { return m_pos != other.m_pos; }
+
+private:
+    const wchar_t* m_pos = nullptr;
+    CMatchBudget* m_budget = nullptr;
+};
+
+typedef std::match_results<CBudgetIterator> BudgetMatch;
+
+CStdRegExMatcher::CStdRegExMatcher(_In_ const wchar_t* pattern, _In_ bool caseInsensitive, _In_ std::chrono::steady_clock::duration matchBudget) :
+    m_regex(pattern, caseInsensitive ? std::regex_constants::icase | std::regex_constants::ECMAScript : std::regex_constants::ECMAScript),
+    m_matchBudget(matchBudget)
+{
+}
+
+// Converts the groups of a std::wcmatch to offsets from the beginning of the source.
+// offset is where the searched range starts in the source.
+static void GetCaptures(_In_ const BudgetMatch& match, _In_ size_t offset, _Out_ MatchCaptures& captures)
+{
+    captures.resize(match.size());
+    for (size_t group = 0; group < match.size(); group++)
+    {
+        if (match[group].matched)
+        {
+            size_t groupStart = offset + static_cast<size_t>(match.position(group));
+            captures[group] = { groupStart, groupStart + static_cast<size_t>(match.length(group)) };
+        }
+        else
+        {
+            captures[group] = { std::wstring::npos, std::wstring::npos };
+        }
+    }
+}
+
+bool CStdRegExMatcher::Search(_In_ std::wstring_view source, _In_ size_t start, _Out_ MatchCaptures& captures) const
+{
+    captures.clear();
+
+    CMatchBudget budget(m_matchBudget);
+    BudgetMatch match;
+    auto flags = (start > 0) ? std::regex_constants::match_prev_avail : std::regex_constants::match_default;
+    if (!std::regex_search(CBudgetIterator(source.data() + start, &budget), CBudgetIterator(source.data() + source.size(), &budget), match, m_regex, flags))
+    {
+        return false;
+    }
+
+    GetCaptures(match, start, captures);
+    return true;
+}
+
+void CStdRegExMatcher::FindAll(_In_ std::wstring_view source, _Out_ std::vector<PowerRenameMatch>& matches) const
+{
+    size_t matchCount = 0;
+
+    // Walk the matches with the same iterator std::regex_replace uses.  Its prefix is
+    // what $` expands to.  The budget covers every match in the source.
+    CMatchBudget budget(m_matchBudget);
+    CBudgetIterator first(source.data(), &budget);
+    CBudgetIterator last(source.data() + source.size(), &budget);
+    for (std::regex_iterator<CBudgetIterator> it(first, last, m_regex), end; it != end; ++it)
+    {
+        PowerRenameMatch& match = s_NextMatch(matches, matchCount);
+        match.searchStart = static_cast<size_t>(it->prefix().first.base() - source.data());
+        GetCaptures(*it, 0, match.captures);
+    }
+
+    matches.resize(matchCount);
+}
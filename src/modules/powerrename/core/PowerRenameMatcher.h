@@ -0,0 +1,65 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameTypes.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Time a backtracking search of one name may take before it is given up
+#define DEFAULT_MATCH_BUDGET std::chrono::milliseconds(100)
+
+// Compiled search pattern used by CPowerRenameSearch.  Implementations are immutable
+// once built so a single instance can be shared by every concurrent Match call.
+class CPowerRenameMatcher
+{
+public:
+    virtual ~CPowerRenameMatcher() = default;
+
+    // Finds the leftmost match starting at or after start.  offsets in captures are
+    // relative to the beginning of source.
+    virtual bool Search(_In_ std::wstring_view source, _In_ size_t start, _Out_ MatchCaptures& captures) const = 0;
+
+    // Finds every match in source in the order std::regex_replace would replace them.
+    // The entries already in matches are overwritten so their storage is reused.
+    virtual void FindAll(_In_ std::wstring_view source, _Out_ std::vector<PowerRenameMatch>& matches) const = 0;
+
+    // Replaces every match in source using ECMAScript format rules ($&, $n, $$...).
+    std::wstring ReplaceAll(_In_ std::wstring_view source, _In_ std::wstring_view format) const;
+
+    // Appends format with its $ references expanded for a single match
+    static void s_AppendFormat(_In_ std::wstring_view source, _In_ const PowerRenameMatch& match,
+        _In_ std::wstring_view format, _Inout_ std::wstring& result);
+
+    // Returns the next entry of matches to fill in, reusing one left from a previous
+    // search when there is one.  matches is trimmed to matchCount once the search is done.
+    static PowerRenameMatch& s_NextMatch(_Inout_ std::vector<PowerRenameMatch>& matches, _Inout_ size_t& matchCount);
+
+    // Returns nullptr when pattern is not a valid regular expression.  matchBudget
+    // bounds each search of a backtracking matcher.
+    static std::unique_ptr<CPowerRenameMatcher> s_Create(_In_ const wchar_t* pattern, _In_ std::uint32_t flags, _In_ PowerRenameRegExEngine engine,
+        _In_ std::chrono::steady_clock::duration matchBudget = DEFAULT_MATCH_BUDGET);
+};
+
+// Backtracking matcher built on std::wregex.  Used when explicitly selected and
+// as the fallback for patterns the linear engine does not support.
+//
+// A search that takes longer than matchBudget throws std::regex_error with
+// error_complexity, like MSVC's std::regex does for searches that are too complex.
+class CStdRegExMatcher : public CPowerRenameMatcher
+{
+public:
+    CStdRegExMatcher(_In_ const wchar_t* pattern, _In_ bool caseInsensitive,
+        _In_ std::chrono::steady_clock::duration matchBudget = DEFAULT_MATCH_BUDGET);
+
+    bool Search(_In_ std::wstring_view source, _In_ size_t start, _Out_ MatchCaptures& captures) const override;
+    void FindAll(_In_ std::wstring_view source, _Out_ std::vector<PowerRenameMatch>& matches) const override;
+
+private:
+    std::wregex m_regex;
+    std::chrono::steady_clock::duration m_matchBudget;
+};
@@ -0,0 +1,262 @@
+#include "PowerRenameMetadata.h"
+#include "PowerRenameNaming.h"
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+
+// Exif tags, from the TIFF 6.0 and Exif 2.3 specifications
+#define TIFF_TAG_DATE_TIME 0x0132
+#define TIFF_TAG_EXIF_IFD 0x8769
+#define EXIF_TAG_DATE_TIME_ORIGINAL 0x9003
+#define TIFF_TYPE_ASCII 2
+#define TIFF_TYPE_LONG 4
+// "YYYY:MM:DD HH:MM:SS" and its terminator
+#define EXIF_DATE_TIME_LENGTH 20
+
+bool MayHaveExifHeader(_In_ std::wstring_view name)
+{
+    static const wchar_t* s_extensions[] = { L".jpg", L".jpeg", L".jpe", L".tif", L".tiff" };
+
+    std::wstring_view extension = name.substr(GetExtensionStart(name));
+    for (const wchar_t* candidate : s_extensions)
+    {
+        std::wstring_view expected(candidate);
+        bool same = extension.size() == expected.size();
+        for (size_t i = 0; same && i < extension.size(); i++)
+        {
+            same = static_cast<wchar_t>(std::towlower(extension[i])) == expected[i];
+        }
+
+        if (same)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bounds checked reads from a TIFF block in the byte order its header gives
+class CTiffReader
+{
+public:
+    CTiffReader(_In_ const unsigned char* data, _In_ size_t size) :
+        m_data(data), m_size(size)
+    {
+    }
+
+    bool ReadByteOrder()
+    {
+        if (m_size < 8)
+        {
+            return false;
+        }
+
+        if (m_data[0] == 'I' && m_data[1] == 'I')
+        {
+            m_bigEndian = false;
+        }
+        else if (m_data[0] == 'M' && m_data[1] == 'M')
+        {
+            m_bigEndian = true;
+        }
+        else
+        {
+            return false;
+        }
+
+        std::uint32_t magic = 0;
+        return Read16(2, magic) && magic == 42;
+    }
+
+    bool Read16(_In_ size_t offset, _Out_ std::uint32_t& value) const
+    {
+        value = 0;
+        if (offset > m_size || m_size - offset < 2)
+        {
+            return false;
+        }
+
+        const unsigned char* bytes = m_data + offset;
+        value = m_bigEndian ? (bytes[0] << 8) | bytes[1] : (bytes[1] << 8) | bytes[0];
+        return true;
+    }
+
+    bool Read32(_In_ size_t offset, _Out_ std::uint32_t& value) const
+    {
+        std::uint32_t high = 0;
+        std::uint32_t low = 0;
+        bool read = m_bigEndian ? (Read16(offset, high) && Read16(offset + 2, low)) : (Read16(offset, low) && Read16(offset + 2, high));
+        value = (high << 16) | low;
+        return read;
+    }
+
+    // Finds tag among the entries of the IFD at offset and returns where its value is,
+    // inline or at the offset the entry holds
+    bool FindTag(_In_ size_t ifd, _In_ std::uint32_t tag, _In_ std::uint32_t type, _In_ std::uint32_t count, _Out_ size_t& value) const
+    {
+        value = 0;
+        std::uint32_t entryCount = 0;
+        if (!Read16(ifd, entryCount))
+        {
+            return false;
+        }
+
+        for (std::uint32_t i = 0; i < entryCount; i++)
+        {
+            size_t entry = ifd + 2 + i * 12;
+            std::uint32_t entryTag = 0;
+            std::uint32_t entryType = 0;
+            std::uint32_t valueCount = 0;
+            if (!Read16(entry, entryTag) || !Read16(entry + 2, entryType) || !Read32(entry + 4, valueCount))
+            {
+                return false;
+            }
+
+            if (entryTag == tag)
+            {
+                if (entryType != type || valueCount < count)
+                {
+                    return false;
+                }
+
+                // Values of up to 4 bytes are stored in the entry itself
+                size_t bytes = type == TIFF_TYPE_LONG ? 4 * static_cast<size_t>(count) : count;
+                std::uint32_t offset = static_cast<std::uint32_t>(entry + 8);
+                if (bytes > 4 && !Read32(entry + 8, offset))
+                {
+                    return false;
+                }
+                value = offset;
+                return offset <= m_size && m_size - offset >= bytes;
+            }
+        }
+        return false;
+    }
+
+    const unsigned char* Data() const { return m_data; }
+
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+    bool m_bigEndian = false;
+};
+
+// Parses "YYYY:MM:DD HH:MM:SS".  Cameras that don't know the time write zeros or spaces.
+static bool ParseExifDateTime(_In_ const unsigned char* text, _Out_ PowerRenameDateTime& dateTime)
+{
+    static const struct
+    {
+        size_t offset;
+        size_t digits;
+        unsigned int minimum;
+        unsigned int maximum;
+    } s_fields[] = {
+        { 0, 4, 1, 9999 },
+        { 5, 2, 1, 12 },
+        { 8, 2, 1, 31 },
+        { 11, 2, 0, 23 },
+        { 14, 2, 0, 59 },
+        { 17, 2, 0, 60 },
+    };
+
+    unsigned int values[6] = { 0 };
+    for (size_t i = 0; i < 6; i++)
+    {
+        for (size_t digit = 0; digit < s_fields[i].digits; digit++)
+        {
+            unsigned char ch = text[s_fields[i].offset + digit];
+            if (ch < '0' || ch > '9')
+            {
+                return false;
+            }
+            values[i] = values[i] * 10 + (ch - '0');
+        }
+
+        if (values[i] < s_fields[i].minimum || values[i] > s_fields[i].maximum)
+        {
+            return false;
+        }
+    }
+
+    dateTime.year = values[0];
+    dateTime.month = values[1];
+    dateTime.day = values[2];
+    dateTime.hour = values[3];
+    dateTime.minute = values[4];
+    dateTime.second = values[5];
+    return true;
+}
+
+static bool ParseTiffDateTaken(_In_ const unsigned char* data, _In_ size_t size, _Out_ PowerRenameDateTime& taken)
+{
+    CTiffReader reader(data, size);
+    std::uint32_t ifd0 = 0;
+    if (!reader.ReadByteOrder() || !reader.Read32(4, ifd0))
+    {
+        return false;
+    }
+
+    size_t value = 0;
+    std::uint32_t exifIfd = 0;
+    if (reader.FindTag(ifd0, TIFF_TAG_EXIF_IFD, TIFF_TYPE_LONG, 1, value) && reader.Read32(value, exifIfd) &&
+        reader.FindTag(exifIfd, EXIF_TAG_DATE_TIME_ORIGINAL, TIFF_TYPE_ASCII, EXIF_DATE_TIME_LENGTH, value) &&
+        ParseExifDateTime(reader.Data() + value, taken))
+    {
+        return true;
+    }
+
+    return reader.FindTag(ifd0, TIFF_TAG_DATE_TIME, TIFF_TYPE_ASCII, EXIF_DATE_TIME_LENGTH, value) &&
+           ParseExifDateTime(reader.Data() + value, taken);
+}
+
+bool ParseExifDateTaken(_In_ const unsigned char* header, _In_ size_t size, _Out_ PowerRenameDateTime& taken)
+{
+    taken = PowerRenameDateTime();
+    if (size < 4)
+    {
+        return false;
+    }
+
+    // TIFF files are a TIFF block from the start
+    if (header[0] != 0xFF || header[1] != 0xD8)
+    {
+        return ParseTiffDateTaken(header, size, taken);
+    }
+
+    // JPEG files keep it in an APP1 segment that starts with "Exif\0\0".  The segments
+    // before the image data are walked until it turns up.
+    static const unsigned char s_exifId[] = { 'E', 'x', 'i', 'f', 0, 0 };
+    size_t pos = 2;
+    while (pos + 4 <= size && header[pos] == 0xFF)
+    {
+        unsigned char marker = header[pos + 1];
+        if (marker == 0xFF)
+        {
+            // Fill byte
+            pos++;
+            continue;
+        }
+
+        // Start of scan and end of image, no metadata follows
+        if (marker == 0xDA || marker == 0xD9)
+        {
+            break;
+        }
+
+        size_t length = (header[pos + 2] << 8) | header[pos + 3];
+        if (length < 2)
+        {
+            break;
+        }
+
+        size_t segment = pos + 4;
+        size_t segmentSize = (std::min)(length - 2, size - segment);
+        if (marker == 0xE1 && segmentSize > sizeof(s_exifId) &&
+            std::equal(s_exifId, s_exifId + sizeof(s_exifId), header + segment))
+        {
+            return ParseTiffDateTaken(header + segment + sizeof(s_exifId), segmentSize - sizeof(s_exifId), taken);
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameTypes.h"
+#include <cstddef>
+#include <string_view>
+
+// Bytes at the start of a file the date taken is looked for in.  Cameras write the
+// Exif block right after the start of the image, well within this.
+#define POWERRENAME_METADATA_HEADER_SIZE (64 * 1024)
+
+// Returns true for names of the file types that carry Exif data, JPEG and TIFF.  Only
+// their headers are worth reading.
+bool MayHaveExifHeader(_In_ std::wstring_view name);
+
+// Reads the date a picture was taken from the Exif data in the first size bytes of a
+// JPEG or TIFF file.  Falls back to the date the picture was last changed.  Returns
+// false when the header has neither.
+bool ParseExifDateTaken(_In_ const unsigned char* header, _In_ size_t size, _Out_ PowerRenameDateTime& taken);
@@ -0,0 +1,102 @@
+#include "PowerRenameNameIndex.h"
+#include "PowerRenameNaming.h"
+
+// Only called with m_lock held.  Lists a folder the first time a name is looked up in
+// it, unless its contents were enumerated.
+CPowerRenameNameIndex::Folder& CPowerRenameNameIndex::_GetFolder(_In_ const std::wstring& parent, _In_ bool load)
+{
+    Folder& folder = m_folders[FoldName(parent)];
+    if (load && !folder.complete && !folder.loaded && m_loader)
+    {
+        folder.loaded = true;
+
+        std::vector<std::wstring> names;
+        m_loader(parent, names);
+        for (const auto& name : names)
+        {
+            folder.existing.insert(FoldName(name));
+        }
+    }
+    return folder;
+}
+
+bool CPowerRenameNameIndex::_IsTaken(_In_ const Folder& folder, _In_ const std::wstring& foldedName)
+{
+    return folder.existing.find(foldedName) != folder.existing.end() ||
+           folder.reserved.find(foldedName) != folder.reserved.end();
+}
+
+void CPowerRenameNameIndex::AddName(_In_ const std::wstring& parent, _In_ std::wstring_view name)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    _GetFolder(parent, false).existing.insert(FoldName(name));
+}
+
+void CPowerRenameNameIndex::AddFolder(_In_ const std::wstring& folder)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    _GetFolder(folder, false).complete = true;
+}
+
+bool CPowerRenameNameIndex::IsTaken(_In_ const std::wstring& parent, _In_ std::wstring_view name)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return _IsTaken(_GetFolder(parent, true), FoldName(name));
+}
+
+bool CPowerRenameNameIndex::Reserve(_In_ const std::wstring& parent, _In_ std::wstring_view name)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Folder& folder = _GetFolder(parent, true);
+    std::wstring foldedName = FoldName(name);
+    if (_IsTaken(folder, foldedName))
+    {
+        return false;
+    }
+
+    folder.reserved.insert(std::move(foldedName));
+    return true;
+}
+
+bool CPowerRenameNameIndex::ReserveEnumeratedName(
+    _In_ const std::wstring& parent,
+    _In_ std::wstring_view currentName,
+    _In_ std::wstring_view templateName,
+    _In_ unsigned long minNumber,
+    _In_ size_t maxLength,
+    _Out_ std::wstring& uniqueName,
+    _Out_ unsigned long* numberUsed)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Folder& folder = _GetFolder(parent, true);
+    std::wstring foldedCurrentName = FoldName(currentName);
+
+    // The candidates are checked and the winner reserved under the same lock so two
+    // items can't end up with the same name
+    std::wstring foldedName;
+    bool found = GetEnumeratedName(templateName, minNumber, maxLength, [&](const std::wstring& name) {
+        foldedName = FoldName(name);
+        return foldedName != foldedCurrentName && _IsTaken(folder, foldedName);
+    }, uniqueName, numberUsed);
+
+    if (found)
+    {
+        folder.reserved.insert(std::move(foldedName));
+    }
+    return found;
+}
+
+void CPowerRenameNameIndex::ClearReservations()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto& folder : m_folders)
+    {
+        folder.second.reserved.clear();
+    }
+}
+
+void CPowerRenameNameIndex::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_folders.clear();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "CorePlatform.h"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Names in use per folder, so numbered names can be picked without asking the file
+// system about every candidate.  The names come from the items that were enumerated;
+// a folder whose contents weren't enumerated is listed once through the loader.
+// Names are compared case insensitively.  All methods are thread safe.
+class CPowerRenameNameIndex
+{
+public:
+    // Appends the names of the entries in parent to names
+    using Loader = std::function<void(const std::wstring& parent, std::vector<std::wstring>& names)>;
+
+    explicit CPowerRenameNameIndex(_In_ Loader loader = nullptr) :
+        m_loader(std::move(loader))
+    {
+    }
+
+    // Records an existing entry of parent
+    void AddName(_In_ const std::wstring& parent, _In_ std::wstring_view name);
+
+    // Marks the contents of folder as complete: every entry in it is added with AddName,
+    // so the loader isn't needed for it
+    void AddFolder(_In_ const std::wstring& folder);
+
+    // Returns true when name exists in parent or was reserved
+    bool IsTaken(_In_ const std::wstring& parent, _In_ std::wstring_view name);
+
+    // Takes name in parent unless it is taken.  Returns false when it was.
+    bool Reserve(_In_ const std::wstring& parent, _In_ std::wstring_view name);
+
+    // Numbers templateName like GetEnumeratedName with the first number from minNumber
+    // up that gives a name that isn't taken in parent, and reserves the name.  The
+    // current name of the item is never taken by the item itself.
+    bool ReserveEnumeratedName(
+        _In_ const std::wstring& parent,
+        _In_ std::wstring_view currentName,
+        _In_ std::wstring_view templateName,
+        _In_ unsigned long minNumber,
+        _In_ size_t maxLength,
+        _Out_ std::wstring& uniqueName,
+        _Out_ unsigned long* numberUsed);
+
+    // Frees every reserved name, for a new preview
+    void ClearReservations();
+
+    // Forgets every name and folder
+    void Clear();
+
+private:
+    struct Folder
+    {
+        std::unordered_set<std::wstring> existing;
+        std::unordered_set<std::wstring> reserved;
+        bool complete = false;
+        bool loaded = false;
+    };
+
+    Folder& _GetFolder(_In_ const std::wstring& parent, _In_ bool load);
+    static bool _IsTaken(_In_ const Folder& folder, _In_ const std::wstring& foldedName);
+
+    Loader m_loader;
+    std::mutex m_lock;
+    std::unordered_map<std::wstring, Folder> m_folders;
+};
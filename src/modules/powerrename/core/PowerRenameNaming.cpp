@@ -0,0 +1,174 @@
+#include "PowerRenameNaming.h"
+#include "PowerRenameTypes.h"
+#include <algorithm>
+#include <cwctype>
+
+size_t GetExtensionStart(_In_ std::wstring_view name)
+{
+    size_t dot = name.rfind(L'.');
+    if (dot == std::wstring_view::npos || dot == 0 || name == L"..")
+    {
+        return name.size();
+    }
+    return dot;
+}
+
+std::wstring_view GetMatchSource(_In_ std::wstring_view name, _In_ std::uint32_t flags)
+{
+    size_t extensionStart = GetExtensionStart(name);
+    if (flags & NameOnly)
+    {
+        return name.substr(0, extensionStart);
+    }
+    else if (flags & ExtensionOnly)
+    {
+        // Without the dot
+        return name.substr((std::min)(extensionStart + 1, name.size()));
+    }
+    return name;
+}
+
+bool ComposeNewName(_In_ std::wstring_view originalName, _In_ std::uint32_t flags, _Inout_ std::wstring& newName)
+{
+    size_t extensionStart = GetExtensionStart(originalName);
+    if (flags & NameOnly)
+    {
+        newName.append(originalName.substr(extensionStart));
+    }
+    else if (flags & ExtensionOnly)
+    {
+        if (extensionStart < originalName.size())
+        {
+            newName.insert(0, originalName.substr(0, extensionStart + 1));
+        }
+        else
+        {
+            newName = originalName;
+        }
+    }
+
+    if (newName.size() >= POWERRENAME_MAX_PATH)
+    {
+        newName.resize(POWERRENAME_MAX_PATH - 1);
+    }
+
+    return originalName != newName;
+}
+
+bool IsExcluded(_In_ bool isFolder, _In_ bool isSubFolderContent, _In_ std::uint32_t flags)
+{
+    return (isFolder && (flags & ExcludeFolders)) ||
+           (!isFolder && (flags & ExcludeFiles)) ||
+           (isSubFolderContent && (flags & ExcludeSubfolders));
+}
+
+std::wstring FoldName(_In_ std::wstring_view name)
+{
+    std::wstring folded(name);
+    for (auto& ch : folded)
+    {
+        ch = static_cast<wchar_t>(std::towlower(ch));
+    }
+    return folded;
+}
+
+// Same rules as PathFindExtension: the last dot of the name unless a space follows it
+static size_t FindTemplateExtension(_In_ std::wstring_view name)
+{
+    size_t extension = name.size();
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        if (name[i] == L'.')
+        {
+            extension = i;
+        }
+        else if (name[i] == L' ' || name[i] == L'\\' || name[i] == L'/')
+        {
+            extension = name.size();
+        }
+    }
+    return extension;
+}
+
+bool GetEnumeratedName(
+    _In_ std::wstring_view templateName,
+    _In_ unsigned long minNumber,
+    _In_ size_t maxLength,
+    _In_ const std::function<bool(const std::wstring&)>& isTaken,
+    _Out_ std::wstring& uniqueName,
+    _Out_ unsigned long* numberUsed)
+{
+    uniqueName.clear();
+    *numberUsed = 0;
+
+    // Look for a number in parentheses to replace, "name (1).ext"
+    size_t rest = std::wstring_view::npos;
+    for (size_t open = templateName.find(L'('); open != std::wstring_view::npos; open = templateName.find(L'(', open + 1))
+    {
+        size_t endDigits = open + 1;
+        while (endDigits < templateName.size() && templateName[endDigits] >= L'0' && templateName[endDigits] <= L'9')
+        {
+            endDigits++;
+        }
+
+        if (endDigits < templateName.size() && templateName[endDigits] == L')')
+        {
+            rest = open;
+            break;
+        }
+    }
+
+    std::wstring_view stem;
+    std::wstring_view prefix;
+    std::wstring_view suffix;
+    if (rest == std::wstring_view::npos)
+    {
+        rest = FindTemplateExtension(templateName);
+        stem = templateName.substr(0, rest);
+        prefix = L" (";
+        suffix = L")";
+    }
+    else
+    {
+        rest++;
+        stem = templateName.substr(0, rest);
+        while (rest < templateName.size() && templateName[rest] >= L'0' && templateName[rest] <= L'9')
+        {
+            rest++;
+        }
+    }
+
+    // Bound the number by the digits that still fit
+    long long digits = static_cast<long long>(maxLength) - static_cast<long long>(stem.size() + prefix.size() + suffix.size());
+    unsigned long maxNumber = 1000000;
+    if (digits <= 0)
+    {
+        maxNumber = minNumber;
+    }
+    else if (digits < 6)
+    {
+        maxNumber = 1;
+        while (digits-- > 0)
+        {
+            maxNumber *= 10;
+        }
+    }
+
+    std::wstring candidate;
+    for (unsigned long number = minNumber; number < maxNumber; number++)
+    {
+        candidate.assign(stem);
+        candidate.append(prefix);
+        candidate.append(std::to_wstring(number));
+        candidate.append(suffix);
+        candidate.append(templateName.substr(rest));
+        if (candidate.size() < maxLength && !(isTaken && isTaken(candidate)))
+        {
+            uniqueName = std::move(candidate);
+            *numberUsed = number;
+            return true;
+        }
+    }
+
+    return false;
+}
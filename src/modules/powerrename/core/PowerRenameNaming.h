@@ -0,0 +1,40 @@
+#pragma once
+#include "CorePlatform.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Longest name, including the terminator, that the Windows shell accepts.  New names
+// are limited to it on every platform so a preview looks the same everywhere.
+#define POWERRENAME_MAX_PATH 260
+
+// Returns where the extension of a file name starts, or the length of the name when it
+// has none.  Follows std::filesystem::path so a leading dot is part of the stem.
+size_t GetExtensionStart(_In_ std::wstring_view name);
+
+// Returns the part of name the search term is matched against for the given flags
+std::wstring_view GetMatchSource(_In_ std::wstring_view name, _In_ std::uint32_t flags);
+
+// Turns the substituted match source in newName into the full new name by putting back
+// the parts of originalName that NameOnly or ExtensionOnly left out.  Returns false when
+// the new name is the same as the original one.
+bool ComposeNewName(_In_ std::wstring_view originalName, _In_ std::uint32_t flags, _Inout_ std::wstring& newName);
+
+// Returns true when the exclude flags skip an item
+bool IsExcluded(_In_ bool isFolder, _In_ bool isSubFolderContent, _In_ std::uint32_t flags);
+
+// Lower cases a name so names that only differ in case compare equal, the way NTFS
+// compares them by default
+std::wstring FoldName(_In_ std::wstring_view name);
+
+// Numbers a name the way Explorer does, "name (n).ext", or replaces the number in a
+// name that already has one in parentheses.  Tries numbers from minNumber up until
+// isTaken returns false for the result.  The name has at most maxLength - 1 characters.
+bool GetEnumeratedName(
+    _In_ std::wstring_view templateName,
+    _In_ unsigned long minNumber,
+    _In_ size_t maxLength,
+    _In_ const std::function<bool(const std::wstring&)>& isTaken,
+    _Out_ std::wstring& uniqueName,
+    _Out_ unsigned long* numberUsed);
@@ -0,0 +1,534 @@
+#include "PowerRenameRegExAnalyzer.h"
+#include <climits>
+#include <utility>
+#include <vector>
+
+// Characters a part of the pattern can start with.  ASCII letters are kept in both
+// cases so the overlap check holds with and without CaseSensitive.
+struct RegExFirstChars
+{
+    bool any = false;
+    std::vector<std::pair<wchar_t, wchar_t>> ranges;
+
+    bool IsEmpty() const
+    {
+        return !any && ranges.empty();
+    }
+
+    void AddRange(_In_ wchar_t first, _In_ wchar_t last)
+    {
+        ranges.push_back({ first, last });
+        _AddOtherCase(first, last, L'A', L'Z', L'a');
+        _AddOtherCase(first, last, L'a', L'z', L'A');
+    }
+
+    void Add(_In_ const RegExFirstChars& other)
+    {
+        any = any || other.any;
+        ranges.insert(ranges.end(), other.ranges.begin(), other.ranges.end());
+    }
+
+    bool Overlaps(_In_ const RegExFirstChars& other) const
+    {
+        if ((any && !other.IsEmpty()) || (other.any && !IsEmpty()))
+        {
+            return true;
+        }
+
+        for (const auto& range : ranges)
+        {
+            for (const auto& otherRange : other.ranges)
+            {
+                if (range.first <= otherRange.second && otherRange.first <= range.second)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    void _AddOtherCase(_In_ wchar_t first, _In_ wchar_t last, _In_ wchar_t caseFirst, _In_ wchar_t caseLast, _In_ wchar_t otherCaseFirst)
+    {
+        wchar_t overlapFirst = first > caseFirst ? first : caseFirst;
+        wchar_t overlapLast = last < caseLast ? last : caseLast;
+        if (overlapFirst <= overlapLast)
+        {
+            ranges.push_back({ static_cast<wchar_t>(otherCaseFirst + (overlapFirst - caseFirst)), static_cast<wchar_t>(otherCaseFirst + (overlapLast - caseFirst)) });
+        }
+    }
+};
+
+// What a part of the pattern can match, as far as the risks are concerned
+struct RegExFragment
+{
+    // Can match the empty string
+    bool nullable = true;
+    // Contains a quantifier that can repeat more than once
+    bool repeats = false;
+    // Contains a quantifier without an upper bound
+    bool unbounded = false;
+    // Contains an alternation whose alternatives can match the same text
+    bool ambiguous = false;
+    RegExFirstChars first;
+
+    // Adds the fragment that follows this one in a sequence
+    void Append(_In_ const RegExFragment& next)
+    {
+        if (nullable)
+        {
+            first.Add(next.first);
+        }
+        nullable = nullable && next.nullable;
+        repeats = repeats || next.repeats;
+        unbounded = unbounded || next.unbounded;
+        ambiguous = ambiguous || next.ambiguous;
+    }
+};
+
+// Recursive descent over the ECMAScript syntax std::wregex accepts.  Only keeps track of
+// what the checks need, it doesn't validate the pattern.
+class CRegExPatternScanner
+{
+public:
+    CRegExPatternScanner(_In_ std::wstring_view pattern) :
+        m_pattern(pattern)
+    {
+    }
+
+    PowerRenameRegExAnalysis Scan()
+    {
+        while (m_pos < m_pattern.size())
+        {
+            _ParseAlternation();
+
+            // Stopped at a ) without a matching (
+            m_pos++;
+        }
+        return m_analysis;
+    }
+
+private:
+    bool _AtEnd() const
+    {
+        return m_pos >= m_pattern.size();
+    }
+
+    void _Report(_In_ PowerRenameRegExRisk risk, _In_ size_t position)
+    {
+        if (m_analysis.risk == NoRegExRisk)
+        {
+            m_analysis.risk = risk;
+            m_analysis.position = position;
+        }
+    }
+
+    RegExFragment _ParseAlternation()
+    {
+        std::vector<RegExFragment> alternatives;
+        alternatives.push_back(_ParseSequence());
+        while (!_AtEnd() && m_pattern[m_pos] == L'|')
+        {
+            m_pos++;
+            alternatives.push_back(_ParseSequence());
+        }
+
+        if (alternatives.size() == 1)
+        {
+            return alternatives[0];
+        }
+
+        RegExFragment alternation;
+        alternation.nullable = false;
+        for (size_t i = 0; i < alternatives.size(); i++)
+        {
+            const RegExFragment& alternative = alternatives[i];
+            for (size_t j = 0; j < i; j++)
+            {
+                if ((alternative.nullable && alternatives[j].nullable) || alternative.first.Overlaps(alternatives[j].first))
+                {
+                    alternation.ambiguous = true;
+                }
+            }
+
+            alternation.nullable = alternation.nullable || alternative.nullable;
+            alternation.repeats = alternation.repeats || alternative.repeats;
+            alternation.unbounded = alternation.unbounded || alternative.unbounded;
+            alternation.ambiguous = alternation.ambiguous || alternative.ambiguous;
+            alternation.first.Add(alternative.first);
+        }
+        return alternation;
+    }
+
+    RegExFragment _ParseSequence()
+    {
+        RegExFragment sequence;
+        while (!_AtEnd() && m_pattern[m_pos] != L'|' && m_pattern[m_pos] != L')')
+        {
+            RegExFragment atom = _ParseAtom();
+            _ParseQuantifier(atom);
+            sequence.Append(atom);
+        }
+        return sequence;
+    }
+
+    RegExFragment _ParseAtom()
+    {
+        RegExFragment atom;
+        wchar_t ch = m_pattern[m_pos++];
+        switch (ch)
+        {
+        case L'(':
+        {
+            bool lookahead = false;
+            if (m_pattern.compare(m_pos, 2, L"?:") == 0)
+            {
+                m_pos += 2;
+            }
+            else if (m_pattern.compare(m_pos, 2, L"?=") == 0 || m_pattern.compare(m_pos, 2, L"?!") == 0)
+            {
+                lookahead = true;
+                m_pos += 2;
+            }
+
+            atom = _ParseAlternation();
+            if (!_AtEnd())
+            {
+                m_pos++;
+            }
+
+            // A lookahead doesn't consume what it matches
+            if (lookahead)
+            {
+                atom.nullable = true;
+                atom.first = RegExFirstChars();
+            }
+            return atom;
+        }
+
+        case L'^':
+        case L'$':
+            return atom;
+
+        case L'.':
+            atom.first.any = true;
+            break;
+
+        case L'[':
+            _ParseClass(atom.first);
+            break;
+
+        case L'\\':
+            if (!_AtEnd())
+            {
+                ch = m_pattern[m_pos++];
+                if (ch == L'b' || ch == L'B')
+                {
+                    return atom;
+                }
+
+                if (ch >= L'1' && ch <= L'9')
+                {
+                    // A backreference matches whatever its group did, maybe nothing
+                    while (!_AtEnd() && m_pattern[m_pos] >= L'0' && m_pattern[m_pos] <= L'9')
+                    {
+                        m_pos++;
+                    }
+                    atom.first.any = true;
+                    return atom;
+                }
+
+                if (!_AddEscapedSet(ch, atom.first))
+                {
+                    ch = _ReadEscapedChar(ch);
+                    atom.first.AddRange(ch, ch);
+                }
+                break;
+            }
+            atom.first.AddRange(ch, ch);
+            break;
+
+        default:
+            atom.first.AddRange(ch, ch);
+            break;
+        }
+
+        atom.nullable = false;
+        return atom;
+    }
+
+    void _ParseQuantifier(_Inout_ RegExFragment& atom)
+    {
+        if (_AtEnd())
+        {
+            return;
+        }
+
+        size_t quantifierStart = m_pos;
+        unsigned int min = 1;
+        unsigned int max = 1;
+        switch (m_pattern[m_pos])
+        {
+        case L'*':
+            min = 0;
+            max = UINT_MAX;
+            m_pos++;
+            break;
+        case L'+':
+            max = UINT_MAX;
+            m_pos++;
+            break;
+        case L'?':
+            min = 0;
+            m_pos++;
+            break;
+        case L'{':
+            if (!_ParseBounds(min, max))
+            {
+                // Read as a literal {
+                return;
+            }
+            break;
+        default:
+            return;
+        }
+
+        // Lazy quantifiers try the same ways to match, only in another order
+        if (!_AtEnd() && m_pattern[m_pos] == L'?')
+        {
+            m_pos++;
+        }
+
+        bool repeats = max > 1;
+        bool unbounded = max == UINT_MAX;
+        if (repeats && (atom.unbounded || (unbounded && atom.repeats)))
+        {
+            _Report(NestedQuantifierRisk, quantifierStart);
+        }
+        else if (repeats && atom.ambiguous)
+        {
+            _Report(AmbiguousAlternationRisk, quantifierStart);
+        }
+
+        atom.nullable = atom.nullable || min == 0;
+        atom.repeats = atom.repeats || repeats;
+        atom.unbounded = atom.unbounded || unbounded;
+    }
+
+    // Reads {n}, {n,} or {n,m}.  Leaves the position alone when there is none.
+    bool _ParseBounds(_Out_ unsigned int& min, _Out_ unsigned int& max)
+    {
+        size_t pos = m_pos + 1;
+        auto readNumber = [&](unsigned int& value) {
+            size_t start = pos;
+            value = 0;
+            while (pos < m_pattern.size() && m_pattern[pos] >= L'0' && m_pattern[pos] <= L'9')
+            {
+                value = value < UINT_MAX / 10 ? value * 10 + (m_pattern[pos] - L'0') : UINT_MAX - 1;
+                pos++;
+            }
+            return pos > start;
+        };
+
+        if (!readNumber(min))
+        {
+            return false;
+        }
+
+        max = min;
+        if (pos < m_pattern.size() && m_pattern[pos] == L',')
+        {
+            pos++;
+            if (!readNumber(max))
+            {
+                max = UINT_MAX;
+            }
+        }
+
+        if (pos >= m_pattern.size() || m_pattern[pos] != L'}')
+        {
+            return false;
+        }
+
+        m_pos = pos + 1;
+        return true;
+    }
+
+    void _ParseClass(_Inout_ RegExFirstChars& first)
+    {
+        bool negated = !_AtEnd() && m_pattern[m_pos] == L'^';
+        if (negated)
+        {
+            m_pos++;
+        }
+
+        RegExFirstChars members;
+        while (!_AtEnd() && m_pattern[m_pos] != L']')
+        {
+            wchar_t low = 0;
+            if (!_ParseClassChar(members, low))
+            {
+                continue;
+            }
+
+            wchar_t high = low;
+            if (m_pos + 1 < m_pattern.size() && m_pattern[m_pos] == L'-' && m_pattern[m_pos + 1] != L']')
+            {
+                m_pos++;
+                if (!_ParseClassChar(members, high) || high < low)
+                {
+                    // Not a range after all, the - is a member of its own
+                    members.AddRange(L'-', L'-');
+                    high = low;
+                }
+            }
+            members.AddRange(low, high);
+        }
+
+        if (!_AtEnd())
+        {
+            m_pos++;
+        }
+
+        // A negated class can start with almost anything
+        if (negated)
+        {
+            first.any = true;
+        }
+        else
+        {
+            first.Add(members);
+        }
+    }
+
+    // Reads a member of a class.  Returns false when it was a set such as \d, which
+    // is added to members.
+    bool _ParseClassChar(_Inout_ RegExFirstChars& members, _Out_ wchar_t& ch)
+    {
+        ch = m_pattern[m_pos++];
+        if (ch != L'\\' || _AtEnd())
+        {
+            return true;
+        }
+
+        ch = m_pattern[m_pos++];
+        if (_AddEscapedSet(ch, members))
+        {
+            return false;
+        }
+
+        ch = (ch == L'b') ? L'\b' : _ReadEscapedChar(ch);
+        return true;
+    }
+
+    // Adds the characters of \d, \w, \s and their negations
+    bool _AddEscapedSet(_In_ wchar_t ch, _Inout_ RegExFirstChars& chars)
+    {
+        switch (ch)
+        {
+        case L'd':
+            chars.AddRange(L'0', L'9');
+            return true;
+        case L'w':
+            chars.AddRange(L'0', L'9');
+            chars.AddRange(L'A', L'Z');
+            chars.AddRange(L'_', L'_');
+            return true;
+        case L's':
+            chars.AddRange(L'\t', L'\r');
+            chars.AddRange(L' ', L' ');
+            chars.AddRange(0xA0, 0xA0);
+            chars.AddRange(0x2000, 0x200A);
+            chars.AddRange(0x2028, 0x2029);
+            chars.AddRange(0x3000, 0x3000);
+            chars.AddRange(0xFEFF, 0xFEFF);
+            return true;
+        case L'D':
+        case L'W':
+        case L'S':
+            chars.any = true;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Returns the character an escape other than a set stands for
+    wchar_t _ReadEscapedChar(_In_ wchar_t ch)
+    {
+        auto readHex = [&](size_t digitCount, wchar_t& value) {
+            if (m_pos + digitCount > m_pattern.size())
+            {
+                return false;
+            }
+
+            unsigned int result = 0;
+            for (size_t i = 0; i < digitCount; i++)
+            {
+                wchar_t digit = m_pattern[m_pos + i];
+                if (digit >= L'0' && digit <= L'9')
+                {
+                    result = result * 16 + (digit - L'0');
+                }
+                else if ((digit | 0x20) >= L'a' && (digit | 0x20) <= L'f')
+                {
+                    result = result * 16 + ((digit | 0x20) - L'a' + 10);
+                }
+                else
+                {
+                    return false;
+                }
+            }
+
+            m_pos += digitCount;
+            value = static_cast<wchar_t>(result);
+            return true;
+        };
+
+        wchar_t value = ch;
+        switch (ch)
+        {
+        case L'x':
+            readHex(2, value);
+            break;
+        case L'u':
+            readHex(4, value);
+            break;
+        case L'c':
+            if (!_AtEnd() && ((m_pattern[m_pos] | 0x20) >= L'a' && (m_pattern[m_pos] | 0x20) <= L'z'))
+            {
+                value = static_cast<wchar_t>(m_pattern[m_pos++] % 32);
+            }
+            break;
+        case L'0':
+            value = L'\0';
+            break;
+        case L't':
+            value = L'\t';
+            break;
+        case L'n':
+            value = L'\n';
+            break;
+        case L'v':
+            value = L'\v';
+            break;
+        case L'f':
+            value = L'\f';
+            break;
+        case L'r':
+            value = L'\r';
+            break;
+        }
+        return value;
+    }
+
+    std::wstring_view m_pattern;
+    size_t m_pos = 0;
+    PowerRenameRegExAnalysis m_analysis;
+};
+
+PowerRenameRegExAnalysis AnalyzeRegExPattern(_In_ std::wstring_view pattern)
+{
+    return CRegExPatternScanner(pattern).Scan();
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameTypes.h"
+#include <string>
+#include <string_view>
+
+// What AnalyzeRegExPattern found.  position is the offset in the pattern of the
+// quantifier that repeats the risky part, or npos when there is no risk.
+struct PowerRenameRegExAnalysis
+{
+    PowerRenameRegExRisk risk = NoRegExRisk;
+    size_t position = std::wstring::npos;
+};
+
+// Looks for the shapes of pattern that make a backtracking engine try an exponential
+// number of ways to match before it fails: a repeated part that is itself repeated and
+// a repeated alternation whose alternatives can start with the same character.  The
+// check is conservative, some patterns it reports only backtrack a little.  Invalid
+// patterns are analyzed as far as they can be read.
+PowerRenameRegExAnalysis AnalyzeRegExPattern(_In_ std::wstring_view pattern);
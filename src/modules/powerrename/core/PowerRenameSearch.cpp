@@ -0,0 +1,187 @@
+#include "PowerRenameSearch.h"
+#include <algorithm>
+
+bool CPowerRenameSearch::SetSearchTerm(_In_ std::wstring_view searchTerm)
+{
+    if (m_searchTerm == searchTerm)
+    {
+        return false;
+    }
+
+    m_searchTerm = searchTerm;
+    _Compile();
+    return true;
+}
+
+bool CPowerRenameSearch::SetReplaceTerm(_In_ std::wstring_view replaceTerm)
+{
+    if (m_replaceTerm == replaceTerm)
+    {
+        return false;
+    }
+
+    m_replaceTerm = replaceTerm;
+    m_regExTemplate.Compile(m_replaceTerm, true);
+    m_plainTemplate.Compile(m_replaceTerm, false);
+    return true;
+}
+
+bool CPowerRenameSearch::SetFlags(_In_ std::uint32_t flags)
+{
+    if (m_flags == flags)
+    {
+        return false;
+    }
+
+    m_flags = flags;
+    _Compile();
+    return true;
+}
+
+bool CPowerRenameSearch::SetEngine(_In_ PowerRenameRegExEngine engine)
+{
+    if (m_engine == engine)
+    {
+        return false;
+    }
+
+    m_engine = engine;
+    _Compile();
+    return true;
+}
+
+bool CPowerRenameSearch::SetMatchBudget(_In_ std::chrono::steady_clock::duration matchBudget)
+{
+    if (m_matchBudget == matchBudget)
+    {
+        return false;
+    }
+
+    m_matchBudget = matchBudget;
+    _Compile();
+    return true;
+}
+
+bool CPowerRenameSearch::Match(_In_ std::wstring_view source, _Inout_ PowerRenameMatches& matches) const
+{
+    matches.expandReplaceTerm = false;
+    matches.timedOut = false;
+    size_t matchCount = 0;
+
+    // The pattern is compiled when the search term or flags change.  A missing
+    // matcher means the search term is empty or not a valid regular expression.
+    bool succeeded = !source.empty() && ((m_flags & UseRegularExpressions) ? m_matcher != nullptr : m_literalSearcher != nullptr);
+    if (succeeded)
+    {
+        try
+        {
+            if (m_flags & UseRegularExpressions)
+            {
+                if (m_flags & MatchAllOccurences)
+                {
+                    matches.expandReplaceTerm = true;
+                    m_matcher->FindAll(source, matches.matches);
+                    matchCount = matches.matches.size();
+                }
+                else
+                {
+                    // The replace term is used as is in place of the search term's
+                    // length of text at the first match.
+                    PowerRenameMatch& match = CPowerRenameMatcher::s_NextMatch(matches.matches, matchCount);
+                    if (m_matcher->Search(source, 0, match.captures))
+                    {
+                        size_t matchStart = match.captures[0].first;
+                        size_t matchEnd = (std::min)(matchStart + m_searchTerm.length(), source.length());
+                        match.searchStart = 0;
+                        match.captures.resize(1);
+                        match.captures[0] = { matchStart, matchEnd };
+                    }
+                    else
+                    {
+                        matchCount--;
+                    }
+                }
+            }
+            else
+            {
+                // Simple search
+                size_t pos = 0;
+                do
+                {
+                    pos = m_literalSearcher->Find(source, pos);
+                    if (pos != std::wstring::npos)
+                    {
+                        PowerRenameMatch& match = CPowerRenameMatcher::s_NextMatch(matches.matches, matchCount);
+                        match.searchStart = pos;
+                        match.captures.resize(1);
+                        match.captures[0] = { pos, pos + m_searchTerm.length() };
+                        pos += m_searchTerm.length();
+                    }
+
+                    if (!(m_flags & MatchAllOccurences))
+                    {
+                        break;
+                    }
+                } while (pos != std::wstring::npos);
+            }
+        }
+        catch (std::regex_error e)
+        {
+            succeeded = false;
+            matchCount = 0;
+            matches.timedOut = e.code() == std::regex_constants::error_complexity;
+        }
+    }
+
+    matches.matches.resize(matchCount);
+    return succeeded;
+}
+
+void CPowerRenameSearch::Substitute(_In_ std::wstring_view source, _In_ const PowerRenameMatches& matches, _Out_ std::wstring& result) const
+{
+    Substitute(source, matches, PowerRenameTemplateContext(), result);
+}
+
+void CPowerRenameSearch::Substitute(_In_ std::wstring_view source, _In_ const PowerRenameMatches& matches,
+    _In_ const PowerRenameTemplateContext& context, _Out_ std::wstring& result) const
+{
+    // Assigned rather than replaced so the caller's buffer is reused
+    result.clear();
+
+    const CPowerRenameTemplate& replaceTemplate = matches.expandReplaceTerm ? m_regExTemplate : m_plainTemplate;
+    size_t pos = 0;
+    for (const auto& match : matches.matches)
+    {
+        result.append(source, pos, match.captures[0].first - pos);
+        replaceTemplate.Append(source, match, context, result);
+        pos = match.captures[0].second;
+    }
+    result.append(source, pos, std::wstring::npos);
+}
+
+void CPowerRenameSearch::_Compile()
+{
+    m_matcher.reset();
+    m_literalSearcher.reset();
+    m_regExAnalysis = PowerRenameRegExAnalysis();
+    if (!m_searchTerm.empty())
+    {
+        if (m_flags & UseRegularExpressions)
+        {
+            // The linear engine takes patterns that could backtrack for a long time even
+            // when std::wregex was selected.  It finds the same matches, empty ones
+            // included, and only the captures of a quantified group that can match an
+            // empty string may differ.  Patterns it doesn't support are left to
+            // std::wregex and the match budget.
+            m_regExAnalysis = AnalyzeRegExPattern(m_searchTerm);
+            PowerRenameRegExEngine engine = (m_regExAnalysis.risk != NoRegExRisk) ? LinearRegExEngine : m_engine;
+
+            // On failure the matcher is left empty and Match reports it for every item
+            m_matcher = CPowerRenameMatcher::s_Create(m_searchTerm.c_str(), m_flags, engine, m_matchBudget);
+        }
+        else
+        {
+            m_literalSearcher = std::make_unique<CLiteralSearcher>(m_searchTerm.c_str(), !(m_flags & CaseSensitive));
+        }
+    }
+}
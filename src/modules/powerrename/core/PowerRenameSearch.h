@@ -0,0 +1,74 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameTypes.h"
+#include "PowerRenameMatcher.h"
+#include "PowerRenameRegExAnalyzer.h"
+#include "PowerRenameTemplate.h"
+#include "LiteralSearcher.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#define DEFAULT_FLAGS MatchAllOccurences
+
+// Search term, replace term and flags of a rename along with the matcher and the
+// template compiled for them.  Both are rebuilt whenever a setter changes something
+// they depend on so Match and Substitute only run them.
+//
+// Not synchronized.  Match and Substitute only read so they can be called from any
+// number of threads as long as no setter runs at the same time.
+class CPowerRenameSearch
+{
+public:
+    const std::wstring& GetSearchTerm() const { return m_searchTerm; }
+    const std::wstring& GetReplaceTerm() const { return m_replaceTerm; }
+    std::uint32_t GetFlags() const { return m_flags; }
+    PowerRenameRegExEngine GetEngine() const { return m_engine; }
+    std::chrono::steady_clock::duration GetMatchBudget() const { return m_matchBudget; }
+
+    // What AnalyzeRegExPattern found in the search term when it is a regular expression
+    const PowerRenameRegExAnalysis& GetRegExAnalysis() const { return m_regExAnalysis; }
+
+    // PowerRenameTemplateUsage flags of the tokens in the replace term
+    std::uint32_t GetTemplateUsage() const { return m_regExTemplate.GetUsage() | m_plainTemplate.GetUsage(); }
+
+    // The setters return true when the value changed
+    bool SetSearchTerm(_In_ std::wstring_view searchTerm);
+    bool SetReplaceTerm(_In_ std::wstring_view replaceTerm);
+    bool SetFlags(_In_ std::uint32_t flags);
+    bool SetEngine(_In_ PowerRenameRegExEngine engine);
+    bool SetMatchBudget(_In_ std::chrono::steady_clock::duration matchBudget);
+
+    // Finds the matches of the search term in source.  Returns false when there is
+    // nothing to search, the search term is not a valid regular expression or the
+    // search took longer than the match budget.  matches.timedOut tells the last apart.
+    bool Match(_In_ std::wstring_view source, _Inout_ PowerRenameMatches& matches) const;
+
+    // Builds the result of replacing matches in source with the replace term.  context
+    // gives the values of the counter and metadata tokens for the item.
+    void Substitute(_In_ std::wstring_view source, _In_ const PowerRenameMatches& matches, _Out_ std::wstring& result) const;
+    void Substitute(_In_ std::wstring_view source, _In_ const PowerRenameMatches& matches,
+        _In_ const PowerRenameTemplateContext& context, _Out_ std::wstring& result) const;
+
+private:
+    void _Compile();
+
+    std::wstring m_searchTerm;
+    std::wstring m_replaceTerm;
+    std::uint32_t m_flags = DEFAULT_FLAGS;
+    PowerRenameRegExEngine m_engine = LinearRegExEngine;
+    std::chrono::steady_clock::duration m_matchBudget = DEFAULT_MATCH_BUDGET;
+    PowerRenameRegExAnalysis m_regExAnalysis;
+
+    // Only one of these is set, depending on UseRegularExpressions.  Neither is set
+    // when the search term is empty or not a valid regular expression.
+    std::unique_ptr<CPowerRenameMatcher> m_matcher;
+    std::unique_ptr<CLiteralSearcher> m_literalSearcher;
+
+    // The replace term for regular expression matches, which expand $ references, and
+    // for plain text matches
+    CPowerRenameTemplate m_regExTemplate;
+    CPowerRenameTemplate m_plainTemplate;
+};
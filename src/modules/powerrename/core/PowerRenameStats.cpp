@@ -0,0 +1,217 @@
+#include "PowerRenameStats.h"
+#include <algorithm>
+#include <cstdio>
+
+// Search terms kept for the slowest pattern list.  Typing a search term runs a pass per
+// keystroke so the fastest are dropped once there are more.
+#define MAX_TRACKED_PATTERNS 64
+
+static const char* GetPhaseName(_In_ PowerRenamePhase phase)
+{
+    switch (phase)
+    {
+    case PowerRenamePhase::Enumerate:
+        return "enumerate";
+    case PowerRenamePhase::Match:
+        return "match";
+    case PowerRenamePhase::Number:
+        return "number";
+    default:
+        return "commit";
+    }
+}
+
+static void UpdateMax(_Inout_ std::atomic<std::uint64_t>& max, _In_ std::uint64_t value)
+{
+    std::uint64_t current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+// Writes text as a JSON string in UTF-8 whatever the size of wchar_t
+static void AppendJsonString(_In_ const std::wstring& text, _Inout_ std::string& out)
+{
+    out += '"';
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        std::uint32_t ch = static_cast<std::uint32_t>(text[i]);
+        if (sizeof(wchar_t) == 2 && ch >= 0xD800 && ch < 0xDC00 && i + 1 < text.size())
+        {
+            std::uint32_t low = static_cast<std::uint32_t>(text[i + 1]);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+        }
+
+        if (ch == '"' || ch == '\\')
+        {
+            out += '\\';
+            out += static_cast<char>(ch);
+        }
+        else if (ch < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+            out += escaped;
+        }
+        else if (ch < 0x80)
+        {
+            out += static_cast<char>(ch);
+        }
+        else if (ch < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (ch >> 6));
+            out += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else if (ch < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (ch >> 12));
+            out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (ch >> 18));
+            out += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+    }
+    out += '"';
+}
+
+static std::uint64_t GetNsPerItem(_In_ std::uint64_t totalNs, _In_ std::uint64_t items)
+{
+    return items ? totalNs / items : 0;
+}
+
+void CPowerRenameStats::AddPhaseTime(_In_ PowerRenamePhase phase, _In_ std::chrono::nanoseconds elapsed)
+{
+    PhaseTime& phaseTime = m_phases[static_cast<size_t>(phase)];
+    std::uint64_t ns = static_cast<std::uint64_t>(elapsed.count());
+    phaseTime.runs.fetch_add(1, std::memory_order_relaxed);
+    phaseTime.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    UpdateMax(phaseTime.maxNs, ns);
+}
+
+void CPowerRenameStats::AddMatchTime(_In_ std::chrono::nanoseconds elapsed)
+{
+    std::uint64_t ns = static_cast<std::uint64_t>((std::max)(elapsed.count(), static_cast<std::chrono::nanoseconds::rep>(0)));
+    size_t bucket = 0;
+    while (bucket + 1 < POWERRENAME_MATCH_TIME_BUCKETS && ns >= (1ull << bucket))
+    {
+        bucket++;
+    }
+    m_matchTimes[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CPowerRenameStats::AddPatternPass(_In_ const std::wstring& searchTerm, _In_ std::uint32_t flags, _In_ size_t itemCount, _In_ std::chrono::nanoseconds matchTime)
+{
+    std::lock_guard<std::mutex> lock(m_patternLock);
+    auto it = std::find_if(m_patterns.begin(), m_patterns.end(), [&](const PatternTime& pattern) {
+        return pattern.flags == flags && pattern.searchTerm == searchTerm;
+    });
+    if (it == m_patterns.end())
+    {
+        if (m_patterns.size() == MAX_TRACKED_PATTERNS)
+        {
+            auto fastest = std::min_element(m_patterns.begin(), m_patterns.end(), [](const PatternTime& left, const PatternTime& right) {
+                return GetNsPerItem(left.totalNs, left.items) < GetNsPerItem(right.totalNs, right.items);
+            });
+            m_patterns.erase(fastest);
+        }
+
+        PatternTime pattern;
+        pattern.searchTerm = searchTerm;
+        pattern.flags = flags;
+        m_patterns.push_back(pattern);
+        it = m_patterns.end() - 1;
+    }
+
+    it->passes++;
+    it->items += itemCount;
+    it->totalNs += static_cast<std::uint64_t>(matchTime.count());
+}
+
+std::string CPowerRenameStats::ToJson() const
+{
+    std::string json = "{\"version\":1,\"phases\":{";
+    for (size_t i = 0; i < m_phases.size(); i++)
+    {
+        const PhaseTime& phaseTime = m_phases[i];
+        json += i ? ",\"" : "\"";
+        json += GetPhaseName(static_cast<PowerRenamePhase>(i));
+        json += "\":{\"runs\":" + std::to_string(phaseTime.runs.load()) +
+                ",\"totalNs\":" + std::to_string(phaseTime.totalNs.load()) +
+                ",\"maxNs\":" + std::to_string(phaseTime.maxNs.load()) + "}";
+    }
+
+    json += "},\"counters\":{\"itemsScanned\":" + std::to_string(m_itemsScanned.load()) +
+            ",\"itemsMatched\":" + std::to_string(m_itemsMatched.load()) +
+            ",\"itemsRenamed\":" + std::to_string(m_itemsRenamed.load()) + "}";
+
+    json += ",\"matchTimeHistogram\":[";
+    bool first = true;
+    for (size_t i = 0; i < m_matchTimes.size(); i++)
+    {
+        std::uint64_t items = m_matchTimes[i].load();
+        if (items == 0)
+        {
+            continue;
+        }
+
+        std::uint64_t lessThanNs = i + 1 < m_matchTimes.size() ? (1ull << i) : 0;
+        json += first ? "" : ",";
+        json += "{\"lessThanNs\":" + std::to_string(lessThanNs) + ",\"items\":" + std::to_string(items) + "}";
+        first = false;
+    }
+
+    std::vector<PatternTime> patterns;
+    {
+        std::lock_guard<std::mutex> lock(m_patternLock);
+        patterns = m_patterns;
+    }
+    std::stable_sort(patterns.begin(), patterns.end(), [](const PatternTime& left, const PatternTime& right) {
+        return GetNsPerItem(left.totalNs, left.items) > GetNsPerItem(right.totalNs, right.items);
+    });
+    patterns.resize((std::min)(patterns.size(), static_cast<size_t>(POWERRENAME_SLOWEST_PATTERNS)));
+
+    json += "],\"slowestPatterns\":[";
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+        const PatternTime& pattern = patterns[i];
+        json += i ? ",{\"searchTerm\":" : "{\"searchTerm\":";
+        AppendJsonString(pattern.searchTerm, json);
+        json += ",\"flags\":" + std::to_string(pattern.flags) +
+                ",\"passes\":" + std::to_string(pattern.passes) +
+                ",\"items\":" + std::to_string(pattern.items) +
+                ",\"totalNs\":" + std::to_string(pattern.totalNs) +
+                ",\"nsPerItem\":" + std::to_string(GetNsPerItem(pattern.totalNs, pattern.items)) + "}";
+    }
+    json += "]}";
+
+    return json;
+}
+
+void CPowerRenameStats::Reset()
+{
+    for (auto& phaseTime : m_phases)
+    {
+        phaseTime.runs = 0;
+        phaseTime.totalNs = 0;
+        phaseTime.maxNs = 0;
+    }
+    for (auto& matchTime : m_matchTimes)
+    {
+        matchTime = 0;
+    }
+    m_itemsScanned = 0;
+    m_itemsMatched = 0;
+    m_itemsRenamed = 0;
+
+    std::lock_guard<std::mutex> lock(m_patternLock);
+    m_patterns.clear();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameTypes.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Number of buckets of the match time histogram.  Bucket i counts the items matched in
+// less than 2^i nanoseconds, the last one every item that took longer.
+#define POWERRENAME_MATCH_TIME_BUCKETS 32
+
+// Number of search terms the export lists, slowest per item first
+#define POWERRENAME_SLOWEST_PATTERNS 5
+
+// Where the time of a rename session goes: how long each phase took, how long matching
+// a single item takes, which search terms are the slowest and how many items were
+// scanned, matched and renamed.  The Add methods are thread safe and cheap enough to
+// call for every item from the pool threads.
+class CPowerRenameStats
+{
+public:
+    void AddPhaseTime(_In_ PowerRenamePhase phase, _In_ std::chrono::nanoseconds elapsed);
+
+    // Records the time it took to match and substitute one item
+    void AddMatchTime(_In_ std::chrono::nanoseconds elapsed);
+
+    // Records a pass of a search term over itemCount items that took matchTime in all
+    void AddPatternPass(_In_ const std::wstring& searchTerm, _In_ std::uint32_t flags, _In_ size_t itemCount, _In_ std::chrono::nanoseconds matchTime);
+
+    void AddItemsScanned(_In_ size_t count) { m_itemsScanned += count; }
+    void AddItemsMatched(_In_ size_t count) { m_itemsMatched += count; }
+    void AddItemsRenamed(_In_ size_t count) { m_itemsRenamed += count; }
+
+    // Returns everything recorded so far as a JSON object in UTF-8:
+    //   { "version": 1,
+    //     "phases": { "enumerate": { "runs", "totalNs", "maxNs" }, "match", "number", "commit" },
+    //     "counters": { "itemsScanned", "itemsMatched", "itemsRenamed" },
+    //     "matchTimeHistogram": [ { "lessThanNs", "items" }, ... ],
+    //     "slowestPatterns": [ { "searchTerm", "flags", "passes", "items", "totalNs", "nsPerItem" }, ... ] }
+    // Empty histogram buckets are left out.  The last bucket has no upper bound and
+    // reports lessThanNs as 0.
+    std::string ToJson() const;
+
+    void Reset();
+
+private:
+    struct PhaseTime
+    {
+        std::atomic<std::uint64_t> runs = 0;
+        std::atomic<std::uint64_t> totalNs = 0;
+        std::atomic<std::uint64_t> maxNs = 0;
+    };
+
+    struct PatternTime
+    {
+        std::wstring searchTerm;
+        std::uint32_t flags = 0;
+        std::uint64_t passes = 0;
+        std::uint64_t items = 0;
+        std::uint64_t totalNs = 0;
+    };
+
+    std::array<PhaseTime, static_cast<size_t>(PowerRenamePhase::Count)> m_phases;
+    std::array<std::atomic<std::uint64_t>, POWERRENAME_MATCH_TIME_BUCKETS> m_matchTimes = {};
+    std::atomic<std::uint64_t> m_itemsScanned = 0;
+    std::atomic<std::uint64_t> m_itemsMatched = 0;
+    std::atomic<std::uint64_t> m_itemsRenamed = 0;
+
+    mutable std::mutex m_patternLock;
+    std::vector<PatternTime> m_patterns;
+};
+
+// Adds the time from its construction to its destruction to a phase
+class CPowerRenamePhaseTimer
+{
+public:
+    CPowerRenamePhaseTimer(_In_ CPowerRenameStats& stats, _In_ PowerRenamePhase phase) :
+        m_stats(stats), m_phase(phase), m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~CPowerRenamePhaseTimer()
+    {
+        m_stats.AddPhaseTime(m_phase, std::chrono::steady_clock::now() - m_start);
+    }
+
+    CPowerRenamePhaseTimer(const CPowerRenamePhaseTimer&) = delete;
+    CPowerRenamePhaseTimer& operator=(const CPowerRenamePhaseTimer&) = delete;
+
+private:
+    CPowerRenameStats& m_stats;
+    PowerRenamePhase m_phase;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,350 @@
+#include "PowerRenameTemplate.h"
+#include <cwctype>
+
+// Appends value in decimal, zero padded to width, without going through a string
+static void AppendNumber(_In_ std::uint64_t value, _In_ std::uint32_t width, _Inout_ std::wstring& result)
+{
+    wchar_t digits[20];
+    size_t count = 0;
+    do
+    {
+        digits[count++] = static_cast<wchar_t>(L'0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    if (width > count)
+    {
+        result.append(width - count, L'0');
+    }
+    while (count > 0)
+    {
+        result.push_back(digits[--count]);
+    }
+}
+
+// Parses a whole field of decimal digits.  An empty field keeps value as it is.
+static bool ParseNumber(_In_ std::wstring_view field, _Inout_ size_t& value)
+{
+    if (field.empty())
+    {
+        return true;
+    }
+
+    size_t number = 0;
+    for (wchar_t ch : field)
+    {
+        if (ch < L'0' || ch > L'9' || number > (SIZE_MAX - 9) / 10)
+        {
+            return false;
+        }
+        number = number * 10 + (ch - L'0');
+    }
+    value = number;
+    return true;
+}
+
+// Splits off the part of text up to the next colon
+static std::wstring_view NextField(_Inout_ std::wstring_view& text)
+{
+    size_t colon = text.find(L':');
+    std::wstring_view field = text.substr(0, colon);
+    text.remove_prefix(colon == std::wstring_view::npos ? text.size() : colon + 1);
+    return field;
+}
+
+void CPowerRenameTemplate::Compile(_In_ std::wstring_view replaceTerm, _In_ bool expandReferences)
+{
+    m_program.clear();
+    m_text.clear();
+    m_usage = 0;
+
+    for (size_t i = 0; i < replaceTerm.size(); i++)
+    {
+        wchar_t ch = replaceTerm[i];
+        if (ch != L'$' || i + 1 >= replaceTerm.size())
+        {
+            _AppendText(replaceTerm.substr(i, 1));
+            continue;
+        }
+
+        wchar_t next = replaceTerm[i + 1];
+        if (next == L'{')
+        {
+            size_t end = replaceTerm.find(L'}', i + 2);
+            if (end != std::wstring_view::npos && _CompileToken(replaceTerm.substr(i + 2, end - i - 2)))
+            {
+                i = end;
+            }
+            else
+            {
+                _AppendText(replaceTerm.substr(i, end == std::wstring_view::npos ? std::wstring_view::npos : end - i + 1));
+                i = end == std::wstring_view::npos ? replaceTerm.size() : end;
+            }
+        }
+        else if (!expandReferences)
+        {
+            _AppendText(replaceTerm.substr(i, 1));
+        }
+        else if (next == L'$')
+        {
+            _AppendText(replaceTerm.substr(i, 1));
+            i++;
+        }
+        else if (next == L'&')
+        {
+            _AppendOp(Op::Group, 0);
+            i++;
+        }
+        else if (next == L'`')
+        {
+            _AppendOp(Op::Prefix);
+            i++;
+        }
+        else if (next == L'\'')
+        {
+            _AppendOp(Op::Suffix);
+            i++;
+        }
+        else if (next >= L'0' && next <= L'9')
+        {
+            // Like std::regex_replace, a second digit is always part of the group number
+            size_t group = next - L'0';
+            i++;
+            if (i + 1 < replaceTerm.size() && replaceTerm[i + 1] >= L'0' && replaceTerm[i + 1] <= L'9')
+            {
+                group = group * 10 + (replaceTerm[i + 1] - L'0');
+                i++;
+            }
+            _AppendOp(Op::Group, group);
+        }
+        else
+        {
+            _AppendText(replaceTerm.substr(i, 1));
+        }
+    }
+}
+
+void CPowerRenameTemplate::Append(_In_ std::wstring_view source, _In_ const PowerRenameMatch& match,
+    _In_ const PowerRenameTemplateContext& context, _Inout_ std::wstring& result) const
+{
+    const MatchCaptures& captures = match.captures;
+    const PowerRenameItemMetadata* metadata = (context.metadata && context.metadata->valid) ? context.metadata : nullptr;
+    const PowerRenameDateTime* modified = metadata ? &metadata->modified : nullptr;
+    const PowerRenameDateTime* taken = (metadata && metadata->hasTaken) ? &metadata->taken : nullptr;
+    for (const auto& instruction : m_program)
+    {
+        switch (instruction.op)
+        {
+        case Op::Text:
+            result.append(m_text, instruction.first, instruction.second);
+            break;
+        case Op::Group:
+            if (instruction.first < captures.size() && captures[instruction.first].first != std::wstring::npos)
+            {
+                size_t start = result.size();
+                result.append(source, captures[instruction.first].first, captures[instruction.first].second - captures[instruction.first].first);
+
+                bool wordStart = true;
+                for (size_t i = start; i < result.size() && instruction.transform != Transform::None; i++)
+                {
+                    wchar_t ch = result[i];
+                    bool upper = instruction.transform == Transform::Upper || (instruction.transform == Transform::Title && wordStart);
+                    result[i] = static_cast<wchar_t>(upper ? std::towupper(ch) : std::towlower(ch));
+                    wordStart = !std::iswalnum(ch);
+                }
+            }
+            break;
+        case Op::Prefix:
+            result.append(source, match.searchStart, captures[0].first - match.searchStart);
+            break;
+        case Op::Suffix:
+            result.append(source, captures[0].second, std::wstring::npos);
+            break;
+        case Op::Counter:
+        {
+            std::uint64_t place = context.counter ? context.counter - 1 : 0;
+            AppendNumber(instruction.first + place * instruction.second, instruction.width, result);
+            break;
+        }
+        case Op::Size:
+            if (metadata)
+            {
+                AppendNumber(metadata->size, 0, result);
+            }
+            break;
+        default:
+            if (const PowerRenameDateTime* date = instruction.taken ? taken : modified)
+            {
+                switch (instruction.op)
+                {
+                case Op::DateText:
+                    result.append(m_text, instruction.first, instruction.second);
+                    break;
+                case Op::Year:
+                    AppendNumber(date->year, 4, result);
+                    break;
+                case Op::ShortYear:
+                    AppendNumber(date->year % 100, 2, result);
+                    break;
+                case Op::Month:
+                    AppendNumber(date->month, 2, result);
+                    break;
+                case Op::Day:
+                    AppendNumber(date->day, 2, result);
+                    break;
+                case Op::Hour:
+                    AppendNumber(date->hour, 2, result);
+                    break;
+                case Op::Minute:
+                    AppendNumber(date->minute, 2, result);
+                    break;
+                default:
+                    AppendNumber(date->second, 2, result);
+                    break;
+                }
+            }
+            break;
+        }
+    }
+}
+
+void CPowerRenameTemplate::_AppendText(_In_ std::wstring_view text, _In_ Op op, _In_ bool taken)
+{
+    // Runs of text end up as a single instruction
+    if (!m_program.empty() && m_program.back().op == op && m_program.back().taken == taken)
+    {
+        m_program.back().second += text.size();
+    }
+    else
+    {
+        Instruction instruction;
+        instruction.op = op;
+        instruction.taken = taken;
+        instruction.first = m_text.size();
+        instruction.second = text.size();
+        m_program.push_back(instruction);
+    }
+    m_text.append(text);
+}
+
+void CPowerRenameTemplate::_AppendOp(_In_ Op op, _In_ size_t first, _In_ Transform transform)
+{
+    Instruction instruction;
+    instruction.op = op;
+    instruction.first = first;
+    instruction.transform = transform;
+    m_program.push_back(instruction);
+}
+
+bool CPowerRenameTemplate::_CompileToken(_In_ std::wstring_view token)
+{
+    std::wstring_view name = NextField(token);
+    if (name == L"counter")
+    {
+        size_t width = 0;
+        size_t start = 1;
+        size_t step = 1;
+        if (!ParseNumber(NextField(token), width) || !ParseNumber(NextField(token), start) ||
+            !ParseNumber(NextField(token), step) || !token.empty() || width > POWERRENAME_MAX_COUNTER_WIDTH)
+        {
+            return false;
+        }
+
+        Instruction instruction;
+        instruction.op = Op::Counter;
+        instruction.width = static_cast<std::uint32_t>(width);
+        instruction.first = start;
+        instruction.second = step;
+        m_program.push_back(instruction);
+        m_usage |= TemplateUsesCounter;
+        return true;
+    }
+
+    if (name == L"size" && token.empty())
+    {
+        _AppendOp(Op::Size);
+        m_usage |= TemplateUsesMetadata;
+        return true;
+    }
+
+    if (name == L"modified" || name == L"taken")
+    {
+        // The rest is the format, colons included
+        bool taken = name == L"taken";
+        _CompileDateFormat(token.empty() ? L"yyyy-MM-dd" : token, taken);
+        m_usage |= taken ? TemplateUsesHeader : TemplateUsesMetadata;
+        return true;
+    }
+
+    size_t group = 0;
+    if (name.empty() || (name != L"&" && !ParseNumber(name, group)))
+    {
+        return false;
+    }
+
+    Transform transform = Transform::None;
+    std::wstring_view transformName = NextField(token);
+    if (!token.empty())
+    {
+        return false;
+    }
+    else if (transformName == L"upper")
+    {
+        transform = Transform::Upper;
+    }
+    else if (transformName == L"lower")
+    {
+        transform = Transform::Lower;
+    }
+    else if (transformName == L"title")
+    {
+        transform = Transform::Title;
+    }
+    else if (!transformName.empty())
+    {
+        return false;
+    }
+
+    _AppendOp(Op::Group, group, transform);
+    return true;
+}
+
+void CPowerRenameTemplate::_CompileDateFormat(_In_ std::wstring_view format, _In_ bool taken)
+{
+    static const struct
+    {
+        const wchar_t* pattern;
+        Op op;
+    } s_parts[] = {
+        { L"yyyy", Op::Year },
+        { L"yy", Op::ShortYear },
+        { L"MM", Op::Month },
+        { L"dd", Op::Day },
+        { L"HH", Op::Hour },
+        { L"mm", Op::Minute },
+        { L"ss", Op::Second },
+    };
+
+    while (!format.empty())
+    {
+        bool found = false;
+        for (const auto& part : s_parts)
+        {
+            std::wstring_view pattern(part.pattern);
+            if (format.substr(0, pattern.size()) == pattern)
+            {
+                _AppendOp(part.op);
+                m_program.back().taken = taken;
+                format.remove_prefix(pattern.size());
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+        {
+            _AppendText(format.substr(0, 1), Op::DateText, taken);
+            format.remove_prefix(1);
+        }
+    }
+}
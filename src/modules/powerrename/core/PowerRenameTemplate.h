@@ -0,0 +1,98 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameTypes.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Widest a counter can be padded to
+#define POWERRENAME_MAX_COUNTER_WIDTH 20
+
+// Replace term compiled into a short program that is run for every match, so the term
+// is parsed once per change rather than once per item.
+//
+// Besides the text it stands for, a replace term can hold these tokens:
+//   ${n} ${&}                  capture group n or the whole match
+//   ${n:upper} ${n:lower} ${n:title}
+//                              the group with its case changed, title upper cases the
+//                              first letter of every word and lower cases the rest
+//   ${counter}                 the place of the item among the ones the search term
+//   ${counter:width:start:step} matched, zero padded to width, counting from start by step
+//   ${size}                    the size of the file in bytes
+//   ${modified} ${modified:format}
+//                              the local time the item was last written, yyyy-MM-dd
+//                              by default.  format takes yyyy, yy, MM, dd, HH, mm, ss.
+//   ${taken} ${taken:format}   the date the picture was taken, from its Exif data
+// Tokens that are not recognized are kept as they are.  When compiled for a regular
+// expression the $ references of std::regex_replace ($&, $n, $nn, $`, $' and $$) are
+// expanded too, the same way CPowerRenameMatcher::s_AppendFormat does.
+//
+// Immutable once compiled so Append can run on any number of threads at once.
+class CPowerRenameTemplate
+{
+public:
+    void Compile(_In_ std::wstring_view replaceTerm, _In_ bool expandReferences);
+
+    // PowerRenameTemplateUsage flags of the tokens in the template
+    std::uint32_t GetUsage() const { return m_usage; }
+
+    // Appends the template expanded for match, a match in source
+    void Append(_In_ std::wstring_view source, _In_ const PowerRenameMatch& match,
+        _In_ const PowerRenameTemplateContext& context, _Inout_ std::wstring& result) const;
+
+private:
+    enum class Op : std::uint8_t
+    {
+        // m_text from first, second characters
+        Text,
+        // The same for the text of a date format, left out with the date
+        DateText,
+        // Capture group first
+        Group,
+        // $` and $'
+        Prefix,
+        Suffix,
+        Counter,
+        Size,
+        Year,
+        ShortYear,
+        Month,
+        Day,
+        Hour,
+        Minute,
+        Second
+    };
+
+    enum class Transform : std::uint8_t
+    {
+        None,
+        Upper,
+        Lower,
+        Title
+    };
+
+    struct Instruction
+    {
+        Op op = Op::Text;
+        Transform transform = Transform::None;
+        // Date parts and date text of ${taken} rather than ${modified}
+        bool taken = false;
+        // Zero padding of the counter
+        std::uint32_t width = 0;
+        // Text offset, group number or counter start
+        size_t first = 0;
+        // Text length or counter step
+        size_t second = 0;
+    };
+
+    void _AppendText(_In_ std::wstring_view text, _In_ Op op = Op::Text, _In_ bool taken = false);
+    void _AppendOp(_In_ Op op, _In_ size_t first = 0, _In_ Transform transform = Transform::None);
+    bool _CompileToken(_In_ std::wstring_view token);
+    void _CompileDateFormat(_In_ std::wstring_view format, _In_ bool taken);
+
+    std::vector<Instruction> m_program;
+    // Literal parts of the template, the Text instructions point into it
+    std::wstring m_text;
+    std::uint32_t m_usage = 0;
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Types shared by the portable core and the COM objects built on top of it
+
+enum PowerRenameFlags
+{
+    CaseSensitive = 0x1,
+    MatchAllOccurences = 0x2,
+    UseRegularExpressions = 0x4,
+    EnumerateItems = 0x8,
+    ExcludeFiles = 0x10,
+    ExcludeFolders = 0x20,
+    ExcludeSubfolders = 0x40,
+    NameOnly = 0x80,
+    ExtensionOnly = 0x100
+};
+
+// Steps of a rename session that are timed separately
+enum class PowerRenamePhase
+{
+    // Reading the selected items and the contents of selected folders
+    Enumerate,
+    // Matching the search term and building the new names
+    Match,
+    // Numbering the new names and applying them to the items
+    Number,
+    // Renaming the items on disk
+    Commit,
+    Count
+};
+
+enum PowerRenameRegExEngine
+{
+    // Linear-time NFA matcher.  Falls back to std::wregex for unsupported patterns.
+    LinearRegExEngine = 0,
+    // Backtracking std::wregex matcher
+    StdRegExEngine = 1
+};
+
+// Why a search term could take exponential time in a backtracking regex engine
+enum PowerRenameRegExRisk
+{
+    NoRegExRisk = 0,
+    // A repeated part of the pattern is itself repeated, as in (a+)+
+    NestedQuantifierRisk = 1,
+    // A repeated alternation has alternatives that can match the same text, as in (a|ab)*
+    AmbiguousAlternationRisk = 2
+};
+
+// Start and end offsets of a match (index 0) and each of its capture groups.
+// Groups that did not participate in the match hold npos for both offsets.
+typedef std::vector<std::pair<size_t, size_t>> MatchCaptures;
+
+// A single match of the search term.  searchStart is where the search that found it
+// began and bounds $` in the replace term.
+struct PowerRenameMatch
+{
+    size_t searchStart;
+    MatchCaptures captures;
+};
+
+// Every match of the search term in a source string.  Keeping these lets the new name
+// be rebuilt for another replace term without searching again.  Match overwrites the
+// entries in place so a PowerRenameMatches that is reused keeps its capacity.
+struct PowerRenameMatches
+{
+    // Regular expression matches expand $ references in the replace term.  Plain text
+    // matches use it as is.
+    bool expandReplaceTerm = false;
+    std::vector<PowerRenameMatch> matches;
+    // Set when the search ran out of its time budget.  matches is empty then.
+    bool timedOut = false;
+};
+
+// Local date and time as the calendar shows it
+struct PowerRenameDateTime
+{
+    unsigned int year = 0;
+    unsigned int month = 0;
+    unsigned int day = 0;
+    unsigned int hour = 0;
+    unsigned int minute = 0;
+    unsigned int second = 0;
+};
+
+// What rename templates can read about an item besides its name
+struct PowerRenameItemMetadata
+{
+    // False when the item could not be read, the metadata tokens expand to nothing then
+    bool valid = false;
+    // 0 for folders
+    std::uint64_t size = 0;
+    PowerRenameDateTime modified;
+    // From the Exif data of pictures, when the header had it
+    bool hasTaken = false;
+    PowerRenameDateTime taken;
+};
+
+// Tokens a rename template uses that need more than the matches of an item
+enum PowerRenameTemplateUsage
+{
+    // ${counter}, numbered in the order of the items
+    TemplateUsesCounter = 0x1,
+    // ${size} or ${modified}
+    TemplateUsesMetadata = 0x2,
+    // ${taken}, which needs the start of the file read
+    TemplateUsesHeader = 0x4
+};
+
+// Per item values the template tokens expand to
+struct PowerRenameTemplateContext
+{
+    // 1 for the first item the search term matched, 0 when the item has no place in a
+    // list and counts as the first
+    unsigned long counter = 0;
+    const PowerRenameItemMetadata* metadata = nullptr;
+};
@@ -0,0 +1,592 @@
+#include "PowerRenameUndoLog.h"
+#include <algorithm>
+#include <fstream>
+#include <system_error>
+#include <unordered_map>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const char s_undoLogMagic[8] = { 'P', 'R', 'U', 'N', 'D', 'O', '0', '1' };
+// Each record starts with the size of its payload and a checksum of it
+#define UNDO_RECORD_HEADER_SIZE 8
+// Larger records are taken for damage rather than read
+#define UNDO_RECORD_MAX_SIZE (1u << 30)
+
+static size_t GetPathDepth(_In_ const std::wstring& path)
+{
+    return std::count_if(path.begin(), path.end(), [](wchar_t ch) { return ch == L'/' || ch == L'\\'; });
+}
+
+static std::wstring JoinPath(_In_ const std::wstring& parent, _In_ const std::wstring& name)
+{
+    if (parent.empty() || parent.back() == L'/' || parent.back() == L'\\')
+    {
+        return parent + name;
+    }
+
+    // The separator the path already uses
+    size_t separator = parent.find_last_of(L"/\\");
+    return parent + (separator == std::wstring::npos ? static_cast<wchar_t>(fs::path::preferred_separator) : parent[separator]) + name;
+}
+
+PowerRenamePlan CreateUndoPlan(_In_ const std::vector<PowerRenameStep>& doneSteps)
+{
+    // Where every entry renamed so far was before the batch, by the path it has now
+    std::unordered_map<std::wstring, std::wstring> originalPaths;
+    std::unordered_map<std::wstring, size_t> folderIndexes;
+    std::vector<std::pair<std::wstring, std::vector<size_t>>> folders;
+    std::vector<PowerRenameStep> steps;
+    steps.reserve(doneSteps.size());
+    for (size_t i = 0; i < doneSteps.size(); i++)
+    {
+        const PowerRenameStep& done = doneSteps[i];
+
+        // The deepest renamed folder the step ran in gives the original path
+        std::wstring parent = done.parent;
+        for (size_t length = parent.size(); length > 0;)
+        {
+            auto it = originalPaths.find(parent.substr(0, length));
+            if (it != originalPaths.end())
+            {
+                parent = it->second + parent.substr(length);
+                break;
+            }
+
+            size_t separator = parent.find_last_of(L"/\\", length - 1);
+            length = separator == std::wstring::npos ? 0 : separator;
+        }
+
+        // An entry renamed twice, through a temporary name, keeps its first path
+        std::wstring fromPath = JoinPath(parent, done.from);
+        auto previous = originalPaths.find(JoinPath(done.parent, done.from));
+        if (previous != originalPaths.end())
+        {
+            fromPath = previous->second;
+            originalPaths.erase(previous);
+        }
+        originalPaths[JoinPath(done.parent, done.to)] = fromPath;
+
+        auto folder = folderIndexes.find(parent);
+        if (folder == folderIndexes.end())
+        {
+            folder = folderIndexes.emplace(parent, folders.size()).first;
+            folders.push_back({ parent, {} });
+        }
+        folders[folder->second].second.push_back(steps.size());
+        steps.push_back({ parent, done.from, done.to, i });
+    }
+
+    // Folders of a depth keep the order they were first renamed in
+    PowerRenamePlan plan;
+    plan.steps.reserve(steps.size());
+    for (const auto& folder : folders)
+    {
+        PowerRenameFolderPlan folderPlan;
+        folderPlan.firstStep = plan.steps.size();
+        folderPlan.stepCount = folder.second.size();
+        folderPlan.depth = GetPathDepth(folder.first);
+        for (size_t step : folder.second)
+        {
+            plan.steps.push_back(steps[step]);
+        }
+        plan.folders.push_back(folderPlan);
+    }
+
+    std::stable_sort(plan.folders.begin(), plan.folders.end(), [](const PowerRenameFolderPlan& left, const PowerRenameFolderPlan& right) {
+        return left.depth > right.depth;
+    });
+    return plan;
+}
+
+// FNV-1a
+static std::uint32_t GetChecksum(_In_ const std::string& data)
+{
+    std::uint32_t hash = 2166136261u;
+    for (char ch : data)
+    {
+        hash = (hash ^ static_cast<unsigned char>(ch)) * 16777619u;
+    }
+    return hash;
+}
+
+static void AppendUInt32(_In_ std::uint32_t value, _Inout_ std::string& out)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static std::uint32_t ReadUInt32(_In_ const char* data)
+{
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; i--)
+    {
+        value = (value << 8) | static_cast<unsigned char>(data[i]);
+    }
+    return value;
+}
+
+// Seven bits at a time, low bits first, the high bit set on all but the last byte
+static void AppendVarInt(_In_ std::uint64_t value, _Inout_ std::string& out)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+// Writes text as its length in bytes and its UTF-8 whatever the size of wchar_t
+static void AppendString(_In_ const std::wstring& text, _Inout_ std::string& out)
+{
+    std::string utf8;
+    utf8.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        std::uint32_t ch = static_cast<std::uint32_t>(text[i]);
+        if (sizeof(wchar_t) == 2 && ch >= 0xD800 && ch < 0xDC00 && i + 1 < text.size())
+        {
+            std::uint32_t low = static_cast<std::uint32_t>(text[i + 1]);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+        }
+
+        if (ch < 0x80)
+        {
+            utf8 += static_cast<char>(ch);
+        }
+        else if (ch < 0x800)
+        {
+            utf8 += static_cast<char>(0xC0 | (ch >> 6));
+            utf8 += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else if (ch < 0x10000)
+        {
+            utf8 += static_cast<char>(0xE0 | (ch >> 12));
+            utf8 += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            utf8 += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else
+        {
+            utf8 += static_cast<char>(0xF0 | (ch >> 18));
+            utf8 += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+            utf8 += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            utf8 += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+    }
+
+    AppendVarInt(utf8.size(), out);
+    out += utf8;
+}
+
+// Bounds checked reads from the payload of a record
+class CUndoRecordReader
+{
+public:
+    explicit CUndoRecordReader(_In_ const std::string& data) :
+        m_data(data)
+    {
+    }
+
+    bool ReadVarInt(_Out_ std::uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && m_pos < m_data.size(); shift += 7)
+        {
+            unsigned char byte = static_cast<unsigned char>(m_data[m_pos++]);
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ReadString(_Out_ std::wstring& text)
+    {
+        text.clear();
+        std::uint64_t size = 0;
+        if (!ReadVarInt(size) || size > m_data.size() - m_pos)
+        {
+            return false;
+        }
+
+        size_t end = m_pos + static_cast<size_t>(size);
+        while (m_pos < end)
+        {
+            unsigned char lead = static_cast<unsigned char>(m_data[m_pos]);
+            size_t length = lead < 0x80 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+            if (length == 0 || m_pos + length > end)
+            {
+                return false;
+            }
+
+            std::uint32_t ch = length == 1 ? lead : lead & (0xFF >> (length + 1));
+            for (size_t i = 1; i < length; i++)
+            {
+                ch = (ch << 6) | (static_cast<unsigned char>(m_data[m_pos + i]) & 0x3F);
+            }
+            m_pos += length;
+
+            if (sizeof(wchar_t) == 2 && ch >= 0x10000)
+            {
+                ch -= 0x10000;
+                text += static_cast<wchar_t>(0xD800 + (ch >> 10));
+                text += static_cast<wchar_t>(0xDC00 + (ch & 0x3FF));
+            }
+            else
+            {
+                text += static_cast<wchar_t>(ch);
+            }
+        }
+        return true;
+    }
+
+    bool AtEnd() const { return m_pos == m_data.size(); }
+
+private:
+    const std::string& m_data;
+    size_t m_pos = 0;
+};
+
+// Exclusive lock on the file next to the log, held while the log is read or changed.
+// The log itself can't be locked since compacting it replaces it.
+class CUndoLogLock
+{
+public:
+    explicit CUndoLogLock(_In_ const fs::path& logPath)
+    {
+        fs::path lockPath = logPath;
+        lockPath += ".lock";
+#ifdef _WIN32
+        m_file = CreateFileW(lockPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        OVERLAPPED overlapped = {};
+        m_locked = m_file != INVALID_HANDLE_VALUE && LockFileEx(m_file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+#else
+        m_file = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        m_locked = m_file != -1 && flock(m_file, LOCK_EX) == 0;
+#endif
+    }
+
+    ~CUndoLogLock()
+    {
+#ifdef _WIN32
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            // Closing the handle releases the lock
+            CloseHandle(m_file);
+        }
+#else
+        if (m_file != -1)
+        {
+            close(m_file);
+        }
+#endif
+    }
+
+    CUndoLogLock(const CUndoLogLock&) = delete;
+    CUndoLogLock& operator=(const CUndoLogLock&) = delete;
+
+    bool IsLocked() const { return m_locked; }
+
+private:
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+    int m_file = -1;
+#endif
+    bool m_locked = false;
+};
+
+bool CPowerRenameUndoLog::Append(_In_ const PowerRenamePlan& plan, _In_ const std::vector<PowerRenameStepState>& states)
+{
+    CUndoLogLock lock(m_path);
+    return lock.IsLocked() && _Append(plan, states);
+}
+
+bool CPowerRenameUndoLog::_Append(_In_ const PowerRenamePlan& plan, _In_ const std::vector<PowerRenameStepState>& states)
+{
+    // Payload: the number of folders, then for every folder its depth, its path, the
+    // number of its steps and the old and new name of each
+    std::string payload;
+    size_t folderCount = 0;
+    for (const auto& folder : plan.folders)
+    {
+        for (size_t i = folder.firstStep; i < folder.firstStep + folder.stepCount; i++)
+        {
+            if (i < states.size() && states[i] == PowerRenameStepState::Done)
+            {
+                folderCount++;
+                break;
+            }
+        }
+    }
+    if (folderCount == 0)
+    {
+        return true;
+    }
+
+    AppendVarInt(folderCount, payload);
+    for (const auto& folder : plan.folders)
+    {
+        size_t doneCount = 0;
+        for (size_t i = folder.firstStep; i < folder.firstStep + folder.stepCount; i++)
+        {
+            doneCount += i < states.size() && states[i] == PowerRenameStepState::Done;
+        }
+        if (doneCount == 0)
+        {
+            continue;
+        }
+
+        AppendVarInt(folder.depth, payload);
+        AppendString(plan.steps[folder.firstStep].parent, payload);
+        AppendVarInt(doneCount, payload);
+        for (size_t i = folder.firstStep; i < folder.firstStep + folder.stepCount; i++)
+        {
+            if (states[i] == PowerRenameStepState::Done)
+            {
+                AppendString(plan.steps[i].from, payload);
+                AppendString(plan.steps[i].to, payload);
+            }
+        }
+    }
+
+    std::string record;
+    AppendUInt32(static_cast<std::uint32_t>(payload.size()), record);
+    AppendUInt32(GetChecksum(payload), record);
+    record += payload;
+
+    std::vector<std::uint64_t> batches;
+    std::uint64_t end = 0;
+    _Scan(batches, end);
+
+    std::error_code error;
+    if (batches.size() >= POWERRENAME_UNDO_LOG_BATCHES)
+    {
+        // The oldest batches go.  The ones kept are copied to a new log that replaces
+        // the old one in one step.
+        fs::path compacted = m_path;
+        compacted += ".tmp";
+        std::uint64_t keepFrom = batches[batches.size() - POWERRENAME_UNDO_LOG_BATCHES + 1];
+        std::ifstream in(m_path, std::ios::binary);
+        std::string kept(static_cast<size_t>(end - keepFrom), '\0');
+        in.seekg(static_cast<std::streamoff>(keepFrom));
+        in.read(&kept[0], kept.size());
+        {
+            std::ofstream out(compacted, std::ios::binary | std::ios::trunc);
+            out.write(s_undoLogMagic, sizeof(s_undoLogMagic));
+            out << kept << record;
+            if (!in || !out.flush())
+            {
+                return false;
+            }
+        }
+        fs::rename(compacted, m_path, error);
+        return !error;
+    }
+
+    // A record cut short by a crash is dropped before the new one goes after the last
+    // complete one
+    if (end == 0)
+    {
+        std::ofstream out(m_path, std::ios::binary | std::ios::trunc);
+        out.write(s_undoLogMagic, sizeof(s_undoLogMagic));
+        end = sizeof(s_undoLogMagic);
+        if (!out.flush())
+        {
+            return false;
+        }
+    }
+    else
+    {
+        fs::resize_file(m_path, end, error);
+        if (error)
+        {
+            return false;
+        }
+    }
+
+    std::ofstream out(m_path, std::ios::binary | std::ios::app);
+    out << record;
+    return !!out.flush();
+}
+
+void CPowerRenameUndoLog::_Scan(_Out_ std::vector<std::uint64_t>& batches, _Out_ std::uint64_t& end) const
+{
+    batches.clear();
+    end = 0;
+
+    std::ifstream file(m_path, std::ios::binary);
+    char header[UNDO_RECORD_HEADER_SIZE];
+    if (!file.read(header, sizeof(s_undoLogMagic)) || !std::equal(s_undoLogMagic, s_undoLogMagic + sizeof(s_undoLogMagic), header))
+    {
+        return;
+    }
+    end = sizeof(s_undoLogMagic);
+
+    // Only the headers are read and the payloads skipped, except for the last record,
+    // whose checksum tells whether it was written completely
+    std::error_code error;
+    std::uint64_t fileSize = fs::file_size(m_path, error);
+    while (!error && file.read(header, UNDO_RECORD_HEADER_SIZE))
+    {
+        std::uint32_t size = ReadUInt32(header);
+        std::uint64_t next = end + UNDO_RECORD_HEADER_SIZE + size;
+        if (size > UNDO_RECORD_MAX_SIZE || next > fileSize)
+        {
+            break;
+        }
+
+        if (next == fileSize)
+        {
+            std::string payload(size, '\0');
+            if (!file.read(&payload[0], size) || GetChecksum(payload) != ReadUInt32(header + 4))
+            {
+                break;
+            }
+        }
+        else
+        {
+            file.seekg(static_cast<std::streamoff>(next));
+        }
+
+        batches.push_back(end);
+        end = next;
+    }
+}
+
+bool CPowerRenameUndoLog::_ReadBatch(_In_ std::uint64_t offset, _Out_ PowerRenamePlan& plan) const
+{
+    plan = PowerRenamePlan();
+
+    std::ifstream file(m_path, std::ios::binary);
+    char header[UNDO_RECORD_HEADER_SIZE];
+    file.seekg(static_cast<std::streamoff>(offset));
+    if (!file.read(header, UNDO_RECORD_HEADER_SIZE))
+    {
+        return false;
+    }
+
+    std::string payload(ReadUInt32(header), '\0');
+    if (!file.read(&payload[0], payload.size()) || GetChecksum(payload) != ReadUInt32(header + 4))
+    {
+        return false;
+    }
+
+    CUndoRecordReader reader(payload);
+    std::uint64_t folderCount = 0;
+    if (!reader.ReadVarInt(folderCount))
+    {
+        return false;
+    }
+
+    for (std::uint64_t folderIndex = 0; folderIndex < folderCount; folderIndex++)
+    {
+        PowerRenameFolderPlan folder;
+        std::uint64_t depth = 0;
+        std::uint64_t stepCount = 0;
+        std::wstring parent;
+        if (!reader.ReadVarInt(depth) || !reader.ReadString(parent) || !reader.ReadVarInt(stepCount))
+        {
+            return false;
+        }
+
+        folder.firstStep = plan.steps.size();
+        folder.depth = static_cast<size_t>(depth);
+        for (std::uint64_t i = 0; i < stepCount; i++)
+        {
+            PowerRenameStep step;
+            step.parent = parent;
+            step.item = plan.steps.size();
+            if (!reader.ReadString(step.from) || !reader.ReadString(step.to))
+            {
+                return false;
+            }
+            plan.steps.push_back(std::move(step));
+        }
+        folder.stepCount = plan.steps.size() - folder.firstStep;
+        plan.folders.push_back(folder);
+    }
+    return reader.AtEnd();
+}
+
+size_t CPowerRenameUndoLog::GetBatchCount() const
+{
+    CUndoLogLock lock(m_path);
+    std::vector<std::uint64_t> batches;
+    std::uint64_t end = 0;
+    _Scan(batches, end);
+    return batches.size();
+}
+
+bool CPowerRenameUndoLog::ReadLastBatch(_Out_ PowerRenamePlan& plan) const
+{
+    CUndoLogLock lock(m_path);
+    std::vector<std::uint64_t> batches;
+    std::uint64_t end = 0;
+    _Scan(batches, end);
+    plan = PowerRenamePlan();
+    return !batches.empty() && _ReadBatch(batches.back(), plan);
+}
+
+size_t CPowerRenameUndoLog::RevertLastBatch(_In_ IPowerRenameSink& sink, _In_ unsigned int threadCount)
+{
+    // Held until the batch is replaced so another dialog can't append or revert the
+    // same batch in between
+    CUndoLogLock lock(m_path);
+    if (!lock.IsLocked())
+    {
+        return 0;
+    }
+
+    std::vector<std::uint64_t> batches;
+    std::uint64_t end = 0;
+    _Scan(batches, end);
+
+    PowerRenamePlan plan;
+    if (batches.empty() || !_ReadBatch(batches.back(), plan))
+    {
+        return 0;
+    }
+
+    std::vector<PowerRenameStepState> states(plan.steps.size(), PowerRenameStepState::Done);
+    CPowerRenameCommitter committer(threadCount);
+    if (!committer.RollBack(plan, sink, nullptr, states))
+    {
+        // A revert that was interrupted before undid some of the steps already.  Only
+        // then are names checked, and the steps whose old name is back are skipped.
+        for (size_t i = 0; i < plan.steps.size(); i++)
+        {
+            const PowerRenameStep& step = plan.steps[i];
+            if (states[i] == PowerRenameStepState::Done && sink.Exists(step.parent, step.from) && !sink.Exists(step.parent, step.to))
+            {
+                states[i] = PowerRenameStepState::RolledBack;
+            }
+        }
+        committer.RollBack(plan, sink, nullptr, states);
+    }
+
+    // The batch is replaced by the steps that are still done, if any
+    std::error_code error;
+    fs::resize_file(m_path, batches.back(), error);
+    if (!error)
+    {
+        _Append(plan, states);
+    }
+
+    return std::count(states.begin(), states.end(), PowerRenameStepState::RolledBack);
+}
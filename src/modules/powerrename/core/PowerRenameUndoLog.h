@@ -0,0 +1,54 @@
+#pragma once
+#include "CorePlatform.h"
+#include "PowerRenameCommit.h"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Batches the log keeps.  Appending another drops the oldest.
+#define POWERRENAME_UNDO_LOG_BATCHES 16
+
+// Orders renames that were done, given in the order they ran, into a plan
+// CPowerRenameCommitter::RollBack undoes.  Steps that ran after their folder was renamed
+// are moved to the original path of the folder, as if the folder was renamed after its
+// contents like a plan does.
+PowerRenamePlan CreateUndoPlan(_In_ const std::vector<PowerRenameStep>& doneSteps);
+
+// Append-only log of the batches of renames that were committed, so the last one can be
+// reverted without searching the items again.  Each batch is a binary record: its size,
+// a checksum and the steps grouped by folder, with every folder path stored once and
+// the names in UTF-8.  A record cut short by a crash fails its checksum and is dropped
+// on the next append.  Every dialog shares the log, so each call holds an exclusive
+// lock on a file next to it.
+class CPowerRenameUndoLog
+{
+public:
+    explicit CPowerRenameUndoLog(_In_ const std::filesystem::path& path) :
+        m_path(path)
+    {
+    }
+
+    // Appends the steps of plan that are done as a batch.  Nothing is appended when no
+    // step is done.
+    bool Append(_In_ const PowerRenamePlan& plan, _In_ const std::vector<PowerRenameStepState>& states);
+
+    // Number of complete batches in the log
+    size_t GetBatchCount() const;
+
+    // Reads the last complete batch
+    bool ReadLastBatch(_Out_ PowerRenamePlan& plan) const;
+
+    // Undoes the last batch, the folders of a depth on threadCount threads, and removes
+    // it from the log.  Steps that could not be undone stay in the log as the last
+    // batch.  Returns the number of steps undone.
+    size_t RevertLastBatch(_In_ IPowerRenameSink& sink, _In_ unsigned int threadCount = 0);
+
+private:
+    // Append without taking the lock
+    bool _Append(_In_ const PowerRenamePlan& plan, _In_ const std::vector<PowerRenameStepState>& states);
+    // Finds the offsets of the complete batches and where the last one ends
+    void _Scan(_Out_ std::vector<std::uint64_t>& batches, _Out_ std::uint64_t& end) const;
+    bool _ReadBatch(_In_ std::uint64_t offset, _Out_ PowerRenamePlan& plan) const;
+
+    std::filesystem::path m_path;
+};
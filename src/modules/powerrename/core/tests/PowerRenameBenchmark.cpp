@@ -0,0 +1,429 @@
+#include "PowerRenameCorpus.h"
+#include "PowerRenameEngine.h"
+#include "PowerRenameFileSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Times the rename core on generated corpora of every shape:
+//
+//   load              the items of the corpus into the engine, from memory
+//   preview-literal   a full preview of a plain text search
+//   preview-regex     a full preview of a regular expression with a capture group
+//   preview-template  a full preview of a replace term with a counter
+//   keystroke         a preview for every character of a search term typed one at a time
+//   enumerate         the corpus written to disk and loaded from there
+//   preview-disk      a preview that checks every new name against the disk
+//   commit            renaming every picture on disk
+//
+// The in memory scenarios run --files items, the ones on disk --disk-files.  Results
+// are printed and, with --json, written one scenario per line with the stats of the
+// engine.  With --baseline the results are compared to the ones of an earlier run and
+// the benchmark fails when a scenario got slower by more than --tolerance.
+//
+//   PowerRenameBenchmark [--files n] [--disk-files n] [--shapes flat,deep,unicode,long]
+//                        [--seed n] [--root path] [--json path]
+//                        [--baseline path] [--tolerance fraction]
+
+namespace fs = std::filesystem;
+
+using Clock = std::chrono::steady_clock;
+
+// Differences below this are noise however large they are relative to the baseline
+#define BENCHMARK_NOISE_MS 5.0
+
+struct BenchmarkResult
+{
+    std::string scenario;
+    std::string shape;
+    size_t items = 0;
+    // Items renamed or, for enumerate and load, loaded
+    size_t count = 0;
+    double ms = 0;
+    // Keystroke only: the median and slowest single preview
+    size_t keystrokes = 0;
+    double p50Ms = 0;
+    double maxMs = 0;
+    // CPowerRenameStats::ToJson of the engine for the scenario
+    std::string stats{};
+};
+
+struct BenchmarkOptions
+{
+    size_t files = 1000000;
+    size_t diskFiles = 100000;
+    std::vector<CorpusShape> shapes = { CorpusShape::Flat, CorpusShape::Deep, CorpusShape::Unicode, CorpusShape::Long };
+    std::uint32_t seed = 1;
+    fs::path root = fs::temp_directory_path() / "PowerRenameBenchmark";
+    std::string json;
+    std::string baseline;
+    double tolerance = 0.25;
+};
+
+static double ElapsedMs(_In_ Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void Report(_In_ const BenchmarkResult& result)
+{
+    printf("%-17s %-8s %9zu items %9zu renames %10.1f ms %12.0f items/s", result.scenario.c_str(), result.shape.c_str(), result.items, result.count, result.ms,
+           result.ms > 0 ? result.items * 1000.0 / result.ms : 0.0);
+    if (result.keystrokes)
+    {
+        printf("  p50 %.1f ms, max %.1f ms", result.p50Ms, result.maxMs);
+    }
+    printf("\n");
+}
+
+static std::string ToJson(_In_ const BenchmarkResult& result)
+{
+    char numbers[256];
+    snprintf(numbers, sizeof(numbers), "\"items\":%zu,\"count\":%zu,\"ms\":%.3f,\"itemsPerSecond\":%.0f", result.items, result.count, result.ms,
+             result.ms > 0 ? result.items * 1000.0 / result.ms : 0.0);
+    std::string json = "{\"scenario\":\"" + result.scenario + "\",\"shape\":\"" + result.shape + "\"," + numbers;
+    if (result.keystrokes)
+    {
+        snprintf(numbers, sizeof(numbers), ",\"keystrokes\":%zu,\"p50Ms\":%.3f,\"maxMs\":%.3f", result.keystrokes, result.p50Ms, result.maxMs);
+        json += numbers;
+    }
+    if (!result.stats.empty())
+    {
+        json += ",\"stats\":" + result.stats;
+    }
+    return json + "}";
+}
+
+// Returns the value of "key": in a line written by ToJson, without quotes
+static std::string ReadField(_In_ const std::string& line, _In_ const std::string& key)
+{
+    std::string prefix = "\"" + key + "\":";
+    size_t start = line.find(prefix);
+    if (start == std::string::npos)
+    {
+        return std::string();
+    }
+
+    start += prefix.size();
+    if (start < line.size() && line[start] == '"')
+    {
+        size_t end = line.find('"', start + 1);
+        return end == std::string::npos ? std::string() : line.substr(start + 1, end - start - 1);
+    }
+    return line.substr(start, line.find_first_of(",}", start) - start);
+}
+
+static bool WriteJson(_In_ const BenchmarkOptions& options, _In_ const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream file(options.json, std::ios::trunc);
+    file << "{\"version\":1,\"seed\":" << options.seed << ",\"threads\":" << std::thread::hardware_concurrency() << ",\"results\":[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        file << ToJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "]}\n";
+    return static_cast<bool>(file);
+}
+
+// Compares results to the ones of the same scenario, shape and size in the baseline.
+// Returns false when any of them is slower than the tolerance allows.
+static bool CompareToBaseline(_In_ const BenchmarkOptions& options, _In_ const std::vector<BenchmarkResult>& results)
+{
+    std::ifstream file(options.baseline);
+    if (!file)
+    {
+        fprintf(stderr, "Failed to read baseline %s\n", options.baseline.c_str());
+        return false;
+    }
+
+    bool passed = true;
+    size_t compared = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::string scenario = ReadField(line, "scenario");
+        std::string shape = ReadField(line, "shape");
+        std::string items = ReadField(line, "items");
+        for (const BenchmarkResult& result : results)
+        {
+            if (result.scenario != scenario || result.shape != shape || std::to_string(result.items) != items)
+            {
+                continue;
+            }
+
+            compared++;
+            double baselineMs = std::strtod(ReadField(line, "ms").c_str(), nullptr);
+            if (result.ms > baselineMs * (1 + options.tolerance) && result.ms - baselineMs > BENCHMARK_NOISE_MS)
+            {
+                fprintf(stderr, "Regression: %s %s took %.1f ms, %.1f ms in the baseline\n", scenario.c_str(), shape.c_str(), result.ms, baselineMs);
+                passed = false;
+            }
+        }
+    }
+
+    printf("Compared %zu results to %s\n", compared, options.baseline.c_str());
+    return passed;
+}
+
+// Runs a full preview without a sink and checks the number of renames
+static bool RunPreview(_In_ CPowerRenameEngine& engine, _In_ const char* scenario, _In_ const char* shape, _In_ size_t expected, _Inout_ std::vector<BenchmarkResult>& results)
+{
+    BenchmarkResult result = { scenario, shape, engine.GetItems().size() };
+    engine.GetStats().Reset();
+    Clock::time_point start = Clock::now();
+    result.count = engine.Preview(nullptr);
+    result.ms = ElapsedMs(start);
+    result.stats = engine.GetStats().ToJson();
+    Report(result);
+    results.push_back(result);
+
+    if (result.count != expected)
+    {
+        fprintf(stderr, "%s %s renamed %zu items, expected %zu\n", scenario, shape, result.count, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool RunInMemory(_In_ const BenchmarkOptions& options, _In_ CorpusShape shape, _Inout_ std::vector<BenchmarkResult>& results)
+{
+    const char* shapeName = GetCorpusShapeName(shape);
+    CPowerRenameCorpus corpus(shape, options.files, options.seed);
+
+    CPowerRenameEngine engine;
+    BenchmarkResult load = { "load", shapeName, corpus.GetFiles().size() + corpus.GetFolders().size() };
+    Clock::time_point start = Clock::now();
+    CCorpusItemSource source(corpus, options.root);
+    engine.Load(source);
+    load.ms = ElapsedMs(start);
+    load.count = engine.GetItems().size();
+    Report(load);
+    results.push_back(load);
+
+    // Every search only matches the pictures
+    size_t pictures = corpus.GetPictureCount();
+    bool passed = load.count == load.items;
+    CPowerRenameSearch& search = engine.GetSearch();
+    search.SetFlags(DEFAULT_FLAGS | ExcludeFolders);
+    search.SetSearchTerm(L"IMG_");
+    search.SetReplaceTerm(L"PIC_");
+    passed = RunPreview(engine, "preview-literal", shapeName, pictures, results) && passed;
+
+    search.SetFlags(DEFAULT_FLAGS | ExcludeFolders | UseRegularExpressions);
+    search.SetSearchTerm(L"^IMG_(\\d{4})_");
+    search.SetReplaceTerm(L"$1-");
+    passed = RunPreview(engine, "preview-regex", shapeName, pictures, results) && passed;
+
+    search.SetFlags(DEFAULT_FLAGS | ExcludeFolders);
+    search.SetSearchTerm(L"IMG_");
+    search.SetReplaceTerm(L"PIC_${counter:6}_");
+    passed = RunPreview(engine, "preview-template", shapeName, pictures, results) && passed;
+
+    // Typing a search term previews after every character.  The short prefixes match
+    // far more names than the whole term.
+    static const wchar_t s_typed[] = L"IMG_20";
+    BenchmarkResult keystroke = { "keystroke", shapeName, engine.GetItems().size() };
+    std::vector<double> times;
+    engine.GetStats().Reset();
+    search.SetReplaceTerm(L"x");
+    for (size_t length = 1; length < sizeof(s_typed) / sizeof(s_typed[0]); length++)
+    {
+        start = Clock::now();
+        search.SetSearchTerm(std::wstring_view(s_typed, length));
+        keystroke.count = engine.Preview(nullptr);
+        times.push_back(ElapsedMs(start));
+        keystroke.ms += times.back();
+    }
+    keystroke.stats = engine.GetStats().ToJson();
+    keystroke.keystrokes = times.size();
+    std::sort(times.begin(), times.end());
+    keystroke.p50Ms = times[times.size() / 2];
+    keystroke.maxMs = times.back();
+    Report(keystroke);
+    results.push_back(keystroke);
+
+    if (keystroke.count != pictures)
+    {
+        fprintf(stderr, "keystroke %s renamed %zu items, expected %zu\n", shapeName, keystroke.count, pictures);
+        passed = false;
+    }
+    return passed;
+}
+
+static bool RunOnDisk(_In_ const BenchmarkOptions& options, _In_ CorpusShape shape, _Inout_ std::vector<BenchmarkResult>& results)
+{
+    const char* shapeName = GetCorpusShapeName(shape);
+    CPowerRenameCorpus corpus(shape, options.diskFiles, options.seed);
+    fs::path root = options.root / shapeName;
+
+    Clock::time_point start = Clock::now();
+    if (!corpus.Materialize(root))
+    {
+        return false;
+    }
+    printf("Wrote %zu files in %zu folders in %.1f ms\n", corpus.GetFiles().size(), corpus.GetFolders().size(), ElapsedMs(start));
+
+    CPowerRenameEngine engine;
+    BenchmarkResult enumerate = { "enumerate", shapeName, corpus.GetFiles().size() + corpus.GetFolders().size() };
+    start = Clock::now();
+    CFileSystemItemSource source({ root }, true);
+    engine.Load(source);
+    enumerate.ms = ElapsedMs(start);
+    enumerate.count = engine.GetItems().size();
+    enumerate.stats = engine.GetStats().ToJson();
+    Report(enumerate);
+    results.push_back(enumerate);
+
+    size_t pictures = corpus.GetPictureCount();
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | ExcludeFolders);
+    engine.GetSearch().SetSearchTerm(L"IMG_");
+    engine.GetSearch().SetReplaceTerm(L"PIC_");
+
+    CFileSystemRenameSink sink;
+    BenchmarkResult preview = { "preview-disk", shapeName, engine.GetItems().size() };
+    engine.GetStats().Reset();
+    start = Clock::now();
+    preview.count = engine.Preview(&sink);
+    preview.ms = ElapsedMs(start);
+    preview.stats = engine.GetStats().ToJson();
+    Report(preview);
+    results.push_back(preview);
+
+    BenchmarkResult commit = { "commit", shapeName, engine.GetItems().size() };
+    engine.GetStats().Reset();
+    start = Clock::now();
+    commit.count = engine.Commit(sink);
+    commit.ms = ElapsedMs(start);
+    commit.stats = engine.GetStats().ToJson();
+    Report(commit);
+    results.push_back(commit);
+
+    fs::remove_all(root);
+
+    bool passed = enumerate.count == enumerate.items && preview.count == pictures && commit.count == pictures;
+    if (!passed)
+    {
+        fprintf(stderr, "%s: enumerated %zu of %zu items, previewed %zu and committed %zu of %zu renames\n", shapeName, enumerate.count, enumerate.items,
+                preview.count, commit.count, pictures);
+    }
+    return passed;
+}
+
+static bool ParseOptions(_In_ int argc, _In_ char* argv[], _Out_ BenchmarkOptions& options)
+{
+    options = BenchmarkOptions();
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+
+        std::string value = argv[++i];
+        if (name == "--files")
+        {
+            options.files = std::strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (name == "--disk-files")
+        {
+            options.diskFiles = std::strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (name == "--shapes")
+        {
+            options.shapes.clear();
+            for (size_t start = 0; start <= value.size();)
+            {
+                size_t end = std::min(value.find(',', start), value.size());
+                CorpusShape shape;
+                if (!ParseCorpusShape(value.substr(start, end - start), shape))
+                {
+                    return false;
+                }
+                options.shapes.push_back(shape);
+                start = end + 1;
+            }
+        }
+        else if (name == "--seed")
+        {
+            options.seed = static_cast<std::uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--root")
+        {
+            options.root = value;
+        }
+        else if (name == "--json")
+        {
+            options.json = value;
+        }
+        else if (name == "--baseline")
+        {
+            options.baseline = value;
+        }
+        else if (name == "--tolerance")
+        {
+            options.tolerance = std::strtod(value.c_str(), nullptr);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "Usage: PowerRenameBenchmark [--files n] [--disk-files n] [--shapes flat,deep,unicode,long] [--seed n] [--root path]\n"
+                        "                            [--json path] [--baseline path] [--tolerance fraction]\n");
+        return 1;
+    }
+
+#ifndef _WIN32
+    // Paths are converted to UTF-8 whatever the user's locale is, so the unicode corpus
+    // has the same names on disk everywhere
+    if (!setlocale(LC_ALL, "C.UTF-8"))
+    {
+        setlocale(LC_ALL, "");
+    }
+#endif
+
+    printf("%zu items in memory, %zu on disk, seed %u, %u threads\n", options.files, options.diskFiles, options.seed, std::thread::hardware_concurrency());
+
+    bool passed = true;
+    std::vector<BenchmarkResult> results;
+    for (CorpusShape shape : options.shapes)
+    {
+        if (options.files)
+        {
+            passed = RunInMemory(options, shape, results) && passed;
+        }
+        if (options.diskFiles)
+        {
+            passed = RunOnDisk(options, shape, results) && passed;
+        }
+    }
+    fs::remove_all(options.root);
+
+    if (!options.json.empty() && !WriteJson(options, results))
+    {
+        fprintf(stderr, "Failed to write %s\n", options.json.c_str());
+        passed = false;
+    }
+
+    if (!options.baseline.empty())
+    {
+        passed = CompareToBaseline(options, results) && passed;
+    }
+    return passed ? 0 : 1;
+}
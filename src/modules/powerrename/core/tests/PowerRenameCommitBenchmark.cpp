@@ -0,0 +1,137 @@
+#include "PowerRenameCommit.h"
+#include "PowerRenameEngine.h"
+#include "PowerRenameFileSystem.h"
+#include "PowerRenameJournal.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+// Times committing a rename of every file of a generated tree on the local file system:
+// serially and on a pool of threads, with and without a journal, and rolling it back.
+//
+//   PowerRenameCommitBenchmark [fileCount] [filesPerFolder] [root]
+//
+// Defaults to 100000 files, 1000 per folder, in the temp folder.
+
+namespace fs = std::filesystem;
+
+using Clock = std::chrono::steady_clock;
+
+static double ElapsedMs(_In_ Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void Report(_In_ const char* phase, _In_ size_t count, _In_ double ms)
+{
+    printf("%-38s %8zu renames %10.1f ms %10.0f renames/s\n", phase, count, ms, ms > 0 ? count * 1000.0 / ms : 0.0);
+}
+
+// Counts the files whose name starts with prefix
+static size_t CountFiles(_In_ const fs::path& root, _In_ const std::string& prefix)
+{
+    size_t count = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(root))
+    {
+        if (entry.is_regular_file() && entry.path().filename().string().compare(0, prefix.size(), prefix) == 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t fileCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    size_t filesPerFolder = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    fs::path root = argc > 3 ? fs::path(argv[3]) : fs::temp_directory_path() / "PowerRenameCommitBenchmark";
+    if (fileCount == 0 || filesPerFolder == 0)
+    {
+        fprintf(stderr, "Usage: PowerRenameCommitBenchmark [fileCount] [filesPerFolder] [root]\n");
+        return 1;
+    }
+
+    fs::remove_all(root);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < fileCount; i++)
+    {
+        fs::path folder = root / ("folder_" + std::to_string(i / filesPerFolder));
+        if (i % filesPerFolder == 0)
+        {
+            fs::create_directories(folder);
+        }
+        std::ofstream(folder / ("file_" + std::to_string(i) + ".txt"));
+    }
+    printf("Generated %zu files in %zu folders in %.1f ms, %u threads\n", fileCount, (fileCount + filesPerFolder - 1) / filesPerFolder, ElapsedMs(start), std::thread::hardware_concurrency());
+
+    // Rename the files but not the folders they are in
+    CPowerRenameEngine engine;
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | ExcludeFolders);
+    engine.GetSearch().SetSearchTerm(L"file_");
+    engine.GetSearch().SetReplaceTerm(L"doc_");
+
+    start = Clock::now();
+    CFileSystemItemSource source({ root }, true);
+    engine.Load(source);
+    CFileSystemRenameSink sink;
+    size_t renameCount = engine.Preview(&sink);
+    Report("Load and preview", renameCount, ElapsedMs(start));
+
+    std::vector<PowerRenameStep> renames;
+    for (size_t i = 0; i < engine.GetItems().size(); i++)
+    {
+        const PowerRenameEngineItem& item = engine.GetItems()[i];
+        if (item.state == PowerRenameItemState::Renamed)
+        {
+            renames.push_back({ item.source.parent, item.source.name, item.newName, i });
+        }
+    }
+
+    start = Clock::now();
+    PowerRenamePlan plan = CreateRenamePlan(renames, sink);
+    Report("Plan", plan.steps.size(), ElapsedMs(start));
+
+    fs::path journalPath = root / "journal.txt";
+    bool succeeded = true;
+    auto run = [&](const char* phase, unsigned int threadCount, bool journaled, bool rollBack) {
+        CPowerRenameJournal journal;
+        std::vector<PowerRenameStepState> states(plan.steps.size(), rollBack ? PowerRenameStepState::Done : PowerRenameStepState::Pending);
+        CPowerRenameCommitter committer(threadCount);
+
+        start = Clock::now();
+        bool phaseSucceeded = !journaled || journal.Create(journalPath, plan);
+        if (phaseSucceeded)
+        {
+            CPowerRenameJournal* journalToUse = journaled ? &journal : nullptr;
+            phaseSucceeded = rollBack ? committer.RollBack(plan, sink, journalToUse, states) : committer.Commit(plan, sink, journalToUse, states);
+        }
+        if (journaled)
+        {
+            journal.Remove();
+        }
+        Report(phase, plan.steps.size(), ElapsedMs(start));
+
+        phaseSucceeded = phaseSucceeded && CountFiles(root, rollBack ? "file_" : "doc_") == renameCount;
+        if (!phaseSucceeded)
+        {
+            fprintf(stderr, "%s failed\n", phase);
+        }
+        succeeded = succeeded && phaseSucceeded;
+    };
+
+    run("Commit, 1 thread, no journal", 1, false, false);
+    run("Roll back, 1 thread, no journal", 1, false, true);
+    run("Commit, 1 thread, journal", 1, true, false);
+    run("Roll back, 1 thread, journal", 1, true, true);
+    run("Commit, all threads, no journal", 0, false, false);
+    run("Roll back, all threads, no journal", 0, false, true);
+    run("Commit, all threads, journal", 0, true, false);
+    run("Roll back, all threads, journal", 0, true, true);
+
+    fs::remove_all(root);
+    return succeeded ? 0 : 1;
+}
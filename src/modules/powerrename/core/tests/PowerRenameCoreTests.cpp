@@ -0,0 +1,1075 @@
+#include "PowerRenameEngine.h"
+#include "PowerRenameCommit.h"
+#include "PowerRenameFileSystem.h"
+#include "PowerRenameJournal.h"
+#include "PowerRenameMetadata.h"
+#include "PowerRenameNameIndex.h"
+#include "PowerRenameNaming.h"
+#include "PowerRenameRegExAnalyzer.h"
+#include "PowerRenameStats.h"
+#include "PowerRenameTemplate.h"
+#include "PowerRenameUndoLog.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+// Tests of the portable core that build without the Windows SDK.  The shell extension's
+// own tests in unittests cover the same rules through the COM objects.
+
+namespace fs = std::filesystem;
+
+static int s_failures = 0;
+
+#define CHECK(expression)                                                          \
+    do                                                                             \
+    {                                                                              \
+        if (!(expression))                                                         \
+        {                                                                          \
+            fprintf(stderr, "%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #expression); \
+            s_failures++;                                                          \
+        }                                                                          \
+    } while (0)
+
+// Source and sink over an in-memory folder tree
+class CMemoryFileSystem : public IPowerRenameItemSource, public IPowerRenameSink
+{
+public:
+    void Add(const std::wstring& parent, const std::wstring& name, bool isFolder = false, int depth = 0)
+    {
+        PowerRenameSourceItem item;
+        item.parent = parent;
+        item.name = name;
+        item.path = parent + L"/" + name;
+        item.isFolder = isFolder;
+        item.depth = depth;
+        m_items.push_back(item);
+        m_entries.insert(item.path);
+    }
+
+    // Entries that exist but are not handed out as items
+    void AddEntry(const std::wstring& parent, const std::wstring& name)
+    {
+        m_entries.insert(parent + L"/" + name);
+    }
+
+    bool GetNextItem(PowerRenameSourceItem& item) override
+    {
+        if (m_next == m_items.size())
+        {
+            return false;
+        }
+        item = m_items[m_next++];
+        return true;
+    }
+
+    bool Exists(const std::wstring& parent, const std::wstring& name) override
+    {
+        return m_entries.count(parent + L"/" + name) != 0;
+    }
+
+    void List(const std::wstring& parent, std::vector<std::wstring>& names) override
+    {
+        m_listed.push_back(parent);
+        std::wstring prefix = parent + L"/";
+        for (const auto& entry : m_entries)
+        {
+            if (entry.compare(0, prefix.size(), prefix) == 0 && entry.find(L'/', prefix.size()) == std::wstring::npos)
+            {
+                names.push_back(entry.substr(prefix.size()));
+            }
+        }
+    }
+
+    bool Rename(const std::wstring& parent, const std::wstring& name, const std::wstring& newName) override
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::wstring from = parent + L"/" + name;
+        std::wstring to = parent + L"/" + newName;
+        if (m_entries.count(from) == 0 || m_entries.count(to) != 0 || newName == m_failingName)
+        {
+            return false;
+        }
+        m_entries.erase(from);
+        m_entries.insert(to);
+        m_renames.push_back(name + L"->" + newName);
+        return true;
+    }
+
+    std::set<std::wstring> m_entries;
+    std::vector<std::wstring> m_renames;
+    std::vector<std::wstring> m_listed;
+    // Renames to this name fail
+    std::wstring m_failingName;
+
+private:
+    std::mutex m_lock;
+    std::vector<PowerRenameSourceItem> m_items;
+    size_t m_next = 0;
+};
+
+static std::map<std::wstring, PowerRenameEngineItem> ByName(const CPowerRenameEngine& engine)
+{
+    std::map<std::wstring, PowerRenameEngineItem> items;
+    for (const auto& item : engine.GetItems())
+    {
+        items[item.source.name] = item;
+    }
+    return items;
+}
+
+static void TestNaming()
+{
+    CHECK(GetExtensionStart(L"foo.txt") == 3);
+    CHECK(GetExtensionStart(L".gitignore") == 10);
+    CHECK(GetExtensionStart(L"archive.tar.gz") == 11);
+    CHECK(GetExtensionStart(L"..") == 2);
+
+    CHECK(GetMatchSource(L"foo.txt", NameOnly) == L"foo");
+    CHECK(GetMatchSource(L"foo.txt", ExtensionOnly) == L"txt");
+    CHECK(GetMatchSource(L"foo", ExtensionOnly) == L"");
+    CHECK(GetMatchSource(L"foo.txt", 0) == L"foo.txt");
+
+    std::wstring newName = L"bar";
+    CHECK(ComposeNewName(L"foo.txt", NameOnly, newName));
+    CHECK(newName == L"bar.txt");
+    newName = L"md";
+    CHECK(ComposeNewName(L"foo.txt", ExtensionOnly, newName));
+    CHECK(newName == L"foo.md");
+    newName = L"foo.txt";
+    CHECK(!ComposeNewName(L"foo.txt", 0, newName));
+    newName = std::wstring(400, L'a');
+    CHECK(ComposeNewName(L"foo.txt", 0, newName));
+    CHECK(newName.size() == POWERRENAME_MAX_PATH - 1);
+
+    CHECK(IsExcluded(true, false, ExcludeFolders));
+    CHECK(!IsExcluded(false, false, ExcludeFolders));
+    CHECK(IsExcluded(false, false, ExcludeFiles));
+    CHECK(IsExcluded(false, true, ExcludeSubfolders));
+    CHECK(!IsExcluded(false, false, ExcludeSubfolders));
+
+    std::wstring uniqueName;
+    unsigned long numberUsed = 0;
+    CHECK(GetEnumeratedName(L"foo.txt", 1, POWERRENAME_MAX_PATH, nullptr, uniqueName, &numberUsed));
+    CHECK(uniqueName == L"foo (1).txt" && numberUsed == 1);
+    CHECK(GetEnumeratedName(L"foo (7).txt", 3, POWERRENAME_MAX_PATH, nullptr, uniqueName, &numberUsed));
+    CHECK(uniqueName == L"foo (3).txt");
+    CHECK(GetEnumeratedName(L"my file.tar gz", 2, POWERRENAME_MAX_PATH, nullptr, uniqueName, &numberUsed));
+    CHECK(uniqueName == L"my file.tar gz (2)");
+
+    std::set<std::wstring> taken = { L"foo (1).txt", L"foo (2).txt" };
+    CHECK(GetEnumeratedName(L"foo.txt", 1, POWERRENAME_MAX_PATH, [&](const std::wstring& name) { return taken.count(name) != 0; }, uniqueName, &numberUsed));
+    CHECK(uniqueName == L"foo (3).txt" && numberUsed == 3);
+
+    // No room left for a number
+    CHECK(!GetEnumeratedName(std::wstring(POWERRENAME_MAX_PATH, L'a'), 1, POWERRENAME_MAX_PATH, nullptr, uniqueName, &numberUsed));
+}
+
+static void TestSearch()
+{
+    CPowerRenameSearch search;
+    PowerRenameMatches matches;
+    std::wstring result;
+
+    CHECK(search.SetSearchTerm(L"foo"));
+    CHECK(!search.SetSearchTerm(L"foo"));
+    CHECK(search.SetReplaceTerm(L"bar"));
+    CHECK(search.Match(L"FOOfoo", matches));
+    search.Substitute(L"FOOfoo", matches, result);
+    CHECK(result == L"barbar");
+
+    search.SetFlags(CaseSensitive);
+    CHECK(search.Match(L"FOOfoo", matches));
+    search.Substitute(L"FOOfoo", matches, result);
+    CHECK(result == L"FOObar");
+
+    search.SetFlags(UseRegularExpressions | MatchAllOccurences);
+    search.SetSearchTerm(L"(\\d+)-(\\d+)");
+    search.SetReplaceTerm(L"$2_$1");
+    CHECK(search.Match(L"12-34 and 5-6", matches));
+    search.Substitute(L"12-34 and 5-6", matches, result);
+    CHECK(result == L"34_12 and 6_5");
+
+    search.SetEngine(StdRegExEngine);
+    CHECK(search.Match(L"12-34", matches));
+    search.Substitute(L"12-34", matches, result);
+    CHECK(result == L"34_12");
+
+    CHECK(search.SetSearchTerm(L"(unclosed"));
+    CHECK(!search.Match(L"unclosed", matches));
+    CHECK(matches.matches.empty());
+
+    search.SetSearchTerm(L"");
+    CHECK(!search.Match(L"foo", matches));
+}
+
+// Patterns that can match an empty string, where the engines have to agree on which
+// empty matches count after another match
+static void TestEmptyMatches()
+{
+    const wchar_t* patterns[] = { L"x?", L".*", L"[A-Z]*", L"b??", L"\\W{0,}", L"a?1*?", L"o??", L"(t)?" };
+    const wchar_t* sources[] = { L"", L"foo.txt", L"xbx", L"Abc DEF", L"a1a11", L"..." };
+    const std::uint32_t flagSets[] = { UseRegularExpressions | MatchAllOccurences, UseRegularExpressions | MatchAllOccurences | CaseSensitive, UseRegularExpressions };
+    for (std::uint32_t flags : flagSets)
+    {
+        for (const wchar_t* pattern : patterns)
+        {
+            for (const wchar_t* source : sources)
+            {
+                std::wstring results[2];
+                PowerRenameRegExEngine engines[] = { LinearRegExEngine, StdRegExEngine };
+                for (int i = 0; i < 2; i++)
+                {
+                    CPowerRenameSearch search;
+                    search.SetEngine(engines[i]);
+                    search.SetFlags(flags);
+                    search.SetSearchTerm(pattern);
+                    search.SetReplaceTerm(L"[$&]");
+                    PowerRenameMatches matches;
+                    if (search.Match(source, matches))
+                    {
+                        search.Substitute(source, matches, results[i]);
+                    }
+                }
+                if (results[0] != results[1])
+                {
+                    fprintf(stderr, "%ls on %ls: linear %ls, std %ls\n", pattern, source, results[0].c_str(), results[1].c_str());
+                }
+                CHECK(results[0] == results[1]);
+            }
+        }
+    }
+
+    CPowerRenameSearch search;
+    PowerRenameMatches matches;
+    std::wstring result;
+    search.SetFlags(UseRegularExpressions | MatchAllOccurences);
+    search.SetSearchTerm(L"x?");
+    search.SetReplaceTerm(L"-");
+    CHECK(search.Match(L"foo.txt", matches));
+    search.Substitute(L"foo.txt", matches, result);
+    CHECK(result == L"-f-o-o-.-t--t-");
+}
+
+static void TestTemplate()
+{
+    PowerRenameMatch match = { 2, { { 4, 12 }, { 4, 8 }, { std::wstring::npos, std::wstring::npos }, { 9, 12 } } };
+    std::wstring source = L"a b some_DOG file";
+    auto expand = [&](const wchar_t* replaceTerm, bool expandReferences, const PowerRenameTemplateContext& context) {
+        CPowerRenameTemplate replaceTemplate;
+        replaceTemplate.Compile(replaceTerm, expandReferences);
+        std::wstring result;
+        replaceTemplate.Append(source, match, context, result);
+        return result;
+    };
+
+    // The $ references behave like std::regex_replace
+    PowerRenameTemplateContext none;
+    CHECK(expand(L"$3-$1$$-$&-$2-$`-$'-$x$", true, none) == L"DOG-some$-some_DOG--b - file-$x$");
+    CHECK(expand(L"$10", true, none) == L"");
+    CHECK(expand(L"$3-$1", false, none) == L"$3-$1");
+
+    CHECK(expand(L"${3:lower}_${1:upper}_${&:title}_${3:title}", false, none) == L"dog_SOME_Some_Dog_Dog");
+    CHECK(expand(L"${0}${2}", true, none) == L"some_DOG");
+
+    // Tokens that don't parse are kept as they are
+    CHECK(expand(L"${1:shout}${nope}${counter:x}${size:1}${1", true, none) == L"${1:shout}${nope}${counter:x}${size:1}${1");
+
+    PowerRenameItemMetadata metadata;
+    metadata.valid = true;
+    metadata.size = 1234567;
+    metadata.modified = { 2009, 3, 7, 8, 5, 9 };
+    PowerRenameTemplateContext context;
+    context.counter = 12;
+    context.metadata = &metadata;
+    CHECK(expand(L"${counter}-${counter:4}-${counter:3:100:5}-${counter::0:2}", false, context) == L"12-0012-155-22");
+    CHECK(expand(L"${size}_${modified}_${modified:yyMMdd HH:mm:ss}", false, context) == L"1234567_2009-03-07_090307 08:05:09");
+
+    // An item without a place in a list is the first one
+    CHECK(expand(L"${counter:2:7}", false, none) == L"07");
+    // Metadata that couldn't be read expands to nothing
+    metadata.valid = false;
+    CHECK(expand(L"[${size}${modified}]", false, context) == L"[]");
+
+    CPowerRenameTemplate replaceTemplate;
+    replaceTemplate.Compile(L"${counter}${size}", false);
+    CHECK(replaceTemplate.GetUsage() == (TemplateUsesCounter | TemplateUsesMetadata));
+    replaceTemplate.Compile(L"$1 ${1}", true);
+    CHECK(replaceTemplate.GetUsage() == 0);
+}
+
+// A TIFF block whose Exif IFD holds dateTaken, in either byte order
+static std::vector<unsigned char> MakeExifTiff(_In_ bool bigEndian, _In_ const char* dateTaken)
+{
+    std::vector<unsigned char> tiff;
+    auto put16 = [&](unsigned int value) {
+        tiff.push_back(static_cast<unsigned char>(bigEndian ? value >> 8 : value));
+        tiff.push_back(static_cast<unsigned char>(bigEndian ? value : value >> 8));
+    };
+    auto put32 = [&](unsigned int value) {
+        put16(bigEndian ? value >> 16 : value & 0xFFFF);
+        put16(bigEndian ? value & 0xFFFF : value >> 16);
+    };
+
+    tiff.push_back(bigEndian ? 'M' : 'I');
+    tiff.push_back(bigEndian ? 'M' : 'I');
+    put16(42);
+    put32(8);
+    // IFD0 with the pointer to the Exif IFD at 26
+    put16(1);
+    put16(0x8769);
+    put16(4);
+    put32(1);
+    put32(26);
+    put32(0);
+    // Exif IFD with the date at 44
+    put16(1);
+    put16(0x9003);
+    put16(2);
+    put32(20);
+    put32(44);
+    put32(0);
+    tiff.insert(tiff.end(), dateTaken, dateTaken + 20);
+    return tiff;
+}
+
+// A JPEG header with a JFIF segment ahead of the Exif one
+static std::vector<unsigned char> MakeExifJpeg(_In_ const std::vector<unsigned char>& tiff)
+{
+    std::vector<unsigned char> jpeg = { 0xFF, 0xD8, 0xFF, 0xE0, 0, 6, 'J', 'F', 'I', 'F' };
+    size_t length = 2 + 6 + tiff.size();
+    unsigned char app1[] = { 0xFF, 0xE1, static_cast<unsigned char>(length >> 8), static_cast<unsigned char>(length), 'E', 'x', 'i', 'f', 0, 0 };
+    jpeg.insert(jpeg.end(), app1, app1 + sizeof(app1));
+    jpeg.insert(jpeg.end(), tiff.begin(), tiff.end());
+    unsigned char scan[] = { 0xFF, 0xDA, 0, 2 };
+    jpeg.insert(jpeg.end(), scan, scan + sizeof(scan));
+    return jpeg;
+}
+
+static void TestMetadata()
+{
+    CHECK(MayHaveExifHeader(L"IMG_1.JPG"));
+    CHECK(MayHaveExifHeader(L"scan.tiff"));
+    CHECK(!MayHaveExifHeader(L"notes.txt"));
+    CHECK(!MayHaveExifHeader(L"jpg"));
+
+    PowerRenameDateTime taken;
+    std::vector<unsigned char> jpeg = MakeExifJpeg(MakeExifTiff(false, "2019:08:17 14:03:09"));
+    CHECK(ParseExifDateTaken(jpeg.data(), jpeg.size(), taken));
+    CHECK(taken.year == 2019 && taken.month == 8 && taken.day == 17 && taken.hour == 14 && taken.minute == 3 && taken.second == 9);
+
+    std::vector<unsigned char> tiff = MakeExifTiff(true, "2001:12:31 23:59:58");
+    CHECK(ParseExifDateTaken(tiff.data(), tiff.size(), taken));
+    CHECK(taken.year == 2001 && taken.month == 12 && taken.second == 58);
+
+    // Unknown dates, headers cut short and files without Exif data
+    std::vector<unsigned char> unknown = MakeExifJpeg(MakeExifTiff(false, "0000:00:00 00:00:00"));
+    CHECK(!ParseExifDateTaken(unknown.data(), unknown.size(), taken));
+    for (size_t size = 0; size < jpeg.size() - 4; size++)
+    {
+        CHECK(!ParseExifDateTaken(jpeg.data(), size, taken));
+    }
+    unsigned char text[] = "plain text file";
+    CHECK(!ParseExifDateTaken(text, sizeof(text), taken));
+
+    CPowerRenameTemplate replaceTemplate;
+    replaceTemplate.Compile(L"${taken:yyyyMMdd_HHmmss}", false);
+    CHECK(replaceTemplate.GetUsage() == TemplateUsesHeader);
+
+    PowerRenameItemMetadata metadata;
+    metadata.valid = true;
+    metadata.modified = { 2020, 1, 2, 3, 4, 5 };
+    metadata.hasTaken = true;
+    metadata.taken = { 2019, 8, 17, 14, 3, 9 };
+    PowerRenameTemplateContext context;
+    context.metadata = &metadata;
+    PowerRenameMatch match = { 0, { { 0, 3 } } };
+    std::wstring result;
+    replaceTemplate.Append(L"IMG", match, context, result);
+    CHECK(result == L"20190817_140309");
+
+    // Pictures without a date taken still have a modified date
+    metadata.hasTaken = false;
+    replaceTemplate.Compile(L"[${taken}][${modified}]", false);
+    result.clear();
+    replaceTemplate.Append(L"IMG", match, context, result);
+    CHECK(result == L"[][2020-01-02]");
+}
+
+static void TestEngineTemplate()
+{
+    CMemoryFileSystem fs;
+    fs.Add(L"/d", L"IMG_a.jpg");
+    fs.Add(L"/d", L"notes.txt");
+    fs.Add(L"/d", L"IMG_b.jpg");
+    fs.Add(L"/d", L"IMG_c.jpg");
+
+    // The counter numbers the items the search term matched and EnumerateItems still
+    // numbers the names that are taken
+    CPowerRenameEngine engine;
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | UseRegularExpressions | EnumerateItems | NameOnly);
+    engine.GetSearch().SetSearchTerm(L"^IMG_(.)$");
+    engine.GetSearch().SetReplaceTerm(L"photo_${counter:3}_${1:upper}");
+    CHECK(engine.GetSearch().GetTemplateUsage() == TemplateUsesCounter);
+    engine.Load(fs);
+    CHECK(engine.Preview(&fs) == 3);
+
+    auto items = ByName(engine);
+    CHECK(items[L"IMG_a.jpg"].newName == L"photo_001_A.jpg");
+    CHECK(items[L"IMG_b.jpg"].newName == L"photo_002_B.jpg");
+    CHECK(items[L"IMG_c.jpg"].newName == L"photo_003_C.jpg");
+
+    engine.GetSearch().SetReplaceTerm(L"photo");
+    engine.Preview(&fs);
+    items = ByName(engine);
+    CHECK(items[L"IMG_a.jpg"].newName == L"photo (1).jpg");
+    CHECK(items[L"IMG_c.jpg"].newName == L"photo (3).jpg");
+}
+
+static void TestRegExAnalyzer()
+{
+    CHECK(AnalyzeRegExPattern(L"(\\d+)-(\\d+)").risk == NoRegExRisk);
+    CHECK(AnalyzeRegExPattern(L"(foo|bar)+").risk == NoRegExRisk);
+    CHECK(AnalyzeRegExPattern(L"(a{2}){3}").risk == NoRegExRisk);
+    CHECK(AnalyzeRegExPattern(L"[a-z]+\\.(txt|log)").risk == NoRegExRisk);
+    CHECK(AnalyzeRegExPattern(L"a{,}+").risk == NoRegExRisk);
+
+    PowerRenameRegExAnalysis analysis = AnalyzeRegExPattern(L"x(a+)+b");
+    CHECK(analysis.risk == NestedQuantifierRisk);
+    CHECK(analysis.position == 5);
+    CHECK(AnalyzeRegExPattern(L"(\\w*\\s?)*$").risk == NestedQuantifierRisk);
+    CHECK(AnalyzeRegExPattern(L"(?:a{1,3}){2,}").risk == NestedQuantifierRisk);
+
+    analysis = AnalyzeRegExPattern(L"^(a|ab)*c");
+    CHECK(analysis.risk == AmbiguousAlternationRisk);
+    CHECK(analysis.position == 7);
+    CHECK(AnalyzeRegExPattern(L"(A|[a-c])*").risk == AmbiguousAlternationRisk);
+    CHECK(AnalyzeRegExPattern(L"(\\d|1)+").risk == AmbiguousAlternationRisk);
+    CHECK(AnalyzeRegExPattern(L"(.|x)+").risk == AmbiguousAlternationRisk);
+    CHECK(AnalyzeRegExPattern(L"(a?|b?)+").risk == AmbiguousAlternationRisk);
+
+    // Invalid patterns are read as far as they go
+    CHECK(AnalyzeRegExPattern(L"((a+)+").risk == NestedQuantifierRisk);
+    CHECK(AnalyzeRegExPattern(L"a)b[").risk == NoRegExRisk);
+}
+
+static void TestMatchBudget()
+{
+    CPowerRenameSearch search;
+    PowerRenameMatches matches;
+    search.SetFlags(UseRegularExpressions | MatchAllOccurences);
+    search.SetEngine(StdRegExEngine);
+    search.SetMatchBudget(std::chrono::milliseconds(20));
+
+    // Risky patterns the linear engine supports run on it even with std::wregex selected
+    std::wstring name = std::wstring(40, L'a') + L"c";
+    search.SetSearchTerm(L"(a+)+b");
+    CHECK(search.GetRegExAnalysis().risk == NestedQuantifierRisk);
+    CHECK(search.Match(name, matches));
+    CHECK(matches.matches.empty() && !matches.timedOut);
+
+    // A backreference keeps it on std::wregex, which gives up once the budget is spent
+    search.SetSearchTerm(L"^(a)(\\1|a)*b");
+    CHECK(search.GetRegExAnalysis().risk == AmbiguousAlternationRisk);
+    auto start = std::chrono::steady_clock::now();
+    CHECK(!search.Match(name, matches));
+    CHECK(matches.matches.empty() && matches.timedOut);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+    CHECK(search.Match(L"aaab", matches));
+    CHECK(matches.matches.size() == 1 && !matches.timedOut);
+}
+
+static void TestEnginePreview()
+{
+    CMemoryFileSystem fileSystem;
+    fileSystem.Add(L"/d", L"a.txt");
+    fileSystem.Add(L"/d", L"b.txt");
+    fileSystem.Add(L"/d", L"sub", true);
+    fileSystem.Add(L"/d/sub", L"c.txt", false, 1);
+
+    CPowerRenameEngine engine;
+    engine.GetSearch().SetSearchTerm(L"txt");
+    engine.GetSearch().SetReplaceTerm(L"md");
+    engine.Load(fileSystem);
+    CHECK(engine.GetItems().size() == 4);
+    CHECK(engine.Preview(&fileSystem) == 3);
+
+    auto items = ByName(engine);
+    CHECK(items[L"a.txt"].newName == L"a.md");
+    CHECK(items[L"sub"].state == PowerRenameItemState::Unchanged);
+    CHECK(items[L"c.txt"].state == PowerRenameItemState::Renamed);
+
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | ExcludeSubfolders);
+    CHECK(engine.Preview(&fileSystem) == 2);
+    CHECK(ByName(engine)[L"c.txt"].state == PowerRenameItemState::Excluded);
+
+    // Numbered in item order
+    engine.GetSearch().SetSearchTerm(L"^.*$");
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | EnumerateItems | NameOnly | UseRegularExpressions);
+    engine.GetSearch().SetReplaceTerm(L"photo");
+    CHECK(engine.Preview(&fileSystem) == 4);
+    items = ByName(engine);
+    CHECK(items[L"a.txt"].newName == L"photo (1).txt");
+    CHECK(items[L"b.txt"].newName == L"photo (2).txt");
+    CHECK(items[L"sub"].newName == L"photo (3)");
+    CHECK(items[L"c.txt"].newName == L"photo (4).txt");
+}
+
+static void TestEngineCollisions()
+{
+    CMemoryFileSystem fileSystem;
+    fileSystem.Add(L"/d", L"one_a.txt");
+    fileSystem.Add(L"/d", L"one_b.txt");
+    fileSystem.Add(L"/d", L"two.txt");
+    fileSystem.Add(L"/e", L"one_c.txt");
+    fileSystem.AddEntry(L"/d", L"three.txt");
+
+    // Both one_a and one_b become one.txt in /d.  one_c is in another folder.
+    CPowerRenameEngine engine;
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | UseRegularExpressions);
+    engine.GetSearch().SetSearchTerm(L"_.");
+    engine.Load(fileSystem);
+    CHECK(engine.Preview(&fileSystem) == 1);
+    auto items = ByName(engine);
+    CHECK(items[L"one_a.txt"].state == PowerRenameItemState::Collision);
+    CHECK(items[L"one_b.txt"].state == PowerRenameItemState::Collision);
+    CHECK(items[L"one_c.txt"].state == PowerRenameItemState::Renamed);
+
+    // three.txt exists but isn't one of the items
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS);
+    engine.GetSearch().SetSearchTerm(L"two");
+    engine.GetSearch().SetReplaceTerm(L"three");
+    CHECK(engine.Preview(&fileSystem) == 0);
+    CHECK(ByName(engine)[L"two.txt"].state == PowerRenameItemState::Collision);
+
+    // Names differing only in case collide as well
+    CMemoryFileSystem mixedCase;
+    mixedCase.Add(L"/d", L"a1");
+    mixedCase.Add(L"/d", L"A2");
+    CPowerRenameEngine mixedCaseEngine;
+    mixedCaseEngine.GetSearch().SetFlags(DEFAULT_FLAGS | UseRegularExpressions);
+    mixedCaseEngine.GetSearch().SetSearchTerm(L"\\d");
+    mixedCaseEngine.Load(mixedCase);
+    CHECK(mixedCaseEngine.Preview(&mixedCase) == 0);
+
+    // Not when the existing entry is renamed away
+    CMemoryFileSystem chain;
+    chain.Add(L"/d", L"a__.txt");
+    chain.Add(L"/d", L"a_.txt");
+    CPowerRenameEngine chainEngine;
+    chainEngine.GetSearch().SetFlags(0);
+    chainEngine.GetSearch().SetSearchTerm(L"a_");
+    chainEngine.GetSearch().SetReplaceTerm(L"a");
+    chainEngine.Load(chain);
+    CHECK(chainEngine.Preview(&chain) == 2);
+
+    // Removing the whole name leaves it empty, which is not a new name
+    chainEngine.GetSearch().SetSearchTerm(L"a_.txt");
+    chainEngine.GetSearch().SetReplaceTerm(L"");
+    CHECK(chainEngine.Preview(&chain) == 0);
+    CHECK(ByName(chainEngine)[L"a_.txt"].state == PowerRenameItemState::Unchanged);
+}
+
+static void TestEngineCommitOrder()
+{
+    // a__ -> a_ only works once a_ -> a is done
+    CMemoryFileSystem chain;
+    chain.Add(L"/d", L"a__.txt");
+    chain.Add(L"/d", L"a_.txt");
+    CPowerRenameEngine chainEngine;
+    chainEngine.GetSearch().SetFlags(0);
+    chainEngine.GetSearch().SetSearchTerm(L"a_");
+    chainEngine.GetSearch().SetReplaceTerm(L"a");
+    chainEngine.Load(chain);
+    CHECK(chainEngine.Preview(&chain) == 2);
+    CHECK(chainEngine.Commit(chain) == 2);
+    CHECK(chain.m_renames.size() == 2 && chain.m_renames[0] == L"a_.txt->a.txt");
+
+    // A swap goes through a temporary name
+    CMemoryFileSystem swap;
+    swap.Add(L"/d", L"ab");
+    swap.Add(L"/d", L"ba");
+    CPowerRenameEngine swapEngine;
+    swapEngine.GetSearch().SetFlags(DEFAULT_FLAGS | UseRegularExpressions);
+    swapEngine.GetSearch().SetSearchTerm(L"^(.)(.)$");
+    swapEngine.GetSearch().SetReplaceTerm(L"$2$1");
+    swapEngine.Load(swap);
+    CHECK(swapEngine.Preview(&swap) == 2);
+    CHECK(swapEngine.Commit(swap) == 2);
+    CHECK(swap.m_renames.size() == 3 && swap.m_renames[0] == L"ab->~powerrename1.tmp");
+    CHECK(swap.m_entries.count(L"/d/ab") == 1 && swap.m_entries.count(L"/d/ba") == 1);
+    CHECK(ByName(swapEngine)[L"ab"].state == PowerRenameItemState::Committed);
+
+    // One failure undoes the whole batch
+    CMemoryFileSystem failing;
+    failing.Add(L"/d", L"a1");
+    failing.Add(L"/d", L"a2");
+    failing.Add(L"/e", L"a3");
+    failing.m_failingName = L"b2";
+    CPowerRenameEngine failingEngine;
+    failingEngine.GetSearch().SetSearchTerm(L"a");
+    failingEngine.GetSearch().SetReplaceTerm(L"b");
+    failingEngine.Load(failing);
+    CHECK(failingEngine.Preview(&failing) == 3);
+    CHECK(failingEngine.Commit(failing) == 0);
+    CHECK(ByName(failingEngine)[L"a2"].state == PowerRenameItemState::Failed);
+    CHECK(ByName(failingEngine)[L"a1"].state == PowerRenameItemState::Renamed);
+    CHECK(failing.m_entries.count(L"/d/a1") == 1 && failing.m_entries.count(L"/e/a3") == 1);
+
+    // Children before their folder
+    CMemoryFileSystem tree;
+    tree.Add(L"/d", L"x", true);
+    tree.Add(L"/d/x", L"x.md", false, 1);
+    CPowerRenameEngine treeEngine;
+    treeEngine.GetSearch().SetSearchTerm(L"x");
+    treeEngine.GetSearch().SetReplaceTerm(L"y");
+    treeEngine.Load(tree);
+    CHECK(treeEngine.Preview(&tree) == 2);
+    CHECK(treeEngine.Commit(tree) == 2);
+    CHECK(tree.m_renames.size() == 2 && tree.m_renames[0] == L"x.md->y.md");
+    CHECK(tree.m_entries.count(L"/d/y") == 1);
+}
+
+static void WriteFile(const fs::path& path)
+{
+    std::ofstream file(path);
+    file << "test";
+}
+
+static void TestFileSystem()
+{
+    fs::path root = fs::temp_directory_path() / "PowerRenameCoreTests";
+    fs::remove_all(root);
+    fs::create_directories(root / "album_2019" / "nested");
+    WriteFile(root / "album_2019" / "IMG_2019_1.jpg");
+    WriteFile(root / "album_2019" / "IMG_2019_2.jpg");
+    WriteFile(root / "album_2019" / "nested" / "IMG_2019_3.jpg");
+    WriteFile(root / "album_2019" / "IMG_2020_1.jpg");
+
+    // Without recursion only the folder itself is an item
+    CFileSystemItemSource flat({ root / "album_2019" }, false);
+    CPowerRenameEngine engine;
+    engine.Load(flat);
+    CHECK(engine.GetItems().size() == 1);
+    CHECK(engine.GetItems()[0].source.isFolder);
+    CHECK(engine.GetItems()[0].source.name == L"album_2019");
+
+    CFileSystemItemSource source({ root / "album_2019" }, true);
+    engine.Load(source);
+    CHECK(engine.GetItems().size() == 6);
+    CHECK(engine.GetItems()[1].source.name == L"IMG_2019_1.jpg");
+    CHECK(engine.GetItems()[1].source.depth == 1);
+    CHECK(engine.GetItems()[4].source.name == L"nested");
+    CHECK(engine.GetItems()[5].source.depth == 2);
+    CHECK(engine.GetItems()[1].source.metadata.valid);
+    CHECK(engine.GetItems()[1].source.metadata.size == fs::file_size(root / "album_2019" / "IMG_2019_1.jpg"));
+    CHECK(engine.GetItems()[1].source.metadata.modified.year >= 2020);
+
+    // IMG_2019_1 would become the existing IMG_2020_1
+    CFileSystemRenameSink sink;
+    engine.GetSearch().SetSearchTerm(L"2019");
+    engine.GetSearch().SetReplaceTerm(L"2020");
+    CHECK(engine.Preview(&sink) == 3);
+    CHECK(ByName(engine)[L"IMG_2019_1.jpg"].state == PowerRenameItemState::Collision);
+
+    CHECK(engine.Commit(sink) == 3);
+    CHECK(fs::exists(root / "album_2020" / "IMG_2020_2.jpg"));
+    CHECK(fs::exists(root / "album_2020" / "nested" / "IMG_2020_3.jpg"));
+    CHECK(fs::exists(root / "album_2020" / "IMG_2019_1.jpg"));
+    CHECK(!fs::exists(root / "album_2019"));
+
+    // The sink never replaces an existing file
+    PowerRenameSourceItem item;
+    item.path = (root / "album_2020" / "IMG_2019_1.jpg").wstring();
+    item.parent = (root / "album_2020").wstring();
+    item.name = L"IMG_2019_1.jpg";
+    CHECK(!sink.Rename(item.parent, item.name, L"IMG_2020_1.jpg"));
+    CHECK(fs::exists(root / "album_2020" / "IMG_2019_1.jpg"));
+
+    // The date taken comes from the picture's Exif data when headers are read
+    std::vector<unsigned char> jpeg = MakeExifJpeg(MakeExifTiff(false, "2019:08:17 14:03:09"));
+    std::ofstream(root / "taken.jpg", std::ios::binary).write(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+    CFileSystemItemSource headers({ root / "taken.jpg", root / "album_2020" / "IMG_2019_1.jpg" }, false, true);
+    engine.Load(headers);
+    CHECK(engine.GetItems().size() == 2);
+    CHECK(engine.GetItems()[0].source.metadata.hasTaken);
+    CHECK(engine.GetItems()[0].source.metadata.taken.day == 17);
+    CHECK(!engine.GetItems()[1].source.metadata.hasTaken);
+
+    // Names that are not ASCII are renamed whatever the locale is
+    fs::path unicode = ToFileSystemPath(L"café 日本.txt");
+    CHECK(FromFileSystemPath(unicode) == L"café 日本.txt");
+    WriteFile(root / unicode);
+    CFileSystemItemSource unicodeSource({ root / unicode }, false);
+    engine.Load(unicodeSource);
+    CHECK(engine.GetItems().size() == 1);
+    CHECK(engine.GetItems()[0].source.name == L"café 日本.txt");
+    engine.GetSearch().SetSearchTerm(L"é");
+    engine.GetSearch().SetReplaceTerm(L"e");
+    CHECK(engine.Preview(&sink) == 1);
+    CHECK(engine.Commit(sink) == 1);
+    CHECK(fs::exists(root / ToFileSystemPath(L"cafe 日本.txt")));
+
+    fs::remove_all(root);
+}
+
+static void TestRenamePlan()
+{
+    CMemoryFileSystem fileSystem;
+
+    // A chain, a three way cycle, a change of case and a rename in a subfolder
+    std::vector<PowerRenameStep> renames = {
+        { L"/d", L"a", L"b", 0 },
+        { L"/d", L"b", L"c", 1 },
+        { L"/d", L"x", L"y", 2 },
+        { L"/d", L"y", L"z", 3 },
+        { L"/d", L"z", L"x", 4 },
+        { L"/d", L"case", L"CASE", 5 },
+        { L"/d/sub", L"s", L"t", 6 },
+    };
+    PowerRenamePlan plan = CreateRenamePlan(renames, fileSystem);
+    CHECK(plan.folders.size() == 2);
+    CHECK(plan.folders[0].depth == 2 && plan.steps[plan.folders[0].firstStep].from == L"s");
+
+    std::vector<std::wstring> order;
+    for (size_t i = plan.folders[1].firstStep; i < plan.folders[1].firstStep + plan.folders[1].stepCount; i++)
+    {
+        order.push_back(plan.steps[i].from + L"->" + plan.steps[i].to);
+    }
+    std::vector<std::wstring> expected = { L"b->c", L"case->CASE", L"a->b", L"x->~powerrename1.tmp", L"z->x", L"y->z", L"~powerrename1.tmp->y" };
+    CHECK(order == expected);
+}
+
+static void TestJournal()
+{
+    fs::path root = fs::temp_directory_path() / "PowerRenameJournalTests";
+    fs::remove_all(root);
+    fs::create_directories(root);
+    fs::path journalPath = root / "journal.txt";
+
+    CMemoryFileSystem fileSystem;
+    for (const wchar_t* name : { L"a", L"b", L"c", L"tab\tname" })
+    {
+        fileSystem.Add(L"/d", name);
+    }
+
+    // The rename of c fails half way through, as if the batch was interrupted there
+    std::vector<PowerRenameStep> renames = {
+        { L"/d", L"a", L"b", 0 },
+        { L"/d", L"b", L"a", 1 },
+        { L"/d", L"c", L"\u00e9t\u00e9 \U0001F600", 2 },
+        { L"/d", L"tab\tname", L"new\nline", 3 },
+    };
+    PowerRenamePlan plan = CreateRenamePlan(renames, fileSystem);
+    CPowerRenameJournal journal;
+    CHECK(journal.Create(journalPath, plan));
+
+    fileSystem.m_failingName = L"\u00e9t\u00e9 \U0001F600";
+    CPowerRenameCommitter committer(1);
+    std::vector<PowerRenameStepState> states;
+    CHECK(!committer.Commit(plan, fileSystem, &journal, states));
+
+    // The journal holds the same plan and states
+    {
+        std::ofstream cutOff(journalPath, std::ios::binary | std::ios::app);
+        cutOff << "D 9";
+    }
+    CPowerRenameJournal reopened;
+    PowerRenamePlan loadedPlan;
+    std::vector<PowerRenameStepState> loadedStates;
+    CHECK(reopened.Open(journalPath, loadedPlan, loadedStates));
+    CHECK(loadedPlan.steps.size() == plan.steps.size() && loadedPlan.folders.size() == plan.folders.size());
+    for (size_t i = 0; i < plan.steps.size() && i < loadedPlan.steps.size(); i++)
+    {
+        CHECK(loadedPlan.steps[i].from == plan.steps[i].from && loadedPlan.steps[i].to == plan.steps[i].to);
+        CHECK(loadedPlan.steps[i].parent == plan.steps[i].parent && loadedPlan.steps[i].item == plan.steps[i].item);
+    }
+    CHECK(loadedStates == states);
+
+    // Resume once the cause of the failure is gone
+    fileSystem.m_failingName.clear();
+    ResolveStartedSteps(loadedPlan, fileSystem, loadedStates);
+    CHECK(committer.Commit(loadedPlan, fileSystem, &reopened, loadedStates));
+    CHECK(fileSystem.m_entries.count(L"/d/new\nline") == 1);
+    CHECK(fileSystem.m_entries.count(L"/d/a") == 1 && fileSystem.m_entries.count(L"/d/b") == 1);
+
+    // And roll everything back from the journal
+    CPowerRenameJournal again;
+    CHECK(again.Open(journalPath, loadedPlan, loadedStates));
+    CHECK(committer.RollBack(loadedPlan, fileSystem, &again, loadedStates));
+    CHECK(fileSystem.m_entries.count(L"/d/c") == 1 && fileSystem.m_entries.count(L"/d/tab\tname") == 1);
+    CHECK(fileSystem.m_renames.back() == L"\u00e9t\u00e9 \U0001F600->c");
+    again.Remove();
+    CHECK(!fs::exists(journalPath));
+
+    // Without the closing record the plan is incomplete
+    {
+        std::ofstream incomplete(journalPath, std::ios::binary);
+        incomplete << "POWERRENAME JOURNAL 1\nF 0 1 1\n";
+    }
+    CHECK(!reopened.Open(journalPath, loadedPlan, loadedStates));
+
+    fs::remove_all(root);
+}
+
+static void TestUndoLog()
+{
+    // Renames that ran inside folders renamed before them move to the original paths
+    std::vector<PowerRenameStep> done = {
+        { L"/r", L"old", L"new", 0 },
+        { L"/r/new", L"sub", L"dir", 1 },
+        { L"/r/new/dir", L"a.txt", L"b.txt", 2 },
+        { L"/r/new", L"c.txt", L"d.txt", 3 },
+    };
+    PowerRenamePlan undoPlan = CreateUndoPlan(done);
+    CHECK(undoPlan.folders.size() == 3);
+    CHECK(undoPlan.steps[undoPlan.folders[0].firstStep].parent == L"/r/old/sub");
+    CHECK(undoPlan.steps[undoPlan.folders[1].firstStep].parent == L"/r/old");
+    CHECK(undoPlan.folders[1].stepCount == 2);
+    CHECK(undoPlan.steps[undoPlan.folders[2].firstStep].parent == L"/r");
+
+    fs::path root = fs::temp_directory_path() / "PowerRenameUndoLogTests";
+    fs::remove_all(root);
+    fs::create_directories(root / "album_2019" / "nested");
+    WriteFile(root / "album_2019" / "IMG_2019_1.jpg");
+    WriteFile(root / "album_2019" / "nested" / "IMG_2019_2.jpg");
+    WriteFile(root / "notes_2019.txt");
+    fs::path logPath = root / "undo.log";
+
+    // Two batches, the second renaming a folder and its contents
+    CFileSystemRenameSink sink;
+    CPowerRenameEngine engine;
+    CFileSystemItemSource first({ root / "notes_2019.txt" }, false);
+    engine.Load(first);
+    engine.GetSearch().SetSearchTerm(L"2019");
+    engine.GetSearch().SetReplaceTerm(L"2020");
+    CHECK(engine.Preview(&sink) == 1);
+    CHECK(engine.Commit(sink, fs::path(), logPath) == 1);
+
+    CFileSystemItemSource second({ root / "album_2019" }, true);
+    engine.Load(second);
+    CHECK(engine.Preview(&sink) == 3);
+    CHECK(engine.Commit(sink, fs::path(), logPath) == 3);
+    CHECK(fs::exists(root / "album_2020" / "nested" / "IMG_2020_2.jpg"));
+
+    CPowerRenameUndoLog undoLog(logPath);
+    CHECK(undoLog.GetBatchCount() == 2);
+    PowerRenamePlan lastBatch;
+    CHECK(undoLog.ReadLastBatch(lastBatch));
+    CHECK(lastBatch.steps.size() == 3);
+
+    // A record cut short by a crash is not a batch
+    {
+        std::ofstream torn(logPath, std::ios::binary | std::ios::app);
+        torn << std::string("\x20\0\0\0\1\2\3\4partial", 16);
+    }
+    CHECK(undoLog.GetBatchCount() == 2);
+
+    CHECK(undoLog.RevertLastBatch(sink, 2) == 3);
+    CHECK(fs::exists(root / "album_2019" / "nested" / "IMG_2019_2.jpg"));
+    CHECK(fs::exists(root / "album_2019" / "IMG_2019_1.jpg"));
+    CHECK(!fs::exists(root / "album_2020"));
+    CHECK(undoLog.GetBatchCount() == 1);
+
+    // A step that can't be undone stays in the log
+    WriteFile(root / "notes_2019.txt");
+    CHECK(undoLog.RevertLastBatch(sink) == 0);
+    CHECK(undoLog.GetBatchCount() == 1);
+    fs::remove(root / "notes_2019.txt");
+    CHECK(undoLog.RevertLastBatch(sink) == 1);
+    CHECK(fs::exists(root / "notes_2019.txt"));
+    CHECK(undoLog.GetBatchCount() == 0);
+
+    // Only the latest batches are kept
+    CMemoryFileSystem fileSystem;
+    std::vector<PowerRenameStep> renames = { { L"/d", L"a", L"b", 0 } };
+    PowerRenamePlan plan = CreateRenamePlan(renames, fileSystem);
+    std::vector<PowerRenameStepState> states(plan.steps.size(), PowerRenameStepState::Done);
+    for (int i = 0; i < POWERRENAME_UNDO_LOG_BATCHES + 3; i++)
+    {
+        CHECK(undoLog.Append(plan, states));
+    }
+    CHECK(undoLog.GetBatchCount() == POWERRENAME_UNDO_LOG_BATCHES);
+
+    // Dialogs appending at the same time don't lose or tear each other's batches
+    fs::remove(logPath);
+    CHECK(undoLog.Append(plan, states));
+    std::uintmax_t oneBatchSize = fs::file_size(logPath);
+    CHECK(undoLog.Append(plan, states));
+    std::uintmax_t batchSize = fs::file_size(logPath) - oneBatchSize;
+    fs::remove(logPath);
+    std::vector<std::thread> dialogs;
+    for (int i = 0; i < 8; i++)
+    {
+        dialogs.emplace_back([&]() {
+            CPowerRenameUndoLog dialogLog(logPath);
+            for (int j = 0; j < 2 * POWERRENAME_UNDO_LOG_BATCHES; j++)
+            {
+                dialogLog.Append(plan, states);
+            }
+        });
+    }
+    for (auto& dialog : dialogs)
+    {
+        dialog.join();
+    }
+    CHECK(undoLog.GetBatchCount() == POWERRENAME_UNDO_LOG_BATCHES);
+    CHECK(fs::file_size(logPath) == oneBatchSize + (POWERRENAME_UNDO_LOG_BATCHES - 1) * batchSize);
+    CHECK(undoLog.ReadLastBatch(lastBatch) && lastBatch.steps.size() == 1);
+
+    fs::remove_all(root);
+}
+
+static void TestNameIndex()
+{
+    std::vector<std::wstring> listed;
+    CPowerRenameNameIndex index([&](const std::wstring& parent, std::vector<std::wstring>& names) {
+        listed.push_back(parent);
+        names.push_back(L"Listed.txt");
+    });
+
+    index.AddName(L"/a", L"foo (1).txt");
+    index.AddFolder(L"/a");
+    CHECK(index.IsTaken(L"/A", L"FOO (1).TXT"));
+    CHECK(!index.IsTaken(L"/a", L"listed.txt"));
+    CHECK(listed.empty());
+
+    // Folders that weren't enumerated are listed once
+    CHECK(index.IsTaken(L"/b", L"listed.txt"));
+    CHECK(!index.IsTaken(L"/b", L"other.txt"));
+    CHECK(listed.size() == 1 && listed[0] == L"/b");
+
+    CHECK(index.Reserve(L"/a", L"bar.txt"));
+    CHECK(!index.Reserve(L"/a", L"Bar.txt"));
+    CHECK(index.Reserve(L"/b", L"bar.txt"));
+
+    // Numbers skip the existing and reserved names but not the item's own name
+    std::wstring uniqueName;
+    unsigned long numberUsed = 0;
+    CHECK(index.ReserveEnumeratedName(L"/a", L"x.txt", L"foo.txt", 1, POWERRENAME_MAX_PATH, uniqueName, &numberUsed));
+    CHECK(uniqueName == L"foo (2).txt" && numberUsed == 2);
+    CHECK(index.ReserveEnumeratedName(L"/a", L"y.txt", L"foo.txt", 2, POWERRENAME_MAX_PATH, uniqueName, &numberUsed));
+    CHECK(uniqueName == L"foo (3).txt" && numberUsed == 3);
+    CHECK(index.ReserveEnumeratedName(L"/a", L"foo (1).txt", L"foo.txt", 1, POWERRENAME_MAX_PATH, uniqueName, &numberUsed));
+    CHECK(uniqueName == L"foo (1).txt");
+
+    index.ClearReservations();
+    CHECK(!index.IsTaken(L"/a", L"bar.txt"));
+    CHECK(index.IsTaken(L"/a", L"foo (1).txt"));
+
+    index.Clear();
+    CHECK(!index.IsTaken(L"/a", L"foo (1).txt"));
+}
+
+static void TestEngineEnumeratedNames()
+{
+    // Numbers skip the entries already there and the names taken by earlier items
+    CMemoryFileSystem fs;
+    fs.Add(L"/d", L"a.txt");
+    fs.Add(L"/d", L"c.txt");
+    fs.AddEntry(L"/d", L"new (2).txt");
+    fs.Add(L"/d/sub", L"e.txt", false, 1);
+    fs.Add(L"/d/sub", L"new (3).txt", false, 1);
+
+    CPowerRenameEngine engine;
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | UseRegularExpressions | EnumerateItems);
+    engine.GetSearch().SetSearchTerm(L"^[ace]");
+    engine.GetSearch().SetReplaceTerm(L"new");
+    engine.Load(fs);
+    CHECK(engine.Preview(&fs) == 3);
+
+    auto items = ByName(engine);
+    CHECK(items[L"a.txt"].newName == L"new (1).txt");
+    CHECK(items[L"c.txt"].newName == L"new (3).txt");
+    CHECK(items[L"e.txt"].newName == L"new (4).txt");
+
+    // Only the folder whose contents weren't among the items was listed
+    CHECK(fs.m_listed.size() == 1 && fs.m_listed[0] == L"/d");
+}
+
+static void TestStats()
+{
+    CMemoryFileSystem fs;
+    fs.Add(L"/d", L"a.txt");
+    fs.Add(L"/d", L"b.txt");
+    fs.Add(L"/d", L"c.log");
+
+    CPowerRenameEngine engine;
+    engine.GetSearch().SetFlags(DEFAULT_FLAGS | EnumerateItems);
+    engine.GetSearch().SetSearchTerm(L"\"\u00e9.txt");
+    engine.GetSearch().SetReplaceTerm(L"x");
+    engine.Load(fs);
+    engine.Preview(&fs);
+    engine.GetSearch().SetSearchTerm(L".txt");
+    engine.Preview(&fs);
+    CHECK(engine.Commit(fs) == 2);
+
+    std::string json = engine.GetStats().ToJson();
+    CHECK(json.find("{\"version\":1,\"phases\":{") == 0);
+    CHECK(json.find("\"enumerate\":{\"runs\":1,") != std::string::npos);
+    CHECK(json.find("\"match\":{\"runs\":2,") != std::string::npos);
+    CHECK(json.find("\"number\":{\"runs\":2,") != std::string::npos);
+    CHECK(json.find("\"commit\":{\"runs\":1,") != std::string::npos);
+    CHECK(json.find("\"counters\":{\"itemsScanned\":6,\"itemsMatched\":2,\"itemsRenamed\":2}") != std::string::npos);
+    CHECK(json.find("\"searchTerm\":\"\\\"\xc3\xa9.txt\",\"flags\":") != std::string::npos);
+    CHECK(json.find("\"searchTerm\":\".txt\"") != std::string::npos);
+
+    // Every scanned item is in the histogram
+    size_t histogramItems = 0;
+    size_t histogram = json.find("\"matchTimeHistogram\":[");
+    for (size_t at = json.find("\"items\":", histogram); at != std::string::npos && at < json.find("\"slowestPatterns\""); at = json.find("\"items\":", at + 1))
+    {
+        histogramItems += std::stoul(json.substr(at + 8));
+    }
+    CHECK(histogramItems == 6);
+
+    engine.GetStats().Reset();
+    CHECK(engine.GetStats().ToJson().find("\"itemsScanned\":0,") != std::string::npos);
+    CHECK(engine.GetStats().ToJson().find("\"slowestPatterns\":[]") != std::string::npos);
+
+    // The slowest search terms per item come first and only five are listed
+    CPowerRenameStats stats;
+    for (int i = 0; i < 8; i++)
+    {
+        stats.AddPatternPass(L"p" + std::to_wstring(i), 0, 10, std::chrono::nanoseconds(100 * (i + 1)));
+    }
+    json = stats.ToJson();
+    CHECK(json.find("\"slowestPatterns\":[{\"searchTerm\":\"p7\"") != std::string::npos);
+    CHECK(json.find("\"p3\"") != std::string::npos);
+    CHECK(json.find("\"p2\"") == std::string::npos);
+}
+
+int main()
+{
+    TestNaming();
+    TestSearch();
+    TestEmptyMatches();
+    TestTemplate();
+    TestMetadata();
+    TestEngineTemplate();
+    TestRegExAnalyzer();
+    TestMatchBudget();
+    TestEnginePreview();
+    TestEngineCollisions();
+    TestEngineCommitOrder();
+    TestRenamePlan();
+    TestJournal();
+    TestNameIndex();
+    TestEngineEnumeratedNames();
+    TestStats();
+    TestFileSystem();
+    TestUndoLog();
+
+    if (s_failures)
+    {
+        fprintf(stderr, "%d checks failed\n", s_failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include "PowerRenameCorpus.h"
+#include "PowerRenameFileSystem.h"
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+// Files per folder of each shape
+#define CORPUS_FLAT_FOLDER_SIZE 10000
+#define CORPUS_DEEP_FOLDER_SIZE 50
+#define CORPUS_FOLDER_SIZE 1000
+// Levels of the deep shape.  The number of subfolders per folder grows with the corpus.
+#define CORPUS_DEEP_LEVELS 6
+// One file in this many is a picture
+#define CORPUS_PICTURE_RATIO 4
+#define CORPUS_LONG_NAME_MIN 150
+#define CORPUS_LONG_NAME_MAX 200
+
+static const wchar_t* s_words[] = { L"report", L"notes", L"budget", L"draft", L"final", L"summary", L"invoice", L"holiday", L"scan", L"backup" };
+
+// Accented Latin, Cyrillic, Greek, CJK and an emoji that takes a surrogate pair in UTF-16
+static const wchar_t* s_unicodeWords[] = { L"café", L"Straße", L"naïve", L"отчёт", L"σημειώσεις",
+                                           L"日本語", L"写真", L"한국어", L"\U0001F600", L"résumé" };
+
+static const wchar_t* s_extensions[] = { L".txt", L".docx", L".pdf", L".png", L".mp3" };
+
+const char* GetCorpusShapeName(_In_ CorpusShape shape)
+{
+    switch (shape)
+    {
+    case CorpusShape::Flat:
+        return "flat";
+    case CorpusShape::Deep:
+        return "deep";
+    case CorpusShape::Unicode:
+        return "unicode";
+    case CorpusShape::Long:
+        return "long";
+    }
+    return "";
+}
+
+bool ParseCorpusShape(_In_ const std::string& name, _Out_ CorpusShape& shape)
+{
+    for (CorpusShape candidate : { CorpusShape::Flat, CorpusShape::Deep, CorpusShape::Unicode, CorpusShape::Long })
+    {
+        if (name == GetCorpusShapeName(candidate))
+        {
+            shape = candidate;
+            return true;
+        }
+    }
+    shape = CorpusShape::Flat;
+    return false;
+}
+
+// xorshift32.  The standard distributions differ between libraries, this doesn't.
+class CCorpusRandom
+{
+public:
+    explicit CCorpusRandom(_In_ std::uint32_t seed) :
+        m_state(seed ? seed : 1)
+    {
+    }
+
+    std::uint32_t Below(_In_ std::uint32_t bound)
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state % bound;
+    }
+
+    template<typename T, size_t N>
+    const T& Pick(_In_ const T (&values)[N])
+    {
+        return values[Below(static_cast<std::uint32_t>(N))];
+    }
+
+private:
+    std::uint32_t m_state;
+};
+
+static std::wstring Number(_In_ size_t value, _In_ int width)
+{
+    wchar_t text[32];
+    swprintf(text, sizeof(text) / sizeof(text[0]), L"%0*zu", width, value);
+    return text;
+}
+
+CPowerRenameCorpus::CPowerRenameCorpus(_In_ CorpusShape shape, _In_ size_t fileCount, _In_ std::uint32_t seed)
+{
+    CCorpusRandom random(seed);
+    m_folders.push_back({ std::wstring(), -1, 0 });
+
+    size_t folderSize = shape == CorpusShape::Flat ? CORPUS_FLAT_FOLDER_SIZE : shape == CorpusShape::Deep ? CORPUS_DEEP_FOLDER_SIZE : CORPUS_FOLDER_SIZE;
+    size_t folderCount = (fileCount + folderSize - 1) / folderSize;
+    if (shape == CorpusShape::Deep)
+    {
+        // The fewest subfolders per folder that make room for every file
+        size_t branching = 1;
+        for (;;)
+        {
+            size_t treeSize = 0;
+            size_t levelSize = 1;
+            for (int level = 0; level < CORPUS_DEEP_LEVELS; level++)
+            {
+                levelSize *= branching;
+                treeSize += levelSize;
+            }
+            if (treeSize >= folderCount)
+            {
+                break;
+            }
+            branching++;
+        }
+
+        // Breadth first so parents come before their children
+        for (size_t parent = 0; parent < m_folders.size() && m_folders[parent].depth < CORPUS_DEEP_LEVELS; parent++)
+        {
+            for (size_t i = 0; i < branching; i++)
+            {
+                std::wstring name = std::wstring(random.Pick(s_words)) + L"_" + std::to_wstring(m_folders[parent].depth + 1) + L"_" + std::to_wstring(i);
+                std::wstring path = m_folders[parent].path.empty() ? name : m_folders[parent].path + static_cast<wchar_t>(fs::path::preferred_separator) + name;
+                m_folders.push_back({ path, static_cast<int>(parent), m_folders[parent].depth + 1 });
+            }
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < folderCount; i++)
+        {
+            std::wstring name = shape == CorpusShape::Unicode ? std::wstring(random.Pick(s_unicodeWords)) + L" " + Number(i, 4) : L"dir_" + Number(i, 4);
+            m_folders.push_back({ name, 0, 1 });
+        }
+    }
+
+    // Every name ends with the index of the file, so names never repeat
+    const auto& words = shape == CorpusShape::Unicode ? s_unicodeWords : s_words;
+    m_files.reserve(fileCount);
+    for (size_t i = 0; i < fileCount; i++)
+    {
+        File file;
+        if (shape == CorpusShape::Deep)
+        {
+            file.folder = 1 + static_cast<int>(random.Below(static_cast<std::uint32_t>(m_folders.size() - 1)));
+        }
+        else
+        {
+            file.folder = 1 + static_cast<int>(i / folderSize);
+        }
+
+        std::wstring extension;
+        if (random.Below(CORPUS_PICTURE_RATIO) == 0)
+        {
+            file.name = L"IMG_" + std::to_wstring(2000 + random.Below(25)) + L"_";
+            extension = L".jpg";
+            m_pictureCount++;
+        }
+        else
+        {
+            file.name = std::wstring(random.Pick(words)) + L"_" + random.Pick(words) + L" ";
+            extension = random.Pick(s_extensions);
+        }
+
+        if (shape == CorpusShape::Long)
+        {
+            size_t length = CORPUS_LONG_NAME_MIN + random.Below(CORPUS_LONG_NAME_MAX - CORPUS_LONG_NAME_MIN + 1);
+            while (file.name.size() + 16 < length)
+            {
+                file.name += random.Pick(words);
+                file.name += L' ';
+            }
+        }
+        else if (shape == CorpusShape::Unicode)
+        {
+            file.name += random.Pick(words);
+            file.name += L' ';
+        }
+
+        file.name += Number(i, 7) + extension;
+        m_files.push_back(std::move(file));
+    }
+}
+
+bool CPowerRenameCorpus::Materialize(_In_ const fs::path& root) const
+{
+    std::error_code error;
+    fs::remove_all(root, error);
+    for (const Folder& folder : m_folders)
+    {
+        fs::path path = root / ToFileSystemPath(folder.path);
+        if (!fs::create_directories(path, error) && error)
+        {
+            fprintf(stderr, "Failed to create %ls: %s\n", FromFileSystemPath(path).c_str(), error.message().c_str());
+            return false;
+        }
+    }
+
+    for (const File& file : m_files)
+    {
+        fs::path path = root / ToFileSystemPath(m_folders[file.folder].path) / ToFileSystemPath(file.name);
+        if (!std::ofstream(path))
+        {
+            fprintf(stderr, "Failed to create %ls\n", FromFileSystemPath(path).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+CCorpusItemSource::CCorpusItemSource(_In_ const CPowerRenameCorpus& corpus, _In_ const fs::path& root) :
+    m_corpus(corpus),
+    m_folderFiles(corpus.GetFolders().size())
+{
+    fs::path normalized = root.lexically_normal();
+    if (!normalized.has_filename())
+    {
+        normalized = normalized.parent_path();
+    }
+    m_root = FromFileSystemPath(normalized);
+    m_rootParent = FromFileSystemPath(normalized.parent_path());
+    m_rootName = FromFileSystemPath(normalized.filename());
+
+    const auto& files = corpus.GetFiles();
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        m_folderFiles[files[i].folder].push_back(i);
+    }
+}
+
+bool CCorpusItemSource::GetNextItem(_Out_ PowerRenameSourceItem& item)
+{
+    const auto& folders = m_corpus.GetFolders();
+    while (m_nextFolder < folders.size())
+    {
+        const CPowerRenameCorpus::Folder& folder = folders[m_nextFolder];
+        item.metadata = PowerRenameItemMetadata();
+        if (!m_folderHandedOut)
+        {
+            m_folderHandedOut = true;
+            m_folderPath = folder.path.empty() ? m_root : m_root + static_cast<wchar_t>(fs::path::preferred_separator) + folder.path;
+            item.path = m_folderPath;
+            if (folder.parent < 0)
+            {
+                item.parent = m_rootParent;
+                item.name = m_rootName;
+            }
+            else
+            {
+                size_t separator = m_folderPath.find_last_of(static_cast<wchar_t>(fs::path::preferred_separator));
+                item.parent = m_folderPath.substr(0, separator);
+                item.name = m_folderPath.substr(separator + 1);
+            }
+            item.isFolder = true;
+            item.depth = folder.depth;
+            return true;
+        }
+
+        const auto& files = m_folderFiles[m_nextFolder];
+        if (m_nextFile < files.size())
+        {
+            const CPowerRenameCorpus::File& file = m_corpus.GetFiles()[files[m_nextFile++]];
+            item.parent = m_folderPath;
+            item.path = m_folderPath + static_cast<wchar_t>(fs::path::preferred_separator) + file.name;
+            item.name = file.name;
+            item.isFolder = false;
+            item.depth = folder.depth + 1;
+            return true;
+        }
+
+        m_nextFolder++;
+        m_nextFile = 0;
+        m_folderHandedOut = false;
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "PowerRenameEngine.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// How the files of a generated corpus are laid out and named
+enum class CorpusShape
+{
+    // A few folders of 10000 files each
+    Flat,
+    // A tree of folders 6 levels deep with about 50 files in every folder
+    Deep,
+    // Names and folders with accented, Cyrillic, Greek, CJK and emoji characters
+    Unicode,
+    // Names of 150 to 200 characters
+    Long
+};
+
+const char* GetCorpusShapeName(_In_ CorpusShape shape);
+bool ParseCorpusShape(_In_ const std::string& name, _Out_ CorpusShape& shape);
+
+// A generated folder tree.  The same shape, file count and seed always give the same
+// names in the same order on every platform, so timings of runs can be compared.
+//
+// A fixed share of the files is named like camera pictures, IMG_<year>_<n>.jpg, the
+// rest like documents, so searches for IMG_ have a known number of matches.
+class CPowerRenameCorpus
+{
+public:
+    struct Folder
+    {
+        // Relative to the root of the corpus, empty for the root itself
+        std::wstring path;
+        // Index of the parent folder, -1 for the root
+        int parent;
+        int depth;
+    };
+
+    struct File
+    {
+        int folder;
+        std::wstring name;
+    };
+
+    CPowerRenameCorpus(_In_ CorpusShape shape, _In_ size_t fileCount, _In_ std::uint32_t seed);
+
+    const std::vector<Folder>& GetFolders() const { return m_folders; }
+    const std::vector<File>& GetFiles() const { return m_files; }
+
+    // Number of files named IMG_<year>_<n>.jpg
+    size_t GetPictureCount() const { return m_pictureCount; }
+
+    // Creates the folders and empty files under root, which is emptied first
+    bool Materialize(_In_ const std::filesystem::path& root) const;
+
+private:
+    std::vector<Folder> m_folders;
+    std::vector<File> m_files;
+    size_t m_pictureCount = 0;
+};
+
+// Hands out the folders and files of a corpus without touching the disk, as if it was
+// materialized at root and root was loaded with CFileSystemItemSource.  Root is the
+// first item and every folder is followed by its files.
+class CCorpusItemSource : public IPowerRenameItemSource
+{
+public:
+    CCorpusItemSource(_In_ const CPowerRenameCorpus& corpus, _In_ const std::filesystem::path& root);
+
+    bool GetNextItem(_Out_ PowerRenameSourceItem& item) override;
+
+private:
+    const CPowerRenameCorpus& m_corpus;
+    std::wstring m_root;
+    std::wstring m_rootParent;
+    std::wstring m_rootName;
+    // Path of the folder whose files are handed out
+    std::wstring m_folderPath;
+    // Files of each folder, in corpus order
+    std::vector<std::vector<size_t>> m_folderFiles;
+    size_t m_nextFolder = 0;
+    size_t m_nextFile = 0;
+    bool m_folderHandedOut = false;
+};
@@ -110,6 +110,30 @@ HRESULT CPowerRenameMenu::InvokeCommand(_In_ LPCMINVOKECOMMANDINFO pici)
     return hr;
 }
 
+// Folder under the local app data folder the undo log is kept in
+#define POWERRENAME_UNDO_LOG_FOLDER L"Microsoft\\PowerToys\\PowerRename"
+#define POWERRENAME_UNDO_LOG_NAME L"undo.log"
+
+// Points the manager at the undo log of the user, creating its folder if needed
+static void SetUndoLogPath(_In_ IPowerRenameManager* psrm)
+{
+    PWSTR localAppData = nullptr;
+    if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, nullptr, &localAppData)))
+    {
+        wchar_t folder[MAX_PATH];
+        wchar_t path[MAX_PATH];
+        if (PathCombine(folder, localAppData, POWERRENAME_UNDO_LOG_FOLDER))
+        {
+            int result = SHCreateDirectoryEx(nullptr, folder, nullptr);
+            if ((result == ERROR_SUCCESS || result == ERROR_ALREADY_EXISTS) && PathCombine(path, folder, POWERRENAME_UNDO_LOG_NAME))
+            {
+                psrm->put_undoLogPath(path);
+            }
+        }
+        CoTaskMemFree(localAppData);
+    }
+}
+
 DWORD WINAPI CPowerRenameMenu::s_PowerRenameUIThreadProc(_In_ void* pData)
 {
     IStream* pstrm = static_cast<IStream*>(pData);
@@ -120,6 +144,8 @@ DWORD WINAPI CPowerRenameMenu::s_PowerRenameUIThreadProc(_In_ void* pData)
         CComPtr<IPowerRenameManager> spsrm;
         if (SUCCEEDED(CPowerRenameManager::s_CreateInstance(&spsrm)))
         {
+            SetUndoLogPath(spsrm);
+
             // Create the factory for our items
             CComPtr<IPowerRenameItemFactory> spsrif;
             if (SUCCEEDED(CPowerRenameItem::s_CreateInstance(nullptr, IID_PPV_ARGS(&spsrif))))
@@ -1,6 +1,16 @@
 #include "stdafx.h"
 #include "Helpers.h"
+#include "PowerRenameNaming.h"
 #include <ShlGuid.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 HRESULT GetIconIndexFromPath(_In_ PCWSTR path, _Out_ int* index)
 {
@@ -25,264 +35,472 @@ HRESULT GetIconIndexFromPath(_In_ PCWSTR path, _Out_ int* index)
     return hr;
 }
 
-HRESULT _ParseEnumItems(_In_ IEnumShellItems* pesi, _In_ IPowerRenameManager* psrm, _In_ int depth = 0)
-{
-    HRESULT hr = E_INVALIDARG;
+// Shell items fetched from an IEnumShellItems per Next call
+#define ENUM_FETCH_BATCH_SIZE 256
+// Items handed to IPowerRenameManager::AddItems at a time.  Small enough for the list
+// to fill in progressively, large enough to keep the item lock mostly uncontended.
+#define ENUM_ADD_BATCH_SIZE 512
 
-    // We shouldn't get this deep since we only enum the contents of
-    // regular folders but adding just in case
-    if ((pesi) && (depth < (MAX_PATH / 2)))
-    {
-        hr = S_OK;
+// We shouldn't get this deep since we only enum the contents of regular folders but
+// adding just in case
+#define ENUM_MAX_DEPTH (MAX_PATH / 2)
 
-        ULONG celtFetched;
-        CComPtr<IShellItem> spsi;
-        while ((S_OK == pesi->Next(1, &spsi, &celtFetched)) && (SUCCEEDED(hr)))
-        {
-            CComPtr<IPowerRenameItemFactory> spsrif;
-            hr = psrm->get_smartRenameItemFactory(&spsrif);
-            if (SUCCEEDED(hr))
-            {
-                CComPtr<IPowerRenameItem> spNewItem;
-                hr = spsrif->Create(spsi, &spNewItem);
-                if (SUCCEEDED(hr))
-                {
-                    spNewItem->put_depth(depth);
-                    hr = psrm->AddItem(spNewItem);
-                }
-
-                if (SUCCEEDED(hr))
-                {
-                    bool isFolder = false;
-                    if (SUCCEEDED(spNewItem->get_isFolder(&isFolder)) && isFolder)
-                    {
-                        // Bind to the IShellItem for the IEnumShellItems interface
-                        CComPtr<IEnumShellItems> spesiNext;
-                        hr = spsi->BindToHandler(nullptr, BHID_EnumItems, IID_PPV_ARGS(&spesiNext));
-                        if (SUCCEEDED(hr))
-                        {
-                            // Parse the folder contents recursively
-                            hr = _ParseEnumItems(spesiNext, psrm, depth + 1);
-                        }
-                    }
-                }
-            }
-
-            spsi = nullptr;
-        }
-    }
-
-    return hr;
+static bool IsCanceled(_In_opt_ HANDLE cancelEvent)
+{
+    return cancelEvent && WaitForSingleObject(cancelEvent, 0) == WAIT_OBJECT_0;
 }
 
-// Iterate through the data object and add paths to the rotation manager
-HRESULT EnumerateDataObject(_In_ IDataObject* pdo, _In_ IPowerRenameManager* psrm)
+// Drains an IEnumShellItems a batch at a time
+static HRESULT FetchShellItems(_In_ IEnumShellItems* pesi, _In_opt_ HANDLE cancelEvent, _Inout_ std::vector<CComPtr<IShellItem>>& items)
 {
-    CComPtr<IShellItemArray> spsia;
-    HRESULT hr = SHCreateShellItemArrayFromDataObject(pdo, IID_PPV_ARGS(&spsia));
-    if (SUCCEEDED(hr))
+    IShellItem* fetched[ENUM_FETCH_BATCH_SIZE] = { 0 };
+    ULONG celtFetched = 0;
+    HRESULT hr = S_OK;
+    do
     {
-        CComPtr<IEnumShellItems> spesi;
-        hr = spsia->EnumItems(&spesi);
-        if (SUCCEEDED(hr))
+        celtFetched = 0;
+        hr = pesi->Next(ARRAYSIZE(fetched), fetched, &celtFetched);
+        for (ULONG i = 0; i < celtFetched; i++)
         {
-            hr = _ParseEnumItems(spesi, psrm);
+            // Take over the reference Next returned
+            items.emplace_back();
+            items.back().Attach(fetched[i]);
         }
-    }
+    } while (hr == S_OK && !IsCanceled(cancelEvent));
 
-    return hr;
+    return IsCanceled(cancelEvent) ? HRESULT_FROM_WIN32(ERROR_CANCELLED) : (SUCCEEDED(hr) ? S_OK : hr);
 }
 
-HWND CreateMsgWindow(_In_ HINSTANCE hInst, _In_ WNDPROC pfnWndProc, _In_ void* p)
+struct IdListDeleter
 {
-    WNDCLASS wc = { 0 };
-    PWSTR wndClassName = L"MsgWindow";
+    void operator()(_In_ PIDLIST_ABSOLUTE idList) const
+    {
+        ILFree(idList);
+    }
+};
 
-    wc.lpfnWndProc = DefWindowProc;
-    wc.cbWndExtra = sizeof(void*);
-    wc.hInstance = hInst;
-    wc.hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
-    wc.lpszClassName = wndClassName;
+// Shell items are passed between the apartment of the caller and the reader threads
+// as absolute ID lists.  Each side creates its own shell item from them, so items
+// of apartment threaded namespace extensions are only used in their apartment.
+typedef std::unique_ptr<ITEMIDLIST_ABSOLUTE, IdListDeleter> UniqueIdList;
 
-    RegisterClass(&wc);
+struct EnumFolder;
 
-    HWND hwnd = CreateWindowEx(
-        0, wndClassName, nullptr, 0,
-        0, 0, 0, 0, HWND_MESSAGE,
-        0, hInst, nullptr);
-    if (hwnd)
+// A shell item found in a folder, with the folder its contents are read into if it is
+// one whose contents are enumerated
+struct EnumEntry
+{
+    UniqueIdList idList;
+    bool isFolder = false;
+    EnumFolder* folder = nullptr;
+};
+
+// Turns shell items into entries.  Called in the apartment the items were created in.
+static void GetEnumEntries(_In_ const std::vector<CComPtr<IShellItem>>& items, _Inout_ std::vector<EnumEntry>& entries)
+{
+    entries.reserve(entries.size() + items.size());
+    for (const auto& item : items)
     {
-        SetWindowLongPtr(hwnd, 0, (LONG_PTR)p);
-        if (pfnWndProc)
+        PIDLIST_ABSOLUTE idList = nullptr;
+        if (SUCCEEDED(SHGetIDListFromObject(item, &idList)))
         {
-            SetWindowLongPtr(hwnd, GWLP_WNDPROC, (LONG_PTR)pfnWndProc);
+            EnumEntry entry;
+            entry.idList.reset(idList);
+
+            // Same test as CPowerRenameItem uses for isFolder
+            SFGAOF att = 0;
+            entry.isFolder = SUCCEEDED(item->GetAttributes(SFGAO_STREAM | SFGAO_FOLDER, &att)) &&
+                (att & SFGAO_FOLDER) && !(att & SFGAO_STREAM);
+            entries.push_back(std::move(entry));
         }
     }
-
-    return hwnd;
 }
 
-BOOL GetEnumeratedFileName(__out_ecount(cchMax) PWSTR pszUniqueName, UINT cchMax,
-    __in PCWSTR pszTemplate, __in_opt PCWSTR pszDir, unsigned long ulMinLong,
-    __inout unsigned long* pulNumUsed)
+// A folder whose contents are read by CEnumFolderReader
+struct EnumFolder
 {
-    PWSTR pszName = nullptr;
-    HRESULT hr = S_OK;
-    BOOL fRet = FALSE;
-    int cchDir = 0;
+    UniqueIdList idList;
+    // Depth of the items in the folder
+    int depth = 0;
+    std::vector<EnumEntry> children;
+    bool done = false;
+    // Set when every item in the folder was read.  The names of its entries are then
+    // listed from the file system as well, since the shell leaves out some hidden
+    // and system ones.
+    bool enumerated = false;
+    std::wstring path;
+    std::vector<std::wstring> entryNames;
+};
+
+// Reads the contents of folders on a pool of threads, breadth first.  The subfolders
+// found in a folder are queued to be read in turn.  The pool threads are in the
+// multithreaded apartment and only get ID lists, never shell items, from the caller.
+class CEnumFolderReader
+{
+public:
+    CEnumFolderReader(_In_opt_ HANDLE cancelEvent) :
+        m_cancelEvent(cancelEvent)
+    {
+    }
 
-    if (0 != cchMax && pszUniqueName)
+    ~CEnumFolderReader()
     {
-        *pszUniqueName = 0;
-        if (pszDir)
         {
-            hr = StringCchCopy(pszUniqueName, cchMax, pszDir);
-            if (SUCCEEDED(hr))
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stopped = true;
+        }
+        m_changed.notify_all();
+
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Sets the contents of folder, a folder that wasn't read by the pool, and queues
+    // the folders among them
+    void SetChildren(_Inout_ EnumFolder& folder, _Inout_ std::vector<EnumEntry>& entries)
+    {
+        folder.children = std::move(entries);
+        entries.clear();
+
+        std::vector<EnumEntry*> subfolders;
+        if (folder.depth + 1 < ENUM_MAX_DEPTH)
+        {
+            for (auto& child : folder.children)
             {
-                hr = PathCchAddBackslashEx(pszUniqueName, cchMax, &pszName, nullptr);
-                if (SUCCEEDED(hr))
+                if (child.isFolder)
                 {
-                    cchDir = lstrlen(pszDir);
+                    subfolders.push_back(&child);
                 }
             }
         }
-        else
+
         {
-            cchDir = 0;
-            pszName = pszUniqueName;
+            std::lock_guard<std::mutex> guard(m_lock);
+            for (auto child : subfolders)
+            {
+                // The folder gets its own copy since the entry is released once its
+                // rename item is created, which can be before the folder is read
+                m_folders.emplace_back();
+                m_folders.back().idList.reset(ILCloneFull(child->idList.get()));
+                m_folders.back().depth = folder.depth + 1;
+                child->folder = &m_folders.back();
+                m_queue.push_back(child->folder);
+            }
+            folder.done = true;
+
+            // Threads are only started once there is something to read
+            if (!subfolders.empty() && m_threads.empty())
+            {
+                UINT threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+                for (UINT i = 0; i < threadCount; i++)
+                {
+                    m_threads.emplace_back([this]() { _Read(); });
+                }
+            }
         }
+        m_changed.notify_all();
     }
-    else
+
+    bool IsDone(_In_ const EnumFolder& folder)
     {
-        hr = E_INVALIDARG;
+        std::lock_guard<std::mutex> guard(m_lock);
+        return folder.done;
     }
 
-    int cchTmp = 0;
-    int cchStem = 0;
-    PCWSTR pszStem = nullptr;
-    PCWSTR pszRest = nullptr;
-    wchar_t szFormat[MAX_PATH] = { 0 };
-
-    if (SUCCEEDED(hr))
+    void Wait(_In_ const EnumFolder& folder)
     {
-        pszStem = pszTemplate;
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_changed.wait(guard, [&]() { return folder.done; });
+    }
 
-        pszRest = StrChr(pszTemplate, L'(');
-        while (pszRest)
+private:
+    void _Read()
+    {
+        bool comInitialized = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+        while (true)
         {
-            PCWSTR pszEndUniq = CharNext(pszRest);
-            while (*pszEndUniq && *pszEndUniq >= L'0' && *pszEndUniq <= L'9')
+            EnumFolder* folder = nullptr;
             {
-                pszEndUniq++;
+                std::unique_lock<std::mutex> guard(m_lock);
+                m_changed.wait(guard, [&]() { return m_stopped || !m_queue.empty(); });
+                if (m_stopped)
+                {
+                    break;
+                }
+                folder = m_queue.front();
+                m_queue.pop_front();
             }
 
-            if (*pszEndUniq == L')')
+            // Folders that can't be enumerated are renamed but their contents are skipped.
+            // Once canceled the queued folders are only marked done.
+            std::vector<EnumEntry> entries;
+            if (!IsCanceled(m_cancelEvent))
             {
-                break;
+                CComPtr<IShellItem> spsi;
+                CComPtr<IEnumShellItems> spesi;
+                std::vector<CComPtr<IShellItem>> items;
+                PWSTR path = nullptr;
+                if (folder->idList &&
+                    SUCCEEDED(SHCreateItemFromIDList(folder->idList.get(), IID_PPV_ARGS(&spsi))) &&
+                    SUCCEEDED(spsi->BindToHandler(nullptr, BHID_EnumItems, IID_PPV_ARGS(&spesi))) &&
+                    FetchShellItems(spesi, m_cancelEvent, items) == S_OK &&
+                    SUCCEEDED(spsi->GetDisplayName(SIGDN_FILESYSPATH, &path)))
+                {
+                    folder->path = path;
+                    folder->enumerated = GetFolderEntryNames(folder->path, folder->entryNames);
+                }
+                CoTaskMemFree(path);
+                GetEnumEntries(items, entries);
             }
-
-            pszRest = StrChr(CharNext(pszRest), L'(');
+            SetChildren(*folder, entries);
         }
 
-        if (!pszRest)
+        if (comInitialized)
         {
-            pszRest = PathFindExtension(pszTemplate);
-            cchStem = (int)(pszRest - pszTemplate);
+            CoUninitialize();
+        }
+    }
+
+    HANDLE m_cancelEvent;
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    // Deque so the folders don't move while entries point to them
+    std::deque<EnumFolder> m_folders;
+    std::deque<EnumFolder*> m_queue;
+    std::vector<std::thread> m_threads;
+    bool m_stopped = false;
+};
+
+// Creates the rename items for ID lists in order and adds them to the manager in
+// batches
+class CEnumItemAdder
+{
+public:
+    CEnumItemAdder(_In_ IPowerRenameManager* psrm, _In_ IPowerRenameItemFactory* psrif) :
+        m_psrm(psrm), m_psrif(psrif)
+    {
+        m_batch.reserve(ENUM_ADD_BATCH_SIZE);
+    }
 
-            hr = StringCchCopy(szFormat, ARRAYSIZE(szFormat), L" (%lu)");
+    HRESULT Add(_In_ PCIDLIST_ABSOLUTE idList, _In_ int depth)
+    {
+        CComPtr<IShellItem> spsi;
+        HRESULT hr = SHCreateItemFromIDList(idList, IID_PPV_ARGS(&spsi));
+        CComPtr<IPowerRenameItem> spNewItem;
+        if (SUCCEEDED(hr))
+        {
+            hr = m_psrif->Create(spsi, &spNewItem);
         }
-        else
+        if (SUCCEEDED(hr))
         {
-            pszRest++;
+            spNewItem->put_depth(depth);
 
-            cchStem = (int)(pszRest - pszTemplate);
-
-            while (*pszRest && *pszRest >= L'0' && *pszRest <= L'9')
+            m_batch.push_back(spNewItem.Detach());
+            if (m_batch.size() == ENUM_ADD_BATCH_SIZE)
             {
-                pszRest++;
+                hr = Flush();
             }
-
-            hr = StringCchCopy(szFormat, ARRAYSIZE(szFormat), L"%lu");
         }
+        return hr;
     }
 
-    unsigned long ulMax = 0;
-    unsigned long ulMin = 0;
-    if (SUCCEEDED(hr))
+    // Hands the names of the entries of a folder that was read completely to the
+    // manager, so it doesn't list the folder again
+    HRESULT AddFolderEntries(_In_ const EnumFolder& folder)
     {
-        int cchFormat = lstrlen(szFormat);
-        if (cchFormat < 3)
+        std::vector<PCWSTR> names;
+        names.reserve(folder.entryNames.size());
+        for (const auto& name : folder.entryNames)
         {
-            *pszUniqueName = L'\0';
-            return FALSE;
+            names.push_back(name.c_str());
         }
-        ulMin = ulMinLong;
-        cchTmp = cchMax - cchDir - cchStem - (cchFormat - 3);
-        switch (cchTmp)
+        return m_psrm->AddFolderEntries(folder.path.c_str(), names.data(), static_cast<UINT>(names.size()));
+    }
+
+    HRESULT Flush()
+    {
+        HRESULT hr = S_OK;
+        if (!m_batch.empty())
         {
-        case 1:
-            ulMax = 10;
-            break;
-        case 2:
-            ulMax = 100;
-            break;
-        case 3:
-            ulMax = 1000;
-            break;
-        case 4:
-            ulMax = 10000;
-            break;
-        case 5:
-            ulMax = 100000;
-            break;
-        default:
-            if (cchTmp <= 0)
+            hr = m_psrm->AddItems(m_batch.data(), static_cast<UINT>(m_batch.size()));
+            for (auto item : m_batch)
             {
-                ulMax = ulMin;
+                item->Release();
             }
-            else
-            {
-                ulMax = 1000000;
-            }
-            break;
+            m_batch.clear();
         }
+        return hr;
+    }
+
+    ~CEnumItemAdder()
+    {
+        Flush();
+    }
+
+private:
+    IPowerRenameManager* m_psrm;
+    IPowerRenameItemFactory* m_psrif;
+    std::vector<IPowerRenameItem*> m_batch;
+};
+
+// Creates the items of folder and, right after each folder among them, of its contents.
+// Items get their ids, and with that their place in the list, depth first like the
+// folders were read one at a time.  The contents of the folders further on are read
+// while the items before them are created.
+static HRESULT AddFolderItems(_Inout_ EnumFolder& folder, _Inout_ CEnumFolderReader& reader, _Inout_ CEnumItemAdder& adder, _In_opt_ HANDLE cancelEvent)
+{
+    HRESULT hr = S_OK;
+    if (!reader.IsDone(folder))
+    {
+        // Show the items created so far while the folder is read
+        hr = adder.Flush();
+        reader.Wait(folder);
+    }
+
+    if (SUCCEEDED(hr) && folder.enumerated)
+    {
+        hr = adder.AddFolderEntries(folder);
     }
 
+    for (auto& child : folder.children)
+    {
+        if (SUCCEEDED(hr))
+        {
+            hr = IsCanceled(cancelEvent) ? HRESULT_FROM_WIN32(ERROR_CANCELLED) : adder.Add(child.idList.get(), folder.depth);
+        }
+        if (SUCCEEDED(hr) && child.folder)
+        {
+            hr = AddFolderItems(*child.folder, reader, adder, cancelEvent);
+        }
+    }
+
+    // Release the ID lists as soon as they have been turned into rename items
+    folder.children = std::vector<EnumEntry>();
+    folder.entryNames = std::vector<std::wstring>();
+    return hr;
+}
+
+HRESULT EnumerateShellItems(_In_ IShellItemArray* psia, _In_ IPowerRenameManager* psrm, _In_opt_ HANDLE cancelEvent)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CComPtr<IPowerRenameItemFactory> spsrif;
+    HRESULT hr = psrm->get_smartRenameItemFactory(&spsrif);
+
+    std::vector<CComPtr<IShellItem>> items;
     if (SUCCEEDED(hr))
     {
-        hr = StringCchCopyN(pszName, pszUniqueName + cchMax - pszName, pszStem, cchStem);
+        CComPtr<IEnumShellItems> spesi;
+        hr = psia->EnumItems(&spesi);
         if (SUCCEEDED(hr))
         {
-            PWSTR pszDigit = pszName + cchStem;
+            hr = FetchShellItems(spesi, cancelEvent, items);
+        }
+    }
 
-            for (unsigned long ul = ulMin; ((ul < ulMax) && (!fRet)); ul++)
-            {
-                wchar_t szTemp[MAX_PATH] = { 0 };
-                hr = StringCchPrintf(szTemp, ARRAYSIZE(szTemp), szFormat, ul);
-                if (SUCCEEDED(hr))
-                {
-                    hr = StringCchCat(szTemp, ARRAYSIZE(szTemp), pszRest);
-                    if (SUCCEEDED(hr))
-                    {
-                        hr = StringCchCopy(pszDigit, pszUniqueName + cchMax - pszDigit, szTemp);
-                        if (SUCCEEDED(hr))
-                        {
-                            if (!PathFileExists(pszUniqueName))
-                            {
-                                (*pulNumUsed) = ul;
-                                fRet = TRUE;
-                            }
-                        }
-                    }
-                }
-            }
+    if (SUCCEEDED(hr))
+    {
+        CEnumItemAdder adder(psrm, spsrif);
+        CEnumFolderReader reader(cancelEvent);
+
+        // The selected items are the contents of a folder that is read already
+        std::vector<EnumEntry> entries;
+        GetEnumEntries(items, entries);
+        items.clear();
+        EnumFolder selection;
+        reader.SetChildren(selection, entries);
+        hr = AddFolderItems(selection, reader, adder, cancelEvent);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = adder.Flush();
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        psrm->AddPhaseTime(PowerRenamePhase::Enumerate, elapsed.count());
+    }
+
+    return hr;
+}
+
+// Iterate through the data object and add paths to the rotation manager
+HRESULT EnumerateDataObject(_In_ IDataObject* pdo, _In_ IPowerRenameManager* psrm)
+{
+    CComPtr<IShellItemArray> spsia;
+    HRESULT hr = SHCreateShellItemArrayFromDataObject(pdo, IID_PPV_ARGS(&spsia));
+    if (SUCCEEDED(hr))
+    {
+        hr = EnumerateShellItems(spsia, psrm, nullptr);
+    }
+
+    return hr;
+}
+
+HWND CreateMsgWindow(_In_ HINSTANCE hInst, _In_ WNDPROC pfnWndProc, _In_ void* p)
+{
+    WNDCLASS wc = { 0 };
+    PWSTR wndClassName = L"MsgWindow";
+
+    wc.lpfnWndProc = DefWindowProc;
+    wc.cbWndExtra = sizeof(void*);
+    wc.hInstance = hInst;
+    wc.hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
+    wc.lpszClassName = wndClassName;
+
+    RegisterClass(&wc);
+
+    HWND hwnd = CreateWindowEx(
+        0, wndClassName, nullptr, 0,
+        0, 0, 0, 0, HWND_MESSAGE,
+        0, hInst, nullptr);
+    if (hwnd)
+    {
+        SetWindowLongPtr(hwnd, 0, (LONG_PTR)p);
+        if (pfnWndProc)
+        {
+            SetWindowLongPtr(hwnd, GWLP_WNDPROC, (LONG_PTR)pfnWndProc);
         }
     }
 
-    if (!fRet)
+    return hwnd;
+}
+
+bool GetFolderEntryNames(_In_ const std::wstring& folder, _Inout_ std::vector<std::wstring>& names)
+{
+    if (folder.empty())
+    {
+        return false;
+    }
+
+    std::wstring pattern = folder;
+    if (pattern.back() != L'\\')
+    {
+        pattern.push_back(L'\\');
+    }
+    pattern.push_back(L'*');
+
+    // One pass over the folder with the short names left out
+    WIN32_FIND_DATA findData = { 0 };
+    bool complete = false;
+    HANDLE findHandle = FindFirstFileEx(pattern.c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (findHandle != INVALID_HANDLE_VALUE)
     {
-        *pszUniqueName = L'\0';
+        do
+        {
+            if (wcscmp(findData.cFileName, L".") != 0 && wcscmp(findData.cFileName, L"..") != 0)
+            {
+                names.push_back(findData.cFileName);
+            }
+        } while (FindNextFile(findHandle, &findData));
+
+        // Read before FindClose, which may change it
+        complete = GetLastError() == ERROR_NO_MORE_FILES;
+        FindClose(findHandle);
     }
 
-    return fRet;
+    return complete;
 }
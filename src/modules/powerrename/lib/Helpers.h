@@ -1,10 +1,15 @@
 #pragma once
 #include "stdafx.h"
+#include <string>
+#include <vector>
 
 HRESULT EnumerateDataObject(_In_ IDataObject* pdo, _In_ IPowerRenameManager* psrm);
+// Adds the items and the contents of the folders among them to the manager, depth first.
+// The folders are read breadth first on a pool of threads and the items are added in
+// batches as they are found.  Stops early when cancelEvent is signaled.
+HRESULT EnumerateShellItems(_In_ IShellItemArray* psia, _In_ IPowerRenameManager* psrm, _In_opt_ HANDLE cancelEvent);
 HRESULT GetIconIndexFromPath(_In_ PCWSTR path, _Out_ int* index);
 HWND CreateMsgWindow(_In_ HINSTANCE hInst, _In_ WNDPROC pfnWndProc, _In_ void* p);
-BOOL GetEnumeratedFileName(
-    __out_ecount(cchMax) PWSTR pszUniqueName, UINT cchMax,
-    __in PCWSTR pszTemplate, __in_opt PCWSTR pszDir, unsigned long ulMinLong,
-    __inout unsigned long* pulNumUsed);
\ No newline at end of file
+// Appends the names of the entries in folder to names, hidden and system ones included.
+// Used to fill the name index.  Returns false when the folder couldn't be listed.
+bool GetFolderEntryNames(_In_ const std::wstring& folder, _Inout_ std::vector<std::wstring>& names);
\ No newline at end of file
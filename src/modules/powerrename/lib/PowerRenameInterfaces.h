@@ -1,18 +1,7 @@
 #pragma once
 #include "stdafx.h"
-
-enum PowerRenameFlags
-{
-    CaseSensitive = 0x1,
-    MatchAllOccurences = 0x2,
-    UseRegularExpressions = 0x4,
-    EnumerateItems = 0x8,
-    ExcludeFiles = 0x10,
-    ExcludeFolders = 0x20,
-    ExcludeSubfolders = 0x40,
-    NameOnly = 0x80,
-    ExtensionOnly = 0x100
-};
+#include <string>
+#include "PowerRenameTypes.h"
 
 interface __declspec(uuid("3ECBA62B-E0F0-4472-AA2E-DEE7A1AA46B9")) IPowerRenameRegExEvents : public IUnknown
 {
@@ -20,6 +9,7 @@ public:
     IFACEMETHOD(OnSearchTermChanged)(_In_ PCWSTR searchTerm) = 0;
     IFACEMETHOD(OnReplaceTermChanged)(_In_ PCWSTR replaceTerm) = 0;
     IFACEMETHOD(OnFlagsChanged)(_In_ DWORD flags) = 0;
+    IFACEMETHOD(OnEngineChanged)(_In_ PowerRenameRegExEngine engine) = 0;
 };
 
 interface __declspec(uuid("E3ED45B5-9CE0-47E2-A595-67EB950B9B72")) IPowerRenameRegEx : public IUnknown
@@ -33,7 +23,13 @@ public:
     IFACEMETHOD(put_replaceTerm)(_In_ PCWSTR replaceTerm) = 0;
     IFACEMETHOD(get_flags)(_Out_ DWORD* flags) = 0;
     IFACEMETHOD(put_flags)(_In_ DWORD flags) = 0;
+    IFACEMETHOD(get_engine)(_Out_ PowerRenameRegExEngine* engine) = 0;
+    IFACEMETHOD(put_engine)(_In_ PowerRenameRegExEngine engine) = 0;
+    IFACEMETHOD(get_searchTermRisk)(_Out_ PowerRenameRegExRisk* risk) = 0;
+    IFACEMETHOD(get_templateUsage)(_Out_ DWORD* usage) = 0;
     IFACEMETHOD(Replace)(_In_ PCWSTR source, _Outptr_ PWSTR* result) = 0;
+    IFACEMETHOD(Match)(_In_ PCWSTR source, _Out_ PowerRenameMatches* matches) = 0;
+    IFACEMETHOD(Substitute)(_In_ PCWSTR source, _In_ const PowerRenameMatches* matches, _In_opt_ const PowerRenameTemplateContext* context, _Out_ std::wstring* result) = 0;
 };
 
 interface __declspec(uuid("C7F59201-4DE1-4855-A3A2-26FC3279C8A5")) IPowerRenameItem : public IUnknown
@@ -42,7 +38,9 @@ public:
     IFACEMETHOD(get_path)(_Outptr_ PWSTR* path) = 0;
     IFACEMETHOD(get_shellItem)(_Outptr_ IShellItem** ppsi) = 0;
     IFACEMETHOD(get_originalName)(_Outptr_ PWSTR* originalName) = 0;
+    IFACEMETHOD(GetOriginalName)(_Out_writes_(cchMax) PWSTR originalName, _In_ UINT cchMax) = 0;
     IFACEMETHOD(get_newName)(_Outptr_ PWSTR* newName) = 0;
+    IFACEMETHOD(GetNewName)(_Out_writes_(cchMax) PWSTR newName, _In_ UINT cchMax) = 0;
     IFACEMETHOD(put_newName)(_In_opt_ PCWSTR newName) = 0;
     IFACEMETHOD(get_isFolder)(_Out_ bool* isFolder) = 0;
     IFACEMETHOD(get_isSubFolderContent)(_Out_ bool* isSubFolderContent) = 0;
@@ -52,6 +50,8 @@ public:
     IFACEMETHOD(get_iconIndex)(_Out_ int* iconIndex) = 0;
     IFACEMETHOD(get_depth)(_Out_ UINT* depth) = 0;
     IFACEMETHOD(put_depth)(_In_ int depth) = 0;
+    IFACEMETHOD(get_metadata)(_Out_ PowerRenameItemMetadata* metadata) = 0;
+    IFACEMETHOD(put_metadata)(_In_ const PowerRenameItemMetadata* metadata) = 0;
     IFACEMETHOD(ShouldRenameItem)(_In_ DWORD flags, _Out_ bool* shouldRename) = 0;
     IFACEMETHOD(Reset)() = 0;
 };
@@ -66,7 +66,7 @@ interface __declspec(uuid("87FC43F9-7634-43D9-99A5-20876AFCE4AD")) IPowerRenameM
 {
 public:
     IFACEMETHOD(OnItemAdded)(_In_ IPowerRenameItem* renameItem) = 0;
-    IFACEMETHOD(OnUpdate)(_In_ IPowerRenameItem* renameItem) = 0;
+    IFACEMETHOD(OnItemsUpdated)(_In_ UINT firstIndex, _In_ UINT lastIndex, _In_ UINT selectedCount, _In_ UINT renameCount) = 0;
     IFACEMETHOD(OnError)(_In_ IPowerRenameItem* renameItem) = 0;
     IFACEMETHOD(OnRegExStarted)(_In_ DWORD threadId) = 0;
     IFACEMETHOD(OnRegExCanceled)(_In_ DWORD threadId) = 0;
@@ -86,11 +86,20 @@ public:
     IFACEMETHOD(Shutdown)() = 0;
     IFACEMETHOD(Rename)(_In_ HWND hwndParent) = 0;
     IFACEMETHOD(AddItem)(_In_ IPowerRenameItem* pItem) = 0;
+    IFACEMETHOD(AddItems)(_In_reads_(count) IPowerRenameItem** items, _In_ UINT count) = 0;
+    IFACEMETHOD(AddFolderEntries)(_In_ PCWSTR folderPath, _In_reads_(count) PCWSTR* names, _In_ UINT count) = 0;
     IFACEMETHOD(GetItemByIndex)(_In_ UINT index, _COM_Outptr_ IPowerRenameItem** ppItem) = 0;
     IFACEMETHOD(GetItemById)(_In_ int id, _COM_Outptr_ IPowerRenameItem** ppItem) = 0;
     IFACEMETHOD(GetItemCount)(_Out_ UINT* count) = 0;
     IFACEMETHOD(GetSelectedItemCount)(_Out_ UINT* count) = 0;
     IFACEMETHOD(GetRenameItemCount)(_Out_ UINT* count) = 0;
+    IFACEMETHOD(SetItemSelected)(_In_ UINT index, _In_ bool selected) = 0;
+    IFACEMETHOD(SetVisibleRange)(_In_ UINT firstIndex, _In_ UINT lastIndex) = 0;
+    IFACEMETHOD(AddPhaseTime)(_In_ PowerRenamePhase phase, _In_ ULONGLONG elapsedNs) = 0;
+    IFACEMETHOD(GetStatistics)(_Outptr_ PWSTR* json) = 0;
+    IFACEMETHOD(ResetStatistics)() = 0;
+    IFACEMETHOD(put_undoLogPath)(_In_ PCWSTR path) = 0;
+    IFACEMETHOD(RevertLastRename)(_Out_ UINT* revertedCount) = 0;
     IFACEMETHOD(get_flags)(_Out_ DWORD* flags) = 0;
     IFACEMETHOD(put_flags)(_In_ DWORD flags) = 0;
     IFACEMETHOD(get_smartRenameRegEx)(_COM_Outptr_ IPowerRenameRegEx** ppRegEx) = 0;
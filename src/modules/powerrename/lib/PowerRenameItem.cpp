@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "PowerRenameItem.h"
 #include "helpers.h"
+#include <new>
 
 int CPowerRenameItem::s_id = 0;
 
@@ -30,10 +31,11 @@ IFACEMETHODIMP CPowerRenameItem::QueryInterface(_In_ REFIID riid, _Outptr_ void*
     return QISearch(this, qit, riid, ppv);
 }
 
+// The path, the original name, the id and whether the item is a folder don't change
+// once the item is created so they are read without a lock
 IFACEMETHODIMP CPowerRenameItem::get_path(_Outptr_ PWSTR* path)
 {
     *path = nullptr;
-    CSRWSharedAutoLock lock(&m_lock);
     HRESULT hr = m_path ? S_OK : E_FAIL;
     if (SUCCEEDED(hr))
     {
@@ -49,7 +51,6 @@ IFACEMETHODIMP CPowerRenameItem::get_shellItem(_Outptr_ IShellItem** ppsi)
 
 IFACEMETHODIMP CPowerRenameItem::get_originalName(_Outptr_ PWSTR* originalName)
 {
-    CSRWSharedAutoLock lock(&m_lock);
     HRESULT hr = m_originalName ? S_OK : E_FAIL;
     if (SUCCEEDED(hr))
     {
@@ -58,61 +59,102 @@ IFACEMETHODIMP CPowerRenameItem::get_originalName(_Outptr_ PWSTR* originalName)
     return hr;
 }
 
-IFACEMETHODIMP CPowerRenameItem::put_newName(_In_opt_ PCWSTR newName)
+// Copies the name into a caller supplied buffer so the preview doesn't allocate
+IFACEMETHODIMP CPowerRenameItem::GetOriginalName(_Out_writes_(cchMax) PWSTR originalName, _In_ UINT cchMax)
 {
-    CSRWSharedAutoLock lock(&m_lock);
-    CoTaskMemFree(m_newName);
-    m_newName = nullptr;
-    HRESULT hr = S_OK;
-    if (newName != nullptr)
+    HRESULT hr = m_originalName ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
     {
-        hr = SHStrDup(newName, &m_newName);
+        hr = StringCchCopy(originalName, cchMax, m_originalName);
     }
     return hr;
 }
 
+// Returns S_FALSE when newName is the name the item already has
+IFACEMETHODIMP CPowerRenameItem::put_newName(_In_opt_ PCWSTR newName)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    NewNameBlock* current = m_newName.load(std::memory_order_relaxed);
+    if (newName == nullptr)
+    {
+        if (current == nullptr)
+        {
+            return S_FALSE;
+        }
+
+        _PublishNewName(nullptr);
+        return S_OK;
+    }
+
+    if (current != nullptr && wcscmp(current->text, newName) == 0)
+    {
+        return S_FALSE;
+    }
+
+    size_t length = wcslen(newName);
+    NewNameBlock* block = _TakeSpareNewNameBlock(length);
+    if (block == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    wmemcpy(block->text, newName, length + 1);
+    _PublishNewName(block);
+    return S_OK;
+}
+
 IFACEMETHODIMP CPowerRenameItem::get_newName(_Outptr_ PWSTR* newName)
 {
-    CSRWSharedAutoLock lock(&m_lock);
-    HRESULT hr = m_newName ? S_OK : E_FAIL;
+    CEpochReadGuard guard;
+    NewNameBlock* current = m_newName.load();
+    HRESULT hr = current ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        hr = SHStrDup(current->text, newName);
+    }
+    return hr;
+}
+
+// Copies the name into a caller supplied buffer so painting a row neither locks nor
+// allocates
+IFACEMETHODIMP CPowerRenameItem::GetNewName(_Out_writes_(cchMax) PWSTR newName, _In_ UINT cchMax)
+{
+    CEpochReadGuard guard;
+    NewNameBlock* current = m_newName.load();
+    HRESULT hr = current ? S_OK : E_FAIL;
     if (SUCCEEDED(hr))
     {
-        hr = SHStrDup(m_newName, newName);
+        hr = StringCchCopy(newName, cchMax, current->text);
     }
     return hr;
 }
 
 IFACEMETHODIMP CPowerRenameItem::get_isFolder(_Out_ bool* isFolder)
 {
-    CSRWSharedAutoLock lock(&m_lock);
     *isFolder = m_isFolder;
     return S_OK;
 }
 
 IFACEMETHODIMP CPowerRenameItem::get_isSubFolderContent(_Out_ bool* isSubFolderContent)
 {
-    CSRWSharedAutoLock lock(&m_lock);
     *isSubFolderContent = m_depth > 0;
     return S_OK;
 }
 
 IFACEMETHODIMP CPowerRenameItem::get_selected(_Out_ bool* selected)
 {
-    CSRWSharedAutoLock lock(&m_lock);
     *selected = m_selected;
     return S_OK;
 }
 
 IFACEMETHODIMP CPowerRenameItem::put_selected(_In_ bool selected)
 {
-    CSRWSharedAutoLock lock(&m_lock);
     m_selected = selected;
     return S_OK;
 }
 
 IFACEMETHODIMP CPowerRenameItem::get_id(_Out_ int* id)
 {
-    CSRWSharedAutoLock lock(&m_lock);
     *id = m_id;
     return S_OK;
 }
@@ -139,11 +181,40 @@ IFACEMETHODIMP CPowerRenameItem::put_depth(_In_ int depth)
     return S_OK;
 }
 
+// S_FALSE until the metadata prefetcher read the item.  Never touches the disk.
+IFACEMETHODIMP CPowerRenameItem::get_metadata(_Out_ PowerRenameItemMetadata* metadata)
+{
+    if (!m_metadataReady.load(std::memory_order_acquire))
+    {
+        *metadata = PowerRenameItemMetadata();
+        return S_FALSE;
+    }
+
+    *metadata = m_metadata;
+    return S_OK;
+}
+
+// Only the first metadata is kept so readers never see it change
+IFACEMETHODIMP CPowerRenameItem::put_metadata(_In_ const PowerRenameItemMetadata* metadata)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    if (m_metadataReady.load(std::memory_order_relaxed))
+    {
+        return S_FALSE;
+    }
+
+    m_metadata = *metadata;
+    m_metadataReady.store(true, std::memory_order_release);
+    return S_OK;
+}
+
 IFACEMETHODIMP CPowerRenameItem::ShouldRenameItem(_In_ DWORD flags, _Out_ bool* shouldRename)
 {
     // Should we perform a rename on this item given its
     // state and the options that were set?
-    bool hasChanged = m_newName != nullptr && (lstrcmp(m_originalName, m_newName) != 0);
+    CEpochReadGuard guard;
+    NewNameBlock* current = m_newName.load();
+    bool hasChanged = current && (lstrcmp(m_originalName, current->text) != 0);
     bool excludeBecauseFolder = (m_isFolder && (flags & PowerRenameFlags::ExcludeFolders));
     bool excludeBecauseFile = (!m_isFolder && (flags & PowerRenameFlags::ExcludeFiles));
     bool excludeBecauseSubFolderContent = (m_depth > 0 && (flags & PowerRenameFlags::ExcludeSubfolders));
@@ -155,9 +226,8 @@ IFACEMETHODIMP CPowerRenameItem::ShouldRenameItem(_In_ DWORD flags, _Out_ bool*
 
 IFACEMETHODIMP CPowerRenameItem::Reset()
 {
-    CSRWSharedAutoLock lock(&m_lock);
-    CoTaskMemFree(m_newName);
-    m_newName = nullptr;
+    CSRWExclusiveAutoLock lock(&m_lock);
+    _PublishNewName(nullptr);
     return S_OK;
 }
 
@@ -193,8 +263,63 @@ CPowerRenameItem::CPowerRenameItem() :
 CPowerRenameItem::~CPowerRenameItem()
 {
     CoTaskMemFree(m_path);
-    CoTaskMemFree(m_newName);
     CoTaskMemFree(m_originalName);
+
+    // Readers hold a reference so none are left
+    _FreeNewNameBlock(m_newName.load());
+    _FreeNewNameBlock(m_spareNewName);
+}
+
+// Rounded up so names of about the same length fit in the same block
+#define NEW_NAME_BLOCK_GRANULARITY 32
+
+CPowerRenameItem::NewNameBlock* CPowerRenameItem::_AllocNewNameBlock(_In_ size_t length)
+{
+    size_t capacity = (length + NEW_NAME_BLOCK_GRANULARITY) & ~static_cast<size_t>(NEW_NAME_BLOCK_GRANULARITY - 1);
+    NewNameBlock* block = static_cast<NewNameBlock*>(::operator new(offsetof(NewNameBlock, text) + capacity * sizeof(wchar_t), std::nothrow));
+    if (block != nullptr)
+    {
+        block->capacity = static_cast<UINT>(capacity);
+        block->retiredAt = 0;
+    }
+    return block;
+}
+
+void CPowerRenameItem::_FreeNewNameBlock(_In_ void* block)
+{
+    ::operator delete(block);
+}
+
+// Returns a block for a name of length characters that no reader is using, the spare
+// one when it is big enough and its readers are gone.  Called with m_lock held.
+CPowerRenameItem::NewNameBlock* CPowerRenameItem::_TakeSpareNewNameBlock(_In_ size_t length)
+{
+    NewNameBlock* block = m_spareNewName;
+    if (block != nullptr && block->capacity > length && CEpochDomain::Instance().IsSafe(block->retiredAt))
+    {
+        m_spareNewName = nullptr;
+        return block;
+    }
+
+    return _AllocNewNameBlock(length);
+}
+
+// Makes block the current new name and keeps the one it replaces as the spare.  A spare
+// that is still there was not reused and is handed to the domain to free.  Called with
+// m_lock held.
+void CPowerRenameItem::_PublishNewName(_In_opt_ NewNameBlock* block)
+{
+    NewNameBlock* previous = m_newName.exchange(block);
+    if (previous != nullptr)
+    {
+        CEpochDomain& domain = CEpochDomain::Instance();
+        previous->retiredAt = domain.Retire();
+        if (m_spareNewName != nullptr)
+        {
+            domain.Defer(m_spareNewName, m_spareNewName->retiredAt, _FreeNewNameBlock);
+        }
+        m_spareNewName = previous;
+    }
 }
 
 HRESULT CPowerRenameItem::_Init(_In_ IShellItem* psi)
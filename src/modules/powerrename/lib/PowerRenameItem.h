@@ -2,6 +2,8 @@
 #include "stdafx.h"
 #include "PowerRenameInterfaces.h"
 #include "srwlock.h"
+#include "epoch.h"
+#include <atomic>
 
 class CPowerRenameItem :
     public IPowerRenameItem,
@@ -17,8 +19,10 @@ public:
     IFACEMETHODIMP get_path(_Outptr_ PWSTR* path);
     IFACEMETHODIMP get_shellItem(_Outptr_ IShellItem** ppsi);
     IFACEMETHODIMP get_originalName(_Outptr_ PWSTR* originalName);
+    IFACEMETHODIMP GetOriginalName(_Out_writes_(cchMax) PWSTR originalName, _In_ UINT cchMax);
     IFACEMETHODIMP put_newName(_In_opt_ PCWSTR newName);
     IFACEMETHODIMP get_newName(_Outptr_ PWSTR* newName);
+    IFACEMETHODIMP GetNewName(_Out_writes_(cchMax) PWSTR newName, _In_ UINT cchMax);
     IFACEMETHODIMP get_isFolder(_Out_ bool* isFolder);
     IFACEMETHODIMP get_isSubFolderContent(_Out_ bool* isSubFolderContent);
     IFACEMETHODIMP get_selected(_Out_ bool* selected);
@@ -27,6 +31,8 @@ public:
     IFACEMETHODIMP get_iconIndex(_Out_ int* iconIndex);
     IFACEMETHODIMP get_depth(_Out_ UINT* depth);
     IFACEMETHODIMP put_depth(_In_ int depth);
+    IFACEMETHODIMP get_metadata(_Out_ PowerRenameItemMetadata* metadata);
+    IFACEMETHODIMP put_metadata(_In_ const PowerRenameItemMetadata* metadata);
     IFACEMETHODIMP Reset();
     IFACEMETHODIMP ShouldRenameItem(_In_ DWORD flags, _Out_ bool* shouldRename);
 
@@ -46,7 +52,21 @@ protected:
 
     HRESULT _Init(_In_ IShellItem* psi);
 
-    bool     m_selected = true;
+    // New name as published to readers.  A block is never written while it is current
+    // and is only reused once no reader can still be looking at it.
+    struct NewNameBlock
+    {
+        UINT capacity;
+        ULONGLONG retiredAt;
+        wchar_t text[1];
+    };
+
+    static NewNameBlock* _AllocNewNameBlock(_In_ size_t length);
+    static void _FreeNewNameBlock(_In_ void* block);
+    NewNameBlock* _TakeSpareNewNameBlock(_In_ size_t length);
+    void _PublishNewName(_In_opt_ NewNameBlock* block);
+
+    std::atomic<bool> m_selected = true;
     bool     m_isFolder = false;
     int      m_id = -1;
     int      m_iconIndex = -1;
@@ -54,7 +74,16 @@ protected:
     HRESULT  m_error = S_OK;
     PWSTR    m_path = nullptr;
     PWSTR    m_originalName = nullptr;
-    PWSTR    m_newName = nullptr;
+    // Read without a lock inside a CEpochReadGuard.  nullptr when there is no new name.
+    std::atomic<NewNameBlock*> m_newName = nullptr;
+    // The block current before m_newName.  Reused by the next new name so previewing
+    // alternates between two blocks instead of allocating.
+    NewNameBlock* m_spareNewName = nullptr;
+    // Written once by the metadata prefetcher before m_metadataReady is set, then only
+    // read
+    PowerRenameItemMetadata m_metadata;
+    std::atomic<bool> m_metadataReady = false;
+    // Serializes the writers of the new name and of the metadata
     CSRWLock m_lock;
     long     m_refCount = 0;
 };
\ No newline at end of file
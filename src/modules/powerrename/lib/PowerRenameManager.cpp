@@ -2,16 +2,36 @@
 #include "PowerRenameManager.h"
 #include "PowerRenameRegEx.h" // Default RegEx handler
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string_view>
+#include <thread>
 #include <shlobj.h>
 #include "helpers.h"
-#include <filesystem>
-namespace fs = std::filesystem;
+#include "PowerRenameNaming.h"
+#include "PowerRenameFileSystem.h"
+#include "PowerRenameUndoLog.h"
+#include "PowerRenameUndoRecorder.h"
 
 extern HINSTANCE g_hInst;
 
 // The default FOF flags to use in the rename operations
 #define FOF_DEFAULTFLAGS (FOF_ALLOWUNDO | FOFX_ADDUNDORECORD | FOFX_SHOWELEVATIONPROMPT | FOF_RENAMEONCOLLISION)
 
+// Custom messages for worker threads
+enum
+{
+    SRM_REGEX_ITEMS_DIRTY = (WM_APP + 1),   // First item of a new update batch changed by the regex worker thread
+    SRM_REGEX_STARTED,                      // RegEx operation was started
+    SRM_REGEX_CANCELED,                     // Regex operation was canceled
+    SRM_REGEX_COMPLETE,                     // Regex worker thread completed
+    SRM_REGEX_ITEM_TIMEOUT,                 // Matching an item took longer than its budget
+    SRM_FILEOP_COMPLETE,                    // File Operation worker thread completed
+    SRM_ITEMS_ADDED,                        // Items were added with AddItems
+    SRM_METADATA_READY                      // The prefetcher read the metadata of more items
+};
+
 IFACEMETHODIMP_(ULONG) CPowerRenameManager::AddRef()
 {
     return InterlockedIncrement(&m_refCount);
@@ -115,22 +135,96 @@ IFACEMETHODIMP CPowerRenameManager::AddItem(_In_ IPowerRenameItem* pItem)
         int id = 0;
         pItem->get_id(&id);
         // Verify the item isn't already added
-        if (m_smartRenameItems.find(id) == m_smartRenameItems.end())
+        if (m_smartRenameItemSlots.find(id) == m_smartRenameItemSlots.end())
         {
-            m_smartRenameItems[id] = pItem;
+            size_t slot = _InsertItem(id, pItem);
             pItem->AddRef();
+            _RecountItem(slot);
             hr = S_OK;
         }
     }
 
     if (SUCCEEDED(hr))
     {
+        _IndexItemName(pItem);
+        m_metadataPrefetcher.Enqueue(&pItem, 1);
         _OnItemAdded(pItem);
     }
 
     return hr;
 }
 
+IFACEMETHODIMP CPowerRenameManager::AddItems(_In_reads_(count) IPowerRenameItem** items, _In_ UINT count)
+{
+    // Ids are usually handed out in the order the items arrive so the batch is sorted
+    // to keep insertions at the end of the list
+    std::vector<std::pair<int, IPowerRenameItem*>> batch;
+    batch.reserve(count);
+    for (UINT i = 0; i < count; i++)
+    {
+        int id = 0;
+        items[i]->get_id(&id);
+        batch.push_back({ id, items[i] });
+    }
+    std::stable_sort(batch.begin(), batch.end(), [](const auto& left, const auto& right) { return left.first < right.first; });
+
+    std::vector<IPowerRenameItem*> added;
+    added.reserve(count);
+    // Scope lock
+    {
+        CSRWExclusiveAutoLock lock(&m_lockItems);
+        m_smartRenameItems.reserve(m_smartRenameItems.size() + count);
+        for (const auto& entry : batch)
+        {
+            // Skip items that were already added
+            if (m_smartRenameItemSlots.find(entry.first) == m_smartRenameItemSlots.end())
+            {
+                size_t slot = _InsertItem(entry.first, entry.second);
+                entry.second->AddRef();
+                _RecountItem(slot);
+                added.push_back(entry.second);
+            }
+        }
+    }
+
+    if (!added.empty())
+    {
+        for (auto item : added)
+        {
+            _IndexItemName(item);
+        }
+        m_metadataPrefetcher.Enqueue(added.data(), static_cast<UINT>(added.size()));
+        _OnItemsAdded(added);
+
+        // The new items need a preview if there is a search term already.  Items keep
+        // arriving in batches so the passes are coalesced on the manager thread.
+        if (!m_itemsAddedPending.exchange(true))
+        {
+            PostMessage(m_hwndMessage, SRM_ITEMS_ADDED, 0, 0);
+        }
+    }
+
+    return added.empty() ? S_FALSE : S_OK;
+}
+
+// Every entry of a folder the enumerator read.  Numbered names in it are then picked
+// without listing it again.
+IFACEMETHODIMP CPowerRenameManager::AddFolderEntries(_In_ PCWSTR folderPath, _In_reads_(count) PCWSTR* names, _In_ UINT count)
+{
+    std::wstring folder(folderPath);
+    if (!folder.empty() && folder.back() == L'\\')
+    {
+        folder.pop_back();
+    }
+
+    for (UINT i = 0; i < count; i++)
+    {
+        m_nameIndex.AddName(folder, names[i]);
+    }
+    m_nameIndex.AddFolder(folder);
+    return S_OK;
+}
+
 IFACEMETHODIMP CPowerRenameManager::GetItemByIndex(_In_ UINT index, _COM_Outptr_ IPowerRenameItem** ppItem)
 {
     *ppItem = nullptr;
@@ -138,9 +232,7 @@ IFACEMETHODIMP CPowerRenameManager::GetItemByIndex(_In_ UINT index, _COM_Outptr_
     HRESULT hr = E_FAIL;
     if (index < m_smartRenameItems.size())
     {
-        std::map<int, IPowerRenameItem*>::iterator it = m_smartRenameItems.begin();
-        std::advance(it, index);
-        *ppItem = it->second;
+        *ppItem = m_smartRenameItems[index].pItem;
         (*ppItem)->AddRef();
         hr = S_OK;
     }
@@ -154,11 +246,10 @@ IFACEMETHODIMP CPowerRenameManager::GetItemById(_In_ int id, _COM_Outptr_ IPower
 
     CSRWSharedAutoLock lock(&m_lockItems);
     HRESULT hr = E_FAIL;
-    std::map<int, IPowerRenameItem*>::iterator it;
-    it = m_smartRenameItems.find(id);
-    if (it !=  m_smartRenameItems.end())
+    auto it = m_smartRenameItemSlots.find(id);
+    if (it != m_smartRenameItemSlots.end())
     {
-        *ppItem = m_smartRenameItems[id];
+        *ppItem = m_smartRenameItems[it->second].pItem;
         (*ppItem)->AddRef();
         hr = S_OK;
     }
@@ -173,42 +264,110 @@ IFACEMETHODIMP CPowerRenameManager::GetItemCount(_Out_ UINT* count)
     return S_OK;
 }
 
+// The counts are kept up to date as items are added, selected and updated.  Items the
+// regex worker changed are recounted when their update batch is flushed.
 IFACEMETHODIMP CPowerRenameManager::GetSelectedItemCount(_Out_ UINT* count)
 {
-    *count = 0;
     CSRWSharedAutoLock lock(&m_lockItems);
+    *count = m_selectedItemCount;
+    return S_OK;
+}
 
-    for (auto it : m_smartRenameItems)
+IFACEMETHODIMP CPowerRenameManager::GetRenameItemCount(_Out_ UINT* count)
+{
+    CSRWSharedAutoLock lock(&m_lockItems);
+    *count = m_renameItemCount;
+    return S_OK;
+}
+
+IFACEMETHODIMP CPowerRenameManager::SetItemSelected(_In_ UINT index, _In_ bool selected)
+{
+    CSRWExclusiveAutoLock lock(&m_lockItems);
+    HRESULT hr = E_FAIL;
+    if (index < m_smartRenameItems.size())
     {
-        IPowerRenameItem* pItem = it.second;
-        bool selected = false;
-        if (SUCCEEDED(pItem->get_selected(&selected)) && selected)
-        {
-            (*count)++;
-        }
+        hr = m_smartRenameItems[index].pItem->put_selected(selected);
+        _RecountItem(index);
     }
 
+    return hr;
+}
+
+// Called by the UI as rows scroll into view.  A pass that is running picks up the new
+// range with its next chunk.
+IFACEMETHODIMP CPowerRenameManager::SetVisibleRange(_In_ UINT firstIndex, _In_ UINT lastIndex)
+{
+    m_visibleRange = (static_cast<ULONGLONG>(firstIndex) << 32) | lastIndex;
     return S_OK;
 }
 
-IFACEMETHODIMP CPowerRenameManager::GetRenameItemCount(_Out_ UINT* count)
+IFACEMETHODIMP CPowerRenameManager::AddPhaseTime(_In_ PowerRenamePhase phase, _In_ ULONGLONG elapsedNs)
 {
-    *count = 0;
-    CSRWSharedAutoLock lock(&m_lockItems);
+    if (phase >= PowerRenamePhase::Count)
+    {
+        return E_INVALIDARG;
+    }
 
-    for (auto it : m_smartRenameItems)
+    m_stats.AddPhaseTime(phase, std::chrono::nanoseconds(elapsedNs));
+    return S_OK;
+}
+
+IFACEMETHODIMP CPowerRenameManager::GetStatistics(_Outptr_ PWSTR* json)
+{
+    *json = nullptr;
+    std::string utf8 = m_stats.ToJson();
+    int length = MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), static_cast<int>(utf8.size()), nullptr, 0);
+    if (length <= 0)
     {
-        IPowerRenameItem* pItem = it.second;
-        bool shouldRename = false;
-        if (SUCCEEDED(pItem->ShouldRenameItem(m_flags, &shouldRename)) && shouldRename)
-        {
-            (*count)++;
-        }
+        return E_FAIL;
+    }
+
+    *json = static_cast<PWSTR>(CoTaskMemAlloc((length + 1) * sizeof(wchar_t)));
+    if (*json == nullptr)
+    {
+        return E_OUTOFMEMORY;
     }
- 
+
+    MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), static_cast<int>(utf8.size()), *json, length);
+    (*json)[length] = L'\0';
     return S_OK;
 }
 
+IFACEMETHODIMP CPowerRenameManager::ResetStatistics()
+{
+    m_stats.Reset();
+    return S_OK;
+}
+
+IFACEMETHODIMP CPowerRenameManager::put_undoLogPath(_In_ PCWSTR path)
+{
+    m_undoLogPath = path ? path : L"";
+    return S_OK;
+}
+
+// Undoes the renames of the last batch in the undo log, on a thread per processor
+IFACEMETHODIMP CPowerRenameManager::RevertLastRename(_Out_ UINT* revertedCount)
+{
+    *revertedCount = 0;
+    if (m_undoLogPath.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    CPowerRenameUndoLog undoLog(m_undoLogPath);
+    PowerRenamePlan plan;
+    if (!undoLog.ReadLastBatch(plan))
+    {
+        return S_FALSE;
+    }
+
+    CPowerRenamePhaseTimer timer(m_stats, PowerRenamePhase::Commit);
+    CFileSystemRenameSink sink;
+    size_t reverted = undoLog.RevertLastBatch(sink);
+    *revertedCount = static_cast<UINT>(reverted);
+    return reverted == plan.steps.size() ? S_OK : E_FAIL;
+}
+
 IFACEMETHODIMP CPowerRenameManager::get_flags(_Out_ DWORD* flags)
 {
     _EnsureRegEx();
@@ -281,6 +440,18 @@ IFACEMETHODIMP CPowerRenameManager::OnFlagsChanged(_In_ DWORD flags)
 {
     // Flags were updated in the smart rename regex.  Update our preview.
     m_flags = flags;
+
+    // The exclude flags change which items should be renamed even if their new
+    // name stays the same.
+    _RecountAllItems();
+
+    _PerformRegExRename();
+    return S_OK;
+}
+
+IFACEMETHODIMP CPowerRenameManager::OnEngineChanged(_In_ PowerRenameRegExEngine /*engine*/)
+{
+    // Engines can disagree on the matches of some patterns so the preview is redone.
     _PerformRegExRename();
     return S_OK;
 }
@@ -303,6 +474,13 @@ HRESULT CPowerRenameManager::s_CreateInstance(_Outptr_ IPowerRenameManager** pps
 }
 
 CPowerRenameManager::CPowerRenameManager() :
+    m_nameIndex(GetFolderEntryNames),
+    m_metadataPrefetcher([this]() {
+        if (!m_metadataReadyPending.exchange(true))
+        {
+            PostMessage(m_hwndMessage, SRM_METADATA_READY, 0, 0);
+        }
+    }),
     m_refCount(1)
 {
     InitializeCriticalSection(&m_critsecReentrancy);
@@ -325,15 +503,9 @@ HRESULT CPowerRenameManager::_Init()
     return S_OK;
 }
 
-// Custom messages for worker threads
-enum
-{
-    SRM_REGEX_ITEM_UPDATED = (WM_APP + 1),  // Single smart rename item processed by regex worker thread
-    SRM_REGEX_STARTED,                      // RegEx operation was started
-    SRM_REGEX_CANCELED,                     // Regex operation was canceled
-    SRM_REGEX_COMPLETE,                     // Regex worker thread completed
-    SRM_FILEOP_COMPLETE                     // File Operation worker thread completed
-};
+// Timer that flushes the pending item updates at most once per frame
+#define UPDATE_BATCH_TIMER_ID 1
+#define UPDATE_BATCH_INTERVAL 16
 
 struct WorkerThreadData
 {
@@ -375,28 +547,58 @@ LRESULT CPowerRenameManager::_WndProc(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM
 
     switch (msg)
     {
-    case SRM_REGEX_ITEM_UPDATED:
-    {
-        int id = static_cast<int>(lParam);
-        CComPtr<IPowerRenameItem> spItem;
-        if (SUCCEEDED(GetItemById(id, &spItem)))
+    case SRM_REGEX_ITEMS_DIRTY:
+        // Let the rest of the frame's updates accumulate before notifying
+        SetTimer(hwnd, UPDATE_BATCH_TIMER_ID, UPDATE_BATCH_INTERVAL, nullptr);
+        break;
+
+    case WM_TIMER:
+        if (wParam == UPDATE_BATCH_TIMER_ID)
         {
-            _OnUpdate(spItem);
+            KillTimer(hwnd, UPDATE_BATCH_TIMER_ID);
+            _FlushItemUpdates();
         }
         break;
-    }
+
+    case SRM_ITEMS_ADDED:
+        _OnItemsAddedMessage();
+        break;
+
+    case SRM_METADATA_READY:
+        _OnMetadataReadyMessage();
+        break;
+
     case SRM_REGEX_STARTED:
         _OnRegExStarted(static_cast<DWORD>(wParam));
         break;
 
     case SRM_REGEX_CANCELED:
+        KillTimer(hwnd, UPDATE_BATCH_TIMER_ID);
+        _FlushItemUpdates();
         _OnRegExCanceled(static_cast<DWORD>(wParam));
         break;
 
     case SRM_REGEX_COMPLETE:
+        KillTimer(hwnd, UPDATE_BATCH_TIMER_ID);
+        _FlushItemUpdates();
         _OnRegExCompleted(static_cast<DWORD>(wParam));
+        if (m_regExPassPending)
+        {
+            m_regExPassPending = false;
+            _PerformRegExRename();
+        }
         break;
 
+    case SRM_REGEX_ITEM_TIMEOUT:
+    {
+        CComPtr<IPowerRenameItem> spItem;
+        if (SUCCEEDED(GetItemByIndex(static_cast<UINT>(lParam), &spItem)))
+        {
+            _OnError(spItem);
+        }
+        break;
+    }
+
     default:
         lRes = DefWindowProc(hwnd, msg, wParam, lParam);
         break;
@@ -409,6 +611,20 @@ LRESULT CPowerRenameManager::_WndProc(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM
 
 HRESULT CPowerRenameManager::_PerformFileOperation()
 {
+    // Wait for existing regex thread to finish and bring the counts up to date.  A pass
+    // that was held back behind it, or that items added or metadata read since the last
+    // one are still waiting for, has to run first.
+    _WaitForRegExWorkerThread();
+    bool itemsAdded = m_itemsAddedPending.exchange(false);
+    bool metadataReady = m_metadataReadyPending.exchange(false);
+    if (m_regExPassPending || itemsAdded || metadataReady)
+    {
+        m_regExPassPending = false;
+        _PerformRegExRename();
+        _WaitForRegExWorkerThread();
+    }
+    _FlushItemUpdates();
+
     // Do we have items to rename?
     UINT renameItemCount = 0;
     if (FAILED(GetRenameItemCount(&renameItemCount)) || renameItemCount == 0)
@@ -416,13 +632,12 @@ HRESULT CPowerRenameManager::_PerformFileOperation()
         return E_FAIL;
     }
 
-    // Wait for existing regex thread to finish
-    _WaitForRegExWorkerThread();
-
     // Create worker thread which will perform the actual rename
     HRESULT hr = _CreateFileOpWorkerThread();
     if (SUCCEEDED(hr))
     {
+        // The worker reads the new names, so no pass may change them until it is done
+        m_fileOpRunning = true;
         _OnRenameStarted();
 
         // Signal the worker thread that they can start working. We needed to wait until we
@@ -453,7 +668,14 @@ HRESULT CPowerRenameManager::_PerformFileOperation()
             }
         }
 
+        CloseHandle(m_fileOpWorkerThreadHandle);
+        m_fileOpWorkerThreadHandle = nullptr;
+        m_fileOpRunning = false;
         _OnRenameCompleted();
+
+        // Preview what was held back while the worker ran
+        _OnItemsAddedMessage();
+        _OnMetadataReadyMessage();
     }
 
     return 0;
@@ -490,6 +712,9 @@ DWORD WINAPI CPowerRenameManager::s_fileOpWorkerThread(_In_ void* pv)
             // Wait to be told we can begin
             if (WaitForSingleObject(pwtd->startEvent, INFINITE) == WAIT_OBJECT_0)
             {
+                CPowerRenameManager* pThis = static_cast<CPowerRenameManager*>(pwtd->spsrm.p);
+                CPowerRenamePhaseTimer timer(pThis->m_stats, PowerRenamePhase::Commit);
+
                 CComPtr<IPowerRenameRegEx> spRenameRegEx;
                 if (SUCCEEDED(pwtd->spsrm->get_smartRenameRegEx(&spRenameRegEx)))
                 {
@@ -502,6 +727,7 @@ DWORD WINAPI CPowerRenameManager::s_fileOpWorkerThread(_In_ void* pv)
 
                         UINT itemCount = 0;
                         pwtd->spsrm->GetItemCount(&itemCount);
+                        size_t renameCount = 0;
                         // Add each rename operation
                         for (UINT u = 0; u <= itemCount; u++)
                         {
@@ -517,7 +743,10 @@ DWORD WINAPI CPowerRenameManager::s_fileOpWorkerThread(_In_ void* pv)
                                         CComPtr<IShellItem> spShellItem;
                                         if (SUCCEEDED(spItem->get_shellItem(&spShellItem)))
                                         {
-                                            spFileOp->RenameItem(spShellItem, newName, nullptr);
+                                            if (SUCCEEDED(spFileOp->RenameItem(spShellItem, newName, nullptr)))
+                                            {
+                                                renameCount++;
+                                            }
                                         }
                                         CoTaskMemFree(newName);
                                     }
@@ -538,7 +767,27 @@ DWORD WINAPI CPowerRenameManager::s_fileOpWorkerThread(_In_ void* pv)
                             // We don't care about the return code here. We would rather
                             // return control back to explorer so the user can cleanly
                             // undo the operation if it failed halfway through.
-                            spFileOp->PerformOperations();
+                            // Only a complete run counts towards the renamed items.
+                            // The renames that were done are logged even when the run
+                            // stopped halfway, so they can still be reverted.
+                            CComPtr<CPowerRenameUndoRecorder> spRecorder;
+                            spRecorder.Attach(new CPowerRenameUndoRecorder());
+                            DWORD recorderCookie = 0;
+                            bool recording = !pThis->m_undoLogPath.empty() && SUCCEEDED(spFileOp->Advise(spRecorder, &recorderCookie));
+
+                            BOOL aborted = FALSE;
+                            if (SUCCEEDED(spFileOp->PerformOperations()) && SUCCEEDED(spFileOp->GetAnyOperationsAborted(&aborted)) && !aborted)
+                            {
+                                pThis->m_stats.AddItemsRenamed(renameCount);
+                            }
+
+                            if (recording)
+                            {
+                                spFileOp->Unadvise(recorderCookie);
+                                PowerRenamePlan plan = CreateUndoPlan(spRecorder->GetSteps());
+                                std::vector<PowerRenameStepState> states(plan.steps.size(), PowerRenameStepState::Done);
+                                CPowerRenameUndoLog(pThis->m_undoLogPath).Append(plan, states);
+                            }
                         }
                     }
                 }
@@ -555,6 +804,9 @@ DWORD WINAPI CPowerRenameManager::s_fileOpWorkerThread(_In_ void* pv)
     return 0;
 }
 
+// How long a new pass waits for the previous one to be canceled, in milliseconds
+#define REGEX_WORKER_CANCEL_TIMEOUT 250
+
 HRESULT CPowerRenameManager::_PerformRegExRename()
 {
     HRESULT hr = E_FAIL;
@@ -566,18 +818,29 @@ HRESULT CPowerRenameManager::_PerformRegExRename()
     }
     else
     {
-        // Ensure previous thread is canceled
-        _CancelRegExWorkerThread();
-
-        // Create worker thread which will message us progress and completion.
-        hr = _CreateRegExWorkerThread();
-        if (SUCCEEDED(hr))
+        // Ensure previous thread is canceled.  It stops within the match budget of an
+        // item.  Should it still be running the new pass is started once it completes
+        // so the UI isn't blocked on it.
+        if (!_CancelRegExWorkerThread(REGEX_WORKER_CANCEL_TIMEOUT))
+        {
+            m_regExPassPending = true;
+            hr = S_OK;
+        }
+        else
         {
+            // Rearm the events before the new thread can look at them so it doesn't
+            // start early or see the cancel meant for the previous thread.
+            ResetEvent(m_startRegExWorkerEvent);
             ResetEvent(m_cancelRegExWorkerEvent);
 
-            // Signal the worker thread that they can start working. We needed to wait until we
-            // were ready to process thread messages.
-            SetEvent(m_startRegExWorkerEvent);
+            // Create worker thread which will message us progress and completion.
+            hr = _CreateRegExWorkerThread();
+            if (SUCCEEDED(hr))
+            {
+                // Signal the worker thread that they can start working. We needed to wait until we
+                // were ready to process thread messages.
+                SetEvent(m_startRegExWorkerEvent);
+            }
         }
     }
 
@@ -606,6 +869,185 @@ HRESULT CPowerRenameManager::_CreateRegExWorkerThread()
     return hr;
 }
 
+// Number of items a regex pool thread claims from the shared cursor at a time
+#define REGEX_WORKER_CHUNK_SIZE 64
+
+// Runs itemCallback for every index in [0, itemCount) on a pool of threads sized to the
+// core count.  Threads claim chunks from a shared cursor so the ones that finish early
+// pick up the remaining work.  With visibleRange the rows in it are claimed first, and
+// again whenever it changes during the pass.  Returns false if cancelEvent was signaled
+// first.
+static bool ParallelForItems(_In_ UINT itemCount, _In_ HANDLE cancelEvent, _In_opt_ const std::atomic<ULONGLONG>* visibleRange, _In_ const std::function<void(UINT)>& itemCallback)
+{
+    std::atomic<size_t> nextItem = 0;
+    std::atomic<bool> canceled = false;
+
+    // Set for every item a thread has taken, so items done out of order for the visible
+    // range are skipped by the cursor
+    std::unique_ptr<std::atomic<bool>[]> claimed;
+    std::atomic<ULONGLONG> scannedRange = NO_VISIBLE_RANGE;
+    if (visibleRange)
+    {
+        claimed.reset(new std::atomic<bool>[itemCount]());
+    }
+
+    auto runItem = [&](size_t u) {
+        if (!claimed || !claimed[u].exchange(true))
+        {
+            itemCallback(static_cast<UINT>(u));
+        }
+    };
+
+    auto worker = [&]() {
+        while (!canceled)
+        {
+            // Check if cancel event is signaled
+            if (WaitForSingleObject(cancelEvent, 0) == WAIT_OBJECT_0)
+            {
+                canceled = true;
+                break;
+            }
+
+            ULONGLONG range = visibleRange ? visibleRange->load() : NO_VISIBLE_RANGE;
+            if (range != scannedRange.load())
+            {
+                // Threads that see the new range at the same time share its rows
+                size_t lastVisible = static_cast<size_t>(range & 0xFFFFFFFF);
+                for (size_t u = static_cast<size_t>(range >> 32); u <= lastVisible && u < itemCount; u++)
+                {
+                    runItem(u);
+                }
+                scannedRange = range;
+                continue;
+            }
+
+            size_t first = nextItem.fetch_add(REGEX_WORKER_CHUNK_SIZE);
+            if (first >= itemCount)
+            {
+                break;
+            }
+
+            size_t last = (std::min)(first + REGEX_WORKER_CHUNK_SIZE, static_cast<size_t>(itemCount));
+            for (size_t u = first; u < last; u++)
+            {
+                runItem(u);
+            }
+        }
+    };
+
+    UINT chunkCount = (itemCount + REGEX_WORKER_CHUNK_SIZE - 1) / REGEX_WORKER_CHUNK_SIZE;
+    UINT threadCount = (std::max)(1u, (std::min)(std::thread::hardware_concurrency(), chunkCount));
+
+    // The calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (UINT i = 1; i < threadCount; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    return !canceled;
+}
+
+// Flags that change what the search term matches.  The others only change which items
+// are renamed and how the new names are numbered.
+#define MATCH_FLAGS (CaseSensitive | MatchAllOccurences | UseRegularExpressions | NameOnly | ExtensionOnly)
+
+// Splits a path into the folder it is in and its name.  The folder is left without a
+// trailing backslash so it compares equal to the path of the folder item.
+static void SplitItemPath(_In_ PCWSTR path, _Out_ std::wstring& parentPath, _Out_ PCWSTR* name)
+{
+    *name = PathFindFileName(path);
+    parentPath.assign(path, *name - path);
+    if (!parentPath.empty() && parentPath.back() == L'\\')
+    {
+        parentPath.pop_back();
+    }
+}
+
+static bool IsItemExcluded(_In_ IPowerRenameItem* renameItem, _In_ DWORD flags)
+{
+    bool isFolder = false;
+    bool isSubFolderContent = false;
+    renameItem->get_isFolder(&isFolder);
+    renameItem->get_isSubFolderContent(&isSubFolderContent);
+    return IsExcluded(isFolder, isSubFolderContent, flags);
+}
+
+// Matches the search term against the part of the item's name selected by the flags.
+// Only reads from the item so it can run on any pool thread.  The strings in result
+// are assigned in place so a pass over items that were matched before doesn't allocate.
+static void MatchItem(_In_ IPowerRenameItem* renameItem, _In_ IPowerRenameRegEx* renameRegEx, _In_ DWORD flags, _Inout_ RegExItemResult& result)
+{
+    result.matched = true;
+    result.substituted = false;
+
+    wchar_t originalName[MAX_PATH] = { 0 };
+    result.processed = SUCCEEDED(renameItem->GetOriginalName(originalName, ARRAYSIZE(originalName)));
+    if (result.processed)
+    {
+        result.originalName = originalName;
+        result.sourceName = GetMatchSource(result.originalName, flags);
+
+        // Failure here means we had nothing to match.  The new name is cleared in that case.
+        result.matchResult = renameRegEx->Match(result.sourceName.c_str(), &result.matches);
+    }
+}
+
+// Builds the new name of an item from its matches and the current replace term.
+// result.counter and result.metadata give the values of the template tokens.
+static void SubstituteItem(_In_ IPowerRenameRegEx* renameRegEx, _In_ DWORD flags, _Inout_ RegExItemResult& result)
+{
+    result.substituted = true;
+    result.hasNewName = false;
+
+    PowerRenameTemplateContext context;
+    context.counter = result.counter;
+    context.metadata = &result.metadata;
+
+    // A failure likely means we have an empty search string.  The new name is left
+    // empty so we clear the renamed column.
+    std::wstring& newName = result.newName;
+    if (FAILED(result.matchResult) || FAILED(renameRegEx->Substitute(result.sourceName.c_str(), &result.matches, &context, &newName)))
+    {
+        newName.clear();
+        return;
+    }
+
+    // No change from originalName so leave the new name empty
+    // so we clear it from our UI as well.
+    result.hasNewName = ComposeNewName(result.originalName, flags, newName);
+}
+
+// Drops the cached parts of the previous pass that the current search, replace term,
+// flags and engine invalidate.  Only called from the regex worker thread.
+void CPowerRenameManager::_PrepareRegExCache(_In_ UINT itemCount, _In_ PCWSTR searchTerm, _In_ PCWSTR replaceTerm, _In_ DWORD flags, _In_ PowerRenameRegExEngine engine)
+{
+    bool matchesChanged = m_regExCacheSearchTerm != searchTerm || (m_regExCacheFlags & MATCH_FLAGS) != (flags & MATCH_FLAGS) ||
+        m_regExCacheEngine != engine;
+    bool namesChanged = matchesChanged || m_regExCacheReplaceTerm != replaceTerm;
+
+    m_regExCache.resize(itemCount);
+    if (namesChanged)
+    {
+        for (auto& result : m_regExCache)
+        {
+            result.matched = result.matched && !matchesChanged;
+            result.substituted = false;
+        }
+    }
+
+    m_regExCacheSearchTerm = searchTerm;
+    m_regExCacheReplaceTerm = replaceTerm;
+    m_regExCacheFlags = flags;
+    m_regExCacheEngine = engine;
+}
+
 DWORD WINAPI CPowerRenameManager::s_regexWorkerThread(_In_ void* pv)
 {
     if (SUCCEEDED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE)))
@@ -621,141 +1063,252 @@ DWORD WINAPI CPowerRenameManager::s_regexWorkerThread(_In_ void* pv)
                 CComPtr<IPowerRenameRegEx> spRenameRegEx;
                 if (SUCCEEDED(pwtd->spsrm->get_smartRenameRegEx(&spRenameRegEx)))
                 {
+                    CPowerRenameManager* pThis = static_cast<CPowerRenameManager*>(pwtd->spsrm.p);
+
                     DWORD flags = 0;
                     spRenameRegEx->get_flags(&flags);
+                    PowerRenameRegExEngine engine = LinearRegExEngine;
+                    spRenameRegEx->get_engine(&engine);
+                    DWORD templateUsage = 0;
+                    spRenameRegEx->get_templateUsage(&templateUsage);
+                    bool usesCounter = (templateUsage & TemplateUsesCounter) != 0;
+                    bool usesMetadata = (templateUsage & (TemplateUsesMetadata | TemplateUsesHeader)) != 0;
+
+                    PWSTR searchTerm = nullptr;
+                    PWSTR replaceTerm = nullptr;
+                    spRenameRegEx->get_searchTerm(&searchTerm);
+                    spRenameRegEx->get_replaceTerm(&replaceTerm);
+                    std::wstring patternTerm = searchTerm ? searchTerm : L"";
 
                     UINT itemCount = 0;
-                    unsigned long itemEnumIndex = 1;
                     pwtd->spsrm->GetItemCount(&itemCount);
-                    for (UINT u = 0; u <= itemCount; u++)
-                    {
-                        // Check if cancel event is signaled
-                        if (WaitForSingleObject(pwtd->cancelEvent, 0) == WAIT_OBJECT_0)
+
+                    // Matches are kept from the previous pass while the search term, the
+                    // engine and the flags that affect matching are the same.  Editing the replace
+                    // term then only redoes the substitution and toggling the exclude
+                    // flags only filters the items again.
+                    pThis->_PrepareRegExCache(itemCount, searchTerm ? searchTerm : L"", replaceTerm ? replaceTerm : L"", flags, engine);
+                    CoTaskMemFree(searchTerm);
+                    CoTaskMemFree(replaceTerm);
+
+                    // The regex and the items are free threaded so the names are computed
+                    // in parallel, the rows the UI shows first.  Without numbering an item
+                    // is applied as soon as it has its new name so those rows update before
+                    // the rest of the pass is done.  Numbers depend on every item before
+                    // so then the names are applied once every item has one.  So are the
+                    // ${counter} values of the replace term, which count the matched items.
+                    std::vector<RegExItemResult>& results = pThis->m_regExCache;
+                    bool applyEach = !(flags & EnumerateItems) && !usesCounter;
+                    auto applyResult = [&](UINT u, IPowerRenameItem* spItem) {
+                        const RegExItemResult& result = results[u];
+                        if (!result.processed && !result.excluded)
+                        {
+                            return;
+                        }
+
+                        if (result.excluded)
                         {
-                            // Canceled from manager
-                            // Send the manager thread the canceled message
-                            PostMessage(pwtd->hwndManager, SRM_REGEX_CANCELED, GetCurrentThreadId(), 0);
-                            break;
+                            // Ensure new name is cleared
+                            spItem->put_newName(nullptr);
+
+                            // Add the item to the manager thread's next update batch
+                            pThis->_MarkItemDirty(u);
+                            return;
                         }
 
+                        PCWSTR newNameToUse = result.hasNewName ? result.newName.c_str() : nullptr;
+                        if (newNameToUse != nullptr && (flags & EnumerateItems) && result.hasEnumeratedName)
+                        {
+                            newNameToUse = result.enumeratedName.c_str();
+                        }
+
+                        // S_FALSE means the item already had this name
+                        if (spItem->put_newName(newNameToUse) == S_OK)
+                        {
+                            // Add the item to the manager thread's next update batch
+                            pThis->_MarkItemDirty(u);
+                        }
+                    };
+
+                    // Only the items matched again this pass count towards the time of
+                    // the search term.  Cached matches would make it look faster.
+                    using Clock = std::chrono::steady_clock;
+                    Clock::time_point passStart = Clock::now();
+                    std::atomic<size_t> scannedCount = 0;
+                    std::atomic<size_t> matchedCount = 0;
+                    std::atomic<size_t> patternItemCount = 0;
+                    std::atomic<ULONGLONG> patternNs = 0;
+
+                    bool completed = ParallelForItems(itemCount, pwtd->cancelEvent, &pThis->m_visibleRange, [&](UINT u) {
+                        RegExItemResult& result = results[u];
                         CComPtr<IPowerRenameItem> spItem;
-                        if (SUCCEEDED(pwtd->spsrm->GetItemByIndex(u, &spItem)))
+                        if (FAILED(pwtd->spsrm->GetItemByIndex(u, &spItem)))
                         {
-                            int id = -1;
-                            spItem->get_id(&id);
-
-                            bool isFolder = false;
-                            bool isSubFolderContent = false;
-                            spItem->get_isFolder(&isFolder);
-                            spItem->get_isSubFolderContent(&isSubFolderContent);
-                            if ((isFolder && (flags & PowerRenameFlags::ExcludeFolders)) ||
-                                (!isFolder && (flags & PowerRenameFlags::ExcludeFiles)) ||
-                                (isSubFolderContent && (flags & PowerRenameFlags::ExcludeSubfolders)))
-                            {
-                                // Exclude this item from renaming.  Ensure new name is cleared.
-                                spItem->put_newName(nullptr);
+                            result = RegExItemResult();
+                            return;
+                        }
 
-                                // Send the manager thread the item processed message
-                                PostMessage(pwtd->hwndManager, SRM_REGEX_ITEM_UPDATED, GetCurrentThreadId(), id);
+                        int id = 0;
+                        spItem->get_id(&id);
+                        if (result.id != id)
+                        {
+                            // Items were added since the previous pass
+                            result = RegExItemResult();
+                            result.id = id;
 
-                                continue;
+                            PWSTR path = nullptr;
+                            if (SUCCEEDED(spItem->get_path(&path)))
+                            {
+                                PCWSTR name = nullptr;
+                                SplitItemPath(path, result.parentPath, &name);
+                                CoTaskMemFree(path);
                             }
+                        }
 
-                            PWSTR originalName = nullptr;
-                            if (SUCCEEDED(spItem->get_originalName(&originalName)))
+                        result.excluded = IsItemExcluded(spItem, flags);
+                        if (!result.excluded)
+                        {
+                            bool matchedNow = !result.matched;
+                            Clock::time_point itemStart = Clock::now();
+                            if (matchedNow)
                             {
-                                PWSTR currentNewName = nullptr;
-                                spItem->get_newName(&currentNewName);
+                                MatchItem(spItem, spRenameRegEx, flags, result);
 
-                                wchar_t sourceName[MAX_PATH] = { 0 };
-                                if (flags & NameOnly)
+                                // The item is left without a new name and reported
+                                if (result.matchResult == HRESULT_FROM_WIN32(ERROR_TIMEOUT))
                                 {
-                                    StringCchCopy(sourceName, ARRAYSIZE(sourceName), fs::path(originalName).stem().c_str());
+                                    PostMessage(pwtd->hwndManager, SRM_REGEX_ITEM_TIMEOUT, GetCurrentThreadId(), u);
                                 }
-                                else if (flags & ExtensionOnly)
+                            }
+
+                            // The prefetcher may not have read the item yet.  Its tokens expand
+                            // to nothing until then and the pass after the read builds the
+                            // name again.
+                            if (result.processed && !result.metadataRead && usesMetadata &&
+                                spItem->get_metadata(&result.metadata) == S_OK)
+                            {
+                                result.metadataRead = true;
+                                result.substituted = false;
+                            }
+
+                            // Items are counted in order once the pass is done
+                            bool substitutedNow = result.processed && !result.substituted && !usesCounter;
+                            if (substitutedNow)
+                            {
+                                SubstituteItem(spRenameRegEx, flags, result);
+                            }
+
+                            if (matchedNow || substitutedNow)
+                            {
+                                Clock::duration itemTime = Clock::now() - itemStart;
+                                pThis->m_stats.AddMatchTime(itemTime);
+                                if (matchedNow)
                                 {
-                                    std::wstring extension = fs::path(originalName).extension().wstring();
-                                    if (!extension.empty() && extension.front() == '.')
-                                    {
-                                        extension = extension.erase(0, 1);
-                                    }
-                                    StringCchCopy(sourceName, ARRAYSIZE(sourceName), extension.c_str());
+                                    patternItemCount.fetch_add(1, std::memory_order_relaxed);
+                                    patternNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(itemTime).count(), std::memory_order_relaxed);
                                 }
-                                else
+                            }
+
+                            if (result.processed)
+                            {
+                                scannedCount.fetch_add(1, std::memory_order_relaxed);
+                                if (result.hasNewName && !usesCounter)
                                 {
-                                    StringCchCopy(sourceName, ARRAYSIZE(sourceName), originalName);
+                                    matchedCount.fetch_add(1, std::memory_order_relaxed);
                                 }
+                            }
+                        }
 
+                        if (applyEach)
+                        {
+                            applyResult(u, spItem);
+                        }
+                    });
 
-                                PWSTR newName = nullptr;
-                                // Failure here means we didn't match anything or had nothing to match
-                                // Call put_newName with null in that case to reset it
-                                spRenameRegEx->Replace(sourceName, &newName);
+                    if (completed && usesCounter)
+                    {
+                        // The counter numbers the items the search term matched, in order.
+                        // Only the names whose number moved are built again.
+                        unsigned long counter = 0;
+                        for (auto& result : results)
+                        {
+                            if (result.excluded || !result.processed)
+                            {
+                                continue;
+                            }
 
-                                wchar_t resultName[MAX_PATH] = { 0 };
+                            if (SUCCEEDED(result.matchResult) && !result.matches.matches.empty())
+                            {
+                                counter++;
+                            }
 
-                                PWSTR newNameToUse = nullptr;
+                            if (!result.substituted || result.counter != counter)
+                            {
+                                result.counter = counter;
+                                SubstituteItem(spRenameRegEx, flags, result);
+                            }
 
-                                // newName == nullptr likely means we have an empty search string.  We should leave newNameToUse
-                                // as nullptr so we clear the renamed column
-                                if (newName != nullptr)
-                                {
-                                    newNameToUse = resultName;
-                                    if (flags & NameOnly)
-                                    {
-                                        StringCchPrintf(resultName, ARRAYSIZE(resultName), L"%s%s", newName, fs::path(originalName).extension().c_str());
-                                    }
-                                    else if (flags & ExtensionOnly)
-                                    {
-                                        std::wstring extension = fs::path(originalName).extension().wstring();
-                                        if (!extension.empty())
-                                        {
-                                            StringCchPrintf(resultName, ARRAYSIZE(resultName), L"%s.%s", fs::path(originalName).stem().c_str(), newName);
-                                        }
-                                        else
-                                        {
-                                            StringCchCopy(resultName, ARRAYSIZE(resultName), originalName);
-                                        }
-                                    }
-                                    else
-                                    {
-                                        StringCchCopy(resultName, ARRAYSIZE(resultName), newName);
-                                    }
-                                }
-                                
-                                // No change from originalName so set newName to
-                                // null so we clear it from our UI as well.
-                                if (lstrcmp(originalName, newNameToUse) == 0)
-                                {
-                                    newNameToUse = nullptr;
-                                }
+                            if (result.hasNewName)
+                            {
+                                matchedCount++;
+                            }
+                        }
+                    }
 
-                                wchar_t uniqueName[MAX_PATH] = { 0 };
-                                if (newNameToUse != nullptr && (flags & EnumerateItems))
-                                {
-                                    unsigned long countUsed = 0;
-                                    if (GetEnumeratedFileName(uniqueName, ARRAYSIZE(uniqueName), newNameToUse, nullptr, itemEnumIndex, &countUsed))
-                                    {
-                                        newNameToUse = uniqueName;
-                                    }
-                                    itemEnumIndex++;
-                                }
+                    pThis->m_stats.AddPhaseTime(PowerRenamePhase::Match, Clock::now() - passStart);
+                    pThis->m_stats.AddItemsScanned(scannedCount);
+                    pThis->m_stats.AddItemsMatched(matchedCount);
+                    if (patternItemCount > 0)
+                    {
+                        pThis->m_stats.AddPatternPass(patternTerm, flags, patternItemCount, std::chrono::nanoseconds(patternNs.load()));
+                    }
 
-                                spItem->put_newName(newNameToUse);
+                    if (completed && (flags & EnumerateItems))
+                    {
+                        CPowerRenamePhaseTimer numberTimer(pThis->m_stats, PowerRenamePhase::Number);
+
+                        // Enumeration numbers follow item order regardless of which
+                        // thread computed the name.  Numbers already used in the folder,
+                        // on disk or by an earlier item, are skipped.
+                        pThis->m_nameIndex.ClearReservations();
+                        unsigned long itemEnumIndex = 1;
+                        for (auto& result : results)
+                        {
+                            result.hasEnumeratedName = false;
+                            if (result.hasNewName && !result.excluded)
+                            {
+                                result.enumIndex = itemEnumIndex++;
 
-                                // Was there a change?
-                                if (lstrcmp(currentNewName, newNameToUse) != 0)
+                                // A ${counter} in the replace term numbers the names already,
+                                // so only the names that are taken get numbered again
+                                if (usesCounter && pThis->m_nameIndex.Reserve(result.parentPath, result.newName))
                                 {
-                                    // Send the manager thread the item processed message
-                                    PostMessage(pwtd->hwndManager, SRM_REGEX_ITEM_UPDATED, GetCurrentThreadId(), id);
+                                    continue;
                                 }
 
-                                CoTaskMemFree(newName);
-                                CoTaskMemFree(currentNewName);
-                                CoTaskMemFree(originalName);
+                                unsigned long countUsed = 0;
+                                result.hasEnumeratedName = pThis->m_nameIndex.ReserveEnumeratedName(result.parentPath, result.originalName, result.newName, result.enumIndex, MAX_PATH, result.enumeratedName, &countUsed);
                             }
                         }
                     }
+
+                    if (completed && !applyEach)
+                    {
+                        completed = ParallelForItems(itemCount, pwtd->cancelEvent, &pThis->m_visibleRange, [&](UINT u) {
+                            CComPtr<IPowerRenameItem> spItem;
+                            if (SUCCEEDED(pwtd->spsrm->GetItemByIndex(u, &spItem)))
+                            {
+                                applyResult(u, spItem);
+                            }
+                        });
+                    }
+
+                    if (!completed)
+                    {
+                        // Canceled from manager
+                        // Send the manager thread the canceled message
+                        PostMessage(pwtd->hwndManager, SRM_REGEX_CANCELED, GetCurrentThreadId(), 0);
+                    }
                 }
             }
 
@@ -770,7 +1323,8 @@ DWORD WINAPI CPowerRenameManager::s_regexWorkerThread(_In_ void* pv)
     return 0;
 }
 
-void CPowerRenameManager::_CancelRegExWorkerThread()
+// Returns false when the worker is still running after timeout
+bool CPowerRenameManager::_CancelRegExWorkerThread(_In_ DWORD timeout)
 {
     if (m_startRegExWorkerEvent)
     {
@@ -782,17 +1336,22 @@ void CPowerRenameManager::_CancelRegExWorkerThread()
         SetEvent(m_cancelRegExWorkerEvent);
     }
 
-    _WaitForRegExWorkerThread();
+    return _WaitForRegExWorkerThread(timeout);
 }
 
-void CPowerRenameManager::_WaitForRegExWorkerThread()
+bool CPowerRenameManager::_WaitForRegExWorkerThread(_In_ DWORD timeout)
 {
     if (m_regExWorkerThreadHandle)
     {
-        WaitForSingleObject(m_regExWorkerThreadHandle, INFINITE);
+        if (WaitForSingleObject(m_regExWorkerThreadHandle, timeout) != WAIT_OBJECT_0)
+        {
+            return false;
+        }
+
         CloseHandle(m_regExWorkerThreadHandle);
         m_regExWorkerThreadHandle = nullptr;
     }
+    return true;
 }
 
 void CPowerRenameManager::_Cancel()
@@ -854,7 +1413,52 @@ void CPowerRenameManager::_OnItemAdded(_In_ IPowerRenameItem* renameItem)
     }
 }
 
-void CPowerRenameManager::_OnUpdate(_In_ IPowerRenameItem* renameItem)
+// Previews the items added since the last pass.  Nothing to do until there is a
+// search term, or while a file operation is running.  The items may have been
+// previewed before it started already.
+void CPowerRenameManager::_OnItemsAddedMessage()
+{
+    if (m_fileOpRunning || !m_itemsAddedPending.exchange(false))
+    {
+        return;
+    }
+
+    PWSTR searchTerm = nullptr;
+    if (m_spRegEx && SUCCEEDED(m_spRegEx->get_searchTerm(&searchTerm)))
+    {
+        if (searchTerm && *searchTerm)
+        {
+            _PerformRegExRename();
+        }
+        CoTaskMemFree(searchTerm);
+    }
+}
+
+// Previews the items whose metadata arrived since the last pass.  Only replace terms
+// with metadata tokens have names that change with it.  Held back like the items
+// added while a file operation is running.
+void CPowerRenameManager::_OnMetadataReadyMessage()
+{
+    if (m_fileOpRunning || !m_metadataReadyPending.exchange(false))
+    {
+        return;
+    }
+
+    DWORD templateUsage = 0;
+    PWSTR searchTerm = nullptr;
+    if (m_spRegEx && SUCCEEDED(m_spRegEx->get_templateUsage(&templateUsage)) &&
+        (templateUsage & (TemplateUsesMetadata | TemplateUsesHeader)) &&
+        SUCCEEDED(m_spRegEx->get_searchTerm(&searchTerm)))
+    {
+        if (searchTerm && *searchTerm)
+        {
+            _PerformRegExRename();
+        }
+        CoTaskMemFree(searchTerm);
+    }
+}
+
+void CPowerRenameManager::_OnItemsAdded(_In_ const std::vector<IPowerRenameItem*>& renameItems)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
 
@@ -862,7 +1466,23 @@ void CPowerRenameManager::_OnUpdate(_In_ IPowerRenameItem* renameItem)
     {
         if (it.pEvents)
         {
-            it.pEvents->OnUpdate(renameItem);
+            for (auto renameItem : renameItems)
+            {
+                it.pEvents->OnItemAdded(renameItem);
+            }
+        }
+    }
+}
+
+void CPowerRenameManager::_OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT lastIndex, _In_ UINT selectedCount, _In_ UINT renameCount)
+{
+    CSRWSharedAutoLock lock(&m_lockEvents);
+
+    for (auto it : m_PowerRenameManagerEvents)
+    {
+        if (it.pEvents)
+        {
+            it.pEvents->OnItemsUpdated(firstIndex, lastIndex, selectedCount, renameCount);
         }
     }
 }
@@ -970,15 +1590,158 @@ void CPowerRenameManager::_ClearPowerRenameItems()
     // Cleanup smart rename items
     for (auto it : m_smartRenameItems)
     {
-        IPowerRenameItem* pItem = it.second;
+        IPowerRenameItem* pItem = it.pItem;
         pItem->Release();
     }
 
     m_smartRenameItems.clear();
+    m_smartRenameItemSlots.clear();
+    m_selectedItemCount = 0;
+    m_renameItemCount = 0;
+
+    m_nameIndex.Clear();
+}
+
+// Records the item's name in its folder.  The folder is only listed on disk for
+// numbered names unless the enumerator added its entries with AddFolderEntries.
+void CPowerRenameManager::_IndexItemName(_In_ IPowerRenameItem* renameItem)
+{
+    PWSTR path = nullptr;
+    if (SUCCEEDED(renameItem->get_path(&path)))
+    {
+        std::wstring parentPath;
+        PCWSTR name = nullptr;
+        SplitItemPath(path, parentPath, &name);
+        m_nameIndex.AddName(parentPath, name);
+        CoTaskMemFree(path);
+    }
+}
+
+// Caller must hold m_lockItems exclusively
+size_t CPowerRenameManager::_InsertItem(_In_ int id, _In_ IPowerRenameItem* renameItem)
+{
+    // Items are indexed in id order.  Ids are handed out as items are created so
+    // they almost always arrive in order and are simply appended.
+    size_t slot = m_smartRenameItems.size();
+    if (slot > 0 && m_smartRenameItems.back().id > id)
+    {
+        auto it = std::lower_bound(m_smartRenameItems.begin(), m_smartRenameItems.end(), id,
+            [](const SMART_RENAME_ITEM& entry, int value) { return entry.id < value; });
+        slot = static_cast<size_t>(it - m_smartRenameItems.begin());
+    }
+
+    m_smartRenameItems.insert(m_smartRenameItems.begin() + slot, { id, renameItem, false, false });
+
+    // Items after the insertion point moved up one slot
+    for (size_t i = slot; i < m_smartRenameItems.size(); i++)
+    {
+        m_smartRenameItemSlots[m_smartRenameItems[i].id] = i;
+    }
+
+    return slot;
+}
+
+// Caller must hold m_lockItems exclusively
+void CPowerRenameManager::_RecountItem(_In_ size_t slot)
+{
+    SMART_RENAME_ITEM& entry = m_smartRenameItems[slot];
+
+    bool selected = false;
+    entry.pItem->get_selected(&selected);
+    if (selected != entry.countedSelected)
+    {
+        selected ? m_selectedItemCount++ : m_selectedItemCount--;
+        entry.countedSelected = selected;
+    }
+
+    bool shouldRename = false;
+    entry.pItem->ShouldRenameItem(m_flags, &shouldRename);
+    if (shouldRename != entry.countedRename)
+    {
+        shouldRename ? m_renameItemCount++ : m_renameItemCount--;
+        entry.countedRename = shouldRename;
+    }
+}
+
+void CPowerRenameManager::_RecountAllItems()
+{
+    CSRWExclusiveAutoLock lock(&m_lockItems);
+    for (size_t slot = 0; slot < m_smartRenameItems.size(); slot++)
+    {
+        _RecountItem(slot);
+    }
+}
+
+// Called from the regex worker threads for every item whose new name changed
+void CPowerRenameManager::_MarkItemDirty(_In_ UINT index)
+{
+    bool firstInBatch = false;
+    // Scope lock
+    {
+        CSRWExclusiveAutoLock lock(&m_lockDirtyItems);
+        firstInBatch = m_dirtyItems.empty();
+        m_dirtyItems.push_back(index);
+    }
+
+    if (firstInBatch)
+    {
+        PostMessage(m_hwndMessage, SRM_REGEX_ITEMS_DIRTY, GetCurrentThreadId(), 0);
+    }
+}
+
+// Recounts the items changed since the last flush and sends a single notification
+// covering all of them
+void CPowerRenameManager::_FlushItemUpdates()
+{
+    // The two lists trade places so the regex worker keeps the capacity of the last
+    // batch instead of growing a new list for every batch
+    std::vector<UINT>& dirtyItems = m_flushingItems;
+    dirtyItems.clear();
+    // Scope lock
+    {
+        CSRWExclusiveAutoLock lock(&m_lockDirtyItems);
+        dirtyItems.swap(m_dirtyItems);
+    }
+
+    if (dirtyItems.empty())
+    {
+        return;
+    }
+
+    UINT firstIndex = UINT_MAX;
+    UINT lastIndex = 0;
+    UINT selectedCount = 0;
+    UINT renameCount = 0;
+    // Scope lock
+    {
+        CSRWExclusiveAutoLock lock(&m_lockItems);
+        for (UINT index : dirtyItems)
+        {
+            if (index < m_smartRenameItems.size())
+            {
+                _RecountItem(index);
+                firstIndex = (std::min)(firstIndex, index);
+                lastIndex = (std::max)(lastIndex, index);
+            }
+        }
+
+        selectedCount = m_selectedItemCount;
+        renameCount = m_renameItemCount;
+    }
+
+    if (firstIndex <= lastIndex)
+    {
+        _OnItemsUpdated(firstIndex, lastIndex, selectedCount, renameCount);
+    }
 }
 
 void CPowerRenameManager::_Cleanup()
 {
+    // The regex worker and the prefetcher report to the message window so they must
+    // be done first
+    _CancelRegExWorkerThread();
+    m_metadataPrefetcher.Stop();
+
     if (m_hwndMessage)
     {
         DestroyWindow(m_hwndMessage);
@@ -1,7 +1,48 @@
 #pragma once
+#include <string>
 #include <vector>
-#include <map>
+#include <unordered_map>
+#include <atomic>
 #include "srwlock.h"
+#include "PowerRenameMetadataPrefetcher.h"
+#include "PowerRenameNameIndex.h"
+#include "PowerRenameStats.h"
+
+// State of a single item in the regex pass.  Kept between passes so the parts that
+// are still valid are not computed again.
+struct RegExItemResult
+{
+    // Item the state belongs to and the folder it is in
+    int id = -1;
+    std::wstring parentPath;
+    bool excluded = false;
+
+    // Set once the search term was matched against sourceName
+    bool matched = false;
+    bool processed = false;
+    HRESULT matchResult = E_FAIL;
+    std::wstring originalName;
+    std::wstring sourceName;
+    PowerRenameMatches matches;
+
+    // Taken from the item once the prefetcher read it, when the replace term has
+    // ${size}, ${modified} or ${taken}
+    bool metadataRead = false;
+    PowerRenameItemMetadata metadata;
+
+    // Set once newName was built from the matches and the replace term
+    bool substituted = false;
+    bool hasNewName = false;
+    std::wstring newName;
+    // What ${counter} stood for in newName
+    unsigned long counter = 0;
+    unsigned long enumIndex = 0;
+    // newName numbered with enumIndex, or the next number free in the folder
+    bool hasEnumeratedName = false;
+    std::wstring enumeratedName;
+};
+
+#define NO_VISIBLE_RANGE 0x0000000100000000ull
 
 class CPowerRenameManager :
     public IPowerRenameManager,
@@ -22,11 +63,20 @@ public:
     IFACEMETHODIMP Shutdown();
     IFACEMETHODIMP Rename(_In_ HWND hwndParent);
     IFACEMETHODIMP AddItem(_In_ IPowerRenameItem* pItem);
+    IFACEMETHODIMP AddItems(_In_reads_(count) IPowerRenameItem** items, _In_ UINT count);
+    IFACEMETHODIMP AddFolderEntries(_In_ PCWSTR folderPath, _In_reads_(count) PCWSTR* names, _In_ UINT count);
     IFACEMETHODIMP GetItemByIndex(_In_ UINT index, _COM_Outptr_ IPowerRenameItem** ppItem);
     IFACEMETHODIMP GetItemById(_In_ int id, _COM_Outptr_ IPowerRenameItem** ppItem);
     IFACEMETHODIMP GetItemCount(_Out_ UINT* count);
     IFACEMETHODIMP GetSelectedItemCount(_Out_ UINT* count);
     IFACEMETHODIMP GetRenameItemCount(_Out_ UINT* count);
+    IFACEMETHODIMP SetItemSelected(_In_ UINT index, _In_ bool selected);
+    IFACEMETHODIMP SetVisibleRange(_In_ UINT firstIndex, _In_ UINT lastIndex);
+    IFACEMETHODIMP AddPhaseTime(_In_ PowerRenamePhase phase, _In_ ULONGLONG elapsedNs);
+    IFACEMETHODIMP GetStatistics(_Outptr_ PWSTR* json);
+    IFACEMETHODIMP ResetStatistics();
+    IFACEMETHODIMP put_undoLogPath(_In_ PCWSTR path);
+    IFACEMETHODIMP RevertLastRename(_Out_ UINT* revertedCount);
     IFACEMETHODIMP get_flags(_Out_ DWORD* flags);
     IFACEMETHODIMP put_flags(_In_ DWORD flags);
     IFACEMETHODIMP get_smartRenameRegEx(_COM_Outptr_ IPowerRenameRegEx** ppRegEx);
@@ -38,6 +88,7 @@ public:
     IFACEMETHODIMP OnSearchTermChanged(_In_ PCWSTR searchTerm);
     IFACEMETHODIMP OnReplaceTermChanged(_In_ PCWSTR replaceTerm);
     IFACEMETHODIMP OnFlagsChanged(_In_ DWORD flags);
+    IFACEMETHODIMP OnEngineChanged(_In_ PowerRenameRegExEngine engine);
 
     static HRESULT s_CreateInstance(_Outptr_ IPowerRenameManager** ppsrm);
 
@@ -51,7 +102,9 @@ protected:
     void _Cancel();
 
     void _OnItemAdded(_In_ IPowerRenameItem* renameItem);
-    void _OnUpdate(_In_ IPowerRenameItem* renameItem);
+    void _OnItemsAdded(_In_ const std::vector<IPowerRenameItem*>& renameItems);
+    void _IndexItemName(_In_ IPowerRenameItem* renameItem);
+    void _OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT lastIndex, _In_ UINT selectedCount, _In_ UINT renameCount);
     void _OnError(_In_ IPowerRenameItem* renameItem);
     void _OnRegExStarted(_In_ DWORD threadId);
     void _OnRegExCanceled(_In_ DWORD threadId);
@@ -61,13 +114,22 @@ protected:
 
     void _ClearEventHandlers();
     void _ClearPowerRenameItems();
+    size_t _InsertItem(_In_ int id, _In_ IPowerRenameItem* renameItem);
+    void _RecountItem(_In_ size_t slot);
+    void _RecountAllItems();
+
+    void _MarkItemDirty(_In_ UINT index);
+    void _OnItemsAddedMessage();
+    void _OnMetadataReadyMessage();
+    void _FlushItemUpdates();
 
     HRESULT _PerformRegExRename();
+    void _PrepareRegExCache(_In_ UINT itemCount, _In_ PCWSTR searchTerm, _In_ PCWSTR replaceTerm, _In_ DWORD flags, _In_ PowerRenameRegExEngine engine);
     HRESULT _PerformFileOperation();
 
     HRESULT _CreateRegExWorkerThread();
-    void _CancelRegExWorkerThread();
-    void _WaitForRegExWorkerThread();
+    bool _CancelRegExWorkerThread(_In_ DWORD timeout = INFINITE);
+    bool _WaitForRegExWorkerThread(_In_ DWORD timeout = INFINITE);
     HRESULT _CreateFileOpWorkerThread();
 
     HRESULT _EnsureRegEx();
@@ -83,14 +145,20 @@ protected:
     LRESULT _WndProc(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM wParam, _In_ LPARAM lParam);
 
     HANDLE m_regExWorkerThreadHandle = nullptr;
+    // Set when a pass had to wait for the previous worker to get out of a search.  It
+    // is started once that worker completes.
+    bool m_regExPassPending = false;
     HANDLE m_startRegExWorkerEvent = nullptr;
     HANDLE m_cancelRegExWorkerEvent = nullptr;
 
     HANDLE m_fileOpWorkerThreadHandle = nullptr;
     HANDLE m_startFileOpWorkerEvent = nullptr;
+    // Set while the file operation worker renames the items
+    bool m_fileOpRunning = false;
 
     CSRWLock m_lockEvents;
     CSRWLock m_lockItems;
+    CSRWLock m_lockDirtyItems;
 
     DWORD m_flags = 0;
 
@@ -103,11 +171,54 @@ protected:
         DWORD cookie;
     };
 
+    struct SMART_RENAME_ITEM
+    {
+        int id;
+        IPowerRenameItem* pItem;
+        // What the item currently contributes to the running counts
+        bool countedSelected;
+        bool countedRename;
+    };
+
     CComPtr<IPowerRenameItemFactory> m_spItemFactory;
     CComPtr<IPowerRenameRegEx> m_spRegEx;
 
     _Guarded_by_(m_lockEvents) std::vector<SMART_RENAME_MGR_EVENT> m_PowerRenameManagerEvents;
-    _Guarded_by_(m_lockItems) std::map<int, IPowerRenameItem*> m_smartRenameItems;
+    // Items ordered by id so they can be addressed by index, plus the slot of each id
+    _Guarded_by_(m_lockItems) std::vector<SMART_RENAME_ITEM> m_smartRenameItems;
+    _Guarded_by_(m_lockItems) std::unordered_map<int, size_t> m_smartRenameItemSlots;
+    _Guarded_by_(m_lockItems) UINT m_selectedItemCount = 0;
+    _Guarded_by_(m_lockItems) UINT m_renameItemCount = 0;
+    // Names of the items and of the entries next to them, for numbering new names
+    CPowerRenameNameIndex m_nameIndex;
+    // Set while a message to preview the items added since the last pass is pending
+    std::atomic<bool> m_itemsAddedPending = false;
+    // Reads the metadata of the items as they are added
+    CPowerRenameMetadataPrefetcher m_metadataPrefetcher;
+    // Set while a message to preview the items whose metadata was read is pending
+    std::atomic<bool> m_metadataReadyPending = false;
+    // Rows the UI shows, first in the high and last in the low half.  The regex worker
+    // computes these before the rest.  No rows are shown while first is past last.
+    std::atomic<ULONGLONG> m_visibleRange = NO_VISIBLE_RANGE;
+    // Indexes of the items changed by the regex worker since the last update batch
+    _Guarded_by_(m_lockDirtyItems) std::vector<UINT> m_dirtyItems;
+    // Batch being flushed.  Only used by the manager thread.
+    std::vector<UINT> m_flushingItems;
+
+    // Timings and counters of the enumeration, the regex passes and the renames
+    CPowerRenameStats m_stats;
+
+    // Results of the previous regex pass and what they were computed for.  Only used
+    // by the regex worker thread and there is never more than one of those.
+    std::vector<RegExItemResult> m_regExCache;
+    std::wstring m_regExCacheSearchTerm;
+    std::wstring m_regExCacheReplaceTerm;
+    DWORD m_regExCacheFlags = 0;
+    PowerRenameRegExEngine m_regExCacheEngine = LinearRegExEngine;
+
+    // Log the renames are appended to so the last batch can be reverted.  Nothing is
+    // logged while it is empty.  Set before Rename and read by the file op worker.
+    std::wstring m_undoLogPath;
 
     // Parent HWND used by IFileOperation
     HWND m_hwndParent = nullptr;
@@ -0,0 +1,174 @@
+#include "stdafx.h"
+#include "PowerRenameMetadataPrefetcher.h"
+#include "PowerRenameMetadata.h"
+#include <algorithm>
+
+// The file can shrink or go away while it is mapped.  Reading the view then raises an
+// in-page error instead of failing a call.  Kept free of objects with destructors so it
+// can use structured exception handling.
+static bool ParseMappedHeader(_In_reads_bytes_(size) const unsigned char* view, _In_ SIZE_T size, _Out_ PowerRenameDateTime* taken)
+{
+    __try
+    {
+        return ParseExifDateTaken(view, size, *taken);
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+    {
+        return false;
+    }
+}
+
+// Maps the start of the file at path and reads the date the picture was taken from it.
+// Only the pages the Exif parser touches are read from disk.
+static void ReadHeader(_In_ PCWSTR path, _In_ ULONGLONG size, _Inout_ PowerRenameItemMetadata& metadata)
+{
+    HANDLE file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+    {
+        SIZE_T viewSize = static_cast<SIZE_T>((std::min)(size, static_cast<ULONGLONG>(POWERRENAME_METADATA_HEADER_SIZE)));
+        const unsigned char* view = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, viewSize));
+        if (view)
+        {
+            metadata.hasTaken = ParseMappedHeader(view, viewSize, &metadata.taken);
+            UnmapViewOfFile(view);
+        }
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+}
+
+void CPowerRenameMetadataPrefetcher::s_ReadMetadata(_In_ PCWSTR path, _Out_ PowerRenameItemMetadata& metadata)
+{
+    metadata = PowerRenameItemMetadata();
+
+    WIN32_FILE_ATTRIBUTE_DATA data = { 0 };
+    SYSTEMTIME utc = { 0 };
+    SYSTEMTIME local = { 0 };
+    if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data) ||
+        !FileTimeToSystemTime(&data.ftLastWriteTime, &utc) ||
+        !SystemTimeToTzSpecificLocalTime(nullptr, &utc, &local))
+    {
+        return;
+    }
+
+    metadata.valid = true;
+    metadata.modified.year = local.wYear;
+    metadata.modified.month = local.wMonth;
+    metadata.modified.day = local.wDay;
+    metadata.modified.hour = local.wHour;
+    metadata.modified.minute = local.wMinute;
+    metadata.modified.second = local.wSecond;
+
+    if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        metadata.size = (static_cast<ULONGLONG>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+
+        // Files that are only placeholders for cloud content would be downloaded
+        if (metadata.size > 0 && !(data.dwFileAttributes & (FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS)) &&
+            MayHaveExifHeader(path))
+        {
+            ReadHeader(path, metadata.size, metadata);
+        }
+    }
+}
+
+CPowerRenameMetadataPrefetcher::CPowerRenameMetadataPrefetcher(_In_ std::function<void()> ready) :
+    m_ready(std::move(ready))
+{
+}
+
+CPowerRenameMetadataPrefetcher::~CPowerRenameMetadataPrefetcher()
+{
+    Stop();
+}
+
+void CPowerRenameMetadataPrefetcher::Enqueue(_In_reads_(count) IPowerRenameItem** items, _In_ UINT count)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_stopping)
+        {
+            return;
+        }
+
+        for (UINT i = 0; i < count; i++)
+        {
+            items[i]->AddRef();
+            m_queue.push_back(items[i]);
+        }
+
+        // Threads are started as work arrives, up to the limit
+        if (m_idleThreads == 0 && m_threads.size() < METADATA_PREFETCH_THREADS)
+        {
+            m_threads.emplace_back(&CPowerRenameMetadataPrefetcher::_Worker, this);
+        }
+    }
+    m_queued.notify_all();
+}
+
+void CPowerRenameMetadataPrefetcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stopping = true;
+        for (auto item : m_queue)
+        {
+            item->Release();
+        }
+        m_queue.clear();
+    }
+    m_queued.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void CPowerRenameMetadataPrefetcher::_Worker()
+{
+    std::vector<IPowerRenameItem*> batch;
+    batch.reserve(METADATA_PREFETCH_BATCH_SIZE);
+
+    std::unique_lock<std::mutex> guard(m_lock);
+    for (;;)
+    {
+        m_idleThreads++;
+        m_queued.wait(guard, [this]() { return m_stopping || !m_queue.empty(); });
+        m_idleThreads--;
+        if (m_stopping)
+        {
+            break;
+        }
+
+        size_t take = (std::min)(m_queue.size(), static_cast<size_t>(METADATA_PREFETCH_BATCH_SIZE));
+        batch.assign(m_queue.begin(), m_queue.begin() + take);
+        m_queue.erase(m_queue.begin(), m_queue.begin() + take);
+        guard.unlock();
+
+        for (auto item : batch)
+        {
+            // Items added twice are only read once
+            PowerRenameItemMetadata metadata;
+            PWSTR path = nullptr;
+            if (item->get_metadata(&metadata) == S_FALSE && SUCCEEDED(item->get_path(&path)))
+            {
+                s_ReadMetadata(path, metadata);
+                item->put_metadata(&metadata);
+                CoTaskMemFree(path);
+            }
+            item->Release();
+        }
+        batch.clear();
+
+        m_ready();
+        guard.lock();
+    }
+}
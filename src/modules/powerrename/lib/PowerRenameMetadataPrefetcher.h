@@ -0,0 +1,48 @@
+#pragma once
+#include "stdafx.h"
+#include "PowerRenameInterfaces.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reads that may be in flight at once.  Enough to keep a disk's queue busy without
+// taking the cores the regex passes run on.
+#define METADATA_PREFETCH_THREADS 4
+// Items a prefetch thread takes at a time.  Ready is reported once per run.
+#define METADATA_PREFETCH_BATCH_SIZE 64
+
+// Reads the metadata rename templates use, the attributes of every item and the Exif
+// header of pictures, ahead of the preview on threads of its own.  Items are queued as
+// they are added, so the reads overlap the enumeration, and the metadata is stored in
+// the items.  The regex pass takes what is there and never waits for the disk.
+class CPowerRenameMetadataPrefetcher
+{
+public:
+    // ready is called on a prefetch thread each time a run of items got their metadata
+    explicit CPowerRenameMetadataPrefetcher(_In_ std::function<void()> ready);
+    ~CPowerRenameMetadataPrefetcher();
+
+    void Enqueue(_In_reads_(count) IPowerRenameItem** items, _In_ UINT count);
+
+    // Drops the items that are still queued and waits for the threads to exit
+    void Stop();
+
+    // Reads the metadata of the file or folder at path
+    static void s_ReadMetadata(_In_ PCWSTR path, _Out_ PowerRenameItemMetadata& metadata);
+
+private:
+    void _Worker();
+
+    std::function<void()> m_ready;
+    std::mutex m_lock;
+    std::condition_variable m_queued;
+    // Each queued item holds a reference
+    std::deque<IPowerRenameItem*> m_queue;
+    std::vector<std::thread> m_threads;
+    // Threads waiting for items
+    UINT m_idleThreads = 0;
+    bool m_stopping = false;
+};
@@ -1,12 +1,9 @@
 #include "stdafx.h"
 #include "PowerRenameRegEx.h"
-#include <regex>
 #include <string>
-#include <algorithm>
-
+#include <string_view>
 
 using namespace std;
-using std::regex_error;
 
 IFACEMETHODIMP_(ULONG) CPowerRenameRegEx::AddRef()
 {
@@ -73,14 +70,8 @@ IFACEMETHODIMP CPowerRenameRegEx::UnAdvise(_In_ DWORD cookie)
 
 IFACEMETHODIMP CPowerRenameRegEx::get_searchTerm(_Outptr_ PWSTR* searchTerm)
 {
-    *searchTerm = nullptr;
-    HRESULT hr = m_searchTerm ? S_OK : E_FAIL;
-    if (SUCCEEDED(hr))
-    {
-        CSRWSharedAutoLock lock(&m_lock);
-        hr = SHStrDup(m_searchTerm, searchTerm);
-    }
-    return hr;
+    CSRWSharedAutoLock lock(&m_lock);
+    return SHStrDup(m_search.GetSearchTerm().c_str(), searchTerm);
 }
 
 IFACEMETHODIMP CPowerRenameRegEx::put_searchTerm(_In_ PCWSTR searchTerm)
@@ -90,12 +81,7 @@ IFACEMETHODIMP CPowerRenameRegEx::put_searchTerm(_In_ PCWSTR searchTerm)
     if (SUCCEEDED(hr))
     {
         CSRWExclusiveAutoLock lock(&m_lock);
-        if (m_searchTerm == nullptr || lstrcmp(searchTerm, m_searchTerm) != 0)
-        {
-            changed = true;
-            CoTaskMemFree(m_searchTerm);
-            hr = SHStrDup(searchTerm, &m_searchTerm);
-        }
+        changed = m_search.SetSearchTerm(searchTerm);
     }
 
     if (SUCCEEDED(hr) && changed)
@@ -108,14 +94,8 @@ IFACEMETHODIMP CPowerRenameRegEx::put_searchTerm(_In_ PCWSTR searchTerm)
 
 IFACEMETHODIMP CPowerRenameRegEx::get_replaceTerm(_Outptr_ PWSTR* replaceTerm)
 {
-    *replaceTerm = nullptr;
-    HRESULT hr = m_replaceTerm ? S_OK : E_FAIL;
-    if (SUCCEEDED(hr))
-    {
-        CSRWSharedAutoLock lock(&m_lock);
-        hr = SHStrDup(m_replaceTerm, replaceTerm);
-    }
-    return hr;
+    CSRWSharedAutoLock lock(&m_lock);
+    return SHStrDup(m_search.GetReplaceTerm().c_str(), replaceTerm);
 }
 
 IFACEMETHODIMP CPowerRenameRegEx::put_replaceTerm(_In_ PCWSTR replaceTerm)
@@ -125,12 +105,7 @@ IFACEMETHODIMP CPowerRenameRegEx::put_replaceTerm(_In_ PCWSTR replaceTerm)
     if (SUCCEEDED(hr))
     {
         CSRWExclusiveAutoLock lock(&m_lock);
-        if (m_replaceTerm == nullptr || lstrcmp(replaceTerm, m_replaceTerm) != 0)
-        {
-            changed = true;
-            CoTaskMemFree(m_replaceTerm);
-            hr = SHStrDup(replaceTerm, &m_replaceTerm);
-        }
+        changed = m_search.SetReplaceTerm(replaceTerm);
     }
 
     if (SUCCEEDED(hr) && changed)
@@ -143,20 +118,67 @@ IFACEMETHODIMP CPowerRenameRegEx::put_replaceTerm(_In_ PCWSTR replaceTerm)
 
 IFACEMETHODIMP CPowerRenameRegEx::get_flags(_Out_ DWORD* flags)
 {
-    *flags = m_flags;
+    CSRWSharedAutoLock lock(&m_lock);
+    *flags = m_search.GetFlags();
     return S_OK;
 }
 
 IFACEMETHODIMP CPowerRenameRegEx::put_flags(_In_ DWORD flags)
 {
-    if (m_flags != flags)
+    bool changed = false;
+    // Scope lock
+    {
+        CSRWExclusiveAutoLock lock(&m_lock);
+        changed = m_search.SetFlags(flags);
+    }
+
+    if (changed)
     {
-        m_flags = flags;
         _OnFlagsChanged();
     }
     return S_OK;
 }
 
+IFACEMETHODIMP CPowerRenameRegEx::get_engine(_Out_ PowerRenameRegExEngine* engine)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    *engine = m_search.GetEngine();
+    return S_OK;
+}
+
+IFACEMETHODIMP CPowerRenameRegEx::put_engine(_In_ PowerRenameRegExEngine engine)
+{
+    bool changed = false;
+    {
+        CSRWExclusiveAutoLock lock(&m_lock);
+        changed = m_search.SetEngine(engine);
+    }
+
+    if (changed)
+    {
+        _OnEngineChanged();
+    }
+
+    return S_OK;
+}
+
+// Analyzed when the search term or the flags change.  Risky patterns run on the linear
+// engine when it supports them, the others get a time budget per item.
+IFACEMETHODIMP CPowerRenameRegEx::get_searchTermRisk(_Out_ PowerRenameRegExRisk* risk)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    *risk = m_search.GetRegExAnalysis().risk;
+    return S_OK;
+}
+
+// PowerRenameTemplateUsage flags of the replace term, compiled when it changes
+IFACEMETHODIMP CPowerRenameRegEx::get_templateUsage(_Out_ DWORD* usage)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    *usage = m_search.GetTemplateUsage();
+    return S_OK;
+}
+
 HRESULT CPowerRenameRegEx::s_CreateInstance(_Outptr_ IPowerRenameRegEx** renameRegEx)
 {
     *renameRegEx = nullptr;
@@ -174,128 +196,134 @@ HRESULT CPowerRenameRegEx::s_CreateInstance(_Outptr_ IPowerRenameRegEx** renameR
 CPowerRenameRegEx::CPowerRenameRegEx() :
     m_refCount(1)
 {
-    // Init to empty strings
-    SHStrDup(L"", &m_searchTerm);
-    SHStrDup(L"", &m_replaceTerm);
 }
 
 CPowerRenameRegEx::~CPowerRenameRegEx()
 {
-    CoTaskMemFree(m_searchTerm);
-    CoTaskMemFree(m_replaceTerm);
 }
 
 HRESULT CPowerRenameRegEx::Replace(_In_ PCWSTR source, _Outptr_ PWSTR* result)
 {
     *result = nullptr;
 
-    CSRWSharedAutoLock lock(&m_lock);
-    HRESULT hr = (source && wcslen(source) > 0 && m_searchTerm && wcslen(m_searchTerm) > 0) ? S_OK : E_INVALIDARG;
+    PowerRenameMatches matches;
+    HRESULT hr = Match(source, &matches);
     if (SUCCEEDED(hr))
     {
-        wstring res = source;
-        try
+        wstring res;
+        hr = Substitute(source, &matches, nullptr, &res);
+        if (SUCCEEDED(hr))
         {
-            // TODO: creating the regex could be costly.  May want to cache this.
-            std::wstring sourceToUse(source);
-            std::wstring searchTerm(m_searchTerm);
-            std::wstring replaceTerm(m_replaceTerm ? wstring(m_replaceTerm) : wstring(L""));
-
-            if (m_flags & UseRegularExpressions)
-            {
-                std::wregex pattern(m_searchTerm, (!(m_flags & CaseSensitive)) ? regex_constants::icase | regex_constants::ECMAScript : regex_constants::ECMAScript);
-                if (m_flags & MatchAllOccurences)
-                {
-                    res = regex_replace(wstring(source), pattern, replaceTerm);
-                }
-                else
-                {
-                    std::wsmatch m;
-                    if (std::regex_search(sourceToUse, m, pattern))
-                    {
-                        res = sourceToUse.replace(m.prefix().length(), searchTerm.length(), replaceTerm);
-                    }
-                }
-            }
-            else
-            {
-                // Simple search and replace
-                size_t pos = 0;
-                do
-                {
-                    pos = _Find(sourceToUse, searchTerm, (!(m_flags & CaseSensitive)), pos);
-                    if (pos != std::string::npos)
-                    {
-                        res = sourceToUse.replace(pos, searchTerm.length(), replaceTerm);
-                        pos += replaceTerm.length();
-                    }
-
-                    if (!(m_flags & MatchAllOccurences))
-                    {
-                        break;
-                    }
-                } while (pos != std::string::npos);
-            }
-
             *result = StrDup(res.c_str());
             hr = (*result) ? S_OK : E_OUTOFMEMORY;
         }
-        catch (regex_error e)
+    }
+    return hr;
+}
+
+HRESULT CPowerRenameRegEx::Match(_In_ PCWSTR source, _Out_ PowerRenameMatches* matches)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    HRESULT hr = (source && wcslen(source) > 0 && !m_search.GetSearchTerm().empty()) ? S_OK : E_INVALIDARG;
+    if (SUCCEEDED(hr))
+    {
+        if (!m_search.Match(source, *matches))
         {
-            hr = E_FAIL;
+            hr = matches->timedOut ? HRESULT_FROM_WIN32(ERROR_TIMEOUT) : E_FAIL;
         }
     }
+    else
+    {
+        matches->expandReplaceTerm = false;
+        matches->timedOut = false;
+        matches->matches.clear();
+    }
     return hr;
 }
 
-size_t CPowerRenameRegEx::_Find(std::wstring data, std::wstring toSearch, bool caseInsensitive, size_t pos)
+// Without a context the counter of the template counts the item as the first one and the
+// metadata tokens expand to nothing
+HRESULT CPowerRenameRegEx::Substitute(_In_ PCWSTR source, _In_ const PowerRenameMatches* matches, _In_opt_ const PowerRenameTemplateContext* context, _Out_ std::wstring* result)
 {
-    if (caseInsensitive)
+    CSRWSharedAutoLock lock(&m_lock);
+    HRESULT hr = source ? S_OK : E_INVALIDARG;
+    if (SUCCEEDED(hr))
     {
-        // Convert to lower
-        std::transform(data.begin(), data.end(), data.begin(), ::towlower);
-        std::transform(toSearch.begin(), toSearch.end(), toSearch.begin(), ::towlower);
+        m_search.Substitute(source, *matches, context ? *context : PowerRenameTemplateContext(), *result);
     }
-
-    // Find sub string position in given string starting at position pos
-    return data.find(toSearch, pos);
+    else
+    {
+        result->clear();
+    }
+    return hr;
 }
 
 void CPowerRenameRegEx::_OnSearchTermChanged()
 {
+    wstring searchTerm;
+    {
+        CSRWSharedAutoLock lock(&m_lock);
+        searchTerm = m_search.GetSearchTerm();
+    }
+
     CSRWSharedAutoLock lock(&m_lockEvents);
 
     for (auto it : m_smartRenameRegExEvents)
     {
         if (it.pEvents)
         {
-            it.pEvents->OnSearchTermChanged(m_searchTerm);
+            it.pEvents->OnSearchTermChanged(searchTerm.c_str());
         }
     }
 }
 
 void CPowerRenameRegEx::_OnReplaceTermChanged()
 {
+    wstring replaceTerm;
+    {
+        CSRWSharedAutoLock lock(&m_lock);
+        replaceTerm = m_search.GetReplaceTerm();
+    }
+
     CSRWSharedAutoLock lock(&m_lockEvents);
 
     for (auto it : m_smartRenameRegExEvents)
     {
         if (it.pEvents)
         {
-            it.pEvents->OnReplaceTermChanged(m_replaceTerm);
+            it.pEvents->OnReplaceTermChanged(replaceTerm.c_str());
         }
     }
 }
 
 void CPowerRenameRegEx::_OnFlagsChanged()
 {
+    DWORD flags = 0;
+    get_flags(&flags);
+
+    CSRWSharedAutoLock lock(&m_lockEvents);
+
+    for (auto it : m_smartRenameRegExEvents)
+    {
+        if (it.pEvents)
+        {
+            it.pEvents->OnFlagsChanged(flags);
+        }
+    }
+}
+
+void CPowerRenameRegEx::_OnEngineChanged()
+{
+    PowerRenameRegExEngine engine = LinearRegExEngine;
+    get_engine(&engine);
+
     CSRWSharedAutoLock lock(&m_lockEvents);
 
     for (auto it : m_smartRenameRegExEvents)
     {
         if (it.pEvents)
         {
-            it.pEvents->OnFlagsChanged(m_flags);
+            it.pEvents->OnEngineChanged(engine);
         }
     }
 }
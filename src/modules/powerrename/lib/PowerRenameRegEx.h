@@ -2,9 +2,10 @@
 #include "stdafx.h"
 #include <vector>
 #include <string>
+#include <string_view>
+#include <memory>
 #include "srwlock.h"
-
-#define DEFAULT_FLAGS MatchAllOccurences
+#include "PowerRenameSearch.h"
 
 class CPowerRenameRegEx : public IPowerRenameRegEx
 {
@@ -23,7 +24,13 @@ public:
     IFACEMETHODIMP put_replaceTerm(_In_ PCWSTR replaceTerm);
     IFACEMETHODIMP get_flags(_Out_ DWORD* flags);
     IFACEMETHODIMP put_flags(_In_ DWORD flags);
+    IFACEMETHODIMP get_engine(_Out_ PowerRenameRegExEngine* engine);
+    IFACEMETHODIMP put_engine(_In_ PowerRenameRegExEngine engine);
+    IFACEMETHODIMP get_searchTermRisk(_Out_ PowerRenameRegExRisk* risk);
+    IFACEMETHODIMP get_templateUsage(_Out_ DWORD* usage);
     IFACEMETHODIMP Replace(_In_ PCWSTR source, _Outptr_ PWSTR* result);
+    IFACEMETHODIMP Match(_In_ PCWSTR source, _Out_ PowerRenameMatches* matches);
+    IFACEMETHODIMP Substitute(_In_ PCWSTR source, _In_ const PowerRenameMatches* matches, _In_opt_ const PowerRenameTemplateContext* context, _Out_ std::wstring* result);
 
     static HRESULT s_CreateInstance(_Outptr_ IPowerRenameRegEx **renameRegEx);
 
@@ -34,12 +41,11 @@ protected:
     void _OnSearchTermChanged();
     void _OnReplaceTermChanged();
     void _OnFlagsChanged();
+    void _OnEngineChanged();
 
-    size_t _Find(std::wstring data, std::wstring toSearch, bool caseInsensitive, size_t pos);
-
-    DWORD m_flags = DEFAULT_FLAGS;
-    PWSTR m_searchTerm = nullptr;
-    PWSTR m_replaceTerm = nullptr;
+    // Terms, flags and the matcher compiled for them.  Replace, Match and Substitute
+    // only read it so they run concurrently under the shared lock.
+    _Guarded_by_(m_lock) CPowerRenameSearch m_search;
 
     CSRWLock m_lock;
     CSRWLock m_lockEvents;
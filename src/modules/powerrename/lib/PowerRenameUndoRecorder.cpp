@@ -0,0 +1,62 @@
+#include "stdafx.h"
+#include "PowerRenameUndoRecorder.h"
+
+IFACEMETHODIMP_(ULONG) CPowerRenameUndoRecorder::AddRef()
+{
+    return InterlockedIncrement(&m_refCount);
+}
+
+IFACEMETHODIMP_(ULONG) CPowerRenameUndoRecorder::Release()
+{
+    long refCount = InterlockedDecrement(&m_refCount);
+
+    if (refCount == 0)
+    {
+        delete this;
+    }
+    return refCount;
+}
+
+IFACEMETHODIMP CPowerRenameUndoRecorder::QueryInterface(_In_ REFIID riid, _Outptr_ void** ppv)
+{
+    static const QITAB qit[] = {
+        QITABENT(CPowerRenameUndoRecorder, IFileOperationProgressSink),
+        { 0 }
+    };
+    return QISearch(this, qit, riid, ppv);
+}
+
+// The path of item is the one it had before the rename.  The name is taken from the new
+// item when there is one, in case the operation had to pick another.
+IFACEMETHODIMP CPowerRenameUndoRecorder::PostRenameItem(_In_ DWORD, _In_ IShellItem* item, _In_ PCWSTR newName, _In_ HRESULT renameResult, _In_opt_ IShellItem* newItem)
+{
+    if (FAILED(renameResult) || item == nullptr)
+    {
+        return S_OK;
+    }
+
+    PWSTR path = nullptr;
+    if (SUCCEEDED(item->GetDisplayName(SIGDN_FILESYSPATH, &path)))
+    {
+        PowerRenameStep step;
+        step.from = PathFindFileName(path);
+        step.parent = path;
+        PathCchRemoveFileSpec(&step.parent[0], step.parent.size() + 1);
+        step.parent.resize(wcslen(step.parent.c_str()));
+        step.to = newName ? newName : L"";
+
+        PWSTR newPath = nullptr;
+        if (newItem && SUCCEEDED(newItem->GetDisplayName(SIGDN_FILESYSPATH, &newPath)))
+        {
+            step.to = PathFindFileName(newPath);
+            CoTaskMemFree(newPath);
+        }
+        CoTaskMemFree(path);
+
+        if (!step.to.empty() && step.to != step.from)
+        {
+            m_steps.push_back(std::move(step));
+        }
+    }
+    return S_OK;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include "PowerRenameCommit.h"
+
+// Progress sink of the rename IFileOperation.  Records the renames that were done, in
+// the order they ran, so they can be written to the undo log.  The operation calls it
+// on the thread that performs it.
+class CPowerRenameUndoRecorder :
+    public IFileOperationProgressSink
+{
+public:
+    CPowerRenameUndoRecorder() :
+        m_refCount(1)
+    {
+    }
+
+    // IUnknown
+    IFACEMETHODIMP QueryInterface(_In_ REFIID iid, _Outptr_ void** resultInterface);
+    IFACEMETHODIMP_(ULONG) AddRef();
+    IFACEMETHODIMP_(ULONG) Release();
+
+    // IFileOperationProgressSink
+    IFACEMETHODIMP StartOperations() { return S_OK; }
+    IFACEMETHODIMP FinishOperations(_In_ HRESULT) { return S_OK; }
+    IFACEMETHODIMP PreRenameItem(_In_ DWORD, _In_ IShellItem*, _In_opt_ PCWSTR) { return S_OK; }
+    IFACEMETHODIMP PostRenameItem(_In_ DWORD flags, _In_ IShellItem* item, _In_ PCWSTR newName, _In_ HRESULT renameResult, _In_opt_ IShellItem* newItem);
+    IFACEMETHODIMP PreMoveItem(_In_ DWORD, _In_ IShellItem*, _In_ IShellItem*, _In_opt_ PCWSTR) { return S_OK; }
+    IFACEMETHODIMP PostMoveItem(_In_ DWORD, _In_ IShellItem*, _In_ IShellItem*, _In_opt_ PCWSTR, _In_ HRESULT, _In_opt_ IShellItem*) { return S_OK; }
+    IFACEMETHODIMP PreCopyItem(_In_ DWORD, _In_ IShellItem*, _In_ IShellItem*, _In_opt_ PCWSTR) { return S_OK; }
+    IFACEMETHODIMP PostCopyItem(_In_ DWORD, _In_ IShellItem*, _In_ IShellItem*, _In_opt_ PCWSTR, _In_ HRESULT, _In_opt_ IShellItem*) { return S_OK; }
+    IFACEMETHODIMP PreDeleteItem(_In_ DWORD, _In_ IShellItem*) { return S_OK; }
+    IFACEMETHODIMP PostDeleteItem(_In_ DWORD, _In_ IShellItem*, _In_ HRESULT, _In_opt_ IShellItem*) { return S_OK; }
+    IFACEMETHODIMP PreNewItem(_In_ DWORD, _In_ IShellItem*, _In_opt_ PCWSTR) { return S_OK; }
+    IFACEMETHODIMP PostNewItem(_In_ DWORD, _In_ IShellItem*, _In_opt_ PCWSTR, _In_opt_ PCWSTR, _In_ DWORD, _In_ HRESULT, _In_opt_ IShellItem*) { return S_OK; }
+    IFACEMETHODIMP UpdateProgress(_In_ UINT, _In_ UINT) { return S_OK; }
+    IFACEMETHODIMP ResetTimer() { return S_OK; }
+    IFACEMETHODIMP PauseTimer() { return S_OK; }
+    IFACEMETHODIMP ResumeTimer() { return S_OK; }
+
+    const std::vector<PowerRenameStep>& GetSteps() const { return m_steps; }
+
+private:
+    ~CPowerRenameUndoRecorder() = default;
+
+    std::vector<PowerRenameStep> m_steps;
+    long m_refCount;
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <mutex>
+#include <vector>
+
+// Epoch based reclamation for data that is read without a lock.  A reader enters the
+// domain for as long as it uses a pointer it loaded.  A writer that replaces such a
+// pointer stamps the old block with Retire and only reuses or frees it once IsSafe
+// says no reader that could still see it is left.
+class CEpochDomain
+{
+public:
+    static CEpochDomain& Instance()
+    {
+        static CEpochDomain s_domain;
+        return s_domain;
+    }
+
+    // Nests, only the outermost Enter and Leave of a thread count
+    void Enter()
+    {
+        if (s_depth++ == 0)
+        {
+            if (s_slot == nullptr)
+            {
+                s_slot = _AcquireSlot();
+            }
+
+            // Published before the reader loads any pointer so a writer that replaced
+            // one afterwards sees the reader
+            s_slot->epoch.store(m_epoch.load(std::memory_order_relaxed));
+        }
+    }
+
+    void Leave()
+    {
+        if (--s_depth == 0)
+        {
+            s_slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    // Returns the stamp of a block that was just unlinked
+    ULONGLONG Retire()
+    {
+        return m_epoch.load();
+    }
+
+    // Whether no reader that entered before the block with this stamp was unlinked is
+    // still in the domain
+    bool IsSafe(_In_ ULONGLONG retiredAt)
+    {
+        return retiredAt < _GetOldestReaderEpoch(retiredAt);
+    }
+
+    // Frees block with freeBlock once it is safe.  For blocks a writer can't keep around
+    // until then.
+    void Defer(_In_ void* block, _In_ ULONGLONG retiredAt, _In_ void (*freeBlock)(void*))
+    {
+        std::lock_guard<std::mutex> lock(m_deferredLock);
+        m_deferred.push_back({ block, retiredAt, freeBlock });
+        if (m_deferred.size() >= EPOCH_DEFERRED_BATCH)
+        {
+            _Collect();
+        }
+    }
+
+    CEpochDomain(const CEpochDomain&) = delete;
+    CEpochDomain& operator=(const CEpochDomain&) = delete;
+
+private:
+    static constexpr size_t EPOCH_DEFERRED_BATCH = 64;
+
+    struct ReaderSlot
+    {
+        // Epoch the reader entered in, or 0 outside the domain
+        std::atomic<ULONGLONG> epoch = 0;
+        std::atomic<bool> inUse = false;
+        ReaderSlot* next = nullptr;
+    };
+
+    // Slots are kept for the life of the process and handed to the next thread that
+    // needs one once their thread exits
+    struct SlotReleaser
+    {
+        ~SlotReleaser()
+        {
+            if (s_slot != nullptr)
+            {
+                s_slot->inUse.store(false, std::memory_order_release);
+                s_slot = nullptr;
+            }
+        }
+    };
+
+    struct DeferredBlock
+    {
+        void* block;
+        ULONGLONG retiredAt;
+        void (*freeBlock)(void*);
+    };
+
+    CEpochDomain() = default;
+
+    ~CEpochDomain()
+    {
+        for (auto& deferred : m_deferred)
+        {
+            deferred.freeBlock(deferred.block);
+        }
+    }
+
+    ReaderSlot* _AcquireSlot()
+    {
+        // Only touched here so reading the slot and the depth stays a plain thread
+        // local access
+        static thread_local SlotReleaser s_releaser;
+        (void)s_releaser;
+
+        for (ReaderSlot* slot = m_slots.load(); slot != nullptr; slot = slot->next)
+        {
+            bool inUse = false;
+            if (!slot->inUse.load() && slot->inUse.compare_exchange_strong(inUse, true))
+            {
+                return slot;
+            }
+        }
+
+        ReaderSlot* slot = new ReaderSlot();
+        slot->inUse = true;
+        slot->next = m_slots.load();
+        while (!m_slots.compare_exchange_weak(slot->next, slot))
+        {
+        }
+        return slot;
+    }
+
+    // Returns the epoch of the reader that entered first, after moving readers that
+    // enter from now on past retiredAt
+    ULONGLONG _GetOldestReaderEpoch(_In_ ULONGLONG retiredAt)
+    {
+        ULONGLONG current = retiredAt;
+        m_epoch.compare_exchange_strong(current, retiredAt + 1);
+
+        ULONGLONG oldest = ULLONG_MAX;
+        for (ReaderSlot* slot = m_slots.load(); slot != nullptr; slot = slot->next)
+        {
+            ULONGLONG epoch = slot->epoch.load();
+            if (epoch != 0 && epoch < oldest)
+            {
+                oldest = epoch;
+            }
+        }
+        return oldest;
+    }
+
+    void _Collect()
+    {
+        ULONGLONG newest = 0;
+        for (auto& deferred : m_deferred)
+        {
+            newest = (std::max)(newest, deferred.retiredAt);
+        }
+
+        ULONGLONG oldestReader = _GetOldestReaderEpoch(newest);
+        auto kept = m_deferred.begin();
+        for (auto& deferred : m_deferred)
+        {
+            if (deferred.retiredAt < oldestReader)
+            {
+                deferred.freeBlock(deferred.block);
+            }
+            else
+            {
+                *kept++ = deferred;
+            }
+        }
+        m_deferred.erase(kept, m_deferred.end());
+    }
+
+    static inline thread_local ReaderSlot* s_slot = nullptr;
+    static inline thread_local UINT s_depth = 0;
+
+    // Starts at 1 so 0 can mean outside the domain
+    std::atomic<ULONGLONG> m_epoch = 1;
+    std::atomic<ReaderSlot*> m_slots = nullptr;
+    std::mutex m_deferredLock;
+    _Guarded_by_(m_deferredLock) std::vector<DeferredBlock> m_deferred;
+};
+
+// RAII over CEpochDomain::Enter and Leave
+class CEpochReadGuard
+{
+public:
+    CEpochReadGuard()
+    {
+        CEpochDomain::Instance().Enter();
+    }
+
+    ~CEpochReadGuard()
+    {
+        CEpochDomain::Instance().Leave();
+    }
+
+    CEpochReadGuard(const CEpochReadGuard&) = delete;
+    CEpochReadGuard& operator=(const CEpochReadGuard&) = delete;
+};
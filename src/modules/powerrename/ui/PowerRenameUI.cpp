@@ -5,9 +5,34 @@
 #include <Shlobj.h>
 #include <helpers.h>
 #include <windowsx.h>
+#include <vector>
 
 extern HINSTANCE g_hInst;
 
+// Messages posted to the dialog by the enumeration thread
+enum
+{
+    WM_POWERRENAME_ITEMSADDED = (WM_APP + 1),   // Items were added to the manager since the last one
+    WM_POWERRENAME_ENUMCOMPLETE                 // Enumeration thread completed
+};
+
+// Items to enumerate.  The data object belongs to the dialog's thread so only the ID
+// lists of the items are handed to the enumeration thread.
+struct EnumerateThreadData
+{
+    HWND hwnd = nullptr;
+    HANDLE cancelEvent = nullptr;
+    CComPtr<IPowerRenameManager> spsrm;
+    std::vector<PCIDLIST_ABSOLUTE> idLists;
+
+    ~EnumerateThreadData()
+    {
+        for (auto idList : idLists)
+        {
+            ILFree(const_cast<PIDLIST_ABSOLUTE>(idList));
+        }
+    }
+};
 
 int g_rgnMatchModeResIDs[] =
 {
@@ -121,23 +146,27 @@ IFACEMETHODIMP CPowerRenameUI::get_showUI(_Out_ bool* showUI)
 // IPowerRenameManagerEvents
 IFACEMETHODIMP CPowerRenameUI::OnItemAdded(_In_ IPowerRenameItem*)
 {
+    // Called on the enumeration thread for every item.  The list is resized once for
+    // all the items added before the dialog gets to the message.
+    if (m_hwnd && !m_itemsAddedPending.exchange(true))
+    {
+        PostMessage(m_hwnd, WM_POWERRENAME_ITEMSADDED, 0, 0);
+    }
     return S_OK;
 }
 
-IFACEMETHODIMP CPowerRenameUI::OnUpdate(_In_ IPowerRenameItem*)
+IFACEMETHODIMP CPowerRenameUI::OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT lastIndex, _In_ UINT selectedCount, _In_ UINT renameCount)
 {
-    UINT itemCount = 0;
-    if (m_spsrm)
-    {
-        m_spsrm->GetItemCount(&itemCount);
-    }
-    m_listview.RedrawItems(0, itemCount);
-    _UpdateCounts();
+    m_listview.RedrawItems(firstIndex, lastIndex);
+    _SetCounts(selectedCount, renameCount);
     return S_OK;
 }
 
+// Only sent for items whose match took longer than the time budget
 IFACEMETHODIMP CPowerRenameUI::OnError(_In_ IPowerRenameItem*)
 {
+    m_timedOutCount++;
+    _UpdateCounts();
     return S_OK;
 }
 
@@ -145,6 +174,7 @@ IFACEMETHODIMP CPowerRenameUI::OnRegExStarted(_In_ DWORD threadId)
 {
     m_disableCountUpdate = true;
     m_currentRegExId = threadId;
+    m_timedOutCount = 0;
     _UpdateCounts();
     return S_OK;
 }
@@ -229,6 +259,8 @@ IFACEMETHODIMP CPowerRenameUI::Drop(_In_ IDataObject* pdtobj, DWORD, POINTL pt,
         m_spdth->Drop(pdtobj, &ptT, *pdwEffect);
     }
 
+    // Items still being found belong to the previous drop
+    _WaitForEnumeration(true);
     _OnClear();
 
     EnableWindow(GetDlgItem(m_hwnd, ID_RENAME), TRUE);
@@ -253,7 +285,14 @@ HRESULT CPowerRenameUI::_Initialize(_In_ IPowerRenameManager* psrm, _In_opt_ IDa
 
     m_enableDragDrop = enableDragDrop;
 
-    HRESULT hr = CoCreateInstance(CLSID_DragDropHelper, NULL, CLSCTX_INPROC, IID_PPV_ARGS(&m_spdth));
+    m_cancelEnumerateEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+    HRESULT hr = m_cancelEnumerateEvent ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+    if (SUCCEEDED(hr))
+    {
+        hr = CoCreateInstance(CLSID_DragDropHelper, NULL, CLSCTX_INPROC, IID_PPV_ARGS(&m_spdth));
+    }
+
     if (SUCCEEDED(hr))
     {
         // Subscribe to smart rename manager events
@@ -270,6 +309,9 @@ HRESULT CPowerRenameUI::_Initialize(_In_ IPowerRenameManager* psrm, _In_opt_ IDa
 
 void CPowerRenameUI::_Cleanup()
 {
+    // Stop adding items before we stop listening for them
+    _WaitForEnumeration(true);
+
     if (m_spsrm && m_cookie != 0)
     {
         m_spsrm->UnAdvise(m_cookie);
@@ -291,10 +333,83 @@ void CPowerRenameUI::_EnumerateItems(_In_ IDataObject* pdtobj)
     // Enumerate the data object and popuplate the manager
     if (m_spsrm)
     {
-        m_disableCountUpdate = true;
-        EnumerateDataObject(pdtobj, m_spsrm);
-        m_disableCountUpdate = false;
+        // Only one enumeration adds items at a time
+        _WaitForEnumeration(false);
+
+        EnumerateThreadData* petd = new EnumerateThreadData;
+        petd->hwnd = m_hwnd;
+        petd->cancelEvent = m_cancelEnumerateEvent;
+        petd->spsrm = m_spsrm;
 
+        CComPtr<IShellItemArray> spsia;
+        if (SUCCEEDED(SHCreateShellItemArrayFromDataObject(pdtobj, IID_PPV_ARGS(&spsia))))
+        {
+            DWORD count = 0;
+            spsia->GetCount(&count);
+            for (DWORD i = 0; i < count; i++)
+            {
+                CComPtr<IShellItem> spsi;
+                PIDLIST_ABSOLUTE idList = nullptr;
+                if (SUCCEEDED(spsia->GetItemAt(i, &spsi)) && SUCCEEDED(SHGetIDListFromObject(spsi, &idList)))
+                {
+                    petd->idLists.push_back(idList);
+                }
+            }
+        }
+
+        ResetEvent(m_cancelEnumerateEvent);
+        m_enumerateThread = CreateThread(nullptr, 0, s_enumerateThreadProc, petd, 0, nullptr);
+        if (!m_enumerateThread)
+        {
+            delete petd;
+        }
+    }
+}
+
+DWORD WINAPI CPowerRenameUI::s_enumerateThreadProc(_In_ void* pv)
+{
+    EnumerateThreadData* petd = reinterpret_cast<EnumerateThreadData*>(pv);
+    if (SUCCEEDED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE)))
+    {
+        CComPtr<IShellItemArray> spsia;
+        if (!petd->idLists.empty() &&
+            SUCCEEDED(SHCreateShellItemArrayFromIDLists(static_cast<UINT>(petd->idLists.size()), petd->idLists.data(), &spsia)))
+        {
+            EnumerateShellItems(spsia, petd->spsrm, petd->cancelEvent);
+        }
+        CoUninitialize();
+    }
+
+    PostMessage(petd->hwnd, WM_POWERRENAME_ENUMCOMPLETE, 0, 0);
+
+    delete petd;
+    return 0;
+}
+
+// Waits for the enumeration thread to add the remaining items, or with cancel set, to
+// stop adding them.  The thread only posts messages to the dialog so it can't be
+// waiting on us.
+void CPowerRenameUI::_WaitForEnumeration(_In_ bool cancel)
+{
+    if (m_enumerateThread)
+    {
+        if (cancel)
+        {
+            SetEvent(m_cancelEnumerateEvent);
+        }
+
+        WaitForSingleObject(m_enumerateThread, INFINITE);
+        CloseHandle(m_enumerateThread);
+        m_enumerateThread = nullptr;
+    }
+}
+
+void CPowerRenameUI::_OnItemsAdded()
+{
+    m_itemsAddedPending = false;
+
+    if (m_spsrm)
+    {
         UINT itemCount = 0;
         m_spsrm->GetItemCount(&itemCount);
         m_listview.SetItemCount(itemCount);
@@ -334,6 +449,9 @@ void CPowerRenameUI::_OnRename()
 {
     if (m_spsrm)
     {
+        // Rename everything that was selected, not only what was found so far
+        _WaitForEnumeration(false);
+
         m_spsrm->Rename(m_hwnd);
     }
 }
@@ -387,6 +505,11 @@ INT_PTR CPowerRenameUI::_DlgProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
         _OnDestroyDlg();
         break;
 
+    case WM_POWERRENAME_ITEMSADDED:
+    case WM_POWERRENAME_ENUMCOMPLETE:
+        _OnItemsAdded();
+        break;
+
     default:
         bRet = FALSE;
     }
@@ -528,6 +651,15 @@ BOOL CPowerRenameUI::_OnNotify(_In_ WPARAM wParam, _In_ LPARAM lParam)
             }
             break;
 
+        case LVN_ODCACHEHINT:
+            if (m_spsrm)
+            {
+                // Rows about to be drawn.  Their new names are computed first.
+                NMLVCACHEHINT* pnmCacheHint = (NMLVCACHEHINT*)lParam;
+                m_spsrm->SetVisibleRange(pnmCacheHint->iFrom, pnmCacheHint->iTo);
+            }
+            break;
+
         case NM_CLICK:
             {
                 if (m_spsrm)
@@ -607,13 +739,6 @@ void CPowerRenameUI::_ValidateFlagCheckbox(_In_ DWORD checkBoxId)
 
 void CPowerRenameUI::_UpdateCounts()
 {
-    // This method is CPU intensive.  We disable it during certain operations
-    // for performance reasons.
-    if (m_disableCountUpdate)
-    {
-        return;
-    }
-
     UINT selectedCount = 0;
     UINT renamingCount = 0;
     if (m_spsrm)
@@ -622,18 +747,33 @@ void CPowerRenameUI::_UpdateCounts()
         m_spsrm->GetRenameItemCount(&renamingCount);
     }
 
+    _SetCounts(selectedCount, renamingCount);
+}
+
+void CPowerRenameUI::_SetCounts(_In_ UINT selectedCount, _In_ UINT renamingCount)
+{
+    // The counts are in flux while the regex runs so we don't show them until
+    // it completes or is canceled.
+    if (m_disableCountUpdate)
+    {
+        return;
+    }
+
     if (m_selectedCount != selectedCount ||
-        m_renamingCount != renamingCount)
+        m_renamingCount != renamingCount ||
+        m_shownTimedOutCount != m_timedOutCount)
     {
         m_selectedCount = selectedCount;
         m_renamingCount = renamingCount;
+        m_shownTimedOutCount = m_timedOutCount;
 
-        // Update selected and rename count label
+        // Update selected and rename count label.  Items that took too long to match
+        // are counted too so a pathological search term doesn't go unnoticed.
         wchar_t countsLabelFormat[100] = { 0 };
-        LoadString(g_hInst, IDS_COUNTSLABELFMT, countsLabelFormat, ARRAYSIZE(countsLabelFormat));
+        LoadString(g_hInst, m_timedOutCount ? IDS_MATCHTIMEOUTFMT : IDS_COUNTSLABELFMT, countsLabelFormat, ARRAYSIZE(countsLabelFormat));
 
         wchar_t countsLabel[100] = { 0 };
-        StringCchPrintf(countsLabel, ARRAYSIZE(countsLabel), countsLabelFormat, selectedCount, renamingCount);
+        StringCchPrintf(countsLabel, ARRAYSIZE(countsLabel), countsLabelFormat, selectedCount, renamingCount, m_timedOutCount);
         SetDlgItemText(m_hwnd, IDC_STATUS_MESSAGE, countsLabel);
 
         // Update Rename button state
@@ -679,11 +819,7 @@ void CPowerRenameListView::ToggleAll(_In_ IPowerRenameManager* psrm, _In_ bool s
         psrm->GetItemCount(&itemCount);
         for (UINT i = 0; i < itemCount; i++)
         {
-            CComPtr<IPowerRenameItem> spItem;
-            if (SUCCEEDED(psrm->GetItemByIndex(i, &spItem)))
-            {
-                spItem->put_selected(selected);
-            }
+            psrm->SetItemSelected(i, selected);
         }
 
         RedrawItems(0, itemCount);
@@ -697,7 +833,7 @@ void CPowerRenameListView::ToggleItem(_In_ IPowerRenameManager* psrm, _In_ int i
     {
         bool selected = false;
         spItem->get_selected(&selected);
-        spItem->put_selected(!selected);
+        psrm->SetItemSelected(item, !selected);
 
         RedrawItems(item, item);
     }
@@ -740,7 +876,7 @@ void CPowerRenameListView::UpdateItemCheckState(_In_ IPowerRenameManager* psrm,
         if (SUCCEEDED(psrm->GetItemByIndex(iItem, &spItem)))
         {
             bool checked = ListView_GetCheckState(m_hwndLV, iItem);
-            spItem->put_selected(checked);
+            psrm->SetItemSelected(iItem, checked);
 
             UINT uSelected = (checked) ? LVIS_SELECTED : 0;
             ListView_SetItemState(m_hwndLV, iItem, uSelected, LVIS_SELECTED);
@@ -814,10 +950,11 @@ void CPowerRenameListView::GetDisplayInfo(_In_ IPowerRenameManager* psrm, _Inout
 
         if (plvdi->item.mask & LVIF_TEXT)
         {
-            PWSTR subItemText = nullptr;
+            // The names are copied straight into the list view's buffer
+            HRESULT hr = E_FAIL;
             if (plvdi->item.iSubItem == COL_ORIGINAL_NAME)
             {
-                renameItem->get_originalName(&subItemText);
+                hr = renameItem->GetOriginalName(plvdi->item.pszText, plvdi->item.cchTextMax);
             }
             else if (plvdi->item.iSubItem == COL_NEW_NAME)
             {
@@ -826,13 +963,14 @@ void CPowerRenameListView::GetDisplayInfo(_In_ IPowerRenameManager* psrm, _Inout
                 bool shouldRename = false;
                 if (SUCCEEDED(renameItem->ShouldRenameItem(flags, &shouldRename)) && shouldRename)
                 {
-                    renameItem->get_newName(&subItemText);
+                    hr = renameItem->GetNewName(plvdi->item.pszText, plvdi->item.cchTextMax);
                 }
             }
 
-            StringCchCopy(plvdi->item.pszText, plvdi->item.cchTextMax, subItemText ? subItemText : L"");
-            CoTaskMemFree(subItemText);
-            subItemText = nullptr;
+            if (FAILED(hr) && hr != STRSAFE_E_INSUFFICIENT_BUFFER)
+            {
+                StringCchCopy(plvdi->item.pszText, plvdi->item.cchTextMax, L"");
+            }
         }
     }
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <PowerRenameInterfaces.h>
+#include <atomic>
 
 class CPowerRenameListView
 {
@@ -53,7 +54,7 @@ public:
 
     // IPowerRenameManagerEvents
     IFACEMETHODIMP OnItemAdded(_In_ IPowerRenameItem* renameItem);
-    IFACEMETHODIMP OnUpdate(_In_ IPowerRenameItem* renameItem);
+    IFACEMETHODIMP OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT lastIndex, _In_ UINT selectedCount, _In_ UINT renameCount);
     IFACEMETHODIMP OnError(_In_ IPowerRenameItem* renameItem);
     IFACEMETHODIMP OnRegExStarted(_In_ DWORD threadId);
     IFACEMETHODIMP OnRegExCanceled(_In_ DWORD threadId);
@@ -73,6 +74,10 @@ private:
     ~CPowerRenameUI()
     {
         DeleteObject(m_iconMain);
+        if (m_cancelEnumerateEvent)
+        {
+            CloseHandle(m_cancelEnumerateEvent);
+        }
         OleUninitialize();
     }
 
@@ -91,6 +96,10 @@ private:
     }
 
     INT_PTR _DlgProc(UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+    // Thread proc that enumerates the items so the list fills in while they are found
+    static DWORD WINAPI s_enumerateThreadProc(_In_ void* pv);
+
     void _OnCommand(_In_ WPARAM wParam, _In_ LPARAM lParam);
     BOOL _OnNotify(_In_ WPARAM wParam, _In_ LPARAM lParam);
 
@@ -113,7 +122,10 @@ private:
     void _ValidateFlagCheckbox(_In_ DWORD checkBoxId);
 
     void _EnumerateItems(_In_ IDataObject* pdtobj);
+    void _WaitForEnumeration(_In_ bool cancel);
+    void _OnItemsAdded();
     void _UpdateCounts();
+    void _SetCounts(_In_ UINT selectedCount, _In_ UINT renamingCount);
 
     long m_refCount = 0;
     bool m_initialized = false;
@@ -126,6 +138,14 @@ private:
     DWORD m_currentRegExId = 0;
     UINT m_selectedCount = 0;
     UINT m_renamingCount = 0;
+    // Items of the current regex pass whose match ran out of time, and how many the
+    // status shows
+    UINT m_timedOutCount = 0;
+    UINT m_shownTimedOutCount = 0;
+    HANDLE m_enumerateThread = nullptr;
+    HANDLE m_cancelEnumerateEvent = nullptr;
+    // Set while a message to show the items added since the last one is pending
+    std::atomic<bool> m_itemsAddedPending = false;
     CComPtr<IPowerRenameManager> m_spsrm;
     CComPtr<IDataObject> m_spdo;
     CComPtr<IDropTargetHelper> m_spdth;
@@ -31,12 +31,17 @@ IFACEMETHODIMP_(ULONG) CMockPowerRenameManagerEvents::Release()
 IFACEMETHODIMP CMockPowerRenameManagerEvents::OnItemAdded(_In_ IPowerRenameItem* pItem)
 {
     m_itemAdded = pItem;
+    m_itemAddedCount++;
     return S_OK;
 }
 
-IFACEMETHODIMP CMockPowerRenameManagerEvents::OnUpdate(_In_ IPowerRenameItem* pItem)
+IFACEMETHODIMP CMockPowerRenameManagerEvents::OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT lastIndex, _In_ UINT selectedCount, _In_ UINT renameCount)
 {
-    m_itemUpdated = pItem;
+    m_itemsUpdatedCount++;
+    m_updatedFirstIndex = firstIndex;
+    m_updatedLastIndex = lastIndex;
+    m_updatedSelectedCount = selectedCount;
+    m_updatedRenameCount = renameCount;
     return S_OK;
 }
 
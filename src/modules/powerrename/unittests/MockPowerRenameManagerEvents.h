@@ -17,7 +17,7 @@ public:
     
     // IPowerRenameManagerEvents
     IFACEMETHODIMP OnItemAdded(_In_ IPowerRenameItem* renameItem);
-    IFACEMETHODIMP OnUpdate(_In_ IPowerRenameItem* renameItem);
+    IFACEMETHODIMP OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT lastIndex, _In_ UINT selectedCount, _In_ UINT renameCount);
     IFACEMETHODIMP OnError(_In_ IPowerRenameItem* renameItem);
     IFACEMETHODIMP OnRegExStarted(_In_ DWORD threadId);
     IFACEMETHODIMP OnRegExCanceled(_In_ DWORD threadId);
@@ -32,7 +32,12 @@ public:
     }
 
     CComPtr<IPowerRenameItem> m_itemAdded;
-    CComPtr<IPowerRenameItem> m_itemUpdated;
+    UINT m_itemAddedCount = 0;
+    UINT m_itemsUpdatedCount = 0;
+    UINT m_updatedFirstIndex = 0;
+    UINT m_updatedLastIndex = 0;
+    UINT m_updatedSelectedCount = 0;
+    UINT m_updatedRenameCount = 0;
     CComPtr<IPowerRenameItem> m_itemError;
     bool m_regExStarted = false;
     bool m_regExCanceled = false;
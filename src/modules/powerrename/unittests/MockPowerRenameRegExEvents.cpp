@@ -54,6 +54,12 @@ IFACEMETHODIMP CMockPowerRenameRegExEvents::OnFlagsChanged(_In_ DWORD flags)
     return S_OK;
 }
 
+IFACEMETHODIMP CMockPowerRenameRegExEvents::OnEngineChanged(_In_ PowerRenameRegExEngine engine)
+{
+    m_engine = engine;
+    return S_OK;
+}
+
 HRESULT CMockPowerRenameRegExEvents::s_CreateInstance(_Outptr_ IPowerRenameRegExEvents** ppsrree)
 {
     *ppsrree = nullptr;
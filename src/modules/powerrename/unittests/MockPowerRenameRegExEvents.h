@@ -15,6 +15,7 @@ public:
     IFACEMETHODIMP OnSearchTermChanged(_In_ PCWSTR searchTerm);
     IFACEMETHODIMP OnReplaceTermChanged(_In_ PCWSTR replaceTerm);
     IFACEMETHODIMP OnFlagsChanged(_In_ DWORD flags);
+    IFACEMETHODIMP OnEngineChanged(_In_ PowerRenameRegExEngine engine);
 
     static HRESULT s_CreateInstance(_Outptr_ IPowerRenameRegExEvents** ppsrree);
 
@@ -32,5 +33,6 @@ public:
     PWSTR m_searchTerm = nullptr;
     PWSTR m_replaceTerm = nullptr;
     DWORD m_flags = 0;
+    PowerRenameRegExEngine m_engine = LinearRegExEngine;
     long m_refCount;
 };
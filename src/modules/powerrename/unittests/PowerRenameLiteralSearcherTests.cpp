@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <LiteralSearcher.h>
+#include <algorithm>
+#include <cwctype>
+#include <random>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// Differential tests between the literal search kernels and the search the plain text
+// mode used before, which lowercased copies of both strings and called find.
+namespace PowerRenameLiteralSearcherTests
+{
+    static const LiteralSearchKernel s_kernels[] = {
+        LiteralSearchKernel::Scalar,
+        LiteralSearchKernel::Sse2,
+        LiteralSearchKernel::Avx2,
+    };
+
+    static size_t ReferenceFind(std::wstring data, std::wstring toSearch, bool caseInsensitive, size_t pos)
+    {
+        if (caseInsensitive)
+        {
+            std::transform(data.begin(), data.end(), data.begin(), ::towlower);
+            std::transform(toSearch.begin(), toSearch.end(), toSearch.begin(), ::towlower);
+        }
+        return data.find(toSearch, pos);
+    }
+
+    static void VerifyKernelsMatch(_In_ const std::wstring& haystack, _In_ const std::wstring& needle, _In_ bool caseInsensitive)
+    {
+        CLiteralSearcher searcher(needle.c_str(), caseInsensitive);
+        for (size_t start = 0; start <= haystack.size(); start++)
+        {
+            size_t expected = ReferenceFind(haystack, needle, caseInsensitive, start);
+            for (LiteralSearchKernel kernel : s_kernels)
+            {
+                std::wstring message = L"needle: " + needle + L" haystack: " + haystack + L" start: " + std::to_wstring(start) +
+                    L" kernel: " + std::to_wstring(static_cast<int>(kernel));
+                Assert::IsTrue(expected == searcher.Find(haystack, start, kernel), message.c_str());
+            }
+        }
+    }
+
+    TEST_CLASS(LiteralSearcherTests)
+    {
+    public:
+        TEST_METHOD(VerifyBestKernelIsSupported)
+        {
+            Assert::IsTrue(CLiteralSearcher::s_IsKernelSupported(LiteralSearchKernel::Scalar));
+            Assert::IsTrue(CLiteralSearcher::s_IsKernelSupported(CLiteralSearcher::s_GetBestKernel()));
+        }
+
+        TEST_METHOD(VerifyFixedCases)
+        {
+            // Matches on both sides of the 8 and 16 character block boundaries
+            std::wstring longName = L"IMG_20190815_Holiday_PAMPALONA_holiday_pampalona.JPG";
+            PCWSTR needles[] = { L"i", L"holiday", L"PAMPALONA", L".jpg", L"img_2019", L"_", L"x", longName.c_str() };
+            for (PCWSTR needle : needles)
+            {
+                VerifyKernelsMatch(longName, needle, true);
+                VerifyKernelsMatch(longName, needle, false);
+            }
+
+            // Characters outside of ASCII are folded with towlower
+            VerifyKernelsMatch(L"\u00c9t\u00c9 \u00e9t\u00e9 ETE \u00c9T\u00c9 r\u00e9sum\u00e9 R\u00c9SUM\u00c9.docx", L"\u00e9t\u00e9", true);
+            VerifyKernelsMatch(L"\u00c9t\u00c9 \u00e9t\u00e9 ETE \u00c9T\u00c9 r\u00e9sum\u00e9 R\u00c9SUM\u00c9.docx", L"R\u00c9SUM\u00c9", true);
+            VerifyKernelsMatch(L"\u0410\u0411\u0412 abc \u0430\u0431\u0432 ABC \u0430\u0431\u0432abc\u0410\u0411\u0412", L"\u0431\u0432A", true);
+            VerifyKernelsMatch(L"\u0410\u0411\u0412 abc \u0430\u0431\u0432 ABC \u0430\u0431\u0432abc\u0410\u0411\u0412", L"\u0431\u0432A", false);
+        }
+
+        TEST_METHOD(VerifyEmptyAndLongNeedles)
+        {
+            CLiteralSearcher empty(L"", true);
+            Assert::IsTrue(empty.Find(L"foo", 0) == std::wstring::npos);
+
+            CLiteralSearcher tooLong(L"foobar", true);
+            Assert::IsTrue(tooLong.Find(L"foo", 0) == std::wstring::npos);
+            Assert::IsTrue(tooLong.Find(L"foobar", 7) == std::wstring::npos);
+        }
+
+        TEST_METHOD(VerifyRandomInputs)
+        {
+            // Small alphabet so matches are frequent, with characters outside of ASCII
+            // and both cases of each letter
+            const wchar_t alphabet[] = { L'a', L'A', L'b', L'B', L'.', L'_', L'1', L'\u00e9', L'\u00c9', L'\u0431', L'\u0411' };
+            std::mt19937 random(42);
+            std::uniform_int_distribution<size_t> letter(0, ARRAYSIZE(alphabet) - 1);
+            std::uniform_int_distribution<size_t> haystackLength(0, 80);
+            std::uniform_int_distribution<size_t> needleLength(1, 6);
+
+            for (int i = 0; i < 300; i++)
+            {
+                std::wstring haystack(haystackLength(random), L' ');
+                std::wstring needle(needleLength(random), L' ');
+                for (auto& ch : haystack)
+                {
+                    ch = alphabet[letter(random)];
+                }
+                for (auto& ch : needle)
+                {
+                    ch = alphabet[letter(random)];
+                }
+
+                VerifyKernelsMatch(haystack, needle, true);
+                VerifyKernelsMatch(haystack, needle, false);
+            }
+        }
+    };
+}
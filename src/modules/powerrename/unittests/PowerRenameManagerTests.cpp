@@ -6,6 +6,7 @@
 #include "MockPowerRenameItem.h"
 #include "MockPowerRenameManagerEvents.h"
 #include "TestFileHelper.h"
+#include <fstream>
 
 #define DEFAULT_FLAGS MatchAllOccurences
 
@@ -125,6 +126,509 @@ namespace PowerRenameManagerTests
             Assert::IsTrue(mgr->Shutdown() == S_OK);
         }
 
+        TEST_METHOD(VerifyItemsIndexedInIdOrder)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CComPtr<IPowerRenameItem> items[4];
+            for (UINT i = 0; i < ARRAYSIZE(items); i++)
+            {
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo", L"foo", 0, false, &items[i]) == S_OK);
+            }
+
+            // Add out of creation order
+            Assert::IsTrue(mgr->AddItem(items[2]) == S_OK);
+            Assert::IsTrue(mgr->AddItem(items[0]) == S_OK);
+            Assert::IsTrue(mgr->AddItem(items[3]) == S_OK);
+            Assert::IsTrue(mgr->AddItem(items[1]) == S_OK);
+            Assert::IsTrue(mgr->AddItem(items[1]) != S_OK);
+
+            UINT count = 0;
+            Assert::IsTrue(mgr->GetItemCount(&count) == S_OK);
+            Assert::IsTrue(count == ARRAYSIZE(items));
+
+            for (UINT i = 0; i < count; i++)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(mgr->GetItemByIndex(i, &item) == S_OK);
+                Assert::IsTrue(item == items[i]);
+
+                int id = 0;
+                Assert::IsTrue(item->get_id(&id) == S_OK);
+                CComPtr<IPowerRenameItem> itemById;
+                Assert::IsTrue(mgr->GetItemById(id, &itemById) == S_OK);
+                Assert::IsTrue(itemById == items[i]);
+            }
+
+            CComPtr<IPowerRenameItem> item;
+            Assert::IsTrue(mgr->GetItemByIndex(count, &item) != S_OK);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyAddItemsBatch)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CMockPowerRenameManagerEvents* mockMgrEvents = new CMockPowerRenameManagerEvents();
+            CComPtr<IPowerRenameManagerEvents> mgrEvents;
+            Assert::IsTrue(mockMgrEvents->QueryInterface(IID_PPV_ARGS(&mgrEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(mgr->Advise(mgrEvents, &cookie) == S_OK);
+
+            CComPtr<IPowerRenameItem> items[5];
+            for (UINT i = 0; i < ARRAYSIZE(items); i++)
+            {
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo", L"foo", 0, false, &items[i]) == S_OK);
+            }
+
+            // Batches out of creation order, the second one with an item already added
+            IPowerRenameItem* firstBatch[] = { items[3], items[1] };
+            Assert::IsTrue(mgr->AddItems(firstBatch, ARRAYSIZE(firstBatch)) == S_OK);
+            IPowerRenameItem* secondBatch[] = { items[4], items[0], items[1], items[2] };
+            Assert::IsTrue(mgr->AddItems(secondBatch, ARRAYSIZE(secondBatch)) == S_OK);
+            Assert::IsTrue(mgr->AddItems(firstBatch, ARRAYSIZE(firstBatch)) == S_FALSE);
+
+            // One event per item that was added
+            Assert::IsTrue(mockMgrEvents->m_itemAddedCount == ARRAYSIZE(items));
+
+            UINT count = 0;
+            Assert::IsTrue(mgr->GetItemCount(&count) == S_OK);
+            Assert::IsTrue(count == ARRAYSIZE(items));
+            for (UINT i = 0; i < count; i++)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(mgr->GetItemByIndex(i, &item) == S_OK);
+                Assert::IsTrue(item == items[i]);
+            }
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+            mockMgrEvents->Release();
+        }
+
+        TEST_METHOD(VerifyEnumerateItemsNumberingIsDeterministic)
+        {
+            // Enough items to be split across several regex worker threads
+            const UINT itemCount = 2000;
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            for (UINT i = 0; i < itemCount; i++)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo.txt", L"foo.txt", 0, false, &item) == S_OK);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(MatchAllOccurences | EnumerateItems);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            // Every change to the regex restarts the preview pass so wait for the
+            // names of the last one
+            bool allNamed = false;
+            for (int retry = 0; retry < 300 && !allNamed; retry++)
+            {
+                Sleep(100);
+                allNamed = true;
+                for (UINT i = 0; i < itemCount && allNamed; i++)
+                {
+                    CComPtr<IPowerRenameItem> item;
+                    Assert::IsTrue(mgr->GetItemByIndex(i, &item) == S_OK);
+                    PWSTR newName = nullptr;
+                    std::wstring expected = L"bar (" + std::to_wstring(i + 1) + L").txt";
+                    allNamed = SUCCEEDED(item->get_newName(&newName)) && expected == newName;
+                    CoTaskMemFree(newName);
+                }
+            }
+
+            Assert::IsTrue(allNamed);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyEnumeratedNamesSkipNamesInUse)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            // The folder's contents are all items so nothing is looked up on disk
+            PCWSTR paths[] = { L"c:\\dir\\foo1.txt", L"c:\\dir\\foo2.txt", L"c:\\dir\\foo3.txt", L"c:\\dir\\bar (2).txt" };
+            CComPtr<IPowerRenameItem> folder;
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"c:\\dir", L"dir", 0, true, &folder) == S_OK);
+            Assert::IsTrue(mgr->AddItem(folder) == S_OK);
+            CComPtr<IPowerRenameItem> items[ARRAYSIZE(paths)];
+            for (UINT i = 0; i < ARRAYSIZE(paths); i++)
+            {
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(paths[i], PathFindFileName(paths[i]), 1, false, &items[i]) == S_OK);
+                Assert::IsTrue(mgr->AddItem(items[i]) == S_OK);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions | EnumerateItems);
+            renRegEx->put_searchTerm(L"foo\\d");
+            renRegEx->put_replaceTerm(L"bar");
+
+            // "bar (2).txt" exists and the numbers after it are taken by earlier items
+            PCWSTR expected[] = { L"bar (1).txt", L"bar (3).txt", L"bar (4).txt" };
+            bool named = false;
+            for (int retry = 0; retry < 100 && !named; retry++)
+            {
+                Sleep(50);
+                named = true;
+                for (UINT i = 0; i < ARRAYSIZE(expected); i++)
+                {
+                    PWSTR newName = nullptr;
+                    items[i]->get_newName(&newName);
+                    named = named && lstrcmp(newName, expected[i]) == 0;
+                    CoTaskMemFree(newName);
+                }
+            }
+
+            Assert::IsTrue(named);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyTemplateCounterFollowsItemOrder)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            // The counter skips the item the search term doesn't match.  "photo_002_B.jpg"
+            // is taken so EnumerateItems numbers that one name.
+            PCWSTR paths[] = { L"c:\\dir\\IMG_a.jpg", L"c:\\dir\\notes.txt", L"c:\\dir\\IMG_b.jpg", L"c:\\dir\\IMG_c.jpg", L"c:\\dir\\photo_002_B.jpg" };
+            CComPtr<IPowerRenameItem> folder;
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"c:\\dir", L"dir", 0, true, &folder) == S_OK);
+            Assert::IsTrue(mgr->AddItem(folder) == S_OK);
+            CComPtr<IPowerRenameItem> items[ARRAYSIZE(paths)];
+            for (UINT i = 0; i < ARRAYSIZE(paths); i++)
+            {
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(paths[i], PathFindFileName(paths[i]), 1, false, &items[i]) == S_OK);
+                Assert::IsTrue(mgr->AddItem(items[i]) == S_OK);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions | EnumerateItems | NameOnly);
+            renRegEx->put_searchTerm(L"^IMG_(.)$");
+            renRegEx->put_replaceTerm(L"photo_${counter:3}_${1:upper}");
+
+            DWORD usage = 0;
+            Assert::IsTrue(renRegEx->get_templateUsage(&usage) == S_OK);
+            Assert::IsTrue(usage == TemplateUsesCounter);
+
+            PCWSTR expected[] = { L"photo_001_A.jpg", L"", L"photo_002_B (2).jpg", L"photo_003_C.jpg" };
+            bool named = false;
+            for (int retry = 0; retry < 100 && !named; retry++)
+            {
+                Sleep(50);
+                named = true;
+                for (UINT i = 0; i < ARRAYSIZE(expected); i++)
+                {
+                    PWSTR newName = nullptr;
+                    items[i]->get_newName(&newName);
+                    named = named && lstrcmp(newName ? newName : L"", expected[i]) == 0;
+                    CoTaskMemFree(newName);
+                }
+            }
+
+            Assert::IsTrue(named);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyMetadataTokensUsePrefetchedMetadata)
+        {
+            CTestFileHelper testFileHelper;
+            Assert::IsTrue(testFileHelper.AddFile(L"foo.txt"));
+            std::wstring path = testFileHelper.GetFullPath(L"foo.txt");
+            {
+                std::ofstream file(path);
+                file << "12345";
+            }
+
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CComPtr<IPowerRenameItem> item;
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(path.c_str(), L"foo.txt", 0, false, &item) == S_OK);
+            Assert::IsTrue(mgr->AddItem(item) == S_OK);
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(MatchAllOccurences | NameOnly);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"foo_${size}");
+
+            // The name is built again once the prefetcher read the item
+            bool named = false;
+            for (int retry = 0; retry < 100 && !named; retry++)
+            {
+                Sleep(50);
+                PWSTR newName = nullptr;
+                item->get_newName(&newName);
+                named = newName && lstrcmp(newName, L"foo_5.txt") == 0;
+                CoTaskMemFree(newName);
+            }
+
+            PowerRenameItemMetadata metadata;
+            Assert::IsTrue(item->get_metadata(&metadata) == S_OK);
+            Assert::IsTrue(metadata.valid && metadata.size == 5 && !metadata.hasTaken);
+            Assert::IsTrue(named);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyItemCountsTrackSelection)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            for (UINT i = 0; i < 3; i++)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo", L"foo", 0, false, &item) == S_OK);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            UINT selectedCount = 0;
+            UINT renameCount = 0;
+            Assert::IsTrue(mgr->GetSelectedItemCount(&selectedCount) == S_OK);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK);
+            Assert::IsTrue(selectedCount == 3);
+            Assert::IsTrue(renameCount == 0);
+
+            Assert::IsTrue(mgr->SetItemSelected(1, false) == S_OK);
+            Assert::IsTrue(mgr->SetItemSelected(2, false) == S_OK);
+            Assert::IsTrue(mgr->SetItemSelected(2, false) == S_OK);
+            Assert::IsTrue(mgr->SetItemSelected(3, false) != S_OK);
+            Assert::IsTrue(mgr->GetSelectedItemCount(&selectedCount) == S_OK);
+            Assert::IsTrue(selectedCount == 1);
+
+            CComPtr<IPowerRenameItem> item;
+            Assert::IsTrue(mgr->GetItemByIndex(1, &item) == S_OK);
+            bool selected = true;
+            Assert::IsTrue(item->get_selected(&selected) == S_OK);
+            Assert::IsFalse(selected);
+
+            Assert::IsTrue(mgr->SetItemSelected(1, true) == S_OK);
+            Assert::IsTrue(mgr->GetSelectedItemCount(&selectedCount) == S_OK);
+            Assert::IsTrue(selectedCount == 2);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyItemUpdatesAreBatched)
+        {
+            const UINT itemCount = 2000;
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CMockPowerRenameManagerEvents* mockMgrEvents = new CMockPowerRenameManagerEvents();
+            CComPtr<IPowerRenameManagerEvents> mgrEvents;
+            Assert::IsTrue(mockMgrEvents->QueryInterface(IID_PPV_ARGS(&mgrEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(mgr->Advise(mgrEvents, &cookie) == S_OK);
+            for (UINT i = 0; i < itemCount; i++)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo.txt", L"foo.txt", 0, false, &item) == S_OK);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(DEFAULT_FLAGS);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            // The updates are delivered through the manager's message window
+            for (int retry = 0; retry < 3000 && mockMgrEvents->m_updatedRenameCount != itemCount; retry++)
+            {
+                MSG msg;
+                while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    TranslateMessage(&msg);
+                    DispatchMessage(&msg);
+                }
+                Sleep(10);
+            }
+
+            // Every item changed but the listeners only heard about a few batches
+            Assert::IsTrue(mockMgrEvents->m_updatedRenameCount == itemCount);
+            Assert::IsTrue(mockMgrEvents->m_updatedSelectedCount == itemCount);
+            Assert::IsTrue(mockMgrEvents->m_itemsUpdatedCount > 0);
+            Assert::IsTrue(mockMgrEvents->m_itemsUpdatedCount < itemCount / 10);
+            Assert::IsTrue(mockMgrEvents->m_updatedFirstIndex <= mockMgrEvents->m_updatedLastIndex);
+            Assert::IsTrue(mockMgrEvents->m_updatedLastIndex < itemCount);
+
+            UINT renameCount = 0;
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK);
+            Assert::IsTrue(renameCount == itemCount);
+
+            // Excluding files takes every item out of the rename count
+            renRegEx->put_flags(DEFAULT_FLAGS | ExcludeFiles);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK);
+            Assert::IsTrue(renameCount == 0);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+            mockMgrEvents->Release();
+        }
+
+        TEST_METHOD(VerifyReplaceTermAndFlagsOnlyPasses)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CComPtr<IPowerRenameItem> file;
+            CComPtr<IPowerRenameItem> folder;
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo.txt", L"foo.txt", 0, false, &file) == S_OK);
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo", L"foo", 0, true, &folder) == S_OK);
+            Assert::IsTrue(mgr->AddItem(file) == S_OK);
+            Assert::IsTrue(mgr->AddItem(folder) == S_OK);
+
+            // Waits for the preview pass started by the last change
+            auto waitForNames = [&](PCWSTR fileName, PCWSTR folderName) {
+                bool named = false;
+                for (int retry = 0; retry < 100 && !named; retry++)
+                {
+                    Sleep(50);
+                    PWSTR newFileName = nullptr;
+                    PWSTR newFolderName = nullptr;
+                    file->get_newName(&newFileName);
+                    folder->get_newName(&newFolderName);
+                    named = (lstrcmp(newFileName, fileName) == 0) && (lstrcmp(newFolderName, folderName) == 0);
+                    CoTaskMemFree(newFileName);
+                    CoTaskMemFree(newFolderName);
+                }
+                return named;
+            };
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions);
+            renRegEx->put_searchTerm(L"(f)(o+)");
+            renRegEx->put_replaceTerm(L"$2$1");
+            Assert::IsTrue(waitForNames(L"oof.txt", L"oof"));
+
+            // Substitution only
+            renRegEx->put_replaceTerm(L"bar");
+            Assert::IsTrue(waitForNames(L"bar.txt", L"bar"));
+
+            // Filtering only
+            renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions | ExcludeFolders);
+            Assert::IsTrue(waitForNames(L"bar.txt", nullptr));
+            renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions | ExcludeFiles);
+            Assert::IsTrue(waitForNames(nullptr, L"bar"));
+
+            // Matching again
+            renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions | NameOnly);
+            Assert::IsTrue(waitForNames(L"bar.txt", L"bar"));
+            renRegEx->put_searchTerm(L"o");
+            Assert::IsTrue(waitForNames(L"fbarbar.txt", L"fbarbar"));
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyStatisticsJson)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CComPtr<IPowerRenameItem> file;
+            CComPtr<IPowerRenameItem> otherFile;
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"foo.txt", L"foo.txt", 0, false, &file) == S_OK);
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"bar.txt", L"bar.txt", 0, false, &otherFile) == S_OK);
+            Assert::IsTrue(mgr->AddItem(file) == S_OK);
+            Assert::IsTrue(mgr->AddItem(otherFile) == S_OK);
+            Assert::IsTrue(mgr->AddPhaseTime(PowerRenamePhase::Enumerate, 1000) == S_OK);
+            Assert::IsTrue(mgr->AddPhaseTime(PowerRenamePhase::Count, 1000) == E_INVALIDARG);
+
+            // The counters are added once the whole pass is done
+            auto waitForStatistics = [&](PCWSTR expected) {
+                bool found = false;
+                for (int retry = 0; retry < 100 && !found; retry++)
+                {
+                    Sleep(50);
+                    PWSTR json = nullptr;
+                    Assert::IsTrue(mgr->GetStatistics(&json) == S_OK);
+                    found = wcsstr(json, expected) != nullptr;
+                    CoTaskMemFree(json);
+                }
+                return found;
+            };
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(MatchAllOccurences);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"baz");
+            Assert::IsTrue(waitForStatistics(L"\"counters\":{\"itemsScanned\":2,\"itemsMatched\":1,\"itemsRenamed\":0}"));
+
+            PWSTR json = nullptr;
+            Assert::IsTrue(mgr->GetStatistics(&json) == S_OK);
+            Assert::IsTrue(wcsstr(json, L"\"enumerate\":{\"runs\":1,\"totalNs\":1000,\"maxNs\":1000}") != nullptr);
+            Assert::IsTrue(wcsstr(json, L"\"match\":{\"runs\":") != nullptr);
+            Assert::IsTrue(wcsstr(json, L"\"searchTerm\":\"foo\"") != nullptr);
+            CoTaskMemFree(json);
+
+            Assert::IsTrue(mgr->ResetStatistics() == S_OK);
+            Assert::IsTrue(mgr->GetStatistics(&json) == S_OK);
+            Assert::IsTrue(wcsstr(json, L"\"itemsScanned\":0") != nullptr);
+            Assert::IsTrue(wcsstr(json, L"\"slowestPatterns\":[]") != nullptr);
+            CoTaskMemFree(json);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyTimedOutItemsAreReported)
+        {
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CMockPowerRenameManagerEvents* mockMgrEvents = new CMockPowerRenameManagerEvents();
+            CComPtr<IPowerRenameManagerEvents> mgrEvents;
+            Assert::IsTrue(mockMgrEvents->QueryInterface(IID_PPV_ARGS(&mgrEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(mgr->Advise(mgrEvents, &cookie) == S_OK);
+
+            std::wstring slowName(40, L'a');
+            slowName += L"c";
+            CComPtr<IPowerRenameItem> slowItem;
+            CComPtr<IPowerRenameItem> item;
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(slowName.c_str(), slowName.c_str(), 0, false, &slowItem) == S_OK);
+            Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"aab", L"aab", 0, false, &item) == S_OK);
+            Assert::IsTrue(mgr->AddItem(slowItem) == S_OK);
+            Assert::IsTrue(mgr->AddItem(item) == S_OK);
+
+            // Backtracks exponentially on the first name
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions);
+            renRegEx->put_replaceTerm(L"x");
+            renRegEx->put_searchTerm(L"^(a)(\\1|a)*b");
+
+            // The pass goes on past the slow item and reports it through the message window
+            auto isRenamed = [](IPowerRenameItem* renameItem) {
+                PWSTR newName = nullptr;
+                renameItem->get_newName(&newName);
+                bool renamed = newName != nullptr;
+                CoTaskMemFree(newName);
+                return renamed;
+            };
+            for (int retry = 0; retry < 500 && (mockMgrEvents->m_itemError == nullptr || !isRenamed(item)); retry++)
+            {
+                MSG msg;
+                while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    TranslateMessage(&msg);
+                    DispatchMessage(&msg);
+                }
+                Sleep(10);
+            }
+
+            Assert::IsTrue(mockMgrEvents->m_itemError == slowItem);
+            Assert::IsFalse(isRenamed(slowItem));
+            PWSTR newName = nullptr;
+            Assert::IsTrue(item->get_newName(&newName) == S_OK);
+            Assert::IsTrue(lstrcmp(newName, L"x") == 0);
+            CoTaskMemFree(newName);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+            mockMgrEvents->Release();
+        }
+
         TEST_METHOD(VerifySmartManagerEvents)
         {
             CComPtr<IPowerRenameManager> mgr;
@@ -177,6 +681,62 @@ namespace PowerRenameManagerTests
             RenameHelper(renamePairs, ARRAYSIZE(renamePairs), L"foo", L"bar", DEFAULT_FLAGS);
         }
 
+        TEST_METHOD(VerifyRevertLastRename)
+        {
+            // Rename with an undo log and verify reverting restores the original names
+            CTestFileHelper testFileHelper;
+            const std::wstring originalNames[] = { L"foo1.txt", L"foo2.txt", L"foo3.txt" };
+            const std::wstring newNames[] = { L"bar1.txt", L"bar2.txt", L"bar3.txt" };
+            for (const auto& name : originalNames)
+            {
+                Assert::IsTrue(testFileHelper.AddFile(name));
+            }
+
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            std::wstring undoLogPath = (testFileHelper.GetTempDirectory() / L"undo.log").wstring();
+            Assert::IsTrue(mgr->put_undoLogPath(undoLogPath.c_str()) == S_OK);
+
+            for (const auto& name : originalNames)
+            {
+                CComPtr<IPowerRenameItem> item;
+                CMockPowerRenameItem::CreateInstance(testFileHelper.GetFullPath(name).c_str(), name.c_str(), 0, false, &item);
+                mgr->AddItem(item);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(DEFAULT_FLAGS);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            Sleep(1000);
+
+            Assert::IsTrue(mgr->Rename(0) == S_OK);
+
+            Sleep(1000);
+
+            for (const auto& name : newNames)
+            {
+                Assert::IsTrue(testFileHelper.PathExists(name));
+            }
+
+            UINT revertedCount = 0;
+            Assert::IsTrue(mgr->RevertLastRename(&revertedCount) == S_OK);
+            Assert::AreEqual(3u, revertedCount);
+            for (int i = 0; i < ARRAYSIZE(originalNames); i++)
+            {
+                Assert::IsTrue(testFileHelper.PathExists(originalNames[i]));
+                Assert::IsFalse(testFileHelper.PathExists(newNames[i]));
+            }
+
+            // The batch is gone from the log once it was reverted
+            Assert::IsTrue(mgr->RevertLastRename(&revertedCount) == S_FALSE);
+            Assert::AreEqual(0u, revertedCount);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
         TEST_METHOD(VerifyFilesOnlyRename)
         {
             // Verify only files are renamed when folders match too
@@ -0,0 +1,636 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <PowerRenameInterfaces.h>
+#include <PowerRenameRegEx.h>
+#include <PowerRenameManager.h>
+#include <LiteralSearcher.h>
+#include "MockPowerRenameItem.h"
+#include "MockPowerRenameManagerEvents.h"
+#include "srwlock.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cwctype>
+#include <functional>
+#include <new>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// Counting allocator for the allocation benchmarks.  Replacing the global operator new
+// covers the rename library too since it is linked into the test binary.
+static std::atomic<size_t> s_allocationCount = 0;
+static thread_local size_t s_threadAllocationCount = 0;
+
+void* operator new(size_t size)
+{
+    s_allocationCount++;
+    s_threadAllocationCount++;
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+// Benchmarks for the preview path.  These log their timings so regressions can be
+// spotted in the test output.  Timings vary too much between machines and runs to
+// assert on, so only the results and allocation counts are checked.
+namespace PowerRenamePerfTests
+{
+    static std::vector<std::wstring> GenerateNames(_In_ size_t count)
+    {
+        std::vector<std::wstring> names;
+        names.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            names.push_back(L"IMG_" + std::to_wstring(20190000 + i) + L"_holiday_pampalona.jpg");
+        }
+        return names;
+    }
+
+    static void LogTiming(_In_ PCWSTR label, _In_ size_t itemCount, _In_ std::chrono::microseconds elapsed)
+    {
+        wchar_t message[256] = { 0 };
+        StringCchPrintf(message, ARRAYSIZE(message), L"%s: %zu items in %lld us (%.3f us/item)\n",
+            label, itemCount, elapsed.count(), static_cast<double>(elapsed.count()) / itemCount);
+        Logger::WriteMessage(message);
+    }
+
+    static void LogAllocations(_In_ PCWSTR label, _In_ size_t itemCount, _In_ size_t allocationCount)
+    {
+        wchar_t message[256] = { 0 };
+        StringCchPrintf(message, ARRAYSIZE(message), L"%s: %zu items with %zu allocations (%.4f allocations/item)\n",
+            label, itemCount, allocationCount, static_cast<double>(allocationCount) / itemCount);
+        Logger::WriteMessage(message);
+    }
+
+    TEST_CLASS(RegExPerfTests)
+    {
+    public:
+        // Simulates one keystroke in the search box over a large selection.  The pattern
+        // is compiled once in put_searchTerm and every Replace only runs the matcher,
+        // which is logged next to compiling the pattern for every item.
+        TEST_METHOD(CompiledPatternKeystroke)
+        {
+            const size_t itemCount = 50000;
+            std::vector<std::wstring> names = GenerateNames(itemCount);
+            PCWSTR searchTerm = L"(pamp)a(lona)";
+            PCWSTR replaceTerm = L"$1$2";
+
+            CComPtr<IPowerRenameRegEx> renameRegEx;
+            Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences | UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(replaceTerm) == S_OK);
+
+            auto start = std::chrono::steady_clock::now();
+            Assert::IsTrue(renameRegEx->put_searchTerm(searchTerm) == S_OK);
+            for (const auto& name : names)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->Replace(name.c_str(), &result) == S_OK);
+                CoTaskMemFree(result);
+            }
+            auto cached = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+            start = std::chrono::steady_clock::now();
+            for (const auto& name : names)
+            {
+                std::wregex pattern(searchTerm, std::regex_constants::icase | std::regex_constants::ECMAScript);
+                std::wstring result = std::regex_replace(name, pattern, replaceTerm);
+            }
+            auto perItem = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+            LogTiming(L"Compiled once per keystroke", itemCount, cached);
+            LogTiming(L"Compiled per item", itemCount, perItem);
+        }
+
+        // Preview throughput of both regex engines over a million file names.  Only the
+        // results are compared since the relative speed depends on the pattern.  Too slow
+        // for every test run, so it only runs when selected explicitly.
+        BEGIN_TEST_METHOD_ATTRIBUTE(EngineThroughputMillionNames)
+            TEST_IGNORE()
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(EngineThroughputMillionNames)
+        {
+            const size_t itemCount = 1000000;
+            std::vector<std::wstring> names = GenerateNames(itemCount);
+            PCWSTR searchTerm = L"IMG_(\\d{4})(\\d{2})(\\d{2})_(\\w+)";
+            PCWSTR replaceTerm = L"$4_$3-$2-$1";
+
+            std::vector<std::wstring> results[2];
+            const PowerRenameRegExEngine engines[2] = { LinearRegExEngine, StdRegExEngine };
+            PCWSTR labels[2] = { L"Linear engine", L"std::wregex engine" };
+            for (int i = 0; i < 2; i++)
+            {
+                CComPtr<IPowerRenameRegEx> renameRegEx;
+                Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+                Assert::IsTrue(renameRegEx->put_engine(engines[i]) == S_OK);
+                Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences | UseRegularExpressions) == S_OK);
+                Assert::IsTrue(renameRegEx->put_searchTerm(searchTerm) == S_OK);
+                Assert::IsTrue(renameRegEx->put_replaceTerm(replaceTerm) == S_OK);
+
+                results[i].reserve(itemCount);
+                auto start = std::chrono::steady_clock::now();
+                for (const auto& name : names)
+                {
+                    PWSTR result = nullptr;
+                    Assert::IsTrue(renameRegEx->Replace(name.c_str(), &result) == S_OK);
+                    results[i].push_back(result);
+                    CoTaskMemFree(result);
+                }
+                LogTiming(labels[i], itemCount, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+            }
+
+            Assert::IsTrue(results[0] == results[1]);
+        }
+
+        // Case insensitive plain text search with each literal search kernel, checked
+        // against lowercasing copies of both strings and calling find as the plain text
+        // mode did before.  Long names are where the vector kernels pay off.
+        TEST_METHOD(LiteralSearchKernels)
+        {
+            const size_t itemCount = 200000;
+            std::vector<std::wstring> shortNames = GenerateNames(itemCount);
+            std::vector<std::wstring> longNames;
+            longNames.reserve(itemCount);
+            for (const auto& name : shortNames)
+            {
+                longNames.push_back(L"Scanned Documents - Tax Return Receipts And Statements For The Year - " + name);
+            }
+
+            PCWSTR needle = L"PAMPALONA";
+            CLiteralSearcher searcher(needle, true);
+            const LiteralSearchKernel kernels[] = { LiteralSearchKernel::Scalar, LiteralSearchKernel::Sse2, LiteralSearchKernel::Avx2 };
+            PCWSTR kernelLabels[] = { L"scalar", L"SSE2", L"AVX2" };
+
+            for (const auto* names : { &shortNames, &longNames })
+            {
+                std::vector<size_t> expected;
+                expected.reserve(itemCount);
+                auto start = std::chrono::steady_clock::now();
+                for (const auto& name : *names)
+                {
+                    std::wstring data(name);
+                    std::wstring toSearch(needle);
+                    std::transform(data.begin(), data.end(), data.begin(), ::towlower);
+                    std::transform(toSearch.begin(), toSearch.end(), toSearch.begin(), ::towlower);
+                    expected.push_back(data.find(toSearch, 0));
+                }
+                auto reference = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+                wchar_t label[64] = { 0 };
+                StringCchPrintf(label, ARRAYSIZE(label), L"Lowercased copies (%zu chars)", names->front().size());
+                LogTiming(label, itemCount, reference);
+
+                for (int i = 0; i < ARRAYSIZE(kernels); i++)
+                {
+                    if (!CLiteralSearcher::s_IsKernelSupported(kernels[i]))
+                    {
+                        continue;
+                    }
+
+                    size_t mismatches = 0;
+                    start = std::chrono::steady_clock::now();
+                    for (size_t j = 0; j < itemCount; j++)
+                    {
+                        mismatches += (searcher.Find((*names)[j], 0, kernels[i]) != expected[j]) ? 1 : 0;
+                    }
+                    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+                    StringCchPrintf(label, ARRAYSIZE(label), L"Literal search %s (%zu chars)", kernelLabels[i], names->front().size());
+                    LogTiming(label, itemCount, elapsed);
+                    Assert::IsTrue(mismatches == 0);
+                }
+            }
+        }
+    };
+
+    // The new name of an item as it was kept before reads went lock free: a string behind
+    // a reader/writer lock that is copied out on every read
+    class CLockedNewName
+    {
+    public:
+        void Put(_In_ PCWSTR newName)
+        {
+            CSRWExclusiveAutoLock lock(&m_lock);
+            m_newName = newName;
+        }
+
+        HRESULT Get(_Outptr_ PWSTR* newName)
+        {
+            CSRWSharedAutoLock lock(&m_lock);
+            return SHStrDup(m_newName.c_str(), newName);
+        }
+
+    private:
+        CSRWLock m_lock;
+        std::wstring m_newName;
+    };
+
+    TEST_CLASS(ItemPerfTests)
+    {
+    public:
+        struct ContentionResult
+        {
+            size_t reads = 0;
+            size_t writes = 0;
+            // Calls to operator new by the reader threads
+            size_t readAllocations = 0;
+        };
+
+        // Runs one thread calling write and readerCount threads calling read on the
+        // items, round robin, for duration
+        static ContentionResult RunContention(_In_ size_t itemCount, _In_ UINT readerCount, _In_ std::chrono::milliseconds duration, _In_ const std::function<void(size_t, size_t)>& write, _In_ const std::function<bool(size_t)>& read)
+        {
+            std::atomic<bool> stop = false;
+            std::atomic<size_t> reads = 0;
+            std::atomic<size_t> writes = 0;
+            std::atomic<size_t> failedReads = 0;
+            std::atomic<size_t> readAllocations = 0;
+
+            std::vector<std::thread> threads;
+            threads.emplace_back([&]() {
+                size_t count = 0;
+                for (size_t pass = 0; !stop; pass++)
+                {
+                    for (size_t i = 0; i < itemCount && !stop; i++, count++)
+                    {
+                        write(i, pass);
+                    }
+                }
+                writes = count;
+            });
+            for (UINT r = 0; r < readerCount; r++)
+            {
+                threads.emplace_back([&, r]() {
+                    // The first read sets up the thread
+                    read(r);
+                    size_t allocationStart = s_threadAllocationCount;
+                    size_t count = 0;
+                    for (size_t i = r; !stop; i = (i + 1) % itemCount, count++)
+                    {
+                        if (!read(i))
+                        {
+                            failedReads++;
+                        }
+                    }
+                    reads += count;
+                    readAllocations += s_threadAllocationCount - allocationStart;
+                });
+            }
+
+            Sleep(static_cast<DWORD>(duration.count()));
+            stop = true;
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            Assert::IsTrue(failedReads == 0);
+            return { reads, writes, readAllocations };
+        }
+
+        static void LogContention(_In_ PCWSTR label, _In_ UINT readerCount, _In_ std::chrono::milliseconds duration, _In_ const ContentionResult& result)
+        {
+            wchar_t message[256] = { 0 };
+            StringCchPrintf(message, ARRAYSIZE(message), L"%s: 1 writer, %u readers: %.0f reads/s, %.0f writes/s\n",
+                label, readerCount, result.reads * 1000.0 / duration.count(), result.writes * 1000.0 / duration.count());
+            Logger::WriteMessage(message);
+        }
+
+        // The regex worker publishing new names while the list view paints rows.  Reads
+        // of the published name take no lock, and with GetNewName don't copy to the heap.
+        // Every read has to see one of the names whole.
+        TEST_METHOD(NewNameReadContention)
+        {
+            const size_t itemCount = 1000;
+            const UINT readerCount = 4;
+            const std::chrono::milliseconds duration(500);
+            PCWSTR names[] = { L"holiday_pampalona_00-00-2019.jpg", L"holiday_pampalona_20190000_IMG.jpg" };
+            auto IsPublishedName = [&](PCWSTR newName) { return wcscmp(newName, names[0]) == 0 || wcscmp(newName, names[1]) == 0; };
+
+            std::vector<CComPtr<IPowerRenameItem>> items(itemCount);
+            for (auto& item : items)
+            {
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"IMG_20190000_holiday_pampalona.jpg", L"IMG_20190000_holiday_pampalona.jpg", 0, false, &item) == S_OK);
+                Assert::IsTrue(item->put_newName(names[0]) == S_OK);
+            }
+            std::vector<CLockedNewName> lockedNames(itemCount);
+            for (auto& lockedName : lockedNames)
+            {
+                lockedName.Put(names[0]);
+            }
+
+            ContentionResult locked = RunContention(
+                itemCount, readerCount, duration, [&](size_t i, size_t pass) { lockedNames[i].Put(names[pass % 2]); }, [&](size_t i) {
+                    PWSTR newName = nullptr;
+                    bool succeeded = SUCCEEDED(lockedNames[i].Get(&newName)) && IsPublishedName(newName);
+                    CoTaskMemFree(newName);
+                    return succeeded;
+                });
+            ContentionResult lockFreeCopy = RunContention(
+                itemCount, readerCount, duration, [&](size_t i, size_t pass) { items[i]->put_newName(names[pass % 2]); }, [&](size_t i) {
+                    PWSTR newName = nullptr;
+                    bool succeeded = SUCCEEDED(items[i]->get_newName(&newName)) && IsPublishedName(newName);
+                    CoTaskMemFree(newName);
+                    return succeeded;
+                });
+            ContentionResult lockFree = RunContention(
+                itemCount, readerCount, duration, [&](size_t i, size_t pass) { items[i]->put_newName(names[pass % 2]); }, [&](size_t i) {
+                    wchar_t newName[MAX_PATH];
+                    return SUCCEEDED(items[i]->GetNewName(newName, ARRAYSIZE(newName))) && IsPublishedName(newName);
+                });
+
+            LogContention(L"Locked, get_newName", readerCount, duration, locked);
+            LogContention(L"Lock free, get_newName", readerCount, duration, lockFreeCopy);
+            LogContention(L"Lock free, GetNewName", readerCount, duration, lockFree);
+
+            // Throughput depends on the core count so only the copies are checked
+            Assert::IsTrue(lockFree.readAllocations == 0);
+        }
+
+        // Once every item has had two new names the blocks they alternate between are
+        // reused, so publishing a name doesn't allocate
+        TEST_METHOD(NewNamePublishAllocations)
+        {
+            const size_t itemCount = 10000;
+            PCWSTR names[] = { L"holiday_pampalona_00-00-2019.jpg", L"holiday_pampalona_20190000_IMG.jpg" };
+            std::vector<CComPtr<IPowerRenameItem>> items(itemCount);
+            for (auto& item : items)
+            {
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"IMG_20190000_holiday_pampalona.jpg", L"IMG_20190000_holiday_pampalona.jpg", 0, false, &item) == S_OK);
+                Assert::IsTrue(item->put_newName(names[0]) == S_OK);
+                Assert::IsTrue(item->put_newName(names[1]) == S_OK);
+            }
+
+            size_t start = s_allocationCount;
+            for (size_t pass = 0; pass < 4; pass++)
+            {
+                for (auto& item : items)
+                {
+                    Assert::IsTrue(item->put_newName(names[pass % 2]) == S_OK);
+                }
+            }
+            size_t allocations = s_allocationCount - start;
+            LogAllocations(L"Publish new name", itemCount * 4, allocations);
+
+            Assert::IsTrue(allocations == 0);
+        }
+    };
+
+    TEST_CLASS(ManagerPerfTests)
+    {
+    public:
+        // Walks the item list the way the regex worker thread and the list view do,
+        // by index and then by id.  The cost per item logged should stay flat from 1k
+        // to 1M items.  Too slow for every test run, so it only runs when selected
+        // explicitly.
+        BEGIN_TEST_METHOD_ATTRIBUTE(ItemLookupScaling)
+            TEST_IGNORE()
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(ItemLookupScaling)
+        {
+            const size_t itemCounts[] = { 1000, 10000, 100000, 1000000 };
+
+            for (size_t i = 0; i < ARRAYSIZE(itemCounts); i++)
+            {
+                const size_t itemCount = itemCounts[i];
+                CComPtr<IPowerRenameManager> mgr;
+                Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+                std::vector<CComPtr<IPowerRenameItem>> items(itemCount);
+                for (size_t j = 0; j < itemCount; j++)
+                {
+                    Assert::IsTrue(CMockPowerRenameItem::CreateInstance(L"C:\\foo", L"foo", 0, false, &items[j]) == S_OK);
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                for (size_t j = 0; j < itemCount; j++)
+                {
+                    Assert::IsTrue(mgr->AddItem(items[j]) == S_OK);
+                }
+
+                for (UINT j = 0; j < itemCount; j++)
+                {
+                    CComPtr<IPowerRenameItem> item;
+                    Assert::IsTrue(mgr->GetItemByIndex(j, &item) == S_OK);
+                    int id = 0;
+                    item->get_id(&id);
+                    CComPtr<IPowerRenameItem> itemById;
+                    Assert::IsTrue(mgr->GetItemById(id, &itemById) == S_OK);
+                    Assert::IsTrue(item == itemById);
+                }
+                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+                LogTiming(L"Add and look up items", itemCount, elapsed);
+                Assert::IsTrue(mgr->Shutdown() == S_OK);
+            }
+        }
+
+        // Times the preview pass that follows a change to the regex, from the change
+        // until the manager reports the pass completed.
+        static std::chrono::microseconds TimePreviewPass(_In_ CMockPowerRenameManagerEvents* events, _In_ const std::function<void()>& change)
+        {
+            MSG msg;
+            while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            {
+                DispatchMessage(&msg);
+            }
+            events->m_regExCompleted = false;
+
+            auto start = std::chrono::steady_clock::now();
+            change();
+            while (!events->m_regExCompleted)
+            {
+                while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessage(&msg);
+                }
+                Sleep(1);
+            }
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        }
+
+        // Typing in the replace box over a large selection.  The matches are kept from
+        // the search term's pass so each keystroke only redoes the substitution, which
+        // shows in the logged timings of the passes.
+        TEST_METHOD(ReplaceTermKeystroke)
+        {
+            const size_t itemCount = 100000;
+            std::vector<std::wstring> names = GenerateNames(itemCount);
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CMockPowerRenameManagerEvents* mockMgrEvents = new CMockPowerRenameManagerEvents();
+            CComPtr<IPowerRenameManagerEvents> mgrEvents;
+            Assert::IsTrue(mockMgrEvents->QueryInterface(IID_PPV_ARGS(&mgrEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(mgr->Advise(mgrEvents, &cookie) == S_OK);
+            for (const auto& name : names)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(name.c_str(), name.c_str(), 0, false, &item) == S_OK);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions); });
+            TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_replaceTerm(L"$4_$3-$2-$1"); });
+
+            auto searchPass = TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_searchTerm(L"IMG_(\\d{4})(\\d{2})(\\d{2})_(\\w+)"); });
+            auto replacePass = TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_replaceTerm(L"$4_$1$2$3"); });
+            auto flagsPass = TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions | ExcludeFolders); });
+
+            LogTiming(L"Search term pass", itemCount, searchPass);
+            LogTiming(L"Replace term pass", itemCount, replacePass);
+            LogTiming(L"Exclude flag pass", itemCount, flagsPass);
+
+            CComPtr<IPowerRenameItem> item;
+            Assert::IsTrue(mgr->GetItemByIndex(0, &item) == S_OK);
+            PWSTR newName = nullptr;
+            Assert::IsTrue(item->get_newName(&newName) == S_OK);
+            Assert::IsTrue(wcscmp(newName, L"holiday_pampalona_20190000.jpg") == 0);
+            CoTaskMemFree(newName);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+            mockMgrEvents->Release();
+        }
+
+        // A new search term over a large selection with the list scrolled to its end.
+        // The rows in view should get their new names long before the pass is done, the
+        // time until they have them is logged next to the time of the whole pass.
+        TEST_METHOD(VisibleRowsFirst)
+        {
+            const size_t itemCount = 200000;
+            const UINT firstVisible = static_cast<UINT>(itemCount) - 40;
+            std::vector<std::wstring> names = GenerateNames(itemCount);
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CMockPowerRenameManagerEvents* mockMgrEvents = new CMockPowerRenameManagerEvents();
+            CComPtr<IPowerRenameManagerEvents> mgrEvents;
+            Assert::IsTrue(mockMgrEvents->QueryInterface(IID_PPV_ARGS(&mgrEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(mgr->Advise(mgrEvents, &cookie) == S_OK);
+            for (const auto& name : names)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(name.c_str(), name.c_str(), 0, false, &item) == S_OK);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions); });
+            TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_replaceTerm(L"$4_$3-$2-$1"); });
+            Assert::IsTrue(mgr->SetVisibleRange(firstVisible, static_cast<UINT>(itemCount) - 1) == S_OK);
+
+            CComPtr<IPowerRenameItem> lastItem;
+            Assert::IsTrue(mgr->GetItemByIndex(static_cast<UINT>(itemCount) - 1, &lastItem) == S_OK);
+            auto start = std::chrono::steady_clock::now();
+            std::chrono::microseconds visiblePass{};
+            auto fullPass = TimePreviewPass(mockMgrEvents, [&]() {
+                renRegEx->put_searchTerm(L"IMG_(\\d{4})(\\d{2})(\\d{2})_(\\w+)");
+                PWSTR newName = nullptr;
+                while (FAILED(lastItem->get_newName(&newName)))
+                {
+                    Sleep(0);
+                }
+                CoTaskMemFree(newName);
+                visiblePass = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            });
+
+            LogTiming(L"Visible rows", itemCount - firstVisible, visiblePass);
+            LogTiming(L"Full pass", itemCount, fullPass);
+
+            for (UINT i = firstVisible; i < itemCount; i++)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(mgr->GetItemByIndex(i, &item) == S_OK);
+                PWSTR newName = nullptr;
+                Assert::IsTrue(item->get_newName(&newName) == S_OK);
+                CoTaskMemFree(newName);
+            }
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+            mockMgrEvents->Release();
+        }
+
+        // Counts the allocations of preview passes once every item has been matched
+        // before.  The item names, the matches and the new names are all written into
+        // storage left from the earlier passes so only the per pass setup allocates.
+        TEST_METHOD(PreviewPassAllocations)
+        {
+            const size_t itemCount = 100000;
+            std::vector<std::wstring> names = GenerateNames(itemCount);
+            CComPtr<IPowerRenameManager> mgr;
+            Assert::IsTrue(CPowerRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CMockPowerRenameManagerEvents* mockMgrEvents = new CMockPowerRenameManagerEvents();
+            CComPtr<IPowerRenameManagerEvents> mgrEvents;
+            Assert::IsTrue(mockMgrEvents->QueryInterface(IID_PPV_ARGS(&mgrEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(mgr->Advise(mgrEvents, &cookie) == S_OK);
+            for (const auto& name : names)
+            {
+                CComPtr<IPowerRenameItem> item;
+                Assert::IsTrue(CMockPowerRenameItem::CreateInstance(name.c_str(), name.c_str(), 0, false, &item) == S_OK);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            CComPtr<IPowerRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_smartRenameRegEx(&renRegEx) == S_OK);
+            PCWSTR searchTerms[] = { L"IMG_(\\d{4})(\\d{2})(\\d{2})_(\\w+)", L"(\\d{4})(\\d{2})(\\d{2})_(\\w+)" };
+            PCWSTR replaceTerms[] = { L"$4_$3-$2-$1", L"$4_$1$2$3" };
+            TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_flags(MatchAllOccurences | UseRegularExpressions); });
+            for (int i = 0; i < 2; i++)
+            {
+                TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_replaceTerm(replaceTerms[i]); });
+                TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_searchTerm(searchTerms[i]); });
+            }
+
+            size_t start = s_allocationCount;
+            TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_searchTerm(searchTerms[0]); });
+            size_t searchPass = s_allocationCount - start;
+
+            start = s_allocationCount;
+            TimePreviewPass(mockMgrEvents, [&]() { renRegEx->put_replaceTerm(replaceTerms[0]); });
+            size_t replacePass = s_allocationCount - start;
+
+            // Reference: the same work through Replace, which returns a new string per item
+            start = s_allocationCount;
+            for (const auto& name : names)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renRegEx->Replace(name.c_str(), &result) == S_OK);
+                CoTaskMemFree(result);
+            }
+            size_t replaceCalls = s_allocationCount - start;
+
+            LogAllocations(L"Search term pass", itemCount, searchPass);
+            LogAllocations(L"Replace term pass", itemCount, replacePass);
+            LogAllocations(L"Replace per item", itemCount, replaceCalls);
+
+            CComPtr<IPowerRenameItem> item;
+            Assert::IsTrue(mgr->GetItemByIndex(0, &item) == S_OK);
+            PWSTR newName = nullptr;
+            Assert::IsTrue(item->get_newName(&newName) == S_OK);
+            Assert::IsTrue(wcscmp(newName, L"holiday_pampalona_00-00-2019.jpg") == 0);
+            CoTaskMemFree(newName);
+
+            // Thread startup and the update batches allocate a fixed amount per pass
+            Assert::IsTrue(searchPass < itemCount / 100);
+            Assert::IsTrue(replacePass < itemCount / 100);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+            mockMgrEvents->Release();
+        }
+    };
+}
@@ -0,0 +1,243 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <PowerRenameInterfaces.h>
+#include <PowerRenameRegEx.h>
+#include <chrono>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// Differential tests between the linear time regex engine and std::wregex.  Every
+// pattern is run through both engines and the results must be identical.
+namespace PowerRenameRegExEngineTests
+{
+    // Quantified groups that can match an empty string report their captures
+    // differently in the backtracking implementation, so they are left out.  Patterns
+    // that match empty strings otherwise are kept: both engines must report an empty
+    // match after a non-empty one, like std::regex_iterator.
+    static PCWSTR s_patterns[] = {
+        L"foo",
+        L"Foo",
+        L"o",
+        L"^foo",
+        L"bar$",
+        L"^$",
+        L"f.o",
+        L"a|b|c",
+        L"(foo|bar)+",
+        L"(f)(o)(o)",
+        L"([a-z]+)_(\\d+)",
+        L"[^a-z]+",
+        L"[A-Z][a-z]*",
+        L"\\bfoo\\b",
+        L"\\Boo",
+        L"\\w+\\.\\w+",
+        L"\\s+",
+        L"\\S+",
+        L"\\D+",
+        L"\\W",
+        L"a{2}",
+        L"a{2,}",
+        L"a{1,3}?",
+        L"o+?",
+        L"o*?b",
+        L"(?:ab)+",
+        L"(a|ab)(c|bcd)(d*)",
+        L"[\\d.]+",
+        L"[-_ ]",
+        L"\\x41",
+        L"\\u0062",
+        L"\\t",
+        L"\\.",
+        L"(IMG)_(\\d{4})(\\d{2})(\\d{2})",
+        L"(x)?foo",
+        L"x?",
+        L".*",
+        L"[A-Z]*",
+        L"b??",
+        L"\\W{0,}",
+    };
+
+    static PCWSTR s_replaceTerms[] = {
+        L"",
+        L"bar",
+        L"$&$&",
+        L"$1",
+        L"$2-$1",
+        L"$$",
+        L"[$`|$']",
+        L"$10",
+        L"$9",
+    };
+
+    static PCWSTR s_sources[] = {
+        L"",
+        L"foo",
+        L"foobar",
+        L"FOObar foo",
+        L"barfoo.txt",
+        L"aaab",
+        L"abcd abcd",
+        L"IMG_20190815_pampalona.jpg",
+        L"file name - copy (2).docx",
+        L"a\tb\tc",
+        L"AbCdE",
+        L"x_123_y_456",
+        L"fooooob",
+    };
+
+    static bool ReplaceWithEngine(_In_ PowerRenameRegExEngine engine, _In_ PCWSTR search, _In_ PCWSTR replace,
+        _In_ PCWSTR source, _In_ DWORD flags, _Out_ std::wstring& result)
+    {
+        CComPtr<IPowerRenameRegEx> renameRegEx;
+        Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+        Assert::IsTrue(renameRegEx->put_engine(engine) == S_OK);
+        Assert::IsTrue(renameRegEx->put_flags(flags) == S_OK);
+        Assert::IsTrue(renameRegEx->put_searchTerm(search) == S_OK);
+        Assert::IsTrue(renameRegEx->put_replaceTerm(replace) == S_OK);
+
+        PWSTR newName = nullptr;
+        bool succeeded = SUCCEEDED(renameRegEx->Replace(source, &newName));
+        result = newName ? newName : L"";
+        CoTaskMemFree(newName);
+        return succeeded;
+    }
+
+    static void VerifyEnginesMatch(_In_ DWORD flags)
+    {
+        for (PCWSTR search : s_patterns)
+        {
+            for (PCWSTR replace : s_replaceTerms)
+            {
+                for (PCWSTR source : s_sources)
+                {
+                    std::wstring linearResult;
+                    std::wstring stdResult;
+                    bool linearSucceeded = ReplaceWithEngine(LinearRegExEngine, search, replace, source, flags, linearResult);
+                    bool stdSucceeded = ReplaceWithEngine(StdRegExEngine, search, replace, source, flags, stdResult);
+
+                    std::wstring message = std::wstring(L"search: ") + search + L" replace: " + replace + L" source: " + source;
+                    Assert::AreEqual(stdSucceeded, linearSucceeded, message.c_str());
+                    Assert::AreEqual(stdResult, linearResult, message.c_str());
+                }
+            }
+        }
+    }
+
+    TEST_CLASS(EngineDifferentialTests)
+    {
+    public:
+        TEST_METHOD(VerifyDefaultEngine)
+        {
+            CComPtr<IPowerRenameRegEx> renameRegEx;
+            Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            PowerRenameRegExEngine engine = StdRegExEngine;
+            Assert::IsTrue(renameRegEx->get_engine(&engine) == S_OK);
+            Assert::IsTrue(engine == LinearRegExEngine);
+        }
+
+        TEST_METHOD(MatchAllCaseInsensitive)
+        {
+            VerifyEnginesMatch(UseRegularExpressions | MatchAllOccurences);
+        }
+
+        TEST_METHOD(MatchAllCaseSensitive)
+        {
+            VerifyEnginesMatch(UseRegularExpressions | MatchAllOccurences | CaseSensitive);
+        }
+
+        TEST_METHOD(MatchFirstCaseInsensitive)
+        {
+            VerifyEnginesMatch(UseRegularExpressions);
+        }
+
+        TEST_METHOD(MatchFirstCaseSensitive)
+        {
+            VerifyEnginesMatch(UseRegularExpressions | CaseSensitive);
+        }
+
+        TEST_METHOD(VerifyUnsupportedPatternFallsBack)
+        {
+            // Backreferences are handled by std::wregex.
+            std::wstring result;
+            Assert::IsTrue(ReplaceWithEngine(LinearRegExEngine, L"(o)\\1", L"0", L"foobar", UseRegularExpressions | MatchAllOccurences, result));
+            Assert::AreEqual(std::wstring(L"f0bar"), result);
+        }
+
+        TEST_METHOD(VerifyInvalidPatternFails)
+        {
+            std::wstring result;
+            Assert::IsFalse(ReplaceWithEngine(LinearRegExEngine, L"(foo", L"bar", L"foobar", UseRegularExpressions, result));
+            Assert::IsFalse(ReplaceWithEngine(LinearRegExEngine, L"[a-", L"bar", L"foobar", UseRegularExpressions, result));
+        }
+
+        // Nested quantifiers backtrack exponentially in std::wregex on this input.  The
+        // linear engine has to finish regardless of the length of the file name.
+        TEST_METHOD(VerifyNestedQuantifiersAreLinear)
+        {
+            std::wstring source(4096, L'a');
+            source += L"c";
+
+            auto start = std::chrono::steady_clock::now();
+            std::wstring result;
+            Assert::IsTrue(ReplaceWithEngine(LinearRegExEngine, L"(a+)+b", L"x", source.c_str(), UseRegularExpressions | MatchAllOccurences, result));
+            auto elapsed = std::chrono::steady_clock::now() - start;
+
+            Assert::AreEqual(source, result);
+            Assert::IsTrue(elapsed < std::chrono::seconds(5));
+        }
+
+        TEST_METHOD(VerifySearchTermRisk)
+        {
+            CComPtr<IPowerRenameRegEx> renameRegEx;
+            Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(a+)+b") == S_OK);
+
+            // Only regular expressions are analyzed
+            PowerRenameRegExRisk risk = AmbiguousAlternationRisk;
+            Assert::IsTrue(renameRegEx->get_searchTermRisk(&risk) == S_OK);
+            Assert::IsTrue(risk == NoRegExRisk);
+
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions | MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->get_searchTermRisk(&risk) == S_OK);
+            Assert::IsTrue(risk == NestedQuantifierRisk);
+
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(foo|fo)*") == S_OK);
+            Assert::IsTrue(renameRegEx->get_searchTermRisk(&risk) == S_OK);
+            Assert::IsTrue(risk == AmbiguousAlternationRisk);
+
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(foo|bar)*") == S_OK);
+            Assert::IsTrue(renameRegEx->get_searchTermRisk(&risk) == S_OK);
+            Assert::IsTrue(risk == NoRegExRisk);
+        }
+
+        // Risky patterns the linear engine supports run on it even with std::wregex
+        // selected.  The others give up once the time budget of the item is spent.
+        TEST_METHOD(VerifyBacktrackingSearchTimesOut)
+        {
+            std::wstring source(40, L'a');
+            source += L"c";
+
+            std::wstring result;
+            Assert::IsTrue(ReplaceWithEngine(StdRegExEngine, L"(a+)+b", L"x", source.c_str(), UseRegularExpressions | MatchAllOccurences, result));
+            Assert::AreEqual(source, result);
+
+            CComPtr<IPowerRenameRegEx> renameRegEx;
+            Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions | MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"^(a)(\\1|a)*b") == S_OK);
+
+            auto start = std::chrono::steady_clock::now();
+            PowerRenameMatches matches;
+            Assert::IsTrue(renameRegEx->Match(source.c_str(), &matches) == HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+            Assert::IsTrue(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+            Assert::IsTrue(matches.timedOut);
+            Assert::IsTrue(matches.matches.empty());
+
+            // Names it doesn't backtrack on still match
+            Assert::IsTrue(renameRegEx->Match(L"aaab", &matches) == S_OK);
+            Assert::IsFalse(matches.timedOut);
+            Assert::IsTrue(matches.matches.size() == 1);
+        }
+    };
+}
@@ -308,6 +308,75 @@ namespace PowerRenameRegExTests
             }
         }
 
+        TEST_METHOD(VerifyPatternRecompiledOnFlagsChange)
+        {
+            CComPtr<IPowerRenameRegEx> renameRegEx;
+            Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(foo") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"bar") == S_OK);
+
+            // Plain text search
+            PWSTR result = nullptr;
+            Assert::IsTrue(renameRegEx->Replace(L"(foo)", &result) == S_OK);
+            Assert::IsTrue(wcscmp(result, L"bar)") == 0);
+            CoTaskMemFree(result);
+
+            // Same search term is not a valid regular expression
+            result = nullptr;
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences | UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->Replace(L"(foo)", &result) != S_OK);
+            Assert::IsTrue(result == nullptr);
+
+            // Fixing the search term recompiles the pattern
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"\\(foo") == S_OK);
+            Assert::IsTrue(renameRegEx->Replace(L"(foo)", &result) == S_OK);
+            Assert::IsTrue(wcscmp(result, L"bar)") == 0);
+            CoTaskMemFree(result);
+        }
+
+        TEST_METHOD(VerifySubstituteReusesMatches)
+        {
+            CComPtr<IPowerRenameRegEx> renameRegEx;
+            Assert::IsTrue(CPowerRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences | UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(\\d+)_(\\d+)") == S_OK);
+
+            PowerRenameMatches matches;
+            Assert::IsTrue(renameRegEx->Match(L"IMG_2019_08.jpg", &matches) == S_OK);
+            Assert::IsTrue(matches.matches.size() == 1);
+
+            // Only the replace term changes so the matches stay valid
+            PCWSTR replaceTerms[] = { L"$2-$1", L"[$&]", L"x" };
+            PCWSTR expected[] = { L"IMG_08-2019.jpg", L"IMG_[2019_08].jpg", L"IMG_x.jpg" };
+            for (int i = 0; i < ARRAYSIZE(replaceTerms); i++)
+            {
+                Assert::IsTrue(renameRegEx->put_replaceTerm(replaceTerms[i]) == S_OK);
+                std::wstring substituted;
+                Assert::IsTrue(renameRegEx->Substitute(L"IMG_2019_08.jpg", &matches, nullptr, &substituted) == S_OK);
+                Assert::AreEqual(std::wstring(expected[i]), substituted);
+
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->Replace(L"IMG_2019_08.jpg", &result) == S_OK);
+                Assert::IsTrue(wcscmp(result, expected[i]) == 0);
+                CoTaskMemFree(result);
+            }
+
+            // Plain text matches use the replace term as is
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"o") == S_OK);
+            Assert::IsTrue(renameRegEx->Match(L"foo.doc", &matches) == S_OK);
+            Assert::IsTrue(matches.matches.size() == 3);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"$1") == S_OK);
+            std::wstring substituted;
+            Assert::IsTrue(renameRegEx->Substitute(L"foo.doc", &matches, nullptr, &substituted) == S_OK);
+            Assert::AreEqual(std::wstring(L"f$1$1.d$1c"), substituted);
+
+            // Nothing to match
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"") == S_OK);
+            Assert::IsTrue(renameRegEx->Match(L"foo.doc", &matches) != S_OK);
+            Assert::IsTrue(matches.matches.empty());
+        }
+
         TEST_METHOD(VerifyEventsFire)
         {
             CComPtr<IPowerRenameRegEx> renameRegEx;
@@ -321,9 +390,11 @@ namespace PowerRenameRegExTests
             Assert::IsTrue(renameRegEx->put_flags(flags) == S_OK);
             Assert::IsTrue(renameRegEx->put_searchTerm(L"FOO") == S_OK);
             Assert::IsTrue(renameRegEx->put_replaceTerm(L"BAR") == S_OK);
+            Assert::IsTrue(renameRegEx->put_engine(StdRegExEngine) == S_OK);
             Assert::IsTrue(lstrcmpi(L"FOO", mockEvents->m_searchTerm) == 0);
             Assert::IsTrue(lstrcmpi(L"BAR", mockEvents->m_replaceTerm) == 0);
             Assert::IsTrue(flags == mockEvents->m_flags);
+            Assert::IsTrue(mockEvents->m_engine == StdRegExEngine);
             Assert::IsTrue(renameRegEx->UnAdvise(cookie) == S_OK);
             mockEvents->Release();
         }
@@ -17,6 +17,19 @@ void last_unsubscribed(const std::wstring& event) {
     stop_win_hook_event();
 }
 
+void receivers_changed(const std::wstring& event, const std::vector<PowertoyModuleIface*>& subscribers) {
+  if (event == win_hook_event)
+    update_win_hook_event(subscribers);
+}
+
+// Only the win_hook_event events a PowerToy has a filter for are signaled to it
+static bool wants_event(PowertoyModuleIface* module, const std::wstring& event, intptr_t data) {
+  if (event != win_hook_event)
+    return true;
+  auto& hook_event = *reinterpret_cast<WinHookEvent*>(data);
+  return win_hook_event_matches(module->get_win_hook_event_filters(), hook_event.event, hook_event.idObject);
+}
+
 PowertoysEvents& powertoys_events() {
   static PowertoysEvents powertoys_events;
   return powertoys_events;
@@ -29,14 +42,20 @@ void PowertoysEvents::register_receiver(const std::wstring & event, PowertoyModu
     first_subscribed(event);
   }
   subscribers.push_back(module);
+  receivers_changed(event, subscribers);
 }
 
 void PowertoysEvents::unregister_receiver(PowertoyModuleIface* module) {
   std::unique_lock lock(mutex);
   for (auto&[event, subscribers] : receivers) {
-    subscribers.erase(remove(begin(subscribers), end(subscribers), module), end(subscribers));
+    auto removed = remove(begin(subscribers), end(subscribers), module);
+    if (removed == end(subscribers))
+      continue;
+    subscribers.erase(removed, end(subscribers));
     if (subscribers.empty()) {
       last_unsubscribed(event);
+    } else {
+      receivers_changed(event, subscribers);
     }
   }
 }
@@ -46,7 +65,7 @@ intptr_t PowertoysEvents::signal_event(const std::wstring & event, intptr_t data
   std::shared_lock lock(mutex);
   if (auto it = receivers.find(event); it != end(receivers)) {
     for (auto& module : it->second) {
-      if (module)
+      if (module && wants_event(module, event, data))
         rvalue |= module->signal_event(event.c_str(), data);
     }
   }
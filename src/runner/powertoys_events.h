@@ -16,4 +16,5 @@ PowertoysEvents& powertoys_events();
 
 void first_subscribed(const std::wstring& event);
 void last_unsubscribed(const std::wstring& event);
+void receivers_changed(const std::wstring& event, const std::vector<PowertoyModuleIface*>& subscribers);
 
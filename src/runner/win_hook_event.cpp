@@ -4,10 +4,14 @@
 #include <mutex>
 #include <deque>
 #include <thread>
+#include <vector>
 
 static std::mutex mutex;
 static std::deque<WinHookEvent> hook_events;
 static std::condition_variable dispatch_cv;
+// The filters of all the subscribers, nullptr when one of them handles every event
+static std::vector<WinHookEventFilter> hook_filters;
+static const WinHookEventFilter* hook_filter_table = nullptr;
 
 static void CALLBACK win_hook_event_proc(HWINEVENTHOOK winEventHook,
                                          DWORD event,
@@ -17,6 +21,9 @@ static void CALLBACK win_hook_event_proc(HWINEVENTHOOK winEventHook,
                                          DWORD eventThread,
                                          DWORD eventTime) {
   std::unique_lock lock(mutex);
+  // A hook covers a range of event IDs, the objects in it nobody handles end here
+  if (!win_hook_event_matches(hook_filter_table, event, object))
+    return;
   hook_events.push_back({ event,
                           window,
                           object,
@@ -45,15 +52,68 @@ static void dispatch_thread_proc() {
   }
 }
 
-static HWINEVENTHOOK hook_handle;
+static std::vector<HWINEVENTHOOK> hook_handles;
+
+static void unhook_win_hook_event() {
+  for (auto handle : hook_handles)
+    UnhookWinEvent(handle);
+  hook_handles.clear();
+}
 
+// The hooks are installed by update_win_hook_event once the subscribers are known
 void start_win_hook_event() {
   std::lock_guard lock(mutex);
   if (running)
     return;
   running = true;
   dispatch_thread = std::thread(dispatch_thread_proc);
-  hook_handle = SetWinEventHook(EVENT_MIN, EVENT_MAX, nullptr, win_hook_event_proc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+}
+
+void update_win_hook_event(const std::vector<PowertoyModuleIface*>& subscribers) {
+  std::vector<WinHookEventFilter> filters;
+  bool every_event = false;
+  for (auto module : subscribers) {
+    auto module_filters = module ? module->get_win_hook_event_filters() : nullptr;
+    if (!module_filters) {
+      every_event = true;
+      break;
+    }
+    for (; module_filters->eventMin; ++module_filters)
+      filters.push_back(*module_filters);
+  }
+
+  // One hook for each run of consecutive event IDs
+  std::vector<std::pair<DWORD, DWORD>> ranges;
+  if (every_event) {
+    ranges.emplace_back(EVENT_MIN, EVENT_MAX);
+  } else {
+    for (auto& filter : filters)
+      ranges.emplace_back(filter.eventMin, filter.eventMax);
+    std::sort(begin(ranges), end(ranges));
+    std::vector<std::pair<DWORD, DWORD>> merged;
+    for (auto& range : ranges) {
+      if (!merged.empty() && range.first <= merged.back().second + 1) {
+        if (range.second > merged.back().second)
+          merged.back().second = range.second;
+      } else {
+        merged.push_back(range);
+      }
+    }
+    ranges = std::move(merged);
+  }
+  filters.push_back({});
+
+  std::lock_guard lock(mutex);
+  if (!running)
+    return;
+  unhook_win_hook_event();
+  hook_filters = std::move(filters);
+  hook_filter_table = every_event ? nullptr : hook_filters.data();
+  for (auto& [event_min, event_max] : ranges) {
+    auto handle = SetWinEventHook(event_min, event_max, nullptr, win_hook_event_proc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    if (handle)
+      hook_handles.push_back(handle);
+  }
 }
 
 void stop_win_hook_event() {
@@ -61,12 +121,14 @@ void stop_win_hook_event() {
   if (!running)
     return;
   running = false;
-  UnhookWinEvent(hook_handle);
+  unhook_win_hook_event();
   lock.unlock();
   dispatch_cv.notify_one();
   dispatch_thread.join();
   lock.lock();
   hook_events.clear();
   hook_events.shrink_to_fit();
+  hook_filters.clear();
+  hook_filter_table = nullptr;
 }
 
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <interface/powertoy_module_interface.h>
 #include <interface/win_hook_event_data.h>
+#include <vector>
 
 void start_win_hook_event();
 void stop_win_hook_event();
+// Installs the hooks for the events the subscribers handle
+void update_win_hook_event(const std::vector<PowertoyModuleIface*>& subscribers);
 